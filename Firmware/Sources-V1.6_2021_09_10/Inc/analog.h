@@ -48,6 +48,8 @@ void AnalogAdcWDGEnable(uint8_t enable);
 uint8_t AnalogSamplesReady();
 HAL_StatusTypeDef AnalogAdcWDGConfig(uint8_t channel, uint16_t voltThresh_mV);
 uint16_t GetSampleVoltage(uint8_t channel);
+uint16_t GetAverageSampleVoltage(uint8_t channel, uint16_t scans);
+uint16_t AnalogScansReady(void);
 uint16_t GetAverageBatteryVoltage(uint8_t channel);
 void GetAdcSignals02(uint32_t pos, uint8_t* buf);
 void GetAdcSignals12(uint32_t pos, uint8_t* buf);
@@ -60,6 +62,7 @@ __STATIC_INLINE uint16_t GetSample(uint8_t channel) {
 	return analogIn[ind];
 }
 
+int32_t GetSampleAverage(uint8_t channel);
 int32_t GetSampleAverageDiff(uint8_t channel1, uint8_t channel2);
 
 __STATIC_INLINE uint16_t GetAdcWDGThreshold() {
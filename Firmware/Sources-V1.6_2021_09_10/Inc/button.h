@@ -11,6 +11,8 @@
 #include "stdint.h"
 
 #define BUTTON_STATIC_LONG_PRESS_TIME	19600
+#define BUTTON_DEBOUNCE_TIME	10 // ms, state must be stable after edge
+#define BUTTON_EDGES_MAX	16 // edge queue length, power of 2
 
 // Button event function definitions, special functions 0 - 15, user button event functions 15 - 31, other values reserved
 typedef enum ButtonFunction_T {
@@ -49,5 +51,6 @@ void PowerOffButtonEventCb(uint8_t b, ButtonEvent_T event);
 void ButtonEventFuncPowerResetCb(uint8_t b, ButtonEvent_T event);
 void ButtonDualLongPressEventCb(void);
 int8_t IsButtonActive(void);
+void ButtonEdgeCb(uint16_t pin);
 
 #endif /* BUTTON_H_ */
@@ -36,33 +36,47 @@
 
 /* Exported constants --------------------------------------------------------*/
 /* Define the size of the sectors to be used */
-#define PAGE_SIZE             ((uint32_t)0x0400)  /* Page size = 1KByte */
+#define PAGE_SIZE             ((uint32_t)0x0800)  /* Page size = 2KByte, flash erase unit of STM32F030xC */
 
-/* EEPROM start address in Flash */
-#define EEPROM_START_ADDRESS  ((uint32_t)0x0803BC00) /* EEPROM emulation start address: */
+/* Number of pages in circular log, flash event log follows it up to end of flash, so target
+   has room for 2 - 4. More pages reduce page transfers and erases, host tests build 2 - 8 */
+#ifndef EE_PAGES_NUM
+#define EE_PAGES_NUM          4
+#endif
 
-/* Pages 0 and 1 base and end addresses */
-#define PAGE0_BASE_ADDRESS    ((uint32_t)(EEPROM_START_ADDRESS + 0x0000))
-#define PAGE0_END_ADDRESS     ((uint32_t)(EEPROM_START_ADDRESS + (PAGE_SIZE - 1)))
+/* Oldest page variables copied per EE_Task call during background page transfer */
+#define EE_TRANSFER_CHUNK_VARS   16
 
-#define PAGE1_BASE_ADDRESS    ((uint32_t)(EEPROM_START_ADDRESS + 0x0400))
-#define PAGE1_END_ADDRESS     ((uint32_t)(EEPROM_START_ADDRESS + (2 * PAGE_SIZE - 1)))
+/* EEPROM start address in Flash, first erase page above two page layout */
+#define EEPROM_START_ADDRESS  ((uint32_t)0x0803C800) /* EEPROM emulation start address: */
 
-/* Used Flash pages for EEPROM emulation */
-#define PAGE0                 ((uint16_t)0x0000)
-#define PAGE1                 ((uint16_t)0x0001)
+/* EEPROM end address in Flash */
+#define EEPROM_END_ADDRESS    ((uint32_t)(EEPROM_START_ADDRESS + EE_PAGES_NUM * PAGE_SIZE))
+
+/* Page base address */
+#define EE_PAGE_ADDRESS(page) ((uint32_t)(EEPROM_START_ADDRESS + (uint32_t)(page) * PAGE_SIZE))
+
+/* 1KByte pages of two page layout used up to firmware V1.6, migrated on init */
+#define EE_LEGACY_PAGE0_ADDRESS  ((uint32_t)0x0803BC00)
+#define EE_LEGACY_PAGE1_ADDRESS  ((uint32_t)0x0803C000)
+#define EE_LEGACY_PAGE_SIZE      ((uint32_t)0x0400)
+
+/* Flash read access, host tests count reads */
+#ifndef EE_READ_HALFWORD
+#define EE_READ_HALFWORD(Address)  (*(__IO uint16_t*)(Address))
+#endif
+#ifndef EE_READ_WORD
+#define EE_READ_WORD(Address)      (*(__IO uint32_t*)(Address))
+#endif
 
 /* No valid page define */
 #define NO_VALID_PAGE         ((uint16_t)0x00AB)
 
 /* Page status definitions */
 #define ERASED                ((uint16_t)0xFFFF)     /* Page is empty */
-#define RECEIVE_DATA          ((uint16_t)0xEEEE)     /* Page is marked to receive data */
-#define VALID_PAGE            ((uint16_t)0x0000)     /* Page containing valid data */
-
-/* Valid pages in read and write defines */
-#define READ_FROM_VALID_PAGE  ((uint8_t)0x00)
-#define WRITE_IN_VALID_PAGE   ((uint8_t)0x01)
+#define RECEIVE_DATA          ((uint16_t)0xEEEE)     /* Page is marked to receive data, two page layout */
+#define VALID_PAGE            ((uint16_t)0x0000)     /* Page containing valid data in two page layout, obsolete log page otherwise */
+#define LOG_PAGE              ((uint16_t)0xAAAA)     /* Page in circular log, sequence number at page base + 2 */
 
 /* Page full define */
 #define PAGE_FULL             ((uint8_t)0x80)
@@ -70,6 +84,13 @@
 /* Variables' number */
 #define NB_OF_VAR             NV_VAR_NUM//((uint8_t)0x04)
 
+/* Virtual address of transaction records, value of record before group is number of variables
+   that follow, commit record after group has EE_TRANSACTION_COMMIT bit set in addition */
+#define EE_TRANSACTION_VIRT_ADDR  ((uint16_t)0xFFFE)
+#define EE_TRANSACTION_COMMIT     ((uint16_t)0x8000)
+/* Maximum number of variables written in one transaction */
+#define EE_TRANSACTION_MAX_VARS   32
+
 /** @defgroup FLASH_Timeout_definition 
   * @{
   */ 
@@ -102,6 +123,9 @@ HAL_StatusTypeDef FLASH_ProgramHalfWord(uint32_t Address, uint16_t Data);
 uint16_t EE_Init(void);
 uint16_t EE_ReadVariable(uint16_t VirtAddress, uint16_t* Data);
 uint16_t EE_WriteVariable(uint16_t VirtAddress, uint16_t Data);
+uint16_t EE_WriteVariables(uint16_t *VirtAddress, uint16_t *Data, uint16_t Count);
+void EE_Task(void);
+uint8_t EE_PendingWrites(void);
 
 #endif /* __EEPROM_H */
 
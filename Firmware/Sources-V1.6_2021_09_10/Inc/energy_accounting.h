@@ -0,0 +1,32 @@
+/*
+ * energy_accounting.h
+ *
+ *  Created on: 19.10.2026.
+ */
+
+#ifndef ENERGY_ACCOUNTING_H_
+#define ENERGY_ACCOUNTING_H_
+
+#include "stdint.h"
+
+typedef enum EnergyCounter_T {
+	ENERGY_TO_PI = 0, // mWh delivered to the Pi over 5V GPIO rail
+	ENERGY_BAT_OUT, // mWh drawn from battery
+	ENERGY_BAT_IN, // mWh charged into battery
+	ENERGY_FROM_IN, // mWh received from PiJuice micro USB input
+	ENERGY_FROM_5V_IO, // mWh received from Pi 5V GPIO rail
+	CHARGE_BAT_OUT, // mAh drawn from battery
+	CHARGE_BAT_IN, // mAh charged into battery
+	ENERGY_COUNTERS_NUM
+} EnergyCounter_T;
+
+// 6 hours, checkpoint only counters that changed to keep emulated eeprom page erase count low
+#define ENERGY_NV_CHECKPOINT_PERIOD_MS	21600000
+
+void EnergyAccountingInit(void);
+void EnergyAccountingTask(void);
+void EnergyAccountingTimeStep(int32_t delta);
+void EnergyAccountingSetCmd(uint8_t data[], uint16_t len);
+void EnergyAccountingGetCmd(uint8_t data[], uint16_t *len);
+
+#endif /* ENERGY_ACCOUNTING_H_ */
@@ -0,0 +1,47 @@
+/*
+ * flash_log.h
+ *
+ *  Created on: 19.10.2026.
+ */
+
+#ifndef FLASH_LOG_H_
+#define FLASH_LOG_H_
+
+#include "stdint.h"
+#include "eeprom.h"
+
+/* Append only event log in flash pages above emulated eeprom, kept over power loss.
+   Pages are used in rotation, oldest page is erased when head page is full. */
+#define FLASH_LOG_START_ADDRESS	EEPROM_END_ADDRESS // 0x0803E800 with 4 eeprom pages
+#define FLASH_LOG_PAGES_NUM	3
+#define FLASH_LOG_END_ADDRESS	(FLASH_LOG_START_ADDRESS + FLASH_LOG_PAGES_NUM * PAGE_SIZE)
+
+#define FLASH_LOG_PAYLOAD_LEN	4
+#define FLASH_LOG_QUEUE_SIZE	8
+#define FLASH_LOG_FAULT_POLL_MS	1000
+#define FLASH_LOG_FAULT_REARM_MS	600000 // fault that cleared is logged again when set, at most once per this time
+
+// Read frame: records count, flags, records of FLASH_LOG_READ_RECORD_LEN bytes
+#define FLASH_LOG_READ_HEADER_LEN	2
+#define FLASH_LOG_READ_RECORD_LEN	14 // sequence number, seconds since 2000-01-01, 1/256 s, id, payload
+#define FLASH_LOG_READ_RECORDS	8
+#define FLASH_LOG_READ_LEN	(FLASH_LOG_READ_HEADER_LEN + FLASH_LOG_READ_RECORDS * FLASH_LOG_READ_RECORD_LEN)
+
+typedef enum {
+	FLASH_LOG_NONE = 0,
+	FLASH_LOG_MCU_RESET, // execution state, RCC reset flags, state of charge/4, battery voltage in 20 mV
+	FLASH_LOG_5VREG_OFF, // 0, status, state of charge/4, battery voltage in 20 mV
+	FLASH_LOG_FORCED_POWER_OFF, // cause (1 - regulator fault, 0 - low battery), status, state of charge/4, battery voltage in 20 mV
+	FLASH_LOG_WAKEUP, // wakeup triggers, status, state of charge/4, battery voltage in 20 mV
+	FLASH_LOG_FAULT, // active faults, newly set faults, 16 bit
+	FLASH_LOG_IO_SAMPLE // IO1 log record overwritten before read, voltage in 1/16 mV, seconds since sample, 16 bit
+} FlashLogEventId_T;
+
+void FlashLogInit(void);
+void FlashLogTask(void);
+void FlashLogPut(FlashLogEventId_T id, const uint8_t payload[FLASH_LOG_PAYLOAD_LEN]);
+void FlashLogPutStatus(FlashLogEventId_T id, uint8_t data0);
+void FlashLogReadCmd(uint8_t data[], uint16_t *len);
+void FlashLogWriteCmd(uint8_t data[], uint16_t len);
+
+#endif /* FLASH_LOG_H_ */
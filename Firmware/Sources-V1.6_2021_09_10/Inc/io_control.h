@@ -11,6 +11,10 @@
 void MX_TIM1_Init(void);
 
 void IoControlInit();
+void IoControlTask(void);
+uint8_t IoEdgeEvent(uint8_t pin);
+void IoControlStopEntry(void);
+void IoControlStopExit(void);
 
 void IoSetConfiguarion(uint8_t pin, uint8_t data[], uint8_t len);
 void IoGetConfiguarion(uint8_t pin, uint8_t data[], uint16_t *len);
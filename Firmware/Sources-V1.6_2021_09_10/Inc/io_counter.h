@@ -0,0 +1,31 @@
+/*
+ * io_counter.h
+ *
+ *  Created on: 19.10.2026.
+ */
+
+#ifndef IO_COUNTER_H_
+#define IO_COUNTER_H_
+
+#include "stdint.h"
+
+/* Pulse counter input mode, configured with IO mode parameters: parameter 1 bits 0-1 counted edge
+   (0, 2 - rising, 1 - falling, 3 - both), bits 8-15 debounce time in ms, edge is counted only if level
+   before it was stable for this time, parameter 2 counts to post IO wake-up (0 - off).
+   IO2 counts on EXTI interrupt and keeps counting in stop mode. IO1 shares EXTI line with I2C SDA,
+   it counts with TIM14 input capture that needs MCU running. */
+#define IO_COUNTER_MODE	7
+#define IO_COUNTER_GATE_TIME	1000 // ms, shortest frequency measurement time
+#define IO_COUNTER_READ_LEN	8 // count, frequency in mHz
+
+void IoCounterStart(uint8_t pin, uint16_t param1, uint16_t param2);
+void IoCounterStop(uint8_t pin);
+uint8_t IoCounterEdge(uint8_t pin);
+void IoCounterCaptureCb(void);
+void IoCounterStopEntry(void);
+void IoCounterTask(void);
+uint8_t IoCounterIsCapturing(void);
+void IoCounterRead(uint8_t pin, uint8_t data[], uint16_t *len);
+void IoCounterWrite(uint8_t pin, uint8_t data[], uint8_t len);
+
+#endif /* IO_COUNTER_H_ */
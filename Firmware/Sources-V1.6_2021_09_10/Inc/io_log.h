@@ -0,0 +1,32 @@
+/*
+ * io_log.h
+ *
+ *  Created on: 19.10.2026.
+ */
+
+#ifndef IO_LOG_H_
+#define IO_LOG_H_
+
+#include "stdint.h"
+
+/* IO1 analog input acquisition, configured with IO1 analog input mode parameters:
+   parameter 1 sample interval in seconds (0 - off), parameter 2 low byte log2 of averaged ADC scans,
+   high byte flags. Records are kept in RAM ring and read in bulk, logging continues while host is off. */
+#define IO_LOG_BUF_LEN	128 // records, power of 2
+#define IO_LOG_OVERSAMPLING_MAX	8 // 256 scans, half of ADC buffer
+#define IO_LOG_STOP_PERIOD	4 // s, stop mode wake-up period, shorter intervals keep MCU running
+#define IO_LOG_FLAG_FLASH_SPILL	0x01 // unread records overwritten in RAM are moved to flash log
+
+// Read frame: records count, flags, sequence number of first record, records of IO_LOG_READ_RECORD_LEN bytes
+#define IO_LOG_READ_HEADER_LEN	6
+#define IO_LOG_READ_RECORD_LEN	7 // seconds since 2000-01-01, 1/256 s, voltage in 1/16 mV
+#define IO_LOG_READ_RECORDS	32
+#define IO_LOG_READ_LEN	(IO_LOG_READ_HEADER_LEN + IO_LOG_READ_RECORDS * IO_LOG_READ_RECORD_LEN)
+
+void IoLogConfigure(uint16_t interval, uint8_t oversampling, uint8_t flags);
+void IoLogTask(void);
+uint8_t IoLogIsSampling(void);
+void IoLogReadCmd(uint8_t data[], uint16_t *len);
+void IoLogWriteCmd(uint8_t data[], uint16_t len);
+
+#endif /* IO_LOG_H_ */
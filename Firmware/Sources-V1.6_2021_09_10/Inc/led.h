@@ -13,6 +13,25 @@
 #define LED1	0
 #define LED2	1
 
+#define LED_FX_STEPS_MAX	16
+#define LED_FX_STEP_LEN	6 // op, r, g, b, time in ms
+
+// Effect step operations
+#define LED_FX_OP_SET	0 // set color and hold for time
+#define LED_FX_OP_RAMP	1 // ramp to color over time, linear in brightness so gamma curve applies
+#define LED_FX_OP_LOOP	2 // jump to step r, g passes (0 - forever)
+#define LED_FX_OP_END	3 // end, LED returns to its color set by function
+
+#define LED_FX_LOOP_LEVEL	0x01 // loop b flag, passes are battery charge level in g segments
+
+// Running effect owns its LED. Function colors set by firmware are kept and shown when effect ends,
+// user LED state and blink commands, LED configuration and power policy LED action stop it.
+// Effects pause in stop mode.
+
+// Effect command control
+#define LED_FX_CTRL_STOP	0
+#define LED_FX_CTRL_START	1
+
 typedef enum LedFunction_T {
 	LED_NOT_USED = 0,
 	LED_CHARGE_STATUS,
@@ -27,6 +46,7 @@ void LedSetRGB(uint8_t led, uint8_t r, uint8_t g, uint8_t b);
 void LedStop(void);
 void LedStart(void);
 void LedFunctionSetRGB(LedFunction_T func, uint8_t r, uint8_t g, uint8_t b);
+void LedSetState(uint8_t led, uint8_t r, uint8_t g, uint8_t b);
 void LedSetConfiguarion(uint8_t led, uint8_t data[], uint8_t len);
 void LedGetConfiguarion(uint8_t led, uint8_t data[], uint16_t *len);
 void LedCmdSetState(uint8_t led, uint8_t data[], uint8_t len);
@@ -36,5 +56,8 @@ void LedCmdGetBlink(uint8_t led, uint8_t data[], uint16_t *len);
 uint8_t LedGetParamR(uint8_t led);
 uint8_t LedGetParamG(uint8_t led);
 uint8_t LedGetParamB(uint8_t led);
+void LedEffectsTimerCb(void);
+void LedEffectsWriteCmd(uint8_t data[], uint16_t len);
+void LedEffectsReadCmd(uint8_t data[], uint16_t *len);
 
 #endif /* LED_H_ */
@@ -23,6 +23,7 @@ void LoadCurrentSenseTask(void);
 #endif
 void MeasurePMOSLoadCurrent(void);
 int32_t GetLoadCurrent(void);
+int16_t GetLoadCurrentCalib(void);
 int8_t CalibrateLoadCurrent(void);
 
 #endif /* LOAD_CURRENT_SENSE_H_ */
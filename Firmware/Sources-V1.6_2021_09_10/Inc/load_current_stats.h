@@ -0,0 +1,35 @@
+/*
+ * load_current_stats.h
+ *
+ *  Created on: 19.10.2026.
+ */
+
+#ifndef LOAD_CURRENT_STATS_H_
+#define LOAD_CURRENT_STATS_H_
+
+#include "stdint.h"
+
+/* 5V GPIO load current statistics at ADC scan rate. Every scan of completed DMA half buffer is
+   converted to current and accumulated in three nested windows: base window, level 1 of n1 base
+   windows, level 2 of n2 level 1 windows, default 100 ms, 1 s, 1 min. Windows are counted in ADC
+   scans, ADC does not run in stop mode and windows continue after wake-up. Boards below rev 2.3 sense
+   current on resistor with about 320 mA single scan resolution, there min and max are noisy. */
+#define LOAD_CURR_STATS_SCAN_US	144 // 8 channels of 239.5 + 12.5 cycles at 14 MHz ADC clock
+#define LOAD_CURR_STATS_LEVELS	3
+#define LOAD_CURR_STATS_HIST_BINS	16
+#define LOAD_CURR_STATS_BASE_MS_MIN	10
+#define LOAD_CURR_STATS_BASE_MS_MAX	1000
+#define LOAD_CURR_STATS_BIN_SHIFT_MIN	4 // 16 mA histogram bins
+#define LOAD_CURR_STATS_BIN_SHIFT_MAX	9 // 512 mA histogram bins
+
+// Read frame: header, windows per level, peak scan, histogram counts, multi-byte fields little endian
+#define LOAD_CURR_STATS_READ_HEADER_LEN	7
+#define LOAD_CURR_STATS_READ_LEVEL_LEN	24
+#define LOAD_CURR_STATS_READ_PEAK_LEN	7
+#define LOAD_CURR_STATS_READ_LEN	(LOAD_CURR_STATS_READ_HEADER_LEN + LOAD_CURR_STATS_LEVELS * LOAD_CURR_STATS_READ_LEVEL_LEN \
+									+ LOAD_CURR_STATS_READ_PEAK_LEN + LOAD_CURR_STATS_HIST_BINS * 4)
+
+void LoadCurrentStatsReadCmd(uint8_t data[], uint16_t *len);
+void LoadCurrentStatsWriteCmd(uint8_t data[], uint16_t len);
+
+#endif /* LOAD_CURRENT_STATS_H_ */
@@ -11,11 +11,19 @@
 #include "stdint.h"
 #include "stm32f0xx_hal.h"
 
-#define LOG_BUF_SIZE	1024*1 // must be 2^n
-#define LOG_BUF_MASK	0x3FF//((uint16_t)LOG_BUF_SIZE-1) //0x1FFF
-#define LOG_BUF_FRAME_SIZE	32
-#define LOG_MAX_MESSAGES	(LOG_BUF_SIZE/LOG_BUF_FRAME_SIZE)
-#define LOG_MSG_LEN	31
+#define LOG_BUF_SIZE	(1024*2)
+#define LOG_MSG_LEN	31 // configuration read response length
+#define LOG_MSG_MAX_LEN	24 // maximum record payload length
+#define LOG_RECORD_HEADER_LEN	2 // id, payload length
+#define LOG_RECORD_MAX_LEN	(LOG_RECORD_HEADER_LEN+5+LOG_MSG_MAX_LEN)
+#define LOG_DRAIN_HEADER_LEN	7
+#define LOG_DRAIN_MIN_LEN	(LOG_DRAIN_HEADER_LEN+LOG_RECORD_MAX_LEN)
+#define LOG_DRAIN_MAX_LEN	240
+#define LOG_DRAIN_DEFAULT_LEN	64
+#define LOG_ID_ABS_TIME	0x80 // record time is absolute instead of delta from previous record
+#define LOG_CLASSES_NUM	7 // enable bits of log_config, other messages and ids 4 to 9
+#define LOG_CONFIG_RATE_LIMIT	0x80 // limit records rate per class, suppressed records are counted in LOG_REPEATED record
+#define LOG_RATE_BURST	4 // records class can put at once before its rate limit applies
 
 typedef enum {
 	NO_LOG = 0,
@@ -28,7 +36,8 @@ typedef enum {
 	ALARM_EVT,
 	MCU_RESET,
 	LOG_RESERVED2,
-	ALARM_WRITE
+	ALARM_WRITE,
+	LOG_REPEATED // id of suppressed records, count of suppressed records 16 bit
 } LogMsgId_T;
 
 typedef struct __attribute__((packed))
@@ -38,8 +47,9 @@ typedef struct __attribute__((packed))
 
 void LoggingInit(void);
 void LogPut(LogMsgId_T id);
+void LoggingTask(void);
 void LoggingReadMessageCmd(uint8_t data[], uint16_t *len);
 int8_t LoggingWriteConfigCmd(uint8_t data[], uint16_t len);
-uint8_t *LoggingInitMessage(LogMsgId_T id);
+uint8_t *LoggingInitMessage(LogMsgId_T id, uint8_t len);
 
 #endif /* LOGGING_H_ */
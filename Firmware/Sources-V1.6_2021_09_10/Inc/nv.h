@@ -133,7 +133,81 @@
  BAT_R90L_NV_ADDR, \
  BAT_R90H_NV_ADDR, \
  WATCHDOG_CONFIGH_NV_ADDR, \
- LOG_CONFIG_NV_ADDR
+ LOG_CONFIG_NV_ADDR, \
+ ENERGY_TO_PI_L_NV_ADDR, /* energy counters checkpoint, low and high word per counter */ \
+ ENERGY_TO_PI_H_NV_ADDR, \
+ ENERGY_BAT_OUT_L_NV_ADDR, \
+ ENERGY_BAT_OUT_H_NV_ADDR, \
+ ENERGY_BAT_IN_L_NV_ADDR, \
+ ENERGY_BAT_IN_H_NV_ADDR, \
+ ENERGY_FROM_IN_L_NV_ADDR, \
+ ENERGY_FROM_IN_H_NV_ADDR, \
+ ENERGY_FROM_5V_IO_L_NV_ADDR, \
+ ENERGY_FROM_5V_IO_H_NV_ADDR, \
+ CHARGE_BAT_OUT_L_NV_ADDR, \
+ CHARGE_BAT_OUT_H_NV_ADDR, \
+ CHARGE_BAT_IN_L_NV_ADDR, \
+ CHARGE_BAT_IN_H_NV_ADDR, \
+ POWER_POLICY_RULE0_COND_NV_ADDR, /* power policy rules, condition and threshold word, action and hold word */ \
+ POWER_POLICY_RULE0_ACT_NV_ADDR, \
+ POWER_POLICY_RULE1_COND_NV_ADDR, \
+ POWER_POLICY_RULE1_ACT_NV_ADDR, \
+ POWER_POLICY_RULE2_COND_NV_ADDR, \
+ POWER_POLICY_RULE2_ACT_NV_ADDR, \
+ POWER_POLICY_RULE3_COND_NV_ADDR, \
+ POWER_POLICY_RULE3_ACT_NV_ADDR, \
+ POWER_POLICY_RULE4_COND_NV_ADDR, \
+ POWER_POLICY_RULE4_ACT_NV_ADDR, \
+ POWER_POLICY_RULE5_COND_NV_ADDR, \
+ POWER_POLICY_RULE5_ACT_NV_ADDR, \
+ POWER_POLICY_RULE6_COND_NV_ADDR, \
+ POWER_POLICY_RULE6_ACT_NV_ADDR, \
+ POWER_POLICY_RULE7_COND_NV_ADDR, \
+ POWER_POLICY_RULE7_ACT_NV_ADDR, \
+ WATCHDOG_EXT_CONFIG_NV_ADDR, \
+ WATCHDOG_WARN_NV_ADDR, \
+ RTC_WAKE_SCHEDULE0_TIME_NV_ADDR, /* rtc wake schedules, seconds and minutes, hours and day, hours selection, minutes step, week days words */ \
+ RTC_WAKE_SCHEDULE0_DAY_NV_ADDR, \
+ RTC_WAKE_SCHEDULE0_HOURS_L_NV_ADDR, \
+ RTC_WAKE_SCHEDULE0_HOURS_H_NV_ADDR, \
+ RTC_WAKE_SCHEDULE0_WDAYS_NV_ADDR, \
+ RTC_WAKE_SCHEDULE1_TIME_NV_ADDR, \
+ RTC_WAKE_SCHEDULE1_DAY_NV_ADDR, \
+ RTC_WAKE_SCHEDULE1_HOURS_L_NV_ADDR, \
+ RTC_WAKE_SCHEDULE1_HOURS_H_NV_ADDR, \
+ RTC_WAKE_SCHEDULE1_WDAYS_NV_ADDR, \
+ RTC_WAKE_SCHEDULE2_TIME_NV_ADDR, \
+ RTC_WAKE_SCHEDULE2_DAY_NV_ADDR, \
+ RTC_WAKE_SCHEDULE2_HOURS_L_NV_ADDR, \
+ RTC_WAKE_SCHEDULE2_HOURS_H_NV_ADDR, \
+ RTC_WAKE_SCHEDULE2_WDAYS_NV_ADDR, \
+ RTC_WAKE_SCHEDULE3_TIME_NV_ADDR, \
+ RTC_WAKE_SCHEDULE3_DAY_NV_ADDR, \
+ RTC_WAKE_SCHEDULE3_HOURS_L_NV_ADDR, \
+ RTC_WAKE_SCHEDULE3_HOURS_H_NV_ADDR, \
+ RTC_WAKE_SCHEDULE3_WDAYS_NV_ADDR, \
+ RTC_WAKE_SCHEDULE4_TIME_NV_ADDR, \
+ RTC_WAKE_SCHEDULE4_DAY_NV_ADDR, \
+ RTC_WAKE_SCHEDULE4_HOURS_L_NV_ADDR, \
+ RTC_WAKE_SCHEDULE4_HOURS_H_NV_ADDR, \
+ RTC_WAKE_SCHEDULE4_WDAYS_NV_ADDR, \
+ RTC_WAKE_SCHEDULE5_TIME_NV_ADDR, \
+ RTC_WAKE_SCHEDULE5_DAY_NV_ADDR, \
+ RTC_WAKE_SCHEDULE5_HOURS_L_NV_ADDR, \
+ RTC_WAKE_SCHEDULE5_HOURS_H_NV_ADDR, \
+ RTC_WAKE_SCHEDULE5_WDAYS_NV_ADDR, \
+ RTC_WAKE_SCHEDULE6_TIME_NV_ADDR, \
+ RTC_WAKE_SCHEDULE6_DAY_NV_ADDR, \
+ RTC_WAKE_SCHEDULE6_HOURS_L_NV_ADDR, \
+ RTC_WAKE_SCHEDULE6_HOURS_H_NV_ADDR, \
+ RTC_WAKE_SCHEDULE6_WDAYS_NV_ADDR, \
+ RTC_WAKE_SCHEDULE7_TIME_NV_ADDR, \
+ RTC_WAKE_SCHEDULE7_DAY_NV_ADDR, \
+ RTC_WAKE_SCHEDULE7_HOURS_L_NV_ADDR, \
+ RTC_WAKE_SCHEDULE7_HOURS_H_NV_ADDR, \
+ RTC_WAKE_SCHEDULE7_WDAYS_NV_ADDR, \
+ RTC_CALIBRATION_NV_ADDR, \
+ WATCHDOG_PERIOD_SEC_NV_ADDR /* watchdog period seconds stored by extended config, 0 - minutes of watchdog config */
 
 typedef enum
 {
@@ -141,12 +215,17 @@ typedef enum
  NV_VAR_NUM
 } NvVarId_T;
 
+#define NV_SAVE_QUEUE_SIZE	16
+#define NV_SAVE_PERIOD_MS	20
+
 extern uint16_t nvInitFlag;
 
 void NvInit(void);
 void NvSetDataInitialized(void);
 void NvTask(void);
-void NvSaveParameterReq(NvVarId_T id, uint16_t value);
+uint8_t NvSaveParameterReq(NvVarId_T id, uint16_t value);
+void NvSaveStatusSetCmd(uint8_t data[], uint16_t len);
+void NvSaveStatusGetCmd(uint8_t data[], uint16_t *len);
 void NvEreaseAllVariables(void);
 
 uint16_t EE_WriteVariable(uint16_t VirtAddress, uint16_t Data);
@@ -156,4 +235,12 @@ __STATIC_INLINE void NvWriteVariableU8(uint16_t VirtAddress, uint8_t var) {
 }
 uint16_t NvReadVariableU8(uint16_t VirtAddress, uint8_t *pVar);
 
+void NvTransactionBegin(void);
+void NvTransactionStage(uint16_t VirtAddress, uint16_t var);
+uint16_t NvTransactionCommit(void);
+
+__STATIC_INLINE void NvTransactionStageU8(uint16_t VirtAddress, uint8_t var) {
+	NvTransactionStage(VirtAddress, (uint16_t)(var | (((uint16_t)(~var))<<8)));
+}
+
 #endif /* NV_H_ */
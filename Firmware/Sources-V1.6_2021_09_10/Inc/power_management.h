@@ -13,8 +13,19 @@ typedef enum RunPinInstallationStatus_T {
 	RUN_PIN_INSTALLED,
 } RunPinInstallationStatus_T;
 
+typedef enum WakeupTrigger_T {
+	WAKEUP_TRIGGER_ON_CHARGE = 0,
+	WAKEUP_TRIGGER_RTC,
+	WAKEUP_TRIGGER_IO,
+	WAKEUP_TRIGGER_WATCHDOG,
+	WAKEUP_TRIGGER_BUTTON,
+	WAKEUP_TRIGGER_POLICY,
+	WAKEUP_TRIGGER_NUM
+} WakeupTrigger_T;
+
 extern RunPinInstallationStatus_T runPinInstallationStatus;
 extern uint8_t watchdogExpiredFlag;
+extern uint8_t watchdogWarningFlag;
 extern uint8_t rtcWakeupEventFlag;
 extern uint8_t ioWakeupEvent;
 
@@ -28,7 +39,15 @@ void PowerMngmtSchedulePowerOff(uint8_t dalayCode);
 uint8_t PowerMngmtGetPowerOffCounter(void);
 void PowerMngmtConfigureWatchdogCmd(uint8_t data[], uint16_t len);
 void PowerMngmtGetWatchdogConfigurationCmd(uint8_t data[], uint16_t *len);
+void PowerMngmtSetWatchdogExtConfigCmd(uint8_t data[], uint16_t len);
+void PowerMngmtGetWatchdogExtConfigCmd(uint8_t data[], uint16_t *len);
+void PowerMngmtWatchdogHeartbeat(void);
 void PowerMngmtHostPollEvent(void);
+void PowerMngmtSetWakeupOnChargeCmd(uint8_t data[], uint16_t len);
+void PowerMngmtGetWakeupOnChargeCmd(uint8_t data[], uint16_t *len);
+void PowerMngmtPostWakeupEvent(WakeupTrigger_T trigger);
+void PowerMngmtSetWakeupLatencyCmd(uint8_t data[], uint16_t len);
+void PowerMngmtGetWakeupLatencyCmd(uint8_t data[], uint16_t *len);
 //int8_t WakeUpHost(void);
 
 #endif /* POWER_MANAGEMENT_H_ */
@@ -0,0 +1,60 @@
+/*
+ * power_policy.h
+ *
+ *  Created on: 19.10.2026.
+ */
+
+#ifndef POWER_POLICY_H_
+#define POWER_POLICY_H_
+
+#include "stdint.h"
+
+#define POWER_POLICY_RULES_NUM	8
+
+// Telemetry rule condition is evaluated on, threshold units in comments
+typedef enum PowerPolicySource_T {
+	POLICY_SRC_NONE = 0, // rule disabled
+	POLICY_SRC_CHARGE, // %
+	POLICY_SRC_BAT_VOLTAGE, // 20mV
+	POLICY_SRC_POWER_INPUT, // 1 - micro USB or 5V GPIO input present
+	POLICY_SRC_LOAD_CURRENT, // 10mA
+	POLICY_SRC_BAT_TEMP, // degC, signed
+	POLICY_SRC_BUTTON_IDLE, // minutes since last button activity
+	POLICY_SRC_HOST_IDLE, // minutes since last host command
+	POLICY_SRC_5V_REG, // 1 - 5V regulator on
+	POLICY_SRC_BAT_PRESENT, // 1 - battery present
+	POLICY_SRC_NUM
+} PowerPolicySource_T;
+
+typedef enum PowerPolicyOperator_T {
+	POLICY_OP_LT = 0,
+	POLICY_OP_GT,
+	POLICY_OP_EQ,
+	POLICY_OP_NE,
+	POLICY_OP_NUM
+} PowerPolicyOperator_T;
+
+typedef enum PowerPolicyAction_T {
+	POLICY_ACT_NONE = 0,
+	POLICY_ACT_HOST_SHUTDOWN, // raise policy shutdown event to host
+	POLICY_ACT_5V_OFF, // schedule 5V regulator off, parameter delay 8s units
+	POLICY_ACT_WAKEUP, // wake-up host
+	POLICY_ACT_LED, // parameter bit3 led, bits 0-2 blue, green, red on
+	POLICY_ACT_NUM
+} PowerPolicyAction_T;
+
+typedef struct {
+	uint8_t condition; // bits 0-3 source, bits 4-6 operator, bit 7 AND with next rule
+	uint8_t threshold;
+	uint8_t action; // bits 0-3 action, bits 4-7 action parameter
+	uint8_t hold; // bits 0-6 time condition must hold before action, bit 7 minutes else seconds
+} PowerPolicyRule_T;
+
+extern uint8_t policyShutdownFlag;
+
+void PowerPolicyInit(void);
+void PowerPolicyTask(void);
+void PowerPolicySetRuleCmd(uint8_t data[], uint16_t len);
+void PowerPolicyGetRuleCmd(uint8_t data[], uint16_t *len);
+
+#endif /* POWER_POLICY_H_ */
@@ -0,0 +1,48 @@
+/*
+ * power_stats.h
+ *
+ *  Created on: 19.10.2026.
+ */
+
+#ifndef POWER_STATS_H_
+#define POWER_STATS_H_
+
+#include "stdint.h"
+#include "battery.h"
+
+typedef enum PowerStatsWakeCause_T {
+	POWER_STATS_WAKE_RTC_TIMER = 0,
+	POWER_STATS_WAKE_RTC_ALARM,
+	POWER_STATS_WAKE_BUTTON,
+	POWER_STATS_WAKE_CHARGER,
+	POWER_STATS_WAKE_I2C,
+	POWER_STATS_WAKE_IO,
+	POWER_STATS_WAKE_OTHER,
+	POWER_STATS_WAKE_IO_COUNTER, // IO2 pulse counter edge, stop mode resumed without main loop pass
+	POWER_STATS_WAKE_NUM
+} PowerStatsWakeCause_T;
+
+// reasons low power state is refused, bit position in refuse mask
+typedef enum PowerStatsRefuse_T {
+	LOW_POWER_REFUSE_LOAD = 0, // 5V GPIO load current above 50mA
+	LOW_POWER_REFUSE_HOST_COMMAND, // host command within last 5s
+	LOW_POWER_REFUSE_CHARGER, // charger has valid source
+	LOW_POWER_REFUSE_BUTTON, // button active
+	LOW_POWER_REFUSE_WAKEUP, // host wake-up within last 20s
+	LOW_POWER_REFUSE_EVENT_POLL, // pending events need polling
+	LOW_POWER_REFUSE_TRACE, // telemetry trace is sampling
+	LOW_POWER_REFUSE_IO_LOG, // IO1 analog log sample is due
+	LOW_POWER_REFUSE_IO_COUNTER, // IO1 pulse counter needs timer running
+	LOW_POWER_REFUSE_NUM
+} PowerStatsRefuse_T;
+
+#define POWER_STATS_STATES_NUM	3 // STATE_NORMAL, STATE_RUN, STATE_LOWPOWER
+
+void PowerStatsInit(void);
+void PowerStatsUpdate(PowerState_T state, uint16_t refuseMask);
+void PowerStatsStopEntry(void);
+void PowerStatsWakeup(PowerStatsWakeCause_T cause);
+void PowerStatsSetCmd(uint8_t data[], uint16_t len);
+void PowerStatsGetCmd(uint8_t data[], uint16_t *len);
+
+#endif /* POWER_STATS_H_ */
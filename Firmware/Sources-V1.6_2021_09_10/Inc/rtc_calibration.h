@@ -0,0 +1,26 @@
+/*
+ * rtc_calibration.h
+ *
+ *  Created on: 19.10.2026.
+ */
+
+#ifndef RTC_CALIBRATION_H_
+#define RTC_CALIBRATION_H_
+
+#include "stdint.h"
+
+#define RTC_CALIB_MIN_INTERVAL	28800 // s, calibration is not changed from shorter reference windows
+#define RTC_CALIB_MAX_STEP	512 // smooth calibration range, step is 2^-20, 0.954 ppm
+#define RTC_CALIB_MIN_STEP	(-511)
+
+// Calibration status flags
+#define RTC_CALIB_STATUS_ANCHOR	0x01 // reference anchor is set, next submission can measure drift
+#define RTC_CALIB_STATUS_APPLIED	0x02 // last submission updated calibration
+#define RTC_CALIB_STATUS_RANGE	0x04 // measured drift was beyond calibration range, clamped
+
+void RtcCalibrationInit(void);
+void RtcCalibrationTimeStep(int32_t delta);
+void RtcCalibrationReadCmd(uint8_t data[], uint16_t *len);
+void RtcCalibrationWriteCmd(uint8_t data[], uint16_t len);
+
+#endif /* RTC_CALIBRATION_H_ */
@@ -10,6 +10,12 @@
 
 #include "stdint.h"
 
+#define RTC_SUBSECONDS_REG	0x11 // vendor register, 1/256 s elapsed in current second, read in same burst as time
+#define RTC_MAP_LEN	0x12 // registers reachable over i2c, DS1339 registers followed by vendor registers
+
+#define RTC_WAKE_SCHEDULES_NUM	8
+#define RTC_WAKE_SCHEDULE_NV_VARS	5
+
 typedef void (*RtcCommand_T)(uint8_t dir, uint8_t *pData, uint16_t *dataLen);
 
 void RtcDs1339ProcessRequest(uint8_t dir, uint8_t command, uint8_t *pData, uint16_t *dataLen);
@@ -22,7 +28,10 @@ void RtcReadAlarm1(uint8_t *buffer, uint8_t extended);
 void RtcWriteAlarm1(uint8_t *buffer, uint8_t extended);
 void RtcWriteTime(uint8_t *buffer, uint8_t extended);
 void RtcReadTime(uint8_t *buffer, uint8_t extended);
+void RtcReadLinearTime(uint32_t *sec, uint8_t *sub);
 void RtcReadControlStatus(uint8_t *buffer, uint16_t *dataLen);
 void RtcWriteControlStatus(uint8_t *buffer, uint16_t dataLen);
+void RtcWakeScheduleReadCmd(uint8_t data[], uint16_t *len);
+void RtcWakeScheduleWriteCmd(uint8_t data[], uint16_t len);
 
 #endif /* RTC_DS1339_EMU_H_ */
@@ -0,0 +1,47 @@
+/*
+ * rtc_schedule.h
+ *
+ *  Created on: 19.10.2026.
+ */
+
+#ifndef RTC_SCHEDULE_H_
+#define RTC_SCHEDULE_H_
+
+#include "stdint.h"
+
+#define RTC_SCHEDULE_ANY	0x80 // field mask, any value matches
+#define RTC_SCHEDULE_WEEKDAY	0x40 // day field is week day instead of date
+#define RTC_SCHEDULE_HORIZON_DAYS	1461 // four years, so 29th February is covered
+
+// RtcScheduleNext result
+#define RTC_SCHEDULE_NONE	0 // schedule can not match
+#define RTC_SCHEDULE_FOUND	1
+#define RTC_SCHEDULE_HORIZON	2 // no match within horizon, search again from returned time
+
+typedef struct {
+	uint8_t year; // 0-99, since 2000
+	uint8_t month; // 1-12
+	uint8_t date; // 1-31
+	uint8_t weekDay; // 1-7, as written by host
+	uint8_t hours; // 24 hour format
+	uint8_t minutes;
+	uint8_t seconds;
+} RtcCalendar_T;
+
+// DS1339 alarm 1 fields in binary with PiJuice extensions
+typedef struct {
+	uint8_t seconds;
+	uint8_t minutes;
+	uint8_t hours; // 24 hour format
+	uint8_t day; // date, or week day if RTC_SCHEDULE_WEEKDAY set
+	uint32_t hoursSelection; // bit per hour
+	uint8_t minutesStep; // minute must be multiple of step if above 1
+	uint8_t weekDaysSelection; // bit per week day
+} RtcSchedule_T;
+
+uint8_t RtcScheduleMatch(const RtcSchedule_T *s, const RtcCalendar_T *t);
+uint8_t RtcScheduleNext(const RtcSchedule_T *s, RtcCalendar_T *t);
+uint8_t RtcScheduleNextAny(const RtcSchedule_T s[], uint8_t n, RtcCalendar_T *t);
+int8_t RtcCalendarCompare(const RtcCalendar_T *a, const RtcCalendar_T *b);
+
+#endif /* RTC_SCHEDULE_H_ */
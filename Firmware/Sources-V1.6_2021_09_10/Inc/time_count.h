@@ -22,6 +22,9 @@
 
 //int8_t AddTimeCounter();
 void TimeTickCb(uint16_t periodMs);
+uint32_t TimeTickFine(void);
+uint32_t TimeTickFineUs(void);
+uint8_t TimeTickIsSuspended(void);
 
 /**
  * @brief  Delays for amount of micro seconds
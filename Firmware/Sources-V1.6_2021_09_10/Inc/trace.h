@@ -0,0 +1,37 @@
+/*
+ * trace.h
+ *
+ *  Created on: 19.10.2026.
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include "stdint.h"
+
+#define TRACE_BUF_SIZE	2048
+#define TRACE_CHUNK_HEADER_LEN	7 // length, samples count, time of first sample
+#define TRACE_CHUNK_MAX_LEN	200
+#define TRACE_DRAIN_HEADER_LEN	6
+#define TRACE_DRAIN_LEN	240
+#define TRACE_MIN_PERIOD_MS	20 // main loop tick
+#define TRACE_FLAG_HOST_OFF	0x01 // continue sampling while host is powered off
+
+// Traced signals, bit position in signal mask
+typedef enum {
+	TRACE_SIGNAL_VBAT = 0, // battery voltage, mV
+	TRACE_SIGNAL_IBAT, // battery current, mA
+	TRACE_SIGNAL_IIO, // 5V GPIO load current, mA
+	TRACE_SIGNAL_TEMP, // battery temperature, C
+	TRACE_SIGNAL_SOC, // state of charge, 0.1%
+	TRACE_SIGNAL_CHARGER, // charger status
+	TRACE_SIGNALS_NUM
+} TraceSignal_T;
+
+void TraceInit(void);
+void TraceTask(void);
+uint8_t TraceIsSampling(void);
+void TraceReadCmd(uint8_t data[], uint16_t *len);
+void TraceWriteCmd(uint8_t data[], uint16_t len);
+
+#endif /* TRACE_H_ */
@@ -55,6 +55,34 @@ uint16_t GetSampleVoltage(uint8_t channel) {
 	return (analogIn[ind] * ((uint32_t)*VREFINT_CAL_ADDR ) * 412 / analogIn[indRef]) >>  9;
 }
 
+// Average of channel over last complete scans, ratiometric to internal reference, in 1/16 mV.
+// Scans must not exceed half of buffer, so DMA does not overwrite samples while they are summed.
+uint16_t GetAverageSampleVoltage(uint8_t channel, uint16_t scans) {
+	int32_t pos =  __HAL_DMA_GET_COUNTER(hadc.DMA_Handle);
+	int32_t ind = ((ADC_BUFFER_LENGTH - pos) / ADC_SCAN_CHANNELS - 1) * ADC_SCAN_CHANNELS; // last complete scan
+	uint32_t sum = 0, sumRef = 0;
+	uint32_t v;
+	uint16_t i;
+
+	for (i = 0; i < scans; i++) {
+		if (ind < 0) ind += ADC_BUFFER_LENGTH;
+		sum += analogIn[ind + channel];
+		sumRef += analogIn[ind + ADC_VREF_BUFF_CHN];
+		ind -= ADC_SCAN_CHANNELS;
+	}
+	if (sumRef == 0) return 0;
+	// v = sum / sumRef * vrefCal * 3300 / 4096 * 16
+	v = ((uint64_t)sum * (*VREFINT_CAL_ADDR) * 825 + (uint64_t)sumRef * 32) / ((uint64_t)sumRef * 64);
+	return v > 0xFFFF ? 0xFFFF : v;
+}
+
+// Complete scans converted since conversion was started, buffer holds at most ADC_BUFFER_LENGTH/ADC_SCAN_CHANNELS
+uint16_t AnalogScansReady(void) {
+	if (!HAL_IS_BIT_SET(hadc.Instance->CR, ADC_CR_ADSTART)) return 0;
+	if (analogIn[ADC_BUFFER_LENGTH-1] != 0xFFFFFFFF) return ADC_BUFFER_LENGTH / ADC_SCAN_CHANNELS;
+	return (ADC_BUFFER_LENGTH - __HAL_DMA_GET_COUNTER(hadc.DMA_Handle)) / ADC_SCAN_CHANNELS;
+}
+
 //int16_t testBuf[512] __attribute__((section("no_init")));
 //volatile uint16_t testInd = 0;
 #if defined LOGGING
@@ -97,6 +97,23 @@ ButtonEventCb_T buttonEventCbs[BUTTON_EVENT_FUNC_NUMBER] = {
 	ButtonEventFuncPowerResetCb, // BUTTON_EVENT_FUNC_POWER_RESET
 };
 
+typedef struct
+{
+	uint32_t time;
+	uint8_t b;
+	GPIO_PinState state;
+} ButtonEdge_T;
+
+static GPIO_TypeDef * const buttonPorts[3] = {GPIOC, GPIOB, GPIOB}; // sw1, sw2, sw3
+static const uint16_t buttonPins[3] = {GPIO_PIN_13, GPIO_PIN_12, GPIO_PIN_2};
+
+static ButtonEdge_T buttonEdges[BUTTON_EDGES_MAX];
+static volatile uint8_t buttonEdgeWr = 0;
+static volatile uint8_t buttonEdgeRd = 0;
+static GPIO_PinState buttonRawState[3]; // state after last edge
+static uint32_t buttonEdgeTime[3]; // time of last edge
+static uint32_t buttonBounceStart[3]; // time of first edge after state was stable
+
 static int8_t writebuttonConfigData = -1;
 Button_T buttonConfigData;
 
@@ -119,29 +136,29 @@ static ButtonFunction_T GetFuncOfEvent(uint8_t b) {
 	}
 }
 
-/*__STATIC_INLINE*/ void ProcessButton( uint8_t b, GPIO_PinState pinState ) {
+/*__STATIC_INLINE*/ void ProcessButton( uint8_t b, GPIO_PinState pinState, uint32_t time ) {
 	volatile ButtonEvent_T oldEv = buttons[b].event;
 
 	if ( pinState != buttons[b].state ) {
 		if ( pinState == GPIO_PIN_SET ) {
-			if (MS_TIME_COUNT(buttons[b].pressTimer) > 30000) {
+			if ((time - buttons[b].pressTimer) > 30000) {
 				// 30 seconds event timeout, remove it
 				buttons[b].tempEvent = 0;
 				buttons[b].event = 0;
 				oldEv = 0;
 			}
-			if ( buttons[b].doublePressTime && buttons[b].doublePressFunc!=BUTTON_EVENT_NO_FUNC && MS_TIME_COUNT(buttons[b].pressTimer)  < buttons[b].doublePressTime ) {
+			if ( buttons[b].doublePressTime && buttons[b].doublePressFunc!=BUTTON_EVENT_NO_FUNC && (time - buttons[b].pressTimer)  < buttons[b].doublePressTime ) {
 				buttons[b].tempEvent = BUTTON_EVENT_DOUBLE_PRESS;
 				buttons[b].event = BUTTON_EVENT_DOUBLE_PRESS;
 			} else if ( buttons[b].pressFunc != BUTTON_EVENT_NO_FUNC ) {
 				buttons[b].tempEvent = BUTTON_EVENT_PRESS;
 				buttons[b].event = BUTTON_EVENT_PRESS;
 			}
-			MS_TIME_COUNTER_INIT(buttons[b].pressTimer);
+			buttons[b].pressTimer = time;
 		} else {
 			// if release
 			if (buttons[b].tempEvent != BUTTON_EVENT_DOUBLE_PRESS) {
-				if ( buttons[b].singlePressTime && buttons[b].singlePressFunc!=BUTTON_EVENT_NO_FUNC && MS_TIME_COUNT(buttons[b].pressTimer) < buttons[b].singlePressTime ) {
+				if ( buttons[b].singlePressTime && buttons[b].singlePressFunc!=BUTTON_EVENT_NO_FUNC && (time - buttons[b].pressTimer) < buttons[b].singlePressTime ) {
 					buttons[b].tempEvent = BUTTON_EVENT_SINGLE_PRESS;
 					if ( buttons[b].doublePressFunc == BUTTON_EVENT_NO_FUNC ) buttons[b].event = BUTTON_EVENT_SINGLE_PRESS;
 				} else if ( buttons[b].releaseFunc != BUTTON_EVENT_NO_FUNC ) {
@@ -153,7 +170,7 @@ static ButtonFunction_T GetFuncOfEvent(uint8_t b) {
 		}
 		buttons[b].state = pinState;
 	} else if ( pinState == GPIO_PIN_SET ) {
-		uint32_t timePased = MS_TIME_COUNT(buttons[b].pressTimer);
+		uint32_t timePased = (time - buttons[b].pressTimer);
 		if ( buttons[b].longPressFunc2 != BUTTON_EVENT_NO_FUNC && timePased > buttons[b].longPressTime2 ) {
 			if ( buttons[b].tempEvent != BUTTON_EVENT_LONG_PRESS2 ) {
 				buttons[b].tempEvent = BUTTON_EVENT_LONG_PRESS2;
@@ -168,7 +185,7 @@ static ButtonFunction_T GetFuncOfEvent(uint8_t b) {
 		if (timePased > BUTTON_STATIC_LONG_PRESS_TIME) {
 			buttons[b].staticLongPressEvent = 1;
 		}
-	} else if ( buttons[b].tempEvent && pinState == GPIO_PIN_RESET && buttons[b].doublePressFunc!=BUTTON_EVENT_NO_FUNC  && MS_TIME_COUNT(buttons[b].pressTimer)  > buttons[b].doublePressTime ) {
+	} else if ( buttons[b].tempEvent && pinState == GPIO_PIN_RESET && buttons[b].doublePressFunc!=BUTTON_EVENT_NO_FUNC  && (time - buttons[b].pressTimer)  > buttons[b].doublePressTime ) {
 		// generate single press event only if there was no double press
 		if ( buttons[b].tempEvent == BUTTON_EVENT_SINGLE_PRESS ) {
 			buttons[b].event = BUTTON_EVENT_SINGLE_PRESS;
@@ -186,6 +203,81 @@ static ButtonFunction_T GetFuncOfEvent(uint8_t b) {
 	}
 }
 
+// Debounced transition at time of its first edge, events due before it are evaluated first
+static void ButtonSettle(uint8_t b, uint32_t time) {
+	if ( buttonRawState[b] != buttons[b].state && (time - buttonEdgeTime[b]) >= BUTTON_DEBOUNCE_TIME ) {
+		ProcessButton(b, buttons[b].state, buttonBounceStart[b]);
+		ProcessButton(b, buttonRawState[b], buttonBounceStart[b]);
+	}
+}
+
+static void ButtonEdge(uint8_t b, GPIO_PinState pinState, uint32_t time) {
+	// keep order of edges resynchronized after tick suspend
+	if ( (int32_t)(time - buttonEdgeTime[b]) < 0 ) time = buttonEdgeTime[b];
+	ButtonSettle(b, time);
+	if ( (time - buttonEdgeTime[b]) >= BUTTON_DEBOUNCE_TIME ) buttonBounceStart[b] = time;
+	buttonEdgeTime[b] = time;
+	buttonRawState[b] = pinState;
+}
+
+static void ButtonEdgeQueue(uint8_t b, GPIO_PinState pinState, uint32_t time) {
+	uint8_t next = (buttonEdgeWr + 1) & (BUTTON_EDGES_MAX - 1);
+
+	if (next == buttonEdgeRd) {
+		// full, state is resynchronized from pin when queue is drained
+		return;
+	}
+	buttonEdges[buttonEdgeWr].time = time;
+	buttonEdges[buttonEdgeWr].b = b;
+	buttonEdges[buttonEdgeWr].state = pinState;
+	buttonEdgeWr = next;
+}
+
+// Called from EXTI interrupt on both edges of button pins
+void ButtonEdgeCb(uint16_t pin) {
+	uint8_t b;
+
+	for (b = 0; b < 3; b++) {
+		if (buttonPins[b] == pin) break;
+	}
+	// tick is stepped after stop wake-up, edge is taken from pin state in task
+	if (b > 2 || TimeTickIsSuspended()) return;
+	ButtonEdgeQueue(b, HAL_GPIO_ReadPin(buttonPorts[b], buttonPins[b]), TimeTickFine());
+}
+
+#if !defined(RTOS_FREERTOS)
+// Decodes edges queued by interrupt, pin states are only read to recover missed edges
+static void ButtonDecode(void) {
+	uint32_t now;
+	uint8_t b;
+	GPIO_PinState pinState;
+	ButtonEdge_T e;
+
+	__disable_irq();
+	if (buttonEdgeRd == buttonEdgeWr) {
+		now = TimeTickFine();
+		for (b = 0; b < 3; b++) {
+			pinState = HAL_GPIO_ReadPin(buttonPorts[b], buttonPins[b]);
+			if (pinState != buttonRawState[b]) ButtonEdgeQueue(b, pinState, now);
+		}
+	}
+	__enable_irq();
+
+	while (buttonEdgeRd != buttonEdgeWr) {
+		e = buttonEdges[buttonEdgeRd];
+		buttonEdgeRd = (buttonEdgeRd + 1) & (BUTTON_EDGES_MAX - 1);
+		ButtonEdge(e.b, e.state, e.time);
+	}
+
+	now = TimeTickFine();
+	for (b = 0; b < 3; b++) {
+		ButtonSettle(b, now);
+		// time events can not pass transition that is still bouncing
+		ProcessButton(b, buttons[b].state, buttonRawState[b] != buttons[b].state ? buttonBounceStart[b] : now);
+	}
+}
+#endif
+
 static uint8_t ButtonReadConfigurationNv(uint8_t b) {
 	uint8_t nvOffset = b * (BUTTON_PRESS_FUNC_SW2 - BUTTON_PRESS_FUNC_SW1) + BUTTON_PRESS_FUNC_SW1;
 	uint8_t dataValid = 1;
@@ -248,6 +340,8 @@ static void ButtonSetConfigData(uint8_t b) {
 }
 
 void ButtonInit(void) {
+	uint8_t b;
+
 	if ( ButtonReadConfigurationNv(0) == 0 ) {
 		ButtonSetConfigData(0);
 	}
@@ -259,15 +353,28 @@ void ButtonInit(void) {
 	if ( ButtonReadConfigurationNv(2) == 0 ) {
 		ButtonSetConfigData(2);
 	}
+
+	for (b = 0; b < 3; b++) {
+		buttonRawState[b] = buttons[b].state;
+		buttonEdgeTime[b] = TimeTickFine() - BUTTON_DEBOUNCE_TIME;
+		buttonBounceStart[b] = buttonEdgeTime[b];
+	}
+	buttonEdgeRd = buttonEdgeWr;
 #if defined(RTOS_FREERTOS)
 	buttonTaskHandle = osThreadNew(ButtonTask, (void*)NULL, &buttonTask_attributes);
 #endif
 }
 
+// Pressed, bouncing or waiting for double press, stop mode is allowed between presses
 int8_t IsButtonActive(void) {
-	//return buttons[0].tempEvent || buttons[1].tempEvent || buttons[2].tempEvent;
-	return MS_TIME_COUNT(buttons[0].pressTimer) < 2000 || MS_TIME_COUNT(buttons[1].pressTimer) < 2000 || MS_TIME_COUNT(buttons[2].pressTimer) < 2000
-			|| buttons[0].state || buttons[1].state || buttons[2].state;
+	uint8_t b;
+
+	if (buttonEdgeRd != buttonEdgeWr) return 1;
+	for (b = 0; b < 3; b++) {
+		if ( buttons[b].state || buttonRawState[b] || (TimeTickFine() - buttonEdgeTime[b]) < BUTTON_DEBOUNCE_TIME ) return 1;
+		if ( buttons[b].tempEvent && buttons[b].doublePressFunc != BUTTON_EVENT_NO_FUNC ) return 1;
+	}
+	return 0;
 }
 
 #if defined(RTOS_FREERTOS)
@@ -276,26 +383,28 @@ static void ButtonTask(void *argument) {
   {
 	uint8_t oldDualLongPressStatus = buttons[0].staticLongPressEvent && buttons[1].staticLongPressEvent;
 
-	ProcessButton(0, HAL_GPIO_ReadPin(GPIOC, GPIO_PIN_13)); // sw1
+	ProcessButton(0, HAL_GPIO_ReadPin(GPIOC, GPIO_PIN_13), HAL_GetTick()); // sw1
 
-	ProcessButton(1, HAL_GPIO_ReadPin(GPIOB, GPIO_PIN_12)); // sw2
+	ProcessButton(1, HAL_GPIO_ReadPin(GPIOB, GPIO_PIN_12), HAL_GetTick()); // sw2
 
-	ProcessButton(2, HAL_GPIO_ReadPin(GPIOB, GPIO_PIN_2)); // sw3
+	ProcessButton(2, HAL_GPIO_ReadPin(GPIOB, GPIO_PIN_2), HAL_GetTick()); // sw3
 
 	if ((buttons[0].staticLongPressEvent && buttons[1].staticLongPressEvent) > oldDualLongPressStatus) ButtonDualLongPressEventCb();
 
 	if (writebuttonConfigData >= 0) {
 		uint8_t nvOffset = writebuttonConfigData * (BUTTON_PRESS_FUNC_SW2 - BUTTON_PRESS_FUNC_SW1) + BUTTON_PRESS_FUNC_SW1;
-		EE_WriteVariable(nvOffset, buttonConfigData.pressFunc | ((uint16_t)(~buttonConfigData.pressFunc)<<8));
-		EE_WriteVariable(nvOffset + 2, buttonConfigData.releaseFunc | ((uint16_t)(~buttonConfigData.releaseFunc)<<8));
-		EE_WriteVariable(nvOffset + 4, buttonConfigData.singlePressFunc | ((uint16_t)(~buttonConfigData.singlePressFunc)<<8));
-		EE_WriteVariable(nvOffset + 5, buttonConfigData.singlePressTime | ((uint16_t)(~buttonConfigData.singlePressTime)<<8));
-		EE_WriteVariable(nvOffset + 6, buttonConfigData.doublePressFunc | ((uint16_t)(~buttonConfigData.doublePressFunc)<<8));
-		EE_WriteVariable(nvOffset + 7, buttonConfigData.doublePressTime | ((uint16_t)(~buttonConfigData.doublePressTime)<<8));
-		EE_WriteVariable(nvOffset + 8, buttonConfigData.longPressFunc1 | ((uint16_t)(~buttonConfigData.longPressFunc1)<<8));
-		EE_WriteVariable(nvOffset + 9, buttonConfigData.longPressTime1 | ((uint16_t)(~buttonConfigData.longPressTime1)<<8));
-		EE_WriteVariable(nvOffset + 10, buttonConfigData.longPressFunc2 | ((uint16_t)(~buttonConfigData.longPressFunc2)<<8));
-		EE_WriteVariable(nvOffset + 11, buttonConfigData.longPressTime2 | ((uint16_t)(~buttonConfigData.longPressTime2)<<8));
+		NvTransactionBegin();
+		NvTransactionStage(nvOffset, buttonConfigData.pressFunc | ((uint16_t)(~buttonConfigData.pressFunc)<<8));
+		NvTransactionStage(nvOffset + 2, buttonConfigData.releaseFunc | ((uint16_t)(~buttonConfigData.releaseFunc)<<8));
+		NvTransactionStage(nvOffset + 4, buttonConfigData.singlePressFunc | ((uint16_t)(~buttonConfigData.singlePressFunc)<<8));
+		NvTransactionStage(nvOffset + 5, buttonConfigData.singlePressTime | ((uint16_t)(~buttonConfigData.singlePressTime)<<8));
+		NvTransactionStage(nvOffset + 6, buttonConfigData.doublePressFunc | ((uint16_t)(~buttonConfigData.doublePressFunc)<<8));
+		NvTransactionStage(nvOffset + 7, buttonConfigData.doublePressTime | ((uint16_t)(~buttonConfigData.doublePressTime)<<8));
+		NvTransactionStage(nvOffset + 8, buttonConfigData.longPressFunc1 | ((uint16_t)(~buttonConfigData.longPressFunc1)<<8));
+		NvTransactionStage(nvOffset + 9, buttonConfigData.longPressTime1 | ((uint16_t)(~buttonConfigData.longPressTime1)<<8));
+		NvTransactionStage(nvOffset + 10, buttonConfigData.longPressFunc2 | ((uint16_t)(~buttonConfigData.longPressFunc2)<<8));
+		NvTransactionStage(nvOffset + 11, buttonConfigData.longPressTime2 | ((uint16_t)(~buttonConfigData.longPressTime2)<<8));
+		NvTransactionCommit();
 
 		if ( ButtonReadConfigurationNv(writebuttonConfigData) == 0 ) {
 			ButtonSetConfigData(writebuttonConfigData);
@@ -311,26 +420,24 @@ void ButtonTask(void) {
 
 	uint8_t oldDualLongPressStatus = buttons[0].staticLongPressEvent && buttons[1].staticLongPressEvent;
 
-	ProcessButton(0, HAL_GPIO_ReadPin(GPIOC, GPIO_PIN_13)); // sw1
-
-	ProcessButton(1, HAL_GPIO_ReadPin(GPIOB, GPIO_PIN_12)); // sw2
-
-	ProcessButton(2, HAL_GPIO_ReadPin(GPIOB, GPIO_PIN_2)); // sw3
+	ButtonDecode();
 
 	if ((buttons[0].staticLongPressEvent && buttons[1].staticLongPressEvent) > oldDualLongPressStatus) ButtonDualLongPressEventCb();
 
 	if (writebuttonConfigData >= 0) {
 		uint8_t nvOffset = writebuttonConfigData * (BUTTON_PRESS_FUNC_SW2 - BUTTON_PRESS_FUNC_SW1) + BUTTON_PRESS_FUNC_SW1;
-		EE_WriteVariable(nvOffset, buttonConfigData.pressFunc | ((uint16_t)(~buttonConfigData.pressFunc)<<8));
-		EE_WriteVariable(nvOffset + 2, buttonConfigData.releaseFunc | ((uint16_t)(~buttonConfigData.releaseFunc)<<8));
-		EE_WriteVariable(nvOffset + 4, buttonConfigData.singlePressFunc | ((uint16_t)(~buttonConfigData.singlePressFunc)<<8));
-		EE_WriteVariable(nvOffset + 5, buttonConfigData.singlePressTime | ((uint16_t)(~buttonConfigData.singlePressTime)<<8));
-		EE_WriteVariable(nvOffset + 6, buttonConfigData.doublePressFunc | ((uint16_t)(~buttonConfigData.doublePressFunc)<<8));
-		EE_WriteVariable(nvOffset + 7, buttonConfigData.doublePressTime | ((uint16_t)(~buttonConfigData.doublePressTime)<<8));
-		EE_WriteVariable(nvOffset + 8, buttonConfigData.longPressFunc1 | ((uint16_t)(~buttonConfigData.longPressFunc1)<<8));
-		EE_WriteVariable(nvOffset + 9, buttonConfigData.longPressTime1 | ((uint16_t)(~buttonConfigData.longPressTime1)<<8));
-		EE_WriteVariable(nvOffset + 10, buttonConfigData.longPressFunc2 | ((uint16_t)(~buttonConfigData.longPressFunc2)<<8));
-		EE_WriteVariable(nvOffset + 11, buttonConfigData.longPressTime2 | ((uint16_t)(~buttonConfigData.longPressTime2)<<8));
+		NvTransactionBegin();
+		NvTransactionStage(nvOffset, buttonConfigData.pressFunc | ((uint16_t)(~buttonConfigData.pressFunc)<<8));
+		NvTransactionStage(nvOffset + 2, buttonConfigData.releaseFunc | ((uint16_t)(~buttonConfigData.releaseFunc)<<8));
+		NvTransactionStage(nvOffset + 4, buttonConfigData.singlePressFunc | ((uint16_t)(~buttonConfigData.singlePressFunc)<<8));
+		NvTransactionStage(nvOffset + 5, buttonConfigData.singlePressTime | ((uint16_t)(~buttonConfigData.singlePressTime)<<8));
+		NvTransactionStage(nvOffset + 6, buttonConfigData.doublePressFunc | ((uint16_t)(~buttonConfigData.doublePressFunc)<<8));
+		NvTransactionStage(nvOffset + 7, buttonConfigData.doublePressTime | ((uint16_t)(~buttonConfigData.doublePressTime)<<8));
+		NvTransactionStage(nvOffset + 8, buttonConfigData.longPressFunc1 | ((uint16_t)(~buttonConfigData.longPressFunc1)<<8));
+		NvTransactionStage(nvOffset + 9, buttonConfigData.longPressTime1 | ((uint16_t)(~buttonConfigData.longPressTime1)<<8));
+		NvTransactionStage(nvOffset + 10, buttonConfigData.longPressFunc2 | ((uint16_t)(~buttonConfigData.longPressFunc2)<<8));
+		NvTransactionStage(nvOffset + 11, buttonConfigData.longPressTime2 | ((uint16_t)(~buttonConfigData.longPressTime2)<<8));
+		NvTransactionCommit();
 
 		if ( ButtonReadConfigurationNv(writebuttonConfigData) == 0 ) {
 			ButtonSetConfigData(writebuttonConfigData);
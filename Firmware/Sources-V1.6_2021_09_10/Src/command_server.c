@@ -22,6 +22,14 @@
 #include "io_control.h"
 #include "execution.h"
 #include "logging.h"
+#include "energy_accounting.h"
+#include "power_policy.h"
+#include "power_stats.h"
+#include "flash_log.h"
+#include "trace.h"
+#include "rtc_calibration.h"
+#include "io_log.h"
+#include "load_current_stats.h"
 
 #define REGISTERS_NUM	((uint16_t)256)
 
@@ -41,7 +49,7 @@ extern uint8_t powerOffBtnEventFlag;
 
 extern void Error_Handler(void);
 
-const uint8_t firmwareVer = 0x16;
+const uint8_t firmwareVer = 0x17;
 const uint8_t firmwareVariant = 0x00;
 
 typedef  void (*pFunction)(void);
@@ -101,6 +109,19 @@ void CmdServerReadWriteIoConfig2(uint8_t dir, uint8_t *pData, uint16_t *dataLen)
 void CmdServerReadWriteIoValue1(uint8_t dir, uint8_t *pData, uint16_t *dataLen);
 void CmdServerReadWriteIoValue2(uint8_t dir, uint8_t *pData, uint16_t *dataLen);
 void CmdServerReadWriteLogging(uint8_t dir, uint8_t *pData, uint16_t *dataLen);
+void CmdServerReadWriteWakeupLatency(uint8_t dir, uint8_t *pData, uint16_t *dataLen);
+void CmdServerReadWriteEnergyCounters(uint8_t dir, uint8_t *pData, uint16_t *dataLen);
+void CmdServerReadWritePowerPolicyRule(uint8_t dir, uint8_t *pData, uint16_t *dataLen);
+void CmdServerReadWriteWatchdogExtConfig(uint8_t dir, uint8_t *pData, uint16_t *dataLen);
+void CmdServerReadWritePowerStats(uint8_t dir, uint8_t *pData, uint16_t *dataLen);
+void CmdServerReadWriteNvSaveStatus(uint8_t dir, uint8_t *pData, uint16_t *dataLen);
+void CmdServerReadWriteFlashLog(uint8_t dir, uint8_t *pData, uint16_t *dataLen);
+void CmdServerReadWriteTrace(uint8_t dir, uint8_t *pData, uint16_t *dataLen);
+void CmdServerReadWriteRtcWakeSchedule(uint8_t dir, uint8_t *pData, uint16_t *dataLen);
+void CmdServerReadWriteRtcCalibration(uint8_t dir, uint8_t *pData, uint16_t *dataLen);
+void CmdServerReadWriteLedEffects(uint8_t dir, uint8_t *pData, uint16_t *dataLen);
+void CmdServerReadWriteIoLog(uint8_t dir, uint8_t *pData, uint16_t *dataLen);
+void CmdServerReadWriteLoadCurrentStats(uint8_t dir, uint8_t *pData, uint16_t *dataLen);
 
 MasterCommand_T masterCommands[REGISTERS_NUM] =
 {
@@ -172,7 +193,7 @@ MasterCommand_T masterCommands[REGISTERS_NUM] =
 /*65*/	CmdServerReadRsoc, // state of charge %
 /*66*/	CmdServerReadRsocHigherResolution, // state of charge % 0.1 resolution, two bytes
 /*67*/	NULL, // reserved for high byte of state of charge
-/*68*/	CmdServerReadWriteEventFaultStatus, // fault/event codes, cleared after read, bit0-reserved, bit1-sys undervoltage event,bit2-5V shutdown event,bit3-wdg reset,bit4-reserved,bit5 invalid bat profile,bit6-7 bat temp Fault
+/*68*/	CmdServerReadWriteEventFaultStatus, // fault/event codes, cleared after read, bit0-reserved, bit1-sys undervoltage event,bit2-5V shutdown event,bit3-wdg reset,bit4-reserved,bit5 invalid bat profile,bit6-7 bat temp Fault, byte 2 bit0-wdg warning
 /*69*/  CmdServerReadButtonStatus,// sw1 0-3, sw2 4-7
 /*70*/  NULL,// reserved for sw3 0-3
 /*71*/	CmdServerReadBatTemp,// battery temperature celsius
@@ -210,7 +231,7 @@ MasterCommand_T masterCommands[REGISTERS_NUM] =
 /*98*/	CmdServerReadWriteScheduledPowerOff, // 0 - 250 seconds, 0xFF means no power off, 251 - 254 reserved
 /*99*/  CmdServerReadWriteWakeupOnCharge,
 /*100*/	CmdServerReadWriteVSysSwitchState, // --Vsys output switch control--
-/*101*/	NULL,
+/*101*/	CmdServerReadWriteWakeupLatency, // wake-up trigger to 5V on latency statistics, write selects trigger
 
 	// --on board led--
 /*102*/	CmdServerReadWriteLedState1,	//
@@ -327,19 +348,20 @@ MasterCommand_T masterCommands[REGISTERS_NUM] =
 /*193*/	NULL,
 /*194*/	CmdServerReadWriteRtcAlarmCtrlStatus,
 
+/*195*/	CmdServerReadWriteEnergyCounters,
+/*196*/	CmdServerReadWritePowerPolicyRule,
+/*197*/	CmdServerReadWriteWatchdogExtConfig,
+/*198*/	CmdServerReadWritePowerStats,
+/*199*/	CmdServerReadWriteNvSaveStatus,
+/*200*/	CmdServerReadWriteFlashLog,
+/*201*/	CmdServerReadWriteTrace,
+/*202*/	CmdServerReadWriteRtcWakeSchedule,
+/*203*/	CmdServerReadWriteRtcCalibration,
+/*204*/	CmdServerReadWriteLedEffects,
+/*205*/	CmdServerReadWriteIoLog,
+/*206*/	CmdServerReadWriteLoadCurrentStats,
+
 // not used
-/*195*/	NULL,
-/*196*/	NULL,
-/*197*/	NULL,
-/*198*/	NULL,
-/*199*/	NULL,
-/*200*/	NULL,
-/*201*/	NULL,
-/*202*/	NULL,
-/*203*/	NULL,
-/*204*/	NULL,
-/*205*/	NULL,
-/*206*/	NULL,
 /*207*/	NULL,
 
 // not used
@@ -464,6 +486,8 @@ static uint8_t IsEventFault(void) {
 	ev = ev || watchdogExpiredFlag;
 	ev = ev || ((currentBatProfile == NULL) ? 0x20 : 0);
 	ev = ev || CHRGER_TS_FAULT_STATUS();
+	ev = ev || policyShutdownFlag;
+	ev = ev || watchdogWarningFlag;
 	return ev;
 }
 
@@ -488,15 +512,21 @@ void CmdServerReadWriteEventFaultStatus(uint8_t dir, uint8_t *pData, uint16_t *d
 		//forcedVSysOutputOffFlag = 0;
 		ev |= watchdogExpiredFlag << 3;
 		//watchdogExpiredFlag = 0;
+		ev |= policyShutdownFlag << 4;
 		ev |= (currentBatProfile == NULL) ? 0x20 : 0;
 		ev |= CHRGER_TS_FAULT_STATUS() << 6;
 		pData[0] = ev;
-		*dataLen = 1;
+		// All bits of first byte are taken. Second byte is checksum of first byte as one byte
+		// read expects it, so older readers stay valid. Third byte bit0 - watchdog warning.
+		pData[1] = ~ev;
+		pData[2] = watchdogWarningFlag;
+		*dataLen = 3;
 	} else {
 		powerOffBtnEventFlag = powerOffBtnEventFlag && (pData[1] & 0x01);
 		forcedPowerOffFlag = forcedPowerOffFlag && (pData[1] & 0x02);
 		forcedVSysOutputOffFlag = forcedVSysOutputOffFlag && (pData[1] & 0x04);
 		watchdogExpiredFlag = watchdogExpiredFlag && (pData[1] & 0x08);
+		policyShutdownFlag = policyShutdownFlag && (pData[1] & 0x10);
 	}
 }
 
@@ -839,6 +869,110 @@ void CmdServerReadWriteWakeupOnCharge(uint8_t dir, uint8_t *pData, uint16_t *dat
 	}
 }
 
+void CmdServerReadWriteWakeupLatency(uint8_t dir, uint8_t *pData, uint16_t *dataLen) {
+	if (dir == MASTER_CMD_DIR_WRITE) {
+		PowerMngmtSetWakeupLatencyCmd(pData+1, *dataLen - 1);
+	} else {
+		PowerMngmtGetWakeupLatencyCmd(pData, dataLen);
+	}
+}
+
+void CmdServerReadWritePowerStats(uint8_t dir, uint8_t *pData, uint16_t *dataLen) {
+	if (dir == MASTER_CMD_DIR_WRITE) {
+		PowerStatsSetCmd(pData+1, *dataLen - 1);
+	} else {
+		PowerStatsGetCmd(pData, dataLen);
+	}
+}
+
+void CmdServerReadWriteNvSaveStatus(uint8_t dir, uint8_t *pData, uint16_t *dataLen) {
+	if (dir == MASTER_CMD_DIR_WRITE) {
+		NvSaveStatusSetCmd(pData+1, *dataLen - 1);
+	} else {
+		NvSaveStatusGetCmd(pData, dataLen);
+	}
+}
+
+void CmdServerReadWriteFlashLog(uint8_t dir, uint8_t *pData, uint16_t *dataLen) {
+	if (dir == MASTER_CMD_DIR_WRITE) {
+		FlashLogWriteCmd(pData+1, *dataLen - 1);
+	} else {
+		FlashLogReadCmd(pData, dataLen);
+	}
+}
+
+void CmdServerReadWriteTrace(uint8_t dir, uint8_t *pData, uint16_t *dataLen) {
+	if (dir == MASTER_CMD_DIR_WRITE) {
+		TraceWriteCmd(pData+1, *dataLen - 1);
+	} else {
+		TraceReadCmd(pData, dataLen);
+	}
+}
+
+void CmdServerReadWriteRtcWakeSchedule(uint8_t dir, uint8_t *pData, uint16_t *dataLen) {
+	if (dir == MASTER_CMD_DIR_WRITE) {
+		RtcWakeScheduleWriteCmd(pData+1, *dataLen - 1);
+	} else {
+		RtcWakeScheduleReadCmd(pData, dataLen);
+	}
+}
+
+void CmdServerReadWriteRtcCalibration(uint8_t dir, uint8_t *pData, uint16_t *dataLen) {
+	if (dir == MASTER_CMD_DIR_WRITE) {
+		RtcCalibrationWriteCmd(pData+1, *dataLen - 1);
+	} else {
+		RtcCalibrationReadCmd(pData, dataLen);
+	}
+}
+
+void CmdServerReadWriteLedEffects(uint8_t dir, uint8_t *pData, uint16_t *dataLen) {
+	if (dir == MASTER_CMD_DIR_WRITE) {
+		LedEffectsWriteCmd(pData+1, *dataLen - 1);
+	} else {
+		LedEffectsReadCmd(pData, dataLen);
+	}
+}
+
+void CmdServerReadWriteIoLog(uint8_t dir, uint8_t *pData, uint16_t *dataLen) {
+	if (dir == MASTER_CMD_DIR_WRITE) {
+		IoLogWriteCmd(pData+1, *dataLen - 1);
+	} else {
+		IoLogReadCmd(pData, dataLen);
+	}
+}
+
+void CmdServerReadWriteLoadCurrentStats(uint8_t dir, uint8_t *pData, uint16_t *dataLen) {
+	if (dir == MASTER_CMD_DIR_WRITE) {
+		LoadCurrentStatsWriteCmd(pData+1, *dataLen - 1);
+	} else {
+		LoadCurrentStatsReadCmd(pData, dataLen);
+	}
+}
+
+void CmdServerReadWriteWatchdogExtConfig(uint8_t dir, uint8_t *pData, uint16_t *dataLen) {
+	if (dir == MASTER_CMD_DIR_WRITE) {
+		PowerMngmtSetWatchdogExtConfigCmd(pData+1, *dataLen - 1);
+	} else {
+		PowerMngmtGetWatchdogExtConfigCmd(pData, dataLen);
+	}
+}
+
+void CmdServerReadWriteEnergyCounters(uint8_t dir, uint8_t *pData, uint16_t *dataLen) {
+	if (dir == MASTER_CMD_DIR_WRITE) {
+		EnergyAccountingSetCmd(pData+1, *dataLen - 1);
+	} else {
+		EnergyAccountingGetCmd(pData, dataLen);
+	}
+}
+
+void CmdServerReadWritePowerPolicyRule(uint8_t dir, uint8_t *pData, uint16_t *dataLen) {
+	if (dir == MASTER_CMD_DIR_WRITE) {
+		PowerPolicySetRuleCmd(pData+1, *dataLen - 1);
+	} else {
+		PowerPolicyGetRuleCmd(pData, dataLen);
+	}
+}
+
 void CmdServerReadWriteButtonConfigurationSw1(uint8_t dir, uint8_t *pData, uint16_t *dataLen) {
 	if (dir == MASTER_CMD_DIR_WRITE) {
 		ButtonSetConfiguarion(0, pData+1, *dataLen - 1);
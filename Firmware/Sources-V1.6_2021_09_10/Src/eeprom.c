@@ -34,6 +34,15 @@
 //#include "stm32f0xx_flash.h"
 
 /* Private typedef -----------------------------------------------------------*/
+typedef enum
+{
+  EE_PAGE_STATE_ERASED = 0,     /* Page is blank */
+  EE_PAGE_STATE_LOG,            /* Page is part of log */
+  EE_PAGE_STATE_LEGACY_VALID,   /* Valid page of two page layout */
+  EE_PAGE_STATE_LEGACY_RECEIVE, /* Receive page of two page layout */
+  EE_PAGE_STATE_INVALID         /* Obsolete or corrupted page, to be erased */
+} EE_PageState_T;
+
 /* Private define ------------------------------------------------------------*/
 
 /******************  FLASH Keys  **********************************************/
@@ -41,21 +50,69 @@
 #define FLASH_FKEY2                          ((uint32_t)0xCDEF89AB)        /*!< Flash program erase key2: used with FLASH_PEKEY1
                                                                                 to unlock the write access to the FPEC. */
 
+/* 4 byte slots per page: data, virtual address. Slot 0 is page header: status, sequence number */
+#define EE_SLOTS_NUM          ((uint16_t)(PAGE_SIZE / 4))
+#define EE_NO_PAGE            ((uint8_t)0xFF)
+#define EE_SEQ_MASK           ((uint16_t)0x7FFF)
+/* Head page slots kept beyond variables left in oldest page, for slots lost to power loss during transfer */
+#define EE_TRANSFER_SPARE_SLOTS  ((uint16_t)4)
+/* Status of write that has room only after background transfer or erase, it is buffered for EE_Task */
+#define EE_NO_ROOM            ((uint16_t)0x00BC)
+
 /* Private macro -------------------------------------------------------------*/
-/* Private variables ---------------------------------------------------------*/
+#define EE_SLOT_ADDRESS(page, slot)   (EE_PAGE_ADDRESS(page) + (uint32_t)(slot) * 4)
+#define EE_INDEX(page, slot)          ((uint16_t)(((uint16_t)(page) << 9) | (slot)))
+#define EE_INDEX_PAGE(index)          ((uint8_t)((index) >> 9))
+#define EE_INDEX_SLOT(index)          ((uint16_t)((index) & 0x1FF))
+/* Signed distance between 15 bit page sequence numbers */
+#define EE_SEQ_DIFF(a, b)             ((int16_t)((uint16_t)((a) - (b)) << 1) >> 1)
 
-/* Global variable used to store variable value in read sequence */
-uint16_t DataVar = 0;
+/* Private variables ---------------------------------------------------------*/
 
-/* Virtual address defined by the user: 0xFFFF value is prohibited */
-extern uint16_t VirtAddVarTab[NB_OF_VAR];
+/* RAM index: page (high 7 bits) and slot (low 9 bits) of last update per virtual
+   address, 0 if not stored. Virtual addresses are NvVarId_T values 0..NB_OF_VAR-1 */
+static uint16_t EE_Index[NB_OF_VAR];
+/* Newest page receiving writes and oldest page of log */
+static uint8_t EE_HeadPage = EE_NO_PAGE;
+static uint8_t EE_TailPage = EE_NO_PAGE;
+static uint16_t EE_HeadSeq = 0;
+/* First free slot in head page */
+static uint16_t EE_FreeSlot = EE_SLOTS_NUM;
+/* Incomplete transaction found at end of head page, needs to be closed */
+static uint8_t EE_TransactionAbortReq = 0;
+/* Background page transfer: next slot of oldest page to check, 0 if not running */
+static uint16_t EE_TransferSlot = 0;
+/* Upper bound of live variables left in oldest page, head page space is reserved for them while
+   transfer runs */
+static uint16_t EE_TransferLeft = 0;
+/* Pages to be erased in background, bit per page */
+static uint32_t EE_ErasePending = 0;
+/* Writes requested from interrupt handlers or waiting for room, stored from main loop as one group.
+   Entries below EE_DeferredBusy are being stored, interrupt handlers only replace or append after them */
+static uint16_t EE_DeferredAddr[EE_TRANSACTION_MAX_VARS];
+static uint16_t EE_DeferredData[EE_TRANSACTION_MAX_VARS];
+static volatile uint8_t EE_DeferredCount = 0;
+static volatile uint8_t EE_DeferredBusy = 0;
 
 /* Private function prototypes -----------------------------------------------*/
 /* Private functions ---------------------------------------------------------*/
+static EE_PageState_T EE_GetPageState(uint8_t Page);
+static EE_PageState_T EE_GetLegacyPageState(uint32_t Address);
 static HAL_StatusTypeDef EE_Format(void);
-static uint16_t EE_VerifyPageFullWriteVariable(uint16_t VirtAddress, uint16_t Data);
-static uint16_t EE_PageTransfer(uint16_t VirtAddress, uint16_t Data);
-static uint16_t EE_FindValidPage(uint8_t Operation);
+static HAL_StatusTypeDef EE_OpenPage(uint8_t Page, uint8_t Valid);
+static uint16_t EE_AppendVariable(uint16_t VirtAddress, uint16_t Data);
+static uint16_t EE_NextPage(void);
+static uint16_t EE_Reserve(uint16_t Count);
+static void EE_StartTransfer(void);
+static uint16_t EE_PageTransfer(uint16_t MaxVars);
+static uint16_t EE_StoreVariable(uint16_t VirtAddress, uint16_t Data);
+static uint16_t EE_StoreVariables(uint16_t *VirtAddress, uint16_t *Data, uint16_t Count);
+static uint16_t EE_Defer(uint16_t *VirtAddress, uint16_t *Data, uint16_t Count);
+static uint16_t EE_FlushDeferred(void);
+static uint16_t EE_Migrate(void);
+static uint16_t EE_ObsoleteLegacyPages(void);
+static void EE_BuildIndex(void);
+static uint8_t EE_IsTransactionComplete(uint8_t Page, uint16_t Slot, uint16_t Count);
 
 /**
   * @brief  Unlocks the FLASH control register and program memory access.
@@ -162,213 +219,96 @@ HAL_StatusTypeDef FLASH_ProgramHalfWord(uint32_t Address, uint16_t Data)
 
 /**
   * @brief  Restore the pages to a known good state in case of page's status
-  *   corruption after a power loss.
+  *   corruption after a power loss, migrate two page layout used up to
+  *   firmware V1.6 and build RAM index.
   * @param  None.
   * @retval - Flash error code: on write Flash error
   *         - HAL_OK: on success
   */
 uint16_t EE_Init(void)
 {
-  uint16_t PageStatus0 = 6, PageStatus1 = 6;
-  uint16_t VarIdx = 0;
-  uint16_t EepromStatus = 0, ReadStatus = 0;
-  int16_t x = -1;
-  uint16_t  HAL_StatusTypeDef;
-
-  /* Get Page0 status */
-  PageStatus0 = (*(__IO uint16_t*)PAGE0_BASE_ADDRESS);
-  /* Get Page1 status */
-  PageStatus1 = (*(__IO uint16_t*)PAGE1_BASE_ADDRESS);
-
-  /* Check for invalid header states and repair if necessary */
-  switch (PageStatus0)
+  EE_PageState_T PageState;
+  uint16_t EepromStatus = HAL_OK, Seq = 0, TailSeq = 0;
+  uint8_t Page;
+
+  EE_HeadPage = EE_NO_PAGE;
+  EE_TailPage = EE_NO_PAGE;
+  EE_TransferSlot = 0;
+  EE_TransferLeft = 0;
+  EE_ErasePending = 0;
+  EE_DeferredCount = 0;
+  EE_DeferredBusy = 0;
+
+  for (Page = 0; Page < EE_PAGES_NUM; Page++)
   {
-    case ERASED:
-      if (PageStatus1 == VALID_PAGE) /* Page0 erased, Page1 valid */
+    PageState = EE_GetPageState(Page);
+    if (PageState == EE_PAGE_STATE_INVALID)
+    {
+      /* Page was being opened or erased on power loss */
+      EE_ErasePending |= 1UL << Page;
+    }
+    else if (PageState == EE_PAGE_STATE_LOG)
+    {
+      Seq = EE_READ_HALFWORD(EE_PAGE_ADDRESS(Page) + 2);
+      if (EE_HeadPage == EE_NO_PAGE)
       {
-        /* Erase Page0 */
-        HAL_StatusTypeDef = FLASH_ErasePage(PAGE0_BASE_ADDRESS);
-        /* If erase operation was failed, a Flash error code is returned */
-        if (HAL_StatusTypeDef != HAL_OK)
-        {
-          return HAL_StatusTypeDef;
-        }
+        EE_HeadPage = Page;
+        EE_TailPage = Page;
+        EE_HeadSeq = Seq;
+        TailSeq = Seq;
       }
-      else if (PageStatus1 == RECEIVE_DATA) /* Page0 erased, Page1 receive */
+      else if (EE_SEQ_DIFF(Seq, EE_HeadSeq) > 0)
       {
-        /* Erase Page0 */
-        HAL_StatusTypeDef = FLASH_ErasePage(PAGE0_BASE_ADDRESS);
-        /* If erase operation was failed, a Flash error code is returned */
-        if (HAL_StatusTypeDef != HAL_OK)
-        {
-          return HAL_StatusTypeDef;
-        }
-        /* Mark Page1 as valid */
-        HAL_StatusTypeDef = FLASH_ProgramHalfWord(PAGE1_BASE_ADDRESS, VALID_PAGE);
-        /* If program operation was failed, a Flash error code is returned */
-        if (HAL_StatusTypeDef != HAL_OK)
-        {
-          return HAL_StatusTypeDef;
-        }
+        EE_HeadPage = Page;
+        EE_HeadSeq = Seq;
       }
-      else /* First EEPROM access (Page0&1 are erased) or invalid state -> format EEPROM */
+      else if (EE_SEQ_DIFF(Seq, TailSeq) < 0)
       {
-        /* Erase both Page0 and Page1 and set Page0 as valid page */
-        HAL_StatusTypeDef = EE_Format();
-        /* If erase/program operation was failed, a Flash error code is returned */
-        if (HAL_StatusTypeDef != HAL_OK)
-        {
-          return HAL_StatusTypeDef;
-        }
+        EE_TailPage = Page;
+        TailSeq = Seq;
       }
-      break;
+    }
+  }
 
-    case RECEIVE_DATA:
-      if (PageStatus1 == VALID_PAGE) /* Page0 receive, Page1 valid */
-      {
-        /* Transfer data from Page1 to Page0 */
-        for (VarIdx = 0; VarIdx < NB_OF_VAR; VarIdx++)
-        {
-          if (( *(__IO uint16_t*)(PAGE0_BASE_ADDRESS + 6)) == VirtAddVarTab[VarIdx])
-          {
-            x = VarIdx;
-          }
-          if (VarIdx != x)
-          {
-            /* Read the last variables' updates */
-            ReadStatus = EE_ReadVariable(VirtAddVarTab[VarIdx], &DataVar);
-            /* In case variable corresponding to the virtual address was found */
-            if (ReadStatus != 0x1)
-            {
-              /* Transfer the variable to the Page0 */
-              EepromStatus = EE_VerifyPageFullWriteVariable(VirtAddVarTab[VarIdx], DataVar);
-              /* If program operation was failed, a Flash error code is returned */
-              if (EepromStatus != HAL_OK)
-              {
-                return EepromStatus;
-              }
-            }
-          }
-        }
-        /* Mark Page0 as valid */
-        HAL_StatusTypeDef = FLASH_ProgramHalfWord(PAGE0_BASE_ADDRESS, VALID_PAGE);
-        /* If program operation was failed, a Flash error code is returned */
-        if (HAL_StatusTypeDef != HAL_OK)
-        {
-          return HAL_StatusTypeDef;
-        }
-        /* Erase Page1 */
-        HAL_StatusTypeDef = FLASH_ErasePage(PAGE1_BASE_ADDRESS);
-        /* If erase operation was failed, a Flash error code is returned */
-        if (HAL_StatusTypeDef != HAL_OK)
-        {
-          return HAL_StatusTypeDef;
-        }
-      }
-      else if (PageStatus1 == ERASED) /* Page0 receive, Page1 erased */
-      {
-        /* Erase Page1 */
-        HAL_StatusTypeDef = FLASH_ErasePage(PAGE1_BASE_ADDRESS);
-        /* If erase operation was failed, a Flash error code is returned */
-        if (HAL_StatusTypeDef != HAL_OK)
-        {
-          return HAL_StatusTypeDef;
-        }
-        /* Mark Page0 as valid */
-        HAL_StatusTypeDef = FLASH_ProgramHalfWord(PAGE0_BASE_ADDRESS, VALID_PAGE);
-        /* If program operation was failed, a Flash error code is returned */
-        if (HAL_StatusTypeDef != HAL_OK)
-        {
-          return HAL_StatusTypeDef;
-        }
-      }
-      else /* Invalid state -> format eeprom */
-      {
-        /* Erase both Page0 and Page1 and set Page0 as valid page */
-        HAL_StatusTypeDef = EE_Format();
-        /* If erase/program operation was failed, a Flash error code is returned */
-        if (HAL_StatusTypeDef != HAL_OK)
-        {
-          return HAL_StatusTypeDef;
-        }
-      }
-      break;
+  /* Two page layout is migrated until log page is written, then only marked obsolete */
+  if (EE_GetLegacyPageState(EE_LEGACY_PAGE0_ADDRESS) != EE_PAGE_STATE_INVALID
+      || EE_GetLegacyPageState(EE_LEGACY_PAGE1_ADDRESS) != EE_PAGE_STATE_INVALID)
+  {
+    if (EE_HeadPage == EE_NO_PAGE)
+    {
+      return EE_Migrate();
+    }
+    EepromStatus = EE_ObsoleteLegacyPages();
+    if (EepromStatus != HAL_OK)
+    {
+      return EepromStatus;
+    }
+  }
 
-    case VALID_PAGE:
-      if (PageStatus1 == VALID_PAGE) /* Invalid state -> format eeprom */
-      {
-        /* Erase both Page0 and Page1 and set Page0 as valid page */
-        HAL_StatusTypeDef = EE_Format();
-        /* If erase/program operation was failed, a Flash error code is returned */
-        if (HAL_StatusTypeDef != HAL_OK)
-        {
-          return HAL_StatusTypeDef;
-        }
-      }
-      else if (PageStatus1 == ERASED) /* Page0 valid, Page1 erased */
-      {
-        /* Erase Page1 */
-        HAL_StatusTypeDef = FLASH_ErasePage(PAGE1_BASE_ADDRESS);
-        /* If erase operation was failed, a Flash error code is returned */
-        if (HAL_StatusTypeDef != HAL_OK)
-        {
-          return HAL_StatusTypeDef;
-        }
-      }
-      else /* Page0 valid, Page1 receive */
-      {
-        /* Transfer data from Page0 to Page1 */
-        for (VarIdx = 0; VarIdx < NB_OF_VAR; VarIdx++)
-        {
-          if ((*(__IO uint16_t*)(PAGE1_BASE_ADDRESS + 6)) == VirtAddVarTab[VarIdx])
-          {
-            x = VarIdx;
-          }
-          if (VarIdx != x)
-          {
-            /* Read the last variables' updates */
-            ReadStatus = EE_ReadVariable(VirtAddVarTab[VarIdx], &DataVar);
-            /* In case variable corresponding to the virtual address was found */
-            if (ReadStatus != 0x1)
-            {
-              /* Transfer the variable to the Page1 */
-              EepromStatus = EE_VerifyPageFullWriteVariable(VirtAddVarTab[VarIdx], DataVar);
-              /* If program operation was failed, a Flash error code is returned */
-              if (EepromStatus != HAL_OK)
-              {
-                return EepromStatus;
-              }
-            }
-          }
-        }
-        /* Mark Page1 as valid */
-        HAL_StatusTypeDef = FLASH_ProgramHalfWord(PAGE1_BASE_ADDRESS, VALID_PAGE);
-        /* If program operation was failed, a Flash error code is returned */
-        if (HAL_StatusTypeDef != HAL_OK)
-        {
-          return HAL_StatusTypeDef;
-        }
-        /* Erase Page0 */
-        HAL_StatusTypeDef = FLASH_ErasePage(PAGE0_BASE_ADDRESS);
-        /* If erase operation was failed, a Flash error code is returned */
-        if (HAL_StatusTypeDef != HAL_OK)
-        {
-          return HAL_StatusTypeDef;
-        }
-      }
-      break;
+  /* First EEPROM access or no log page -> format EEPROM */
+  if (EE_HeadPage == EE_NO_PAGE)
+  {
+    return EE_Format();
+  }
 
-    default:  /* Any other state -> format eeprom */
-      /* Erase both Page0 and Page1 and set Page0 as valid page */
-      HAL_StatusTypeDef = EE_Format();
-      /* If erase/program operation was failed, a Flash error code is returned */
-      if (HAL_StatusTypeDef != HAL_OK)
-      {
-        return HAL_StatusTypeDef;
-      }
-      break;
+  EE_BuildIndex();
+
+  /* Close transaction interrupted by power loss so its records stay discarded. It is
+     closed first, records appended before abort record would be discarded with it.
+     Full head page needs none, records in next page are not discarded */
+  if (EE_TransactionAbortReq)
+  {
+    EepromStatus = EE_AppendVariable(EE_TRANSACTION_VIRT_ADDR, 0);
+    if (EepromStatus != HAL_OK && EepromStatus != PAGE_FULL)
+    {
+      return EepromStatus;
+    }
+    EE_TransactionAbortReq = 0;
   }
 
+  /* Continue page transfer interrupted by power loss in background, or start one if log is near full */
+  EE_StartTransfer();
+
   return HAL_OK;
 }
 
@@ -384,51 +324,69 @@ uint16_t EE_Init(void)
   */
 uint16_t EE_ReadVariable(uint16_t VirtAddress, uint16_t* Data)
 {
-  uint16_t ValidPage = PAGE0;
-  uint16_t AddressValue = 0x5555, ReadStatus = 1;
-  uint32_t Address = 0x08010000, PageStartAddress = 0x08010000;
-
-  /* Get active Page for read operation */
-  ValidPage = EE_FindValidPage(READ_FROM_VALID_PAGE);
+  uint32_t Address = 0;
+  uint32_t primask;
+  uint16_t Slot = 0;
+  uint8_t Page = 0;
 
   /* Check if there is no valid page */
-  if (ValidPage == NO_VALID_PAGE)
+  if (EE_HeadPage == EE_NO_PAGE)
   {
     return  NO_VALID_PAGE;
   }
 
-  /* Get the valid Page start Address */
-  PageStartAddress = (uint32_t)(EEPROM_START_ADDRESS + (uint32_t)(ValidPage * PAGE_SIZE));
-
-  /* Get the valid Page end Address */
-  Address = (uint32_t)((EEPROM_START_ADDRESS - 2) + (uint32_t)((1 + ValidPage) * PAGE_SIZE));
-
-  /* Check each active page address starting from end */
-  while (Address > (PageStartAddress + 2))
+  /* Write requested from interrupt handler and not stored yet is newest */
+  if (EE_DeferredCount)
   {
-    /* Get the current location content to be compared with virtual address */
-    AddressValue = (*(__IO uint16_t*)Address);
-
-    /* Compare the read address with the virtual address */
-    if (AddressValue == VirtAddress)
+    primask = __get_PRIMASK();
+    __disable_irq();
+    for (Slot = EE_DeferredCount; Slot > 0; Slot--)
     {
-      /* Get content of Address-2 which is variable value */
-      *Data = (*(__IO uint16_t*)(Address - 2));
+      if (EE_DeferredAddr[Slot - 1] == VirtAddress)
+      {
+        *Data = EE_DeferredData[Slot - 1];
+        break;
+      }
+    }
+    __set_PRIMASK(primask);
+    if (Slot)
+    {
+      return 0;
+    }
+  }
 
-      /* In case variable value is read, reset ReadStatus flag */
-      ReadStatus = 0;
+  /* Look up indexed variables directly */
+  if (VirtAddress < NB_OF_VAR)
+  {
+    if (EE_Index[VirtAddress] == 0)
+    {
+      return 1;
+    }
+    *Data = EE_READ_HALFWORD(EE_SLOT_ADDRESS(EE_INDEX_PAGE(EE_Index[VirtAddress]), EE_INDEX_SLOT(EE_Index[VirtAddress])));
+    return 0;
+  }
 
-      break;
+  /* Check each page from newest and each slot starting from end for other addresses */
+  Page = EE_HeadPage;
+  for (;;)
+  {
+    for (Slot = EE_SLOTS_NUM - 1; Slot > 0; Slot--)
+    {
+      Address = EE_SLOT_ADDRESS(Page, Slot);
+      if (EE_READ_HALFWORD(Address + 2) == VirtAddress)
+      {
+        *Data = EE_READ_HALFWORD(Address);
+        return 0;
+      }
     }
-    else
+    if (Page == EE_TailPage)
     {
-      /* Next address location */
-      Address = Address - 4;
+      break;
     }
+    Page = (Page + EE_PAGES_NUM - 1) % EE_PAGES_NUM;
   }
 
-  /* Return ReadStatus value: (0: variable exist, 1: variable doesn't exist) */
-  return ReadStatus;
+  return 1;
 }
 
 /**
@@ -442,17 +400,96 @@ uint16_t EE_ReadVariable(uint16_t VirtAddress, uint16_t* Data)
   *           - Flash error code: on write Flash error
   */
 uint16_t EE_WriteVariable(uint16_t VirtAddress, uint16_t Data)
+{
+  return EE_WriteVariables(&VirtAddress, &Data, 1);
+}
+
+/**
+  * @brief  Writes group of variables so that after power loss either all or
+  *   none of them are visible. Flash is written from main loop only, writes
+  *   from interrupt handlers are stored by EE_Task after ones requested before.
+  *   Writes never wait for page transfer or erase, writes with no room in head
+  *   page and ones after them are buffered and stored by EE_Task when it made room.
+  *   Buffered writes are read back, but lost on power loss before they are stored.
+  * @param  VirtAddress: array of variable virtual addresses
+  * @param  Data: array of 16 bit data to be written
+  * @param  Count: number of variables, up to EE_TRANSACTION_MAX_VARS
+  * @retval Success or error status:
+  *           - HAL_OK: on success, or request stored for EE_Task
+  *           - PAGE_FULL: if group does not fit in page or requests buffer
+  *           - NO_VALID_PAGE: if no valid page was found
+  *           - Flash error code: on write Flash error
+  */
+uint16_t EE_WriteVariables(uint16_t *VirtAddress, uint16_t *Data, uint16_t Count)
+{
+  uint16_t Status = HAL_OK;
+
+  if (__get_IPSR() != 0)
+  {
+    return EE_Defer(VirtAddress, Data, Count);
+  }
+
+  /* Buffered writes are older, new ones wait after them. Full buffer is stored
+     first, so write blocks for one group at most */
+  if (EE_DeferredCount)
+  {
+    Status = EE_Defer(VirtAddress, Data, Count);
+    if (Status == PAGE_FULL)
+    {
+      EE_FlushDeferred();
+      Status = EE_Defer(VirtAddress, Data, Count);
+    }
+    return Status;
+  }
+
+  Status = EE_StoreVariables(VirtAddress, Data, Count);
+  if (Status == EE_NO_ROOM)
+  {
+    return EE_Defer(VirtAddress, Data, Count);
+  }
+
+  return Status;
+}
+
+/**
+  * @brief  Number of buffered variable writes not stored in flash yet. They
+  *   are lost on power loss.
+  * @param  None
+  * @retval Number of variables
+  */
+uint8_t EE_PendingWrites(void)
+{
+  return EE_DeferredCount;
+}
+
+/**
+  * @brief  Writes variable in head page.
+  * @param  VirtAddress: Variable virtual address
+  * @param  Data: 16 bit data to be written
+  * @retval Success or error status, EE_NO_ROOM if next page is not available yet
+  */
+static uint16_t EE_StoreVariable(uint16_t VirtAddress, uint16_t Data)
 {
   uint16_t Status = 0;
 
+  Status = EE_Reserve(1);
+  if (Status != HAL_OK)
+  {
+    return Status;
+  }
+
   /* Write the variable virtual address and value in the EEPROM */
-  Status = EE_VerifyPageFullWriteVariable(VirtAddress, Data);
+  Status = EE_AppendVariable(VirtAddress, Data);
 
-  /* In case the EEPROM active page is full */
+  /* In case the EEPROM head page is full */
   if (Status == PAGE_FULL)
   {
-    /* Perform Page transfer */
-    Status = EE_PageTransfer(VirtAddress, Data);
+    /* Open next page */
+    Status = EE_NextPage();
+    if (Status == HAL_OK)
+    {
+      Status = EE_AppendVariable(VirtAddress, Data);
+    }
   }
 
   /* Return last operation status */
@@ -460,268 +497,787 @@ uint16_t EE_WriteVariable(uint16_t VirtAddress, uint16_t Data)
 }
 
 /**
-  * @brief  Erases PAGE0 and PAGE1 and writes VALID_PAGE header to PAGE0
-  * @param  None
-  * @retval Status of the last operation (Flash write or erase) done during
-  *         EEPROM formating
+  * @brief  Writes group of variables so that after power loss either all or
+  *   none of them are visible. Group is preceded by transaction record holding
+  *   number of variables that follow and closed by commit record, groups
+  *   without commit record are discarded by index. Commit record address
+  *   differs from erased state in one bit, so it can not be partially programmed.
+  * @param  VirtAddress: array of variable virtual addresses
+  * @param  Data: array of 16 bit data to be written
+  * @param  Count: number of variables, up to EE_TRANSACTION_MAX_VARS
+  * @retval Success or error status:
+  *           - HAL_OK: on success
+  *           - PAGE_FULL: if group does not fit in page
+  *           - EE_NO_ROOM: if next page is not available yet, nothing is written
+  *           - NO_VALID_PAGE: if no valid page was found
+  *           - Flash error code: on write Flash error
   */
-static HAL_StatusTypeDef EE_Format(void)
+static uint16_t EE_StoreVariables(uint16_t *VirtAddress, uint16_t *Data, uint16_t Count)
 {
-	HAL_StatusTypeDef HAL_StatusTypeDef = HAL_OK;
+  uint16_t Status = HAL_OK;
+  uint16_t VarIdx = 0;
 
-  /* Erase Page0 */
-  HAL_StatusTypeDef = FLASH_ErasePage(PAGE0_BASE_ADDRESS);
+  if (Count == 0)
+  {
+    return HAL_OK;
+  }
 
-  /* If erase operation was failed, a Flash error code is returned */
-  if (HAL_StatusTypeDef != HAL_OK)
+  /* Single variable update is atomic */
+  if (Count == 1)
   {
-    return HAL_StatusTypeDef;
+    return EE_StoreVariable(VirtAddress[0], Data[0]);
   }
 
-  /* Set Page0 as valid page: Write VALID_PAGE at Page0 base address */
-  HAL_StatusTypeDef = FLASH_ProgramHalfWord(PAGE0_BASE_ADDRESS, VALID_PAGE);
+  if (Count > EE_TRANSACTION_MAX_VARS)
+  {
+    return PAGE_FULL;
+  }
 
-  /* If program operation was failed, a Flash error code is returned */
-  if (HAL_StatusTypeDef != HAL_OK)
+  if (EE_HeadPage == EE_NO_PAGE)
   {
-    return HAL_StatusTypeDef;
+    return NO_VALID_PAGE;
+  }
+
+  /* Group must not be split between pages, open next page in advance if it does not fit */
+  Status = EE_Reserve(Count + 2);
+  if (Status != HAL_OK)
+  {
+    return Status;
   }
 
-  /* Erase Page1 */
-  HAL_StatusTypeDef = FLASH_ErasePage(PAGE1_BASE_ADDRESS);
+  Status = EE_AppendVariable(EE_TRANSACTION_VIRT_ADDR, Count);
 
-  /* Return Page1 erase operation status */
-  return HAL_StatusTypeDef;
+  for (VarIdx = 0; VarIdx < Count && Status == HAL_OK; VarIdx++)
+  {
+    Status = EE_AppendVariable(VirtAddress[VarIdx], Data[VarIdx]);
+  }
+
+  if (Status == HAL_OK)
+  {
+    Status = EE_AppendVariable(EE_TRANSACTION_VIRT_ADDR, EE_TRANSACTION_COMMIT | Count);
+  }
+
+  return Status;
 }
 
 /**
-  * @brief  Find valid Page for write or read operation
-  * @param  Operation: operation to achieve on the valid page.
-  *   This parameter can be one of the following values:
-  *     @arg READ_FROM_VALID_PAGE: read operation from valid page
-  *     @arg WRITE_IN_VALID_PAGE: write operation from valid page
-  * @retval Valid page number (PAGE0 or PAGE1) or NO_VALID_PAGE in case
-  *   of no valid page was found
+  * @brief  Stores write requested from interrupt handler or waiting for room for
+  *   EE_Task. Newest request of variable is replaced, group is rejected if it
+  *   does not fit.
+  * @param  VirtAddress: array of variable virtual addresses
+  * @param  Data: array of 16 bit data to be written
+  * @param  Count: number of variables
+  * @retval HAL_OK, PAGE_FULL if requests buffer is full or NO_VALID_PAGE
   */
-static uint16_t EE_FindValidPage(uint8_t Operation)
+static uint16_t EE_Defer(uint16_t *VirtAddress, uint16_t *Data, uint16_t Count)
 {
-  uint16_t PageStatus0 = 6, PageStatus1 = 6;
+  uint32_t primask;
+  uint16_t VarIdx, Idx, New = 0;
+
+  if (EE_HeadPage == EE_NO_PAGE)
+  {
+    return NO_VALID_PAGE;
+  }
 
-  /* Get Page0 actual status */
-  PageStatus0 = (*(__IO uint16_t*)PAGE0_BASE_ADDRESS);
+  primask = __get_PRIMASK();
+  __disable_irq();
 
-  /* Get Page1 actual status */
-  PageStatus1 = (*(__IO uint16_t*)PAGE1_BASE_ADDRESS);
+  for (VarIdx = 0; VarIdx < Count; VarIdx++)
+  {
+    for (Idx = EE_DeferredCount; Idx > EE_DeferredBusy && EE_DeferredAddr[Idx - 1] != VirtAddress[VarIdx]; Idx--);
+    if (Idx == EE_DeferredBusy)
+    {
+      New++;
+    }
+  }
 
-  /* Write or read operation */
-  switch (Operation)
+  if (EE_DeferredCount + New > EE_TRANSACTION_MAX_VARS)
   {
-    case WRITE_IN_VALID_PAGE:   /* ---- Write operation ---- */
-      if (PageStatus1 == VALID_PAGE)
-      {
-        /* Page0 receiving data */
-        if (PageStatus0 == RECEIVE_DATA)
-        {
-          return PAGE0;         /* Page0 valid */
-        }
-        else
-        {
-          return PAGE1;         /* Page1 valid */
-        }
-      }
-      else if (PageStatus0 == VALID_PAGE)
+    __set_PRIMASK(primask);
+    return PAGE_FULL;
+  }
+
+  for (VarIdx = 0; VarIdx < Count; VarIdx++)
+  {
+    /* Requests left after failed store may repeat variable, newest one is replaced */
+    for (Idx = EE_DeferredCount; Idx > EE_DeferredBusy && EE_DeferredAddr[Idx - 1] != VirtAddress[VarIdx]; Idx--);
+    if (Idx == EE_DeferredBusy)
+    {
+      EE_DeferredAddr[EE_DeferredCount] = VirtAddress[VarIdx];
+      Idx = ++EE_DeferredCount;
+    }
+    EE_DeferredData[Idx - 1] = Data[VarIdx];
+  }
+
+  __set_PRIMASK(primask);
+
+  return HAL_OK;
+}
+
+/**
+  * @brief  Stores buffered writes as one group, so groups requested by
+  *   interrupt handlers stay atomic. Group with no room yet stays buffered,
+  *   failed group is dropped as failed write from main loop, interrupt handler
+  *   has no status to be returned to.
+  * @param  None
+  * @retval Success or error status, EE_NO_ROOM if group stays buffered
+  */
+static uint16_t EE_FlushDeferred(void)
+{
+  uint32_t primask;
+  uint16_t Status;
+  uint8_t Count, i;
+
+  if (EE_DeferredCount == 0)
+  {
+    return HAL_OK;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  Count = EE_DeferredCount;
+  EE_DeferredBusy = Count;
+  __set_PRIMASK(primask);
+
+  Status = EE_StoreVariables(EE_DeferredAddr, EE_DeferredData, Count);
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  if (Status == EE_NO_ROOM)
+  {
+    EE_DeferredBusy = 0;
+    __set_PRIMASK(primask);
+    return Status;
+  }
+  for (i = Count; i < EE_DeferredCount; i++)
+  {
+    EE_DeferredAddr[i - Count] = EE_DeferredAddr[i];
+    EE_DeferredData[i - Count] = EE_DeferredData[i];
+  }
+  EE_DeferredCount -= Count;
+  EE_DeferredBusy = 0;
+  __set_PRIMASK(primask);
+
+  return Status;
+}
+
+/**
+  * @brief  Get page state from page header
+  * @param  Page: page number
+  * @retval Page state
+  */
+static EE_PageState_T EE_GetPageState(uint8_t Page)
+{
+  uint32_t Address = EE_PAGE_ADDRESS(Page);
+  uint16_t PageStatus = EE_READ_HALFWORD(Address);
+  uint16_t Seq = EE_READ_HALFWORD(Address + 2);
+
+  switch (PageStatus)
+  {
+    case LOG_PAGE:
+      return (Seq & ~EE_SEQ_MASK) ? EE_PAGE_STATE_INVALID : EE_PAGE_STATE_LOG;
+
+    case ERASED:
+      /* Erase could be interrupted by power loss */
+      for (; Address < EE_PAGE_ADDRESS(Page + 1); Address += 4)
       {
-        /* Page1 receiving data */
-        if (PageStatus1 == RECEIVE_DATA)
-        {
-          return PAGE1;         /* Page1 valid */
-        }
-        else
+        if (EE_READ_WORD(Address) != 0xFFFFFFFF)
         {
-          return PAGE0;         /* Page0 valid */
+          return EE_PAGE_STATE_INVALID;
         }
       }
-      else
-      {
-        return NO_VALID_PAGE;   /* No valid Page */
-      }
+      return EE_PAGE_STATE_ERASED;
 
-    case READ_FROM_VALID_PAGE:  /* ---- Read operation ---- */
-      if (PageStatus0 == VALID_PAGE)
-      {
-        return PAGE0;           /* Page0 valid */
-      }
-      else if (PageStatus1 == VALID_PAGE)
-      {
-        return PAGE1;           /* Page1 valid */
-      }
-      else
-      {
-        return NO_VALID_PAGE ;  /* No valid Page */
-      }
+    default:
+      return EE_PAGE_STATE_INVALID;
+  }
+}
+
+/**
+  * @brief  Get state of page of two page layout used up to firmware V1.6.
+  *   Page marked obsolete after migration has sequence word cleared.
+  * @param  Address: page address
+  * @retval EE_PAGE_STATE_LEGACY_VALID, EE_PAGE_STATE_LEGACY_RECEIVE or
+  *         EE_PAGE_STATE_INVALID if page is not in use
+  */
+static EE_PageState_T EE_GetLegacyPageState(uint32_t Address)
+{
+  uint16_t PageStatus = EE_READ_HALFWORD(Address);
+  uint16_t Seq = EE_READ_HALFWORD(Address + 2);
+
+  if (Seq != 0xFFFF)
+  {
+    return EE_PAGE_STATE_INVALID;
+  }
+
+  switch (PageStatus)
+  {
+    case VALID_PAGE:
+      return EE_PAGE_STATE_LEGACY_VALID;
+
+    case RECEIVE_DATA:
+      return EE_PAGE_STATE_LEGACY_RECEIVE;
 
     default:
-      return PAGE0;             /* Page0 valid */
+      return EE_PAGE_STATE_INVALID;
   }
 }
 
 /**
-  * @brief  Verify if active page is full and Writes variable in EEPROM.
+  * @brief  Opens first page of log in erased page and schedules erase of other pages
+  * @param  None
+  * @retval Status of the last operation (Flash write or erase) done during
+  *         EEPROM formating
+  */
+static HAL_StatusTypeDef EE_Format(void)
+{
+  HAL_StatusTypeDef HAL_StatusTypeDef = HAL_OK;
+  uint8_t Page, First = EE_NO_PAGE;
+
+  /* Pages are erased in background, page 0 is erased when opened only if no page is erased */
+  for (Page = 0; Page < EE_PAGES_NUM; Page++)
+  {
+    if (EE_GetPageState(Page) != EE_PAGE_STATE_ERASED)
+    {
+      EE_ErasePending |= 1UL << Page;
+    }
+    else if (First == EE_NO_PAGE)
+    {
+      First = Page;
+    }
+  }
+
+  EE_HeadPage = EE_NO_PAGE;
+  EE_TailPage = EE_NO_PAGE;
+  EE_TransferSlot = 0;
+  EE_TransferLeft = 0;
+  HAL_StatusTypeDef = EE_OpenPage(First == EE_NO_PAGE ? 0 : First, 1);
+
+  EE_BuildIndex();
+
+  return HAL_StatusTypeDef;
+}
+
+/**
+  * @brief  Opens page as new head of log. Sequence number is written before
+  *   status, page with sequence number and erased status is erased on init.
+  * @param  Page: page number
+  * @param  Valid: 0 to leave status erased, page is not taken for log page
+  *   on init until caller writes status
+  * @retval Status of the last operation (Flash write or erase)
+  */
+static HAL_StatusTypeDef EE_OpenPage(uint8_t Page, uint8_t Valid)
+{
+  HAL_StatusTypeDef HAL_StatusTypeDef = HAL_OK;
+  uint16_t Seq = (EE_HeadPage == EE_NO_PAGE) ? 0 : ((EE_HeadSeq + 1) & EE_SEQ_MASK);
+
+  /* Page is normally erased in background, erase now if it was not */
+  if (EE_GetPageState(Page) != EE_PAGE_STATE_ERASED)
+  {
+    HAL_StatusTypeDef = FLASH_ErasePage(EE_PAGE_ADDRESS(Page));
+    if (HAL_StatusTypeDef != HAL_OK)
+    {
+      return HAL_StatusTypeDef;
+    }
+  }
+  EE_ErasePending &= ~(1UL << Page);
+
+  HAL_StatusTypeDef = FLASH_ProgramHalfWord(EE_PAGE_ADDRESS(Page) + 2, Seq);
+  if (HAL_StatusTypeDef != HAL_OK)
+  {
+    return HAL_StatusTypeDef;
+  }
+
+  if (Valid)
+  {
+    HAL_StatusTypeDef = FLASH_ProgramHalfWord(EE_PAGE_ADDRESS(Page), LOG_PAGE);
+    if (HAL_StatusTypeDef != HAL_OK)
+    {
+      return HAL_StatusTypeDef;
+    }
+  }
+
+  if (EE_TailPage == EE_NO_PAGE)
+  {
+    EE_TailPage = Page;
+  }
+  EE_HeadPage = Page;
+  EE_HeadSeq = Seq;
+  EE_FreeSlot = 1;
+
+  return HAL_OK;
+}
+
+/**
+  * @brief  Writes variable in first free slot of head page and updates index.
   * @param  VirtAddress: 16 bit virtual address of the variable
   * @param  Data: 16 bit data to be written as variable value
   * @retval Success or error status:
   *           - HAL_OK: on success
-  *           - PAGE_FULL: if valid page is full
+  *           - PAGE_FULL: if head page is full
   *           - NO_VALID_PAGE: if no valid page was found
   *           - Flash error code: on write Flash error
   */
-static uint16_t EE_VerifyPageFullWriteVariable(uint16_t VirtAddress, uint16_t Data)
+static uint16_t EE_AppendVariable(uint16_t VirtAddress, uint16_t Data)
 {
-	HAL_StatusTypeDef HAL_StatusTypeDef = HAL_OK/*HAL_OK*/;
-  uint16_t ValidPage = PAGE0;
-  uint32_t Address = 0x08010000, PageEndAddress = 0x080107FF;
-
-  /* Get valid Page for write operation */
-  ValidPage = EE_FindValidPage(WRITE_IN_VALID_PAGE);
+  HAL_StatusTypeDef HAL_StatusTypeDef = HAL_OK;
+  uint32_t Address = 0;
+  uint16_t Slot = 0;
 
   /* Check if there is no valid page */
-  if (ValidPage == NO_VALID_PAGE)
+  if (EE_HeadPage == EE_NO_PAGE)
   {
     return  NO_VALID_PAGE;
   }
 
-  /* Get the valid Page start Address */
-  Address = (uint32_t)(EEPROM_START_ADDRESS + (uint32_t)(ValidPage * PAGE_SIZE));
-
-  /* Get the valid Page end Address */
-  PageEndAddress = (uint32_t)((EEPROM_START_ADDRESS - 2) + (uint32_t)((1 + ValidPage) * PAGE_SIZE));
-
-  /* Check each active page address starting from begining */
-  while (Address < PageEndAddress)
+  /* Check each slot starting from first free one, skip partially programmed slots */
+  for (Slot = EE_FreeSlot; Slot < EE_SLOTS_NUM; Slot++)
   {
+    Address = EE_SLOT_ADDRESS(EE_HeadPage, Slot);
+
     /* Verify if Address and Address+2 contents are 0xFFFFFFFF */
-    if ((*(__IO uint32_t*)Address) == 0xFFFFFFFF)
+    if (EE_READ_WORD(Address) == 0xFFFFFFFF)
     {
+      /* Slot is used even if program operation fails */
+      EE_FreeSlot = Slot + 1;
+
       /* Set variable data */
       HAL_StatusTypeDef = FLASH_ProgramHalfWord(Address, Data);
       /* If program operation was failed, a Flash error code is returned */
-      if (HAL_StatusTypeDef != HAL_OK/*HAL_OK*/)
+      if (HAL_StatusTypeDef != HAL_OK)
       {
         return HAL_StatusTypeDef;
       }
       /* Set variable virtual address */
       HAL_StatusTypeDef = FLASH_ProgramHalfWord(Address + 2, VirtAddress);
+
+      if (HAL_StatusTypeDef == HAL_OK && VirtAddress < NB_OF_VAR)
+      {
+        EE_Index[VirtAddress] = EE_INDEX(EE_HeadPage, Slot);
+      }
       /* Return program operation status */
       return HAL_StatusTypeDef;
     }
-    else
-    {
-      /* Next address location */
-      Address = Address + 4;
-    }
   }
 
-  /* Return PAGE_FULL in case the valid page is full */
+  EE_FreeSlot = EE_SLOTS_NUM;
+
+  /* Return PAGE_FULL in case the head page is full */
   return PAGE_FULL;
 }
 
 /**
-  * @brief  Transfers last updated variables data from the full Page to
-  *   an empty one.
-  * @param  VirtAddress: 16 bit virtual address of the variable
-  * @param  Data: 16 bit data to be written as variable value
+  * @brief  Opens next page of circular log as head and starts background
+  *   transfer of oldest page if log is near full. Next page is opened only when
+  *   it was erased in background and is not oldest page, transfer and erase
+  *   are never waited for.
+  * @param  None
+  * @retval Success or error status, EE_NO_ROOM if next page is not available yet
+  */
+static uint16_t EE_NextPage(void)
+{
+  uint16_t Status = HAL_OK;
+  uint8_t Page = (EE_HeadPage + 1) % EE_PAGES_NUM;
+
+  if (Page == EE_TailPage || (EE_ErasePending & (1UL << Page)))
+  {
+    return EE_NO_ROOM;
+  }
+
+  Status = EE_OpenPage(Page, 1);
+
+  if (Status == HAL_OK)
+  {
+    EE_StartTransfer();
+  }
+
+  return Status;
+}
+
+/**
+  * @brief  Makes room in head page for variables to be written, keeping space
+  *   for variables of running background transfer. Next page is opened if room
+  *   is not available.
+  * @param  Count: number of slots needed
+  * @retval Success or error status, EE_NO_ROOM if next page is not available yet
+  */
+static uint16_t EE_Reserve(uint16_t Count)
+{
+  uint16_t Status = HAL_OK;
+
+  if (EE_HeadPage == EE_NO_PAGE)
+  {
+    return NO_VALID_PAGE;
+  }
+
+  if ((EE_SLOTS_NUM - EE_FreeSlot) >= EE_TransferLeft + Count)
+  {
+    return HAL_OK;
+  }
+
+  Status = EE_NextPage();
+  if (Status == HAL_OK && (EE_SLOTS_NUM - EE_FreeSlot) < (EE_TransferLeft + Count))
+  {
+    Status = PAGE_FULL;
+  }
+
+  return Status;
+}
+
+/**
+  * @brief  Starts background transfer of oldest page when at most one page
+  *   is left after head page.
+  * @param  None
+  * @retval None
+  */
+static void EE_StartTransfer(void)
+{
+  uint16_t VarIdx;
+
+  if (EE_TransferSlot || EE_HeadPage == EE_TailPage
+      || (EE_TailPage + EE_PAGES_NUM - EE_HeadPage - 1) % EE_PAGES_NUM > 1)
+  {
+    return;
+  }
+
+  EE_TransferLeft = EE_TRANSFER_SPARE_SLOTS;
+  for (VarIdx = 0; VarIdx < NB_OF_VAR; VarIdx++)
+  {
+    if (EE_INDEX_PAGE(EE_Index[VarIdx]) == EE_TailPage && EE_Index[VarIdx])
+    {
+      EE_TransferLeft++;
+    }
+  }
+  EE_TransferSlot = 1;
+}
+
+/**
+  * @brief  Transfers variables whose last update is in oldest page to head
+  *   page. When all slots are checked oldest page is marked obsolete and left
+  *   for background erase. Other records of oldest page are obsolete, they
+  *   are only read, so transfer restarted after power loss catches up fast.
+  * @param  MaxVars: maximum number of variables to copy
   * @retval Success or error status:
   *           - HAL_OK: on success
-  *           - PAGE_FULL: if valid page is full
-  *           - NO_VALID_PAGE: if no valid page was found
+  *           - PAGE_FULL: if head page is full
   *           - Flash error code: on write Flash error
   */
-static uint16_t EE_PageTransfer(uint16_t VirtAddress, uint16_t Data)
+static uint16_t EE_PageTransfer(uint16_t MaxVars)
 {
-	HAL_StatusTypeDef HAL_StatusTypeDef = HAL_OK;
-  uint32_t NewPageAddress = 0x080103FF, OldPageAddress = 0x08010000;
-  uint16_t ValidPage = PAGE0, VarIdx = 0;
-  uint16_t EepromStatus = 0, ReadStatus = 0;
+  HAL_StatusTypeDef HAL_StatusTypeDef = HAL_OK;
+  uint16_t EepromStatus = 0;
+  uint32_t Address = 0;
+  uint16_t VirtAddress = 0;
+  uint8_t Page = EE_TailPage;
+
+  /* Transfer process: transfer live variables from oldest page to head page */
+  for (; EE_TransferSlot < EE_SLOTS_NUM && MaxVars; EE_TransferSlot++)
+  {
+    Address = EE_SLOT_ADDRESS(Page, EE_TransferSlot);
+    VirtAddress = EE_READ_HALFWORD(Address + 2);
+    if (VirtAddress < NB_OF_VAR && EE_Index[VirtAddress] == EE_INDEX(Page, EE_TransferSlot))
+    {
+      EepromStatus = EE_AppendVariable(VirtAddress, EE_READ_HALFWORD(Address));
+      /* If program operation was failed, a Flash error code is returned */
+      if (EepromStatus != HAL_OK)
+      {
+        return EepromStatus;
+      }
+      if (EE_TransferLeft > EE_TRANSFER_SPARE_SLOTS)
+      {
+        EE_TransferLeft--;
+      }
+      MaxVars--;
+    }
+  }
 
-  /* Get active Page for read operation */
-  ValidPage = EE_FindValidPage(READ_FROM_VALID_PAGE);
+  if (EE_TransferSlot < EE_SLOTS_NUM)
+  {
+    return HAL_OK;
+  }
 
-  if (ValidPage == PAGE1)       /* Page1 valid */
+  /* Mark page obsolete, partially erased page is not taken for log page after power loss */
+  HAL_StatusTypeDef = FLASH_ProgramHalfWord(EE_PAGE_ADDRESS(Page), VALID_PAGE);
+  if (HAL_StatusTypeDef != HAL_OK)
   {
-    /* New page address where variable will be moved to */
-    NewPageAddress = PAGE0_BASE_ADDRESS;
+    return HAL_StatusTypeDef;
+  }
+
+  EE_ErasePending |= 1UL << Page;
+  EE_TailPage = (Page + 1) % EE_PAGES_NUM;
+  EE_TransferSlot = 0;
+  EE_TransferLeft = 0;
+
+  /* Log may still be near full with many pages */
+  EE_StartTransfer();
 
-    /* Old page address where variable will be taken from */
-    OldPageAddress = PAGE1_BASE_ADDRESS;
+  return HAL_OK;
+}
+
+/**
+  * @brief  Background EEPROM maintenance, called from main loop. Each call
+  *   either erases one page, stores buffered writes or copies a chunk of
+  *   oldest page variables during page transfer. Page erase stalls flash access for
+  *   20-40 ms and can not be split, it is done alone in its call and not
+  *   during transfer, unless head page has no room left for transfer.
+  * @param  None
+  * @retval None
+  */
+void EE_Task(void)
+{
+  uint8_t Page;
+
+  if (EE_HeadPage == EE_NO_PAGE)
+  {
+    return;
   }
-  else if (ValidPage == PAGE0)  /* Page0 valid */
+
+  /* Head page lost room for transfer to power loss, it continues in next page */
+  if (EE_TransferSlot && EE_FreeSlot == EE_SLOTS_NUM)
   {
-    /* New page address where variable will be moved to */
-    NewPageAddress = PAGE1_BASE_ADDRESS;
+    EE_NextPage();
+  }
 
-    /* Old page address where variable will be taken from */
-    OldPageAddress = PAGE0_BASE_ADDRESS;
+  if (EE_ErasePending && !(EE_TransferSlot && EE_FreeSlot < EE_SLOTS_NUM))
+  {
+    for (Page = 0; Page < EE_PAGES_NUM; Page++)
+    {
+      if (EE_ErasePending & (1UL << Page))
+      {
+        if (FLASH_ErasePage(EE_PAGE_ADDRESS(Page)) == HAL_OK)
+        {
+          EE_ErasePending &= ~(1UL << Page);
+        }
+        return;
+      }
+    }
   }
-  else
+
+  /* Buffered writes are stored in pass of their own, transfer continues while they wait for room */
+  if (EE_DeferredCount && EE_FlushDeferred() != EE_NO_ROOM)
   {
-    return NO_VALID_PAGE;       /* No valid Page */
+    return;
   }
 
-  /* Set the new Page status to RECEIVE_DATA status */
-  HAL_StatusTypeDef = FLASH_ProgramHalfWord(NewPageAddress, RECEIVE_DATA);
-  /* If program operation was failed, a Flash error code is returned */
-  if (HAL_StatusTypeDef != HAL_OK)
+  if (EE_TransferSlot)
   {
-    return HAL_StatusTypeDef;
+    EE_PageTransfer(EE_TRANSFER_CHUNK_VARS);
+  }
+}
+
+/**
+  * @brief  Moves variables from two page layout used up to firmware V1.6 into
+  *   new log page. Receive page records override valid page records. Log page
+  *   status is written only after all variables are stored, so interrupted
+  *   migration is repeated on next init, and old pages after it.
+  * @param  None
+  * @retval Success or error status
+  */
+static uint16_t EE_Migrate(void)
+{
+  const uint32_t LegacyPage[2] = {EE_LEGACY_PAGE0_ADDRESS, EE_LEGACY_PAGE1_ADDRESS};
+  uint8_t Present[(NB_OF_VAR + 7) / 8];
+  uint16_t EepromStatus = HAL_OK;
+  uint32_t Address = 0;
+  uint16_t VirtAddress = 0, VarIdx = 0, Data = 0;
+  uint8_t Page = 0, Pass = 0, i = 0;
+
+  for (VarIdx = 0; VarIdx < sizeof(Present); VarIdx++)
+  {
+    Present[VarIdx] = 0;
+  }
+
+  /* Collect last values in index array, valid page first */
+  for (Pass = 0; Pass < 2; Pass++)
+  {
+    for (i = 0; i < 2; i++)
+    {
+      if (EE_GetLegacyPageState(LegacyPage[i]) != (Pass ? EE_PAGE_STATE_LEGACY_RECEIVE : EE_PAGE_STATE_LEGACY_VALID))
+      {
+        continue;
+      }
+      for (Address = LegacyPage[i] + 4; Address < LegacyPage[i] + EE_LEGACY_PAGE_SIZE; Address += 4)
+      {
+        VirtAddress = EE_READ_HALFWORD(Address + 2);
+        if (VirtAddress < NB_OF_VAR)
+        {
+          EE_Index[VirtAddress] = EE_READ_HALFWORD(Address);
+          Present[VirtAddress >> 3] |= 1 << (VirtAddress & 7);
+        }
+      }
+    }
+  }
+
+  /* Log restarts from first page, it is erased first if interrupted migration used it */
+  EE_HeadPage = EE_NO_PAGE;
+  EE_TailPage = EE_NO_PAGE;
+  EepromStatus = EE_OpenPage(0, 0);
+  if (EepromStatus != HAL_OK)
+  {
+    return EepromStatus;
+  }
+
+  for (VarIdx = 0; VarIdx < NB_OF_VAR; VarIdx++)
+  {
+    Data = EE_Index[VarIdx];
+    EE_Index[VarIdx] = 0;
+    if (Present[VarIdx >> 3] & (1 << (VarIdx & 7)))
+    {
+      EepromStatus = EE_AppendVariable(VarIdx, Data);
+      if (EepromStatus != HAL_OK)
+      {
+        return EepromStatus;
+      }
+    }
+  }
+
+  /* All variables are stored, log page becomes valid */
+  EepromStatus = FLASH_ProgramHalfWord(EE_PAGE_ADDRESS(0), LOG_PAGE);
+  if (EepromStatus != HAL_OK)
+  {
+    return EepromStatus;
   }
 
-  /* Write the variable passed as parameter in the new active page */
-  EepromStatus = EE_VerifyPageFullWriteVariable(VirtAddress, Data);
-  /* If program operation was failed, a Flash error code is returned */
+  EepromStatus = EE_ObsoleteLegacyPages();
   if (EepromStatus != HAL_OK)
   {
     return EepromStatus;
   }
 
-  /* Transfer process: transfer variables from old to the new active page */
+  for (Page = 1; Page < EE_PAGES_NUM; Page++)
+  {
+    if (EE_GetPageState(Page) != EE_PAGE_STATE_ERASED)
+    {
+      EE_ErasePending |= 1UL << Page;
+    }
+  }
+
+  EE_BuildIndex();
+
+  return HAL_OK;
+}
+
+/**
+  * @brief  Marks pages of two page layout obsolete after migration. They share
+  *   erase pages with other flash content and are not erased.
+  * @param  None
+  * @retval Success or error status
+  */
+static uint16_t EE_ObsoleteLegacyPages(void)
+{
+  const uint32_t LegacyPage[2] = {EE_LEGACY_PAGE0_ADDRESS, EE_LEGACY_PAGE1_ADDRESS};
+  uint16_t EepromStatus = HAL_OK;
+  uint8_t i;
+
+  for (i = 0; i < 2 && EepromStatus == HAL_OK; i++)
+  {
+    if (EE_GetLegacyPageState(LegacyPage[i]) != EE_PAGE_STATE_INVALID)
+    {
+      EepromStatus = FLASH_ProgramHalfWord(LegacyPage[i] + 2, 0x0000);
+    }
+  }
+
+  return EepromStatus;
+}
+
+/**
+  * @brief  Builds RAM index of last variable updates scanning log pages from
+  *   oldest to newest and finds first free slot of head page.
+  * @param  None
+  * @retval None
+  */
+static void EE_BuildIndex(void)
+{
+  uint32_t Address, DiscardEnd;
+  uint16_t Slot, VirtAddress, VarIdx;
+  uint8_t Page;
+
+  EE_TransactionAbortReq = 0;
+  EE_FreeSlot = EE_SLOTS_NUM;
+
   for (VarIdx = 0; VarIdx < NB_OF_VAR; VarIdx++)
   {
-    if (VirtAddVarTab[VarIdx] != VirtAddress)  /* Check each variable except the one passed as parameter */
+    EE_Index[VarIdx] = 0;
+  }
+
+  if (EE_HeadPage == EE_NO_PAGE)
+  {
+    return;
+  }
+
+  /* Scan forward so later updates override earlier ones */
+  Page = EE_TailPage;
+  for (;;)
+  {
+    DiscardEnd = 0;
+    for (Slot = 1; Slot < EE_SLOTS_NUM; Slot++)
     {
-      /* Read the other last variable updates */
-      ReadStatus = EE_ReadVariable(VirtAddVarTab[VarIdx], &DataVar);
-      /* In case variable corresponding to the virtual address was found */
-      if (ReadStatus != 0x1)
+      Address = EE_SLOT_ADDRESS(Page, Slot);
+      if (EE_READ_WORD(Address) == 0xFFFFFFFF)
       {
-        /* Transfer the variable to the new active page */
-        EepromStatus = EE_VerifyPageFullWriteVariable(VirtAddVarTab[VarIdx], DataVar);
-        /* If program operation was failed, a Flash error code is returned */
-        if (EepromStatus != HAL_OK)
+        if (Page == EE_HeadPage && EE_FreeSlot == EE_SLOTS_NUM)
         {
-          return EepromStatus;
+          EE_FreeSlot = Slot;
         }
+        continue;
+      }
+
+      VirtAddress = EE_READ_HALFWORD(Address + 2);
+      VarIdx = EE_READ_HALFWORD(Address);
+      if (VirtAddress == EE_TRANSACTION_VIRT_ADDR && (VarIdx & EE_TRANSACTION_COMMIT))
+      {
+        /* Commit record of complete transaction */
+      }
+      else if (VirtAddress == EE_TRANSACTION_VIRT_ADDR)
+      {
+        /* Start of transaction, or abort record closing an incomplete one */
+        DiscardEnd = EE_IsTransactionComplete(Page, Slot, VarIdx) ? 0 : (uint32_t)Slot + VarIdx + 1;
+      }
+      else if (Slot <= DiscardEnd)
+      {
+        /* Record of incomplete transaction */
+      }
+      else if (VirtAddress < NB_OF_VAR)
+      {
+        EE_Index[VirtAddress] = EE_INDEX(Page, Slot);
       }
     }
+
+    if (Page == EE_HeadPage)
+    {
+      /* Incomplete transaction was not followed by abort record */
+      EE_TransactionAbortReq = DiscardEnd != 0;
+      break;
+    }
+    Page = (Page + 1) % EE_PAGES_NUM;
   }
+}
 
-  /* Erase the old Page: Set old Page status to ERASED status */
-  HAL_StatusTypeDef = FLASH_ErasePage(OldPageAddress);
-  /* If erase operation was failed, a Flash error code is returned */
-  if (HAL_StatusTypeDef != HAL_OK)
+/**
+  * @brief  Checks if transaction was committed, commit record follows its
+  *   variables in the same page. Abort record is complete transaction of no variables.
+  * @param  Page: page number
+  * @param  Slot: slot of transaction record
+  * @param  Count: number of variables in transaction
+  * @retval 1 if complete, 0 otherwise
+  */
+static uint8_t EE_IsTransactionComplete(uint8_t Page, uint16_t Slot, uint16_t Count)
+{
+  uint32_t Address;
+
+  if (Count == 0)
   {
-    return HAL_StatusTypeDef;
+    return 1;
   }
 
-  /* Set new Page status to VALID_PAGE status */
-  HAL_StatusTypeDef = FLASH_ProgramHalfWord(NewPageAddress, VALID_PAGE);
-  /* If program operation was failed, a Flash error code is returned */
-  if (HAL_StatusTypeDef != HAL_OK)
+  if ((uint32_t)Slot + Count + 1 >= EE_SLOTS_NUM)
   {
-    return HAL_StatusTypeDef;
+    return 0;
   }
 
-  /* Return last operation flash status */
-  return HAL_StatusTypeDef;
+  Address = EE_SLOT_ADDRESS(Page, Slot + Count + 1);
+  return EE_READ_HALFWORD(Address + 2) == EE_TRANSACTION_VIRT_ADDR
+      && EE_READ_HALFWORD(Address) == (EE_TRANSACTION_COMMIT | Count);
 }
 
 /**
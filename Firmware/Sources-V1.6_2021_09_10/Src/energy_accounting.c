@@ -0,0 +1,186 @@
+/*
+ * energy_accounting.c
+ *
+ *  Created on: 19.10.2026.
+ */
+
+#include "stddef.h"
+#include "energy_accounting.h"
+#include "nv.h"
+#include "time_count.h"
+#include "analog.h"
+#include "battery.h"
+#include "fuel_gauge_lc709203f.h"
+#include "load_current_sense.h"
+#include "power_source.h"
+#include "rtc_ds1339_emu.h"
+
+// trapezoid sums of two samples over time in 1/256 s: 1mWh = 2*3600*256 mW/256s, same for mAh
+#define ENERGY_UNIT_ACC	1843200
+
+extern uint8_t resetStatus;
+
+static uint32_t energyCounters[ENERGY_COUNTERS_NUM] __attribute__((section("no_init")));
+static uint32_t energyAcc[ENERGY_COUNTERS_NUM] __attribute__((section("no_init"))); // fraction of unit
+static uint32_t energyNvCounters[ENERGY_COUNTERS_NUM]; // last values checkpointed to nv
+static uint32_t energyIntegrationTimer;
+static uint64_t energyLastTime; // RTC time of last sample in 1/256 s
+static uint8_t energyLastValid = 0;
+// last sample: load power, battery power, battery current, input power
+static int32_t energyLastLoadPower;
+static int32_t energyLastBatPower;
+static int32_t energyLastBatCurrent;
+static int32_t energyLastInPower;
+static uint32_t energyNvCheckpointTimer;
+static uint8_t energySaveReq = 0;
+
+// value is sum of samples at interval start and end, dt can be hours after stop mode
+static void EnergyAccountingAdd(EnergyCounter_T counter, uint32_t value, uint32_t dt) {
+	uint64_t acc = energyAcc[counter] + (uint64_t)value * dt;
+	if (acc >= ENERGY_UNIT_ACC) {
+		energyCounters[counter] += acc / ENERGY_UNIT_ACC;
+		acc %= ENERGY_UNIT_ACC;
+	}
+	energyAcc[counter] = acc;
+}
+
+// signed sum goes to positive or negative direction counter
+static void EnergyAccountingAddSigned(EnergyCounter_T pos, EnergyCounter_T neg, int32_t value, uint32_t dt) {
+	if (value > 0) {
+		EnergyAccountingAdd(pos, value, dt);
+	} else if (value < 0) {
+		EnergyAccountingAdd(neg, -value, dt);
+	}
+}
+
+static void EnergyAccountingCheckpoint(void) {
+	uint32_t counters[ENERGY_COUNTERS_NUM];
+	uint8_t i;
+
+	// low and high words are committed together, counter is not torn by power loss between them
+	NvTransactionBegin();
+	for (i = 0; i < ENERGY_COUNTERS_NUM; i++) {
+		counters[i] = energyCounters[i];
+		// write only changed words, high words are rarely changed
+		if ((counters[i] & 0xFFFF) != (energyNvCounters[i] & 0xFFFF)) {
+			NvTransactionStage(ENERGY_TO_PI_L_NV_ADDR + 2 * i, counters[i] & 0xFFFF);
+		}
+		if ((counters[i] >> 16) != (energyNvCounters[i] >> 16)) {
+			NvTransactionStage(ENERGY_TO_PI_H_NV_ADDR + 2 * i, counters[i] >> 16);
+		}
+	}
+	if (NvTransactionCommit() == HAL_OK) {
+		for (i = 0; i < ENERGY_COUNTERS_NUM; i++) energyNvCounters[i] = counters[i];
+	}
+	MS_TIME_COUNTER_INIT(energyNvCheckpointTimer);
+}
+
+void EnergyAccountingInit(void) {
+	uint16_t var;
+	uint8_t i;
+	for (i = 0; i < ENERGY_COUNTERS_NUM; i++) {
+		energyNvCounters[i] = 0;
+		var = 0;
+		if (EE_ReadVariable(ENERGY_TO_PI_L_NV_ADDR + 2 * i, &var) == 0) energyNvCounters[i] = var;
+		var = 0;
+		if (EE_ReadVariable(ENERGY_TO_PI_H_NV_ADDR + 2 * i, &var) == 0) energyNvCounters[i] |= (uint32_t)var << 16;
+	}
+
+	if (!resetStatus) {
+		// on mcu power up continue from last checkpoint
+		for (i = 0; i < ENERGY_COUNTERS_NUM; i++) {
+			energyCounters[i] = energyNvCounters[i];
+			energyAcc[i] = 0;
+		}
+	}
+
+	energyLastValid = 0;
+	MS_TIME_COUNTER_INIT(energyIntegrationTimer);
+	MS_TIME_COUNTER_INIT(energyNvCheckpointTimer);
+}
+
+// RTC time was written, shift last sample time by delta in 1/256 s so step is not integrated
+void EnergyAccountingTimeStep(int32_t delta) {
+	energyLastTime += (int64_t)delta;
+}
+
+void EnergyAccountingTask(void) {
+	int32_t loadCurrent, ioVoltage, batPower, loadPower, inPower, current;
+	uint64_t now;
+	int64_t dt;
+	uint32_t sec;
+	uint32_t primask;
+	uint8_t sub;
+
+	// tick is stopped in stop mode, elapsed time is taken from RTC
+	if (MS_TIME_COUNT(energyIntegrationTimer) >= TICK_PERIOD_MS) {
+		MS_TIME_COUNTER_INIT(energyIntegrationTimer);
+		loadCurrent = GetLoadCurrent();
+		ioVoltage = Get5vIoVoltage();
+		current = batteryCurrent;
+		batPower = ((int32_t)batteryVoltage * current) / 1000; // mW, positive when discharging
+		loadPower = (ioVoltage * loadCurrent) / 1000; // mW, positive when delivered to the Pi
+		if (ioVoltage < 0 || loadCurrent == -1) loadPower = 0;
+		// micro USB input supplies system and Pi when Pi does not feed 5V GPIO rail, converter losses are not included
+		inPower = (powerInStatus != POW_SOURCE_NOT_PRESENT && loadPower >= 0) ? loadPower + (batPower < 0 ? -batPower : 0) : 0;
+
+		// host can write RTC time from interrupt between read and update of last time
+		primask = __get_PRIMASK();
+		__disable_irq();
+		RtcReadLinearTime(&sec, &sub);
+		now = ((uint64_t)sec << 8) | sub;
+		dt = energyLastValid ? (int64_t)(now - energyLastTime) : 0;
+		energyLastTime = now;
+		__set_PRIMASK(primask);
+
+		// time going back without time step (RTC reinit) is not integrated, next interval starts from this sample
+		if (dt > 0 && dt <= 0xFFFFFFFF) {
+			// average of samples before and after interval, each interval is integrated once
+			EnergyAccountingAddSigned(ENERGY_TO_PI, ENERGY_FROM_5V_IO, energyLastLoadPower + loadPower, dt);
+			EnergyAccountingAddSigned(ENERGY_BAT_OUT, ENERGY_BAT_IN, energyLastBatPower + batPower, dt);
+			EnergyAccountingAddSigned(CHARGE_BAT_OUT, CHARGE_BAT_IN, energyLastBatCurrent + current, dt);
+			EnergyAccountingAdd(ENERGY_FROM_IN, energyLastInPower + inPower, dt);
+		}
+		energyLastLoadPower = loadPower;
+		energyLastBatPower = batPower;
+		energyLastBatCurrent = current;
+		energyLastInPower = inPower;
+		energyLastValid = 1;
+	}
+
+	if (energySaveReq || MS_TIME_COUNT(energyNvCheckpointTimer) >= ENERGY_NV_CHECKPOINT_PERIOD_MS) {
+		EnergyAccountingCheckpoint();
+		energySaveReq = 0;
+	}
+}
+
+// data[0]: bit0 - checkpoint counters to nv now, bit7 - reset all counters
+void EnergyAccountingSetCmd(uint8_t data[], uint16_t len) {
+	uint8_t i;
+	if (len < 1) return;
+	if (data[0] & 0x80) {
+		for (i = 0; i < ENERGY_COUNTERS_NUM; i++) {
+			energyCounters[i] = 0;
+			energyAcc[i] = 0;
+		}
+	}
+	if (data[0] & 0x81) energySaveReq = 1;
+}
+
+// counters as 32 bit little endian in EnergyCounter_T order, followed by equivalent full cycles * 100
+void EnergyAccountingGetCmd(uint8_t data[], uint16_t *len) {
+	uint8_t i;
+	uint32_t capacity = currentBatProfile != NULL ? currentBatProfile->capacity : 0;
+	uint32_t mah = energyCounters[CHARGE_BAT_OUT];
+	uint32_t cycles = capacity ? (mah < 0x28F5C28 ? mah * 100 / capacity : mah / capacity * 100) : 0;
+	for (i = 0; i < ENERGY_COUNTERS_NUM; i++) {
+		data[i*4] = energyCounters[i];
+		data[i*4+1] = energyCounters[i] >> 8;
+		data[i*4+2] = energyCounters[i] >> 16;
+		data[i*4+3] = energyCounters[i] >> 24;
+	}
+	if (cycles > 0xFFFF) cycles = 0xFFFF;
+	data[ENERGY_COUNTERS_NUM*4] = cycles;
+	data[ENERGY_COUNTERS_NUM*4+1] = cycles >> 8;
+	*len = ENERGY_COUNTERS_NUM*4 + 2;
+}
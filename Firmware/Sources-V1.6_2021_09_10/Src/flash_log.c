@@ -0,0 +1,389 @@
+/*
+ * flash_log.c
+ *
+ *  Created on: 19.10.2026.
+ */
+
+#include "flash_log.h"
+#include "rtc_ds1339_emu.h"
+#include "time_count.h"
+#include "battery.h"
+#include "power_source.h"
+#include "power_management.h"
+#include "charger_bq2416x.h"
+#include "fuel_gauge_lc709203f.h"
+
+// Record slot: commit, sequence number, seconds since 2000-01-01, 1/256 s, payload, 16 bit half words.
+// Commit half word with event id is written last, slot with other content is torn record and is skipped.
+// Slot 0 of page is header: sequence number of first record in page, then magic.
+#define FLASH_LOG_SLOT_SIZE	16
+#define FLASH_LOG_SLOTS_NUM	((uint16_t)(PAGE_SIZE / FLASH_LOG_SLOT_SIZE))
+#define FLASH_LOG_PAGE_MAGIC	((uint16_t)0x4C46)
+#define FLASH_LOG_NO_PAGE	0xFF
+
+#define FLASH_LOG_PAGE_ADDRESS(page)	(FLASH_LOG_START_ADDRESS + (uint32_t)(page) * PAGE_SIZE)
+#define FLASH_LOG_SLOT_ADDRESS(page, slot)	(FLASH_LOG_PAGE_ADDRESS(page) + (uint32_t)(slot) * FLASH_LOG_SLOT_SIZE)
+#define FLASH_LOG_COMMIT(id)	((uint16_t)((id) | ((uint16_t)((id) ^ 0xFF) << 8)))
+#define FLASH_LOG_READ_U32(address)	((*(__IO uint16_t*)(address)) | ((uint32_t)(*(__IO uint16_t*)((address) + 2)) << 16))
+
+#define FLASH_LOG_READ_FLAG_MORE	0x01
+#define FLASH_LOG_READ_FLAG_LOST	0x02
+#define FLASH_LOG_READ_FLAG_DROPPED	0x04
+#define FLASH_LOG_READ_FLAG_BUSY	0x08
+
+typedef struct {
+	uint32_t sec;
+	uint8_t sub;
+	uint8_t id;
+	uint8_t payload[FLASH_LOG_PAYLOAD_LEN];
+} FlashLogEntry_T;
+
+// events are queued from interrupts and written to flash from FlashLogTask
+static FlashLogEntry_T flashLogQueue[FLASH_LOG_QUEUE_SIZE];
+static volatile uint8_t flashLogQueueHead = 0;
+static volatile uint8_t flashLogQueueCount = 0;
+static uint8_t flashLogDropped = 0;
+
+static uint8_t flashLogHeadPage = FLASH_LOG_NO_PAGE;
+static uint16_t flashLogFreeSlot = FLASH_LOG_SLOTS_NUM;
+static uint32_t flashLogNextSeq = 1;
+// Flash is programmed, erased and scanned only in FlashLogTask. Read frame from host cursor is
+// prepared there, I2C command handlers take prepared frame and change cursor.
+static uint32_t flashLogReadSeq = 0; // host read cursor, 0 to read from oldest record
+static uint8_t flashLogReadFrame[FLASH_LOG_READ_LEN];
+static uint32_t flashLogReadFrameNextSeq; // cursor after frame is taken
+static volatile uint8_t flashLogReadFrameReady = 0;
+static volatile uint8_t flashLogReadCursorSet = 0; // cursor changed while frame was prepared
+
+static uint16_t flashLogFaults = 0; // faults already logged
+static uint32_t flashLogFaultTimer;
+static uint32_t flashLogFaultRearmTimer;
+
+// Page is valid if header magic is written, seq is set to sequence number of its first record
+static uint8_t FlashLogIsPageValid(uint8_t page, uint32_t *seq) {
+	uint32_t address = FLASH_LOG_PAGE_ADDRESS(page);
+
+	if ((*(__IO uint16_t*)address) != FLASH_LOG_PAGE_MAGIC) return 0;
+	*seq = FLASH_LOG_READ_U32(address + 2);
+	return 1;
+}
+
+static uint8_t FlashLogIsSlotErased(uint32_t address) {
+	uint8_t i;
+
+	for (i = 0; i < FLASH_LOG_SLOT_SIZE; i += 4) {
+		if ((*(__IO uint32_t*)(address + i)) != 0xFFFFFFFF) return 0;
+	}
+	return 1;
+}
+
+static uint8_t FlashLogIsRecord(uint32_t address) {
+	uint16_t commit = *(__IO uint16_t*)address;
+	uint8_t id = commit & 0xFF;
+
+	return id != FLASH_LOG_NONE && id != 0xFF && commit == FLASH_LOG_COMMIT(id);
+}
+
+// Fills valid pages ordered from oldest to newest, returns their number
+static uint8_t FlashLogPageOrder(uint8_t order[FLASH_LOG_PAGES_NUM]) {
+	uint32_t seq[FLASH_LOG_PAGES_NUM];
+	uint8_t n = 0, i, page;
+
+	for (page = 0; page < FLASH_LOG_PAGES_NUM; page++) {
+		if (!FlashLogIsPageValid(page, &seq[page])) continue;
+		for (i = n; i > 0 && seq[order[i - 1]] > seq[page]; i--) order[i] = order[i - 1];
+		order[i] = page;
+		n++;
+	}
+	return n;
+}
+
+// Erases page following head page and writes its header, records of oldest page are lost
+static HAL_StatusTypeDef FlashLogOpenPage(void) {
+	uint8_t page = (flashLogHeadPage == FLASH_LOG_NO_PAGE) ? 0 : (flashLogHeadPage + 1) % FLASH_LOG_PAGES_NUM;
+	uint32_t address = FLASH_LOG_PAGE_ADDRESS(page);
+	HAL_StatusTypeDef status;
+	uint16_t slot;
+
+	// clear magic first, so interrupted erase can not leave valid page with partly erased records
+	if ((*(__IO uint16_t*)address) == FLASH_LOG_PAGE_MAGIC) {
+		status = FLASH_ProgramHalfWord(address, 0x0000);
+		if (status != HAL_OK) return status;
+	}
+
+	for (slot = 0; slot < FLASH_LOG_SLOTS_NUM && FlashLogIsSlotErased(FLASH_LOG_SLOT_ADDRESS(page, slot)); slot++);
+	if (slot < FLASH_LOG_SLOTS_NUM) {
+		status = FLASH_ErasePage(address);
+		if (status != HAL_OK) return status;
+	}
+
+	status = FLASH_ProgramHalfWord(address + 2, flashLogNextSeq);
+	if (status != HAL_OK) return status;
+	status = FLASH_ProgramHalfWord(address + 4, flashLogNextSeq >> 16);
+	if (status != HAL_OK) return status;
+	status = FLASH_ProgramHalfWord(address, FLASH_LOG_PAGE_MAGIC);
+	if (status != HAL_OK) return status;
+
+	flashLogHeadPage = page;
+	flashLogFreeSlot = 1;
+	return HAL_OK;
+}
+
+static HAL_StatusTypeDef FlashLogAppend(const FlashLogEntry_T *entry) {
+	uint16_t data[7];
+	uint32_t address;
+	HAL_StatusTypeDef status;
+	uint8_t i;
+
+	if (flashLogFreeSlot >= FLASH_LOG_SLOTS_NUM) {
+		status = FlashLogOpenPage();
+		if (status != HAL_OK) return status;
+	}
+
+	// slot is used even if write fails, torn record is skipped
+	address = FLASH_LOG_SLOT_ADDRESS(flashLogHeadPage, flashLogFreeSlot);
+	flashLogFreeSlot++;
+
+	data[0] = flashLogNextSeq;
+	data[1] = flashLogNextSeq >> 16;
+	data[2] = entry->sec;
+	data[3] = entry->sec >> 16;
+	data[4] = entry->sub | 0xFF00;
+	data[5] = entry->payload[0] | ((uint16_t)entry->payload[1] << 8);
+	data[6] = entry->payload[2] | ((uint16_t)entry->payload[3] << 8);
+
+	for (i = 0; i < 7; i++) {
+		if (data[i] == 0xFFFF) continue; // erased value
+		status = FLASH_ProgramHalfWord(address + 2 + i * 2, data[i]);
+		if (status != HAL_OK) return status;
+	}
+
+	status = FLASH_ProgramHalfWord(address, FLASH_LOG_COMMIT(entry->id));
+	if (status != HAL_OK) return status;
+
+	flashLogNextSeq++;
+	return HAL_OK;
+}
+
+// Charger fault status (bits 0-2), fuel gauge i2c fault (3), temperature sense fault (4),
+// charger temperature fault (5-6), watchdog expired (7), system switch forced off (8)
+static uint16_t FlashLogGetFaults(void) {
+	uint16_t faults = CHARGER_FAULT_STATUS();
+
+	faults |= FUEL_GAUGE_IC_FAULT_STATUS() << 3;
+	faults |= (FUEL_GAUGE_TEMP_SENSE_FAULT_STATUS() != 0) << 4;
+	faults |= (CHRGER_TS_FAULT_STATUS() & 0x03) << 5;
+	faults |= (watchdogExpiredFlag != 0) << 7;
+	faults |= (uint16_t)(forcedVSysOutputOffFlag != 0) << 8;
+	return faults;
+}
+
+// Logs newly set faults, fault that cleared can be logged again after rearm period
+static void FlashLogCheckFaults(void) {
+	uint8_t payload[FLASH_LOG_PAYLOAD_LEN];
+	uint16_t faults, newFaults;
+
+	if (MS_TIME_COUNT(flashLogFaultTimer) < FLASH_LOG_FAULT_POLL_MS) return;
+	MS_TIME_COUNTER_INIT(flashLogFaultTimer);
+
+	faults = FlashLogGetFaults();
+	if (MS_TIME_COUNT(flashLogFaultRearmTimer) >= FLASH_LOG_FAULT_REARM_MS) {
+		MS_TIME_COUNTER_INIT(flashLogFaultRearmTimer);
+		flashLogFaults &= faults;
+	}
+
+	newFaults = faults & ~flashLogFaults;
+	flashLogFaults |= faults;
+	if (newFaults) {
+		payload[0] = faults;
+		payload[1] = faults >> 8;
+		payload[2] = newFaults;
+		payload[3] = newFaults >> 8;
+		FlashLogPut(FLASH_LOG_FAULT, payload);
+	}
+}
+
+// Fills read frame with records from read cursor, runs in main loop only
+static void FlashLogPrepareReadFrame(void) {
+	uint8_t order[FLASH_LOG_PAGES_NUM];
+	uint32_t address, seq, readSeq, lastSeq = 0;
+	uint32_t primask;
+	uint16_t slot;
+	uint8_t n, i, k, count = 0, flags = 0, oldest = 1;
+	uint8_t *p, *data = flashLogReadFrame;
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+	readSeq = flashLogReadSeq;
+	flashLogReadCursorSet = 0;
+	__set_PRIMASK(primask);
+
+	for (i = 0; i < FLASH_LOG_READ_LEN; i++) data[i] = 0;
+
+	n = FlashLogPageOrder(order);
+	for (i = 0; i < n && !(flags & FLASH_LOG_READ_FLAG_MORE); i++) {
+		for (slot = 1; slot < FLASH_LOG_SLOTS_NUM; slot++) {
+			address = FLASH_LOG_SLOT_ADDRESS(order[i], slot);
+			if (!FlashLogIsRecord(address)) continue;
+			seq = FLASH_LOG_READ_U32(address + 2);
+			if (oldest && readSeq && seq > readSeq) flags |= FLASH_LOG_READ_FLAG_LOST;
+			oldest = 0;
+			if (seq < readSeq) continue;
+			if (count == FLASH_LOG_READ_RECORDS) {
+				flags |= FLASH_LOG_READ_FLAG_MORE;
+				break;
+			}
+
+			p = data + FLASH_LOG_READ_HEADER_LEN + count * FLASH_LOG_READ_RECORD_LEN;
+			for (k = 0; k < 8; k++) p[k] = *(__IO uint8_t*)(address + 2 + k); // sequence number, seconds
+			p[8] = *(__IO uint8_t*)(address + 10); // 1/256 s
+			p[9] = *(__IO uint8_t*)address; // id
+			for (k = 0; k < FLASH_LOG_PAYLOAD_LEN; k++) p[10 + k] = *(__IO uint8_t*)(address + 12 + k);
+			count++;
+			lastSeq = seq;
+		}
+	}
+
+	data[0] = count;
+	data[1] = flags;
+
+	// frame from old cursor is discarded
+	primask = __get_PRIMASK();
+	__disable_irq();
+	if (!flashLogReadCursorSet) {
+		flashLogReadFrameNextSeq = count ? lastSeq + 1 : readSeq;
+		flashLogReadFrameReady = 1;
+	}
+	__set_PRIMASK(primask);
+}
+
+void FlashLogInit(void) {
+	uint8_t order[FLASH_LOG_PAGES_NUM];
+	uint32_t address, seq;
+	uint16_t slot;
+	uint8_t n, i;
+
+	flashLogHeadPage = FLASH_LOG_NO_PAGE;
+	flashLogFreeSlot = FLASH_LOG_SLOTS_NUM;
+	flashLogNextSeq = 1;
+	flashLogReadFrameReady = 0;
+
+	// sequence number continues from newest record, or from newest page if it is empty
+	n = FlashLogPageOrder(order);
+	for (i = 0; i < n; i++) {
+		FlashLogIsPageValid(order[i], &seq);
+		if (seq > flashLogNextSeq) flashLogNextSeq = seq;
+		for (slot = 1; slot < FLASH_LOG_SLOTS_NUM; slot++) {
+			address = FLASH_LOG_SLOT_ADDRESS(order[i], slot);
+			if (FlashLogIsRecord(address)) {
+				seq = FLASH_LOG_READ_U32(address + 2);
+				if (seq >= flashLogNextSeq) flashLogNextSeq = seq + 1;
+			}
+		}
+	}
+
+	if (n) {
+		// append after last used slot of newest page
+		flashLogHeadPage = order[n - 1];
+		slot = FLASH_LOG_SLOTS_NUM;
+		while (slot > 1 && FlashLogIsSlotErased(FLASH_LOG_SLOT_ADDRESS(flashLogHeadPage, slot - 1))) slot--;
+		flashLogFreeSlot = slot;
+	}
+
+	MS_TIME_COUNTER_INIT(flashLogFaultTimer);
+	MS_TIME_COUNTER_INIT(flashLogFaultRearmTimer);
+}
+
+void FlashLogTask(void) {
+	uint32_t primask;
+
+	FlashLogCheckFaults();
+
+	if (flashLogQueueCount) {
+		// prepared frame does not have new records
+		flashLogReadFrameReady = 0;
+	}
+
+	while (flashLogQueueCount) {
+		if (FlashLogAppend(&flashLogQueue[flashLogQueueHead]) != HAL_OK) flashLogDropped = 1;
+
+		primask = __get_PRIMASK();
+		__disable_irq();
+		flashLogQueueHead = (flashLogQueueHead + 1) % FLASH_LOG_QUEUE_SIZE;
+		flashLogQueueCount--;
+		__set_PRIMASK(primask);
+	}
+
+	if (!flashLogReadFrameReady) FlashLogPrepareReadFrame();
+}
+
+// Queues event with current time, can be called from interrupt
+void FlashLogPut(FlashLogEventId_T id, const uint8_t payload[FLASH_LOG_PAYLOAD_LEN]) {
+	FlashLogEntry_T *entry;
+	uint32_t primask;
+	uint32_t sec;
+	uint8_t sub;
+	uint8_t i;
+
+	RtcReadLinearTime(&sec, &sub);
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+	if (flashLogQueueCount < FLASH_LOG_QUEUE_SIZE) {
+		entry = &flashLogQueue[(flashLogQueueHead + flashLogQueueCount) % FLASH_LOG_QUEUE_SIZE];
+		entry->sec = sec;
+		entry->sub = sub;
+		entry->id = id;
+		for (i = 0; i < FLASH_LOG_PAYLOAD_LEN; i++) entry->payload[i] = payload[i];
+		flashLogQueueCount++;
+	} else {
+		flashLogDropped = 1;
+	}
+	__set_PRIMASK(primask);
+}
+
+// Payload: data0, battery, power input and 5V io status, state of charge/4, battery voltage in 20 mV
+void FlashLogPutStatus(FlashLogEventId_T id, uint8_t data0) {
+	uint8_t payload[FLASH_LOG_PAYLOAD_LEN];
+
+	payload[0] = data0;
+	payload[1] = (batteryStatus << 2) | (powerInStatus << 4) | (power5vIoStatus << 6);
+	payload[2] = batteryRsoc >> 2;
+	payload[3] = batteryVoltage < 255 * 20 ? batteryVoltage / 20 : 255;
+	FlashLogPut(id, payload);
+}
+
+// Frame: records count, flags (bit0 more records, bit1 records after cursor were overwritten,
+// bit2 events dropped, bit3 frame not prepared yet, read again), records from read cursor:
+// sequence number, seconds since 2000-01-01, 1/256 s, id, payload, multi-byte fields little
+// endian. Cursor moves past returned records.
+void FlashLogReadCmd(uint8_t data[], uint16_t *len) {
+	uint8_t i;
+
+	if (flashLogReadFrameReady) {
+		for (i = 0; i < FLASH_LOG_READ_LEN; i++) data[i] = flashLogReadFrame[i];
+		flashLogReadSeq = flashLogReadFrameNextSeq;
+		flashLogReadFrameReady = 0;
+		if (flashLogDropped) data[1] |= FLASH_LOG_READ_FLAG_DROPPED;
+		flashLogDropped = 0;
+	} else {
+		for (i = 0; i < FLASH_LOG_READ_LEN; i++) data[i] = 0;
+		data[1] = FLASH_LOG_READ_FLAG_BUSY;
+	}
+	*len = FLASH_LOG_READ_LEN;
+}
+
+// data[0]: 0 - rewind read cursor to oldest record, 1 - set read cursor to sequence number data[1..4],
+// used to repeat frame received with error
+void FlashLogWriteCmd(uint8_t data[], uint16_t len) {
+	if (len < 1) return;
+	if (data[0] == 0) {
+		flashLogReadSeq = 0;
+	} else if (data[0] == 1 && len >= 5) {
+		flashLogReadSeq = data[1] | ((uint32_t)data[2] << 8) | ((uint32_t)data[3] << 16) | ((uint32_t)data[4] << 24);
+	} else {
+		return;
+	}
+	flashLogReadFrameReady = 0;
+	flashLogReadCursorSet = 1;
+}
@@ -8,6 +8,9 @@
 #include "stm32f0xx_hal.h"
 #include "analog.h"
 #include "nv.h"
+#include "power_management.h"
+#include "io_log.h"
+#include "io_counter.h"
 
 TIM_HandleTypeDef htim1;
 TIM_HandleTypeDef htim14;
@@ -19,9 +22,17 @@ uint8_t ioConfig[2] __attribute__((section("no_init")));
 uint16_t ioParam1[2] __attribute__((section("no_init")));
 uint16_t ioParam2[2] __attribute__((section("no_init")));
 uint16_t pwmLevel[2] __attribute__((section("no_init")));
+static GPIO_PinState heartbeatLevel[2];
+static volatile uint8_t io1Exti = 0; // EXTI line 7 is on IO1, it is on I2C SDA in stop mode
+
+// digital input parameter 1 bit 2, any edge refreshes host watchdog
+#define IO_IS_HEARTBEAT_INPUT(pin)	((ioConfig[pin-1]&0x0F) == 2 && (ioParam1[pin-1]&0x04))
 
 extern uint8_t resetStatus;
 
+extern void Error_Handler(void);
+extern void HAL_TIM_MspPostInit(TIM_HandleTypeDef *htim);
+
 /* TIM1 init function */
 void MX_TIM1_Init(void)
 {
@@ -149,6 +160,12 @@ void IoConfigure(uint8_t pin) {
 	}
 
 	if (htim->Instance->BDTR&(TIM_BDTR_MOE)) HAL_TIM_PWM_Stop(htim, TIM_CHANNEL_1);
+	IoCounterStop(pin);
+	if (pin == 1) {
+		// GPIO init does not clear EXTI line, it is enabled again below for heartbeat only
+		EXTI->IMR &= ~EXTI_IMR_MR7;
+		io1Exti = 0;
+	}
 
 	switch (ioConfig[pin-1]&0x30) {
 	case 0x10: gpioInitStruct.Pull = GPIO_PULLDOWN; break;
@@ -165,7 +182,9 @@ void IoConfigure(uint8_t pin) {
 	case 2:
 		// digital input
 		//HAL_TIM_PWM_Stop(htim, TIM_CHANNEL_1);
-		if ((pin==2) && (ioParam1[pin-1]&0x03) == 1) {
+		if (IO_IS_HEARTBEAT_INPUT(pin)) {
+			gpioInitStruct.Mode = GPIO_MODE_IT_RISING_FALLING; // heartbeat on both edges, IO2 wake-up edge is filtered in IoEdgeEvent
+		} else if ((pin==2) && (ioParam1[pin-1]&0x03) == 1) {
 			gpioInitStruct.Mode = GPIO_MODE_IT_FALLING; // on IO1 enable wakeup on falling edge
 		} else if ((pin==2) && (ioParam1[pin-1]&0x03) == 2) {
 			gpioInitStruct.Mode = GPIO_MODE_IT_RISING; // on IO1 enable wakeup on rising edge
@@ -173,6 +192,8 @@ void IoConfigure(uint8_t pin) {
 			gpioInitStruct.Mode = GPIO_MODE_INPUT;
 		}
 		HAL_GPIO_Init(GPIOA, &gpioInitStruct);
+		heartbeatLevel[pin-1] = HAL_GPIO_ReadPin(GPIOA, gpioInitStruct.Pin);
+		io1Exti = (pin == 1) && IO_IS_HEARTBEAT_INPUT(pin);
 		break;
 	case 3:
 		// digital output, push-pull
@@ -223,11 +244,28 @@ void IoConfigure(uint8_t pin) {
 		//HAL_GPIO_Init(GPIOA, &gpioInitStruct);
 		HAL_TIM_PWM_Start(htim, TIM_CHANNEL_1); // Start channel 1
 		break;
+	case IO_COUNTER_MODE:
+		// pulse counter, IO1 on TIM14 capture, IO2 on EXTI
+		if (pin == 1) {
+			gpioInitStruct.Mode = GPIO_MODE_AF_PP;
+		} else if ((ioParam1[pin-1]&0x03) == 3 || (ioParam1[pin-1]>>8)) {
+			gpioInitStruct.Mode = GPIO_MODE_IT_RISING_FALLING; // debounce follows pin level on both edges
+		} else if ((ioParam1[pin-1]&0x03) == 1) {
+			gpioInitStruct.Mode = GPIO_MODE_IT_FALLING;
+		} else {
+			gpioInitStruct.Mode = GPIO_MODE_IT_RISING;
+		}
+		HAL_GPIO_Init(GPIOA, &gpioInitStruct);
+		IoCounterStart(pin, ioParam1[pin-1], ioParam2[pin-1]);
+		break;
 	default:
 		//HAL_TIM_PWM_Stop(htim, TIM_CHANNEL_1);
 		gpioInitStruct.Mode = GPIO_MODE_ANALOG;
 	    HAL_GPIO_Init(GPIOA, &gpioInitStruct);
 	}
+
+	// IO1 analog input: parameter 1 log interval in s, parameter 2 oversampling and log flags
+	if (pin == 1) IoLogConfigure((ioConfig[0]&0x0F) == 1 ? ioParam1[0] : 0, ioParam2[0] & 0xFF, ioParam2[0] >> 8);
 }
 
 void IoNvReadConfig(uint8_t pin) {
@@ -252,6 +290,59 @@ void IoControlInit() {
 	IoConfigure(2);
 }
 
+void IoControlTask(void) {
+	IoCounterTask();
+}
+
+// IO1 shares EXTI line 7 with I2C SDA, line is mapped to SDA for wake-up from stop mode
+void IoControlStopEntry(void) {
+	io1Exti = 0;
+}
+
+// Maps EXTI line 7 back to IO1 heartbeat after stop mode, level change while line was on SDA is heartbeat too
+void IoControlStopExit(void) {
+	GPIO_PinState level = heartbeatLevel[0];
+
+	if (!IO_IS_HEARTBEAT_INPUT(1)) return;
+	gpioInitStruct.Pin = GPIO_PIN_7;
+	switch (ioConfig[0]&0x30) {
+	case 0x10: gpioInitStruct.Pull = GPIO_PULLDOWN; break;
+	case 0x20: gpioInitStruct.Pull = GPIO_PULLUP; break;
+	default: gpioInitStruct.Pull = GPIO_NOPULL; break;
+	}
+	gpioInitStruct.Mode = GPIO_MODE_IT_RISING_FALLING;
+	HAL_GPIO_Init(GPIOA, &gpioInitStruct);
+	heartbeatLevel[0] = HAL_GPIO_ReadPin(GPIOA, GPIO_PIN_7);
+	io1Exti = 1;
+	if (heartbeatLevel[0] != level) PowerMngmtWatchdogHeartbeat();
+}
+
+// Called from EXTI interrupt on IO edge, returns 1 when edge needs main loop service.
+// Edge on line 7 is I2C SDA wake-up unless line is on IO1 heartbeat.
+uint8_t IoEdgeEvent(uint8_t pin) {
+	GPIO_PinState level;
+	if (pin == 1) {
+		if (!io1Exti) return 1;
+		heartbeatLevel[0] = HAL_GPIO_ReadPin(GPIOA, GPIO_PIN_7);
+		PowerMngmtWatchdogHeartbeat();
+		return 0;
+	}
+	if (pin != 2) return 1;
+	if ((ioConfig[pin-1]&0x0F) == IO_COUNTER_MODE) {
+		return IoCounterEdge(pin);
+	} else if (IO_IS_HEARTBEAT_INPUT(pin)) {
+		PowerMngmtWatchdogHeartbeat();
+		// both edges are enabled for heartbeat, post wake-up only on configured edge
+		level = HAL_GPIO_ReadPin(GPIOA, GPIO_PIN_8);
+		if (((ioParam1[pin-1]&0x03) == 1 && level == GPIO_PIN_RESET) || ((ioParam1[pin-1]&0x03) == 2 && level == GPIO_PIN_SET)) {
+			PowerMngmtPostWakeupEvent(WAKEUP_TRIGGER_IO);
+		}
+	} else {
+		PowerMngmtPostWakeupEvent(WAKEUP_TRIGGER_IO);
+	}
+	return 1;
+}
+
 void IoSetConfiguarion(uint8_t pin, uint8_t data[], uint8_t len) {
 
 	ioConfig[pin-1] = data[0];
@@ -305,6 +396,10 @@ void IoWrite(uint8_t pin, uint8_t data[], uint8_t len)
 		val |= data[0];
 		htim->Instance->CCR1 = val == 65535 ? 65535 : (uint32_t)htim->Instance->ARR*val/65534;
 		pwmLevel[pin-1] = val;
+		break;
+	case IO_COUNTER_MODE:
+		IoCounterWrite(pin, data, len);
+		break;
 	default:
 		break;
 	}
@@ -341,6 +436,9 @@ void IoRead(uint8_t pin, uint8_t data[], uint16_t *len)
 			data[0] = pwmLevel[pin-1]&0xFF;
 			data[1] = (pwmLevel[pin-1] >> 8) & 0xFF;
 			break;
+		case IO_COUNTER_MODE:
+			IoCounterRead(pin, data, len);
+			return;
 		default:
 			break;
 	}
@@ -0,0 +1,311 @@
+/*
+ * io_counter.c
+ *
+ *  Created on: 19.10.2026.
+ */
+
+#include "io_counter.h"
+#include "stm32f0xx_hal.h"
+#include "time_count.h"
+#include "rtc_ds1339_emu.h"
+#include "power_management.h"
+
+#define IO_COUNTER_EDGE_FALLING	1
+#define IO_COUNTER_EDGE_BOTH	3
+#define IO_COUNTER_STOP_AVG_EDGES	16 // stop mode frequency is averaged over this many edges
+#define IO_COUNTER_STOP_AVG_TIME	60 // s, or over this time for slow inputs
+
+typedef struct {
+	uint32_t count; // edges since start or clear
+	uint32_t wakeCount; // count at last posted wake-up
+	uint16_t wakeThreshold;
+	uint16_t debounce; // ms
+	uint8_t edge;
+	uint8_t level; // pin level after last edge, debounced input
+	uint32_t lastEdge; // us, last edge with time stamp, debounced input
+	uint32_t stopLastEdge; // 1/256 s, RTC time of last edge in stop mode, debounced input
+	uint32_t gateStart; // us, first edge of frequency gate
+	uint32_t gateEnd; // us, last edge of frequency gate
+	uint32_t gateEdges; // periods from gateStart to gateEnd
+	uint8_t gateOpen;
+	uint32_t stopEdges; // edges counted in stop mode, without time stamp
+	uint32_t stopRefTime; // 1/256 s, RTC time of stop mode frequency reference
+	uint32_t stopRefCount;
+	uint8_t stopRefValid;
+	uint32_t frequency; // mHz
+	uint32_t seenCount; // count at last task pass
+	uint32_t seenTime; // ms, when count last changed
+	uint8_t enabled;
+} IoCounter_T;
+
+static volatile IoCounter_T ioCounter[2];
+
+static uint8_t IoCounterReadPin(uint8_t pin) {
+	return HAL_GPIO_ReadPin(GPIOA, pin == 1 ? GPIO_PIN_7 : GPIO_PIN_8) == GPIO_PIN_SET;
+}
+
+// Returns 1 when edge posted wake-up event
+static uint8_t IoCounterAddEdge(volatile IoCounter_T *c, uint32_t time, uint8_t timed) {
+	if (timed) {
+		if (c->gateOpen) {
+			c->gateEnd = time;
+			c->gateEdges++;
+		} else {
+			c->gateStart = time;
+			c->gateEnd = time;
+			c->gateEdges = 0;
+			c->gateOpen = 1;
+		}
+	} else {
+		c->stopEdges++;
+		c->gateOpen = 0;
+	}
+
+	c->count++;
+	if (c->wakeThreshold && c->count - c->wakeCount >= c->wakeThreshold) {
+		c->wakeCount = c->count;
+		PowerMngmtPostWakeupEvent(WAKEUP_TRIGGER_IO);
+		return 1;
+	}
+	return 0;
+}
+
+// Debounced input interrupts on both edges, edge is counted when pin level before it was stable
+// for debounce time, bounce edges only update level. Level read in delayed interrupt can already
+// show next bounce, edge after stable level is always transition from that level.
+static uint8_t IoCounterDebouncedEdge(volatile IoCounter_T *c, uint8_t stable, uint8_t level, uint32_t time, uint8_t timed) {
+	uint8_t next = !c->level;
+
+	c->level = level;
+	if (!stable) return 0;
+	if (c->edge != IO_COUNTER_EDGE_BOTH && next != (c->edge != IO_COUNTER_EDGE_FALLING)) return 0;
+	return IoCounterAddEdge(c, time, timed);
+}
+
+static uint8_t IoCounterDebounceEdge(volatile IoCounter_T *c, uint32_t time, uint8_t level) {
+	uint8_t stable = time - c->lastEdge >= (uint32_t)c->debounce * 1000;
+
+	c->lastEdge = time;
+	return IoCounterDebouncedEdge(c, stable, level, time, 1);
+}
+
+// Tick does not run in stop mode, edges are stamped with RTC time. Debounce time is rounded up
+// to RTC sub second steps and one step is added for unknown phase of both stamps.
+static uint32_t IoCounterStopDebounceTime(volatile IoCounter_T *c) {
+	return ((uint32_t)c->debounce * 256 + 999) / 1000 + 1;
+}
+
+static uint32_t IoCounterRtcTime(void) {
+	uint32_t sec;
+	uint8_t sub;
+
+	RtcReadLinearTime(&sec, &sub);
+	return sec * 256 + sub;
+}
+
+static uint8_t IoCounterStopDebounceEdge(volatile IoCounter_T *c, uint8_t level) {
+	uint32_t time = IoCounterRtcTime();
+	uint8_t stable = time - c->stopLastEdge >= IoCounterStopDebounceTime(c);
+
+	c->stopLastEdge = time;
+	return IoCounterDebouncedEdge(c, stable, level, 0, 0);
+}
+
+// IO1 edges are captured by TIM14 channel 1 at 1us resolution
+static void IoCounterCaptureStart(uint8_t edge) {
+	TIM14->CR1 &= ~TIM_CR1_CEN;
+	TIM14->CCER = 0;
+	TIM14->PSC = 7;
+	TIM14->ARR = 0xFFFF;
+	TIM14->CCMR1 = TIM_CCMR1_CC1S_0 | TIM_CCMR1_IC1F_0 | TIM_CCMR1_IC1F_1; // TI1 input, 1us glitch filter
+	if (edge == IO_COUNTER_EDGE_BOTH) {
+		TIM14->CCER = TIM_CCER_CC1P | TIM_CCER_CC1NP | TIM_CCER_CC1E;
+	} else if (edge == IO_COUNTER_EDGE_FALLING) {
+		TIM14->CCER = TIM_CCER_CC1P | TIM_CCER_CC1E;
+	} else {
+		TIM14->CCER = TIM_CCER_CC1E;
+	}
+	TIM14->EGR = TIM_EGR_UG;
+	TIM14->SR = 0;
+	TIM14->DIER = TIM_DIER_CC1IE;
+	HAL_NVIC_SetPriority(TIM14_IRQn, 2, 0);
+	HAL_NVIC_EnableIRQ(TIM14_IRQn);
+	TIM14->CR1 |= TIM_CR1_CEN;
+}
+
+// Channel is returned to PWM output setup of MX_TIM14_Init
+static void IoCounterCaptureStop(void) {
+	HAL_NVIC_DisableIRQ(TIM14_IRQn);
+	TIM14->DIER = 0;
+	TIM14->CR1 &= ~TIM_CR1_CEN;
+	TIM14->CCER = 0;
+	TIM14->CCMR1 = TIM_OCMODE_PWM1 | TIM_CCMR1_OC1PE;
+	TIM14->SR = 0;
+}
+
+// Counts are cleared on configuration, IO2 edge is selected with EXTI mode in IoConfigure
+void IoCounterStart(uint8_t pin, uint16_t param1, uint16_t param2) {
+	volatile IoCounter_T *c = &ioCounter[pin-1];
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	c->count = 0;
+	c->wakeCount = 0;
+	c->wakeThreshold = param2;
+	c->debounce = param1 >> 8;
+	c->edge = param1 & 0x03;
+	c->level = IoCounterReadPin(pin);
+	c->lastEdge = TimeTickFineUs() - (uint32_t)c->debounce * 1000;
+	c->gateOpen = 0;
+	c->stopEdges = 0;
+	c->stopRefValid = 0;
+	c->frequency = 0;
+	c->seenCount = 0;
+	c->seenTime = HAL_GetTick();
+	c->enabled = 1;
+	__set_PRIMASK(primask);
+
+	if (pin == 1) IoCounterCaptureStart(c->debounce ? IO_COUNTER_EDGE_BOTH : c->edge);
+}
+
+void IoCounterStop(uint8_t pin) {
+	if (!ioCounter[pin-1].enabled) return;
+	ioCounter[pin-1].enabled = 0;
+	if (pin == 1) IoCounterCaptureStop();
+}
+
+// Called from EXTI interrupt on IO2 edge, returns 1 when edge needs main loop service
+uint8_t IoCounterEdge(uint8_t pin) {
+	volatile IoCounter_T *c = &ioCounter[pin-1];
+
+	if (pin != 2 || !c->enabled) return 0;
+
+	if (TimeTickIsSuspended()) {
+		// stop mode wake-up, tick does not run, edge is counted without time stamp
+		if (c->debounce) return IoCounterStopDebounceEdge(c, IoCounterReadPin(pin));
+		return IoCounterAddEdge(c, 0, 0);
+	}
+	if (c->debounce) return IoCounterDebounceEdge(c, TimeTickFineUs(), IoCounterReadPin(pin));
+	return IoCounterAddEdge(c, TimeTickFineUs(), 1);
+}
+
+// TIM14 interrupt on IO1 edge capture, edge time is corrected by timer counts since capture
+void IoCounterCaptureCb(void) {
+	uint32_t now;
+	uint16_t age;
+
+	if (!(TIM14->SR & TIM_SR_CC1IF)) return;
+	now = TimeTickFineUs();
+	age = TIM14->CNT - TIM14->CCR1; // reading capture clears flag
+	TIM14->SR = ~(uint32_t)TIM_SR_CC1OF; // missed edge is not counted
+	if (ioCounter[0].debounce) {
+		IoCounterDebounceEdge(&ioCounter[0], now - age, IoCounterReadPin(1));
+	} else {
+		IoCounterAddEdge(&ioCounter[0], now - age, 1);
+	}
+}
+
+// Called with tick suspended before stop mode entry. IO2 stop mode edges are debounced on RTC time
+// stamps, bounce that started before entry keeps level unstable until debounce time from its last edge.
+void IoCounterStopEntry(void) {
+	volatile IoCounter_T *c = &ioCounter[1];
+	uint32_t primask;
+	uint8_t bouncing;
+
+	if (!c->enabled || !c->debounce) return;
+	primask = __get_PRIMASK();
+	__disable_irq();
+	bouncing = TimeTickFineUs() - c->lastEdge < (uint32_t)c->debounce * 1000;
+	c->stopLastEdge = IoCounterRtcTime() - (bouncing ? 0 : IoCounterStopDebounceTime(c));
+	__set_PRIMASK(primask);
+}
+
+static void IoCounterMeasure(volatile IoCounter_T *c) {
+	uint32_t edges, span, stopEdges, count, now, rtc;
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	edges = c->gateEdges;
+	span = c->gateEnd - c->gateStart;
+	if (c->gateOpen && edges && span >= IO_COUNTER_GATE_TIME * 1000UL) {
+		// next gate starts on last edge of this one, no period is lost between gates
+		c->gateStart = c->gateEnd;
+		c->gateEdges = 0;
+	} else {
+		edges = 0;
+	}
+	stopEdges = c->stopEdges;
+	c->stopEdges = 0;
+	count = c->count;
+	__set_PRIMASK(primask);
+
+	if (edges) {
+		// reciprocal counting, resolution is set by edge time stamps and not by gate time
+		c->frequency = (uint64_t)edges * 1000000000 / span;
+		c->stopRefValid = 0;
+	} else if (stopEdges) {
+		// edges in stop mode have no time stamp, frequency is averaged over RTC time between wake-ups
+		rtc = IoCounterRtcTime();
+		if (!c->stopRefValid || (rtc - c->stopRefTime >= IO_COUNTER_GATE_TIME * 256 / 1000
+				&& (count - c->stopRefCount >= IO_COUNTER_STOP_AVG_EDGES || rtc - c->stopRefTime >= IO_COUNTER_STOP_AVG_TIME * 256))) {
+			if (c->stopRefValid) {
+				c->frequency = (uint64_t)(count - c->stopRefCount) * 256000 / (rtc - c->stopRefTime);
+			}
+			c->stopRefTime = rtc;
+			c->stopRefCount = count;
+			c->stopRefValid = 1;
+		}
+	}
+
+	// input stopped, frequency is 0 after two periods without edge
+	now = HAL_GetTick();
+	if (count != c->seenCount) {
+		c->seenCount = count;
+		c->seenTime = now;
+	} else if (c->frequency && now - c->seenTime > IO_COUNTER_GATE_TIME && now - c->seenTime > 2000000 / c->frequency) {
+		c->frequency = 0;
+		c->stopRefValid = 0;
+	}
+}
+
+void IoCounterTask(void) {
+	uint8_t i;
+	for (i = 0; i < 2; i++) {
+		if (ioCounter[i].enabled) IoCounterMeasure(&ioCounter[i]);
+	}
+}
+
+// TIM14 does not run in stop mode, MCU is kept running while IO1 counts
+uint8_t IoCounterIsCapturing(void) {
+	return ioCounter[0].enabled;
+}
+
+// count and frequency in mHz, 32 bit little endian
+void IoCounterRead(uint8_t pin, uint8_t data[], uint16_t *len) {
+	uint32_t count = ioCounter[pin-1].count;
+	uint32_t freq = ioCounter[pin-1].frequency;
+	data[0] = count;
+	data[1] = count >> 8;
+	data[2] = count >> 16;
+	data[3] = count >> 24;
+	data[4] = freq;
+	data[5] = freq >> 8;
+	data[6] = freq >> 16;
+	data[7] = freq >> 24;
+	*len = IO_COUNTER_READ_LEN;
+}
+
+// data[0] bit 0: clear count, wake-up threshold is counted again from zero
+void IoCounterWrite(uint8_t pin, uint8_t data[], uint8_t len) {
+	volatile IoCounter_T *c = &ioCounter[pin-1];
+	uint32_t primask;
+
+	if (len < 1 || !(data[0] & 0x01)) return;
+	primask = __get_PRIMASK();
+	__disable_irq();
+	c->count = 0;
+	c->wakeCount = 0;
+	c->seenCount = 0;
+	c->stopRefValid = 0;
+	__set_PRIMASK(primask);
+}
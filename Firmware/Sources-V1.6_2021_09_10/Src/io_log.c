@@ -0,0 +1,173 @@
+/*
+ * io_log.c
+ *
+ *  Created on: 19.10.2026.
+ */
+
+#include "io_log.h"
+#include "stm32f0xx_hal.h"
+#include "analog.h"
+#include "rtc_ds1339_emu.h"
+#include "flash_log.h"
+
+#define IO_LOG_READ_FLAG_MORE	0x01
+#define IO_LOG_READ_FLAG_LOST	0x02
+
+// Record with sequence number seq is at index seq % IO_LOG_BUF_LEN
+static uint32_t ioLogSec[IO_LOG_BUF_LEN];
+static uint8_t ioLogSub[IO_LOG_BUF_LEN];
+static uint16_t ioLogValue[IO_LOG_BUF_LEN];
+static uint32_t ioLogNextSeq = 0; // sequence number of next record
+static uint16_t ioLogCount = 0;
+static uint32_t ioLogReadSeq = 0; // host read cursor
+
+static uint16_t ioLogInterval = 0; // s, 0 - acquisition off
+static uint8_t ioLogOversampling = 0;
+static uint8_t ioLogFlags = 0;
+static uint32_t ioLogNextDue; // seconds since 2000-01-01
+static uint8_t ioLogScheduled = 0;
+static uint8_t ioLogPending = 0; // sample is due, waiting for ADC scans
+
+void IoLogConfigure(uint16_t interval, uint8_t oversampling, uint8_t flags) {
+	if (interval != ioLogInterval) ioLogScheduled = 0;
+	ioLogInterval = interval;
+	ioLogOversampling = oversampling > IO_LOG_OVERSAMPLING_MAX ? IO_LOG_OVERSAMPLING_MAX : oversampling;
+	ioLogFlags = flags;
+	if (!interval) ioLogPending = 0;
+}
+
+// Oldest record is overwritten when ring is full, if it was not read it is moved to flash log
+// with payload: voltage in 1/16 mV, seconds from sample to flash log record time, 16 bit
+static void IoLogPut(uint32_t sec, uint8_t sub, uint16_t value) {
+	uint8_t payload[FLASH_LOG_PAYLOAD_LEN];
+	uint32_t primask;
+	uint32_t oldest, age;
+	uint16_t i;
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+
+	if (ioLogCount == IO_LOG_BUF_LEN) {
+		oldest = ioLogNextSeq - IO_LOG_BUF_LEN;
+		if ((int32_t)(oldest - ioLogReadSeq) >= 0 && (ioLogFlags & IO_LOG_FLAG_FLASH_SPILL)) {
+			i = oldest % IO_LOG_BUF_LEN;
+			age = sec - ioLogSec[i];
+			if (age > 0xFFFF) age = 0xFFFF;
+			payload[0] = ioLogValue[i];
+			payload[1] = ioLogValue[i] >> 8;
+			payload[2] = age;
+			payload[3] = age >> 8;
+			FlashLogPut(FLASH_LOG_IO_SAMPLE, payload);
+		}
+	} else {
+		ioLogCount++;
+	}
+
+	i = ioLogNextSeq % IO_LOG_BUF_LEN;
+	ioLogSec[i] = sec;
+	ioLogSub[i] = sub;
+	ioLogValue[i] = value;
+	ioLogNextSeq++;
+
+	__set_PRIMASK(primask);
+}
+
+// Samples are taken on multiples of interval in RTC time. In stop mode MCU wakes up every
+// IO_LOG_STOP_PERIOD, due sample is taken on first wake-up after its time, records keep actual time.
+void IoLogTask(void) {
+	uint32_t sec;
+	uint8_t sub;
+	uint16_t scans;
+
+	if (!ioLogInterval) return;
+
+	RtcReadLinearTime(&sec, &sub);
+	if (!ioLogScheduled || (int32_t)(ioLogNextDue - sec) > (int32_t)ioLogInterval) {
+		// also after RTC was set back
+		ioLogNextDue = (sec / ioLogInterval + 1) * ioLogInterval;
+		ioLogScheduled = 1;
+	}
+
+	if ((int32_t)(sec - ioLogNextDue) < 0) {
+		ioLogPending = 0;
+		return;
+	}
+
+	// ADC is restarted after stop mode wake-up, wait until buffer has enough scans
+	ioLogPending = 1;
+	scans = 0x01 << ioLogOversampling;
+	if (AnalogScansReady() < scans) return;
+
+	IoLogPut(sec, sub, GetAverageSampleVoltage(ADC_IO1_CHN, scans));
+	ioLogPending = 0;
+
+	ioLogNextDue += ioLogInterval;
+	if ((int32_t)(sec - ioLogNextDue) >= 0) {
+		// missed samples are skipped
+		ioLogNextDue = (sec / ioLogInterval + 1) * ioLogInterval;
+	}
+}
+
+// Keeps main loop out of low power mode while due sample waits for ADC scans
+uint8_t IoLogIsSampling(void) {
+	return ioLogInterval && (ioLogPending || ioLogInterval < IO_LOG_STOP_PERIOD);
+}
+
+// Frame: records count, flags (bit0 more records, bit1 records after cursor were overwritten),
+// sequence number of first record, records from read cursor: seconds since 2000-01-01, 1/256 s,
+// voltage in 1/16 mV, multi-byte fields little endian. Cursor moves past returned records.
+void IoLogReadCmd(uint8_t data[], uint16_t *len) {
+	uint32_t oldest = ioLogNextSeq - ioLogCount;
+	uint32_t seq;
+	uint8_t count = 0, flags = 0;
+	uint8_t *p;
+	uint16_t i;
+
+	for (i = 0; i < IO_LOG_READ_LEN; i++) data[i] = 0;
+
+	if ((int32_t)(ioLogReadSeq - oldest) < 0) {
+		flags |= IO_LOG_READ_FLAG_LOST;
+		ioLogReadSeq = oldest;
+	} else if ((int32_t)(ioLogReadSeq - ioLogNextSeq) > 0) {
+		ioLogReadSeq = ioLogNextSeq;
+	}
+
+	seq = ioLogReadSeq;
+	while (seq != ioLogNextSeq && count < IO_LOG_READ_RECORDS) {
+		i = seq % IO_LOG_BUF_LEN;
+		p = data + IO_LOG_READ_HEADER_LEN + count * IO_LOG_READ_RECORD_LEN;
+		p[0] = ioLogSec[i];
+		p[1] = ioLogSec[i] >> 8;
+		p[2] = ioLogSec[i] >> 16;
+		p[3] = ioLogSec[i] >> 24;
+		p[4] = ioLogSub[i];
+		p[5] = ioLogValue[i];
+		p[6] = ioLogValue[i] >> 8;
+		seq++;
+		count++;
+	}
+	if (seq != ioLogNextSeq) flags |= IO_LOG_READ_FLAG_MORE;
+
+	data[0] = count;
+	data[1] = flags;
+	data[2] = ioLogReadSeq;
+	data[3] = ioLogReadSeq >> 8;
+	data[4] = ioLogReadSeq >> 16;
+	data[5] = ioLogReadSeq >> 24;
+	ioLogReadSeq = seq;
+	*len = IO_LOG_READ_LEN;
+}
+
+// data[0]: 0 - rewind read cursor to oldest record, 1 - set read cursor to sequence number data[1..4],
+// used to repeat frame received with error, 2 - clear records
+void IoLogWriteCmd(uint8_t data[], uint16_t len) {
+	if (len < 1) return;
+	if (data[0] == 0) {
+		ioLogReadSeq = ioLogNextSeq - ioLogCount;
+	} else if (data[0] == 1 && len >= 5) {
+		ioLogReadSeq = data[1] | ((uint32_t)data[2] << 8) | ((uint32_t)data[3] << 16) | ((uint32_t)data[4] << 24);
+	} else if (data[0] == 2) {
+		ioLogCount = 0;
+		ioLogReadSeq = ioLogNextSeq;
+	}
+}
@@ -6,9 +6,10 @@
  */
 
 #include "led.h"
-#include "stm32f0xx_hal.h"
+#include "main.h"
 #include "nv.h"
 #include "time_count.h"
+#include "fuel_gauge_lc709203f.h"
 
 #if defined(RTOS_FREERTOS)
 #include "cmsis_os.h"
@@ -63,12 +64,39 @@ typedef struct
 
 } Led_T;
 
+typedef struct
+{
+	uint8_t op;
+	uint8_t r;
+	uint8_t g;
+	uint8_t b;
+	uint16_t time; // ms
+} LedFxStep_T;
+
+// Effect advanced from TIM3 update interrupt, so timing does not depend on main loop
+typedef struct
+{
+	LedFxStep_T steps[LED_FX_STEPS_MAX];
+	uint8_t stepsNum;
+	uint8_t step;
+	uint8_t running;
+	uint8_t loops[LED_FX_STEPS_MAX]; // passes made by loop steps
+	uint8_t from[3]; // color at start of current step
+	uint32_t elapsed; // time in current step, 1/125 ms
+} LedFx_T;
+
+#define LED_FX_TICK	1024 // TIM3 update period 65536 / 8 MHz = 8.192 ms, in 1/125 ms
+#define LED_FX_MS	125
+
 static Led_T leds[2] = {
 
 	{ LED_CHARGE_STATUS, 60, 60, 100},
 	{ LED_USER_LED, 0, 0, 0 },
 };
 
+static LedFx_T ledFx[2];
+static uint8_t ledFxSelect = 0;
+
 static const uint16_t pwm_table[] = {
      65535,    65508,    65479,    65451,    65422,    65394,    65365,    65337,
      65308,    65280,    65251,    65223,    65195,    65166,    65138,    65109,
@@ -104,7 +132,6 @@ static const uint16_t pwm_table[] = {
      4543,    3908,    3267,    2623,    1974,    1320,    662,    0
  };
 
-static uint8_t mutMem[64]  __attribute__((aligned(4)));
 void LedInit(void) {
 
 	/*HAL_GPIO_WritePin(GPIOB, GPIO_PIN_15, GPIO_PIN_SET); //LED1B
@@ -163,6 +190,10 @@ void LedInit(void) {
 	    Error_Handler();
 	  }
 
+	// effects update compare registers from TIM3 update, preloaded values apply at next period
+	HAL_NVIC_SetPriority(TIM3_IRQn, 3, 0);
+	HAL_NVIC_EnableIRQ(TIM3_IRQn);
+
 	uint16_t var = 0;
 	EE_ReadVariable(NV_LED_FUNC_1, &var);
 	if (((~var)&0xFF) == (var>>8)) {
@@ -227,6 +258,7 @@ uint8_t LedGetParamR(uint8_t func) {
 	} else if (leds[1].func == func) {
 		return leds[1].paramR;
 	}
+	return 0;
 }
 uint8_t LedGetParamG(uint8_t func) {
 	if (leds[0].func == func) {
@@ -234,6 +266,7 @@ uint8_t LedGetParamG(uint8_t func) {
 	} else if (leds[1].func == func) {
 		return leds[1].paramG;
 	}
+	return 0;
 }
 uint8_t LedGetParamB(uint8_t func) {
 	if (leds[0].func == func) {
@@ -241,6 +274,7 @@ uint8_t LedGetParamB(uint8_t func) {
 	} else if (leds[1].func == func) {
 		return leds[1].paramB;
 	}
+	return 0;
 }
 
 #if defined(RTOS_FREERTOS)
@@ -331,14 +365,145 @@ void LedSetRGB(uint8_t led, uint8_t r, uint8_t g, uint8_t b) {
 	}
 }
 
+// Renders effect at elapsed time of current step, passes finished steps
+static void LedEffectAdvance(uint8_t n) {
+	LedFx_T *fx = &ledFx[n];
+	LedFxStep_T *s;
+	uint32_t duration;
+	uint32_t level;
+	uint8_t passes;
+	uint8_t c[3];
+	uint8_t i;
+	uint8_t executed = 0;
+
+	// zero time loop without end would never render, so steps executed per update are limited
+	while (fx->step < fx->stepsNum && executed++ <= 2 * LED_FX_STEPS_MAX) {
+		s = &fx->steps[fx->step];
+		if (s->op == LED_FX_OP_SET || s->op == LED_FX_OP_RAMP) {
+			duration = (uint32_t)s->time * LED_FX_MS;
+			if (fx->elapsed < duration) {
+				c[0] = s->r;
+				c[1] = s->g;
+				c[2] = s->b;
+				if (s->op == LED_FX_OP_RAMP) {
+					for (i = 0; i < 3; i++) {
+						c[i] = fx->from[i] + ((int32_t)c[i] - fx->from[i]) * (int32_t)fx->elapsed / (int32_t)duration;
+					}
+				}
+				LedSetRGB(n, c[0], c[1], c[2]);
+				return;
+			}
+			// remainder carries to next step, so sequence does not drift
+			fx->elapsed -= duration;
+			fx->from[0] = s->r;
+			fx->from[1] = s->g;
+			fx->from[2] = s->b;
+			fx->step++;
+		} else if (s->op == LED_FX_OP_LOOP) {
+			passes = s->g;
+			if ((s->b & LED_FX_LOOP_LEVEL) && passes) {
+				level = batteryRsoc < 1000 ? batteryRsoc : 1000;
+				passes = (level * passes + 999) / 1000;
+				if (passes == 0) passes = 1;
+			}
+			if (passes == 0 || ++fx->loops[fx->step] < passes) {
+				fx->step = s->r < fx->stepsNum ? s->r : fx->stepsNum;
+			} else {
+				fx->loops[fx->step] = 0;
+				fx->step++;
+			}
+		} else {
+			break;
+		}
+	}
+
+	fx->running = 0;
+	LedSetRGB(n, leds[n].r, leds[n].g, leds[n].b);
+}
+
+void LedEffectsTimerCb(void) {
+	uint8_t n;
+	uint8_t running = 0;
+
+	for (n = 0; n < 2; n++) {
+		if (ledFx[n].running) {
+			ledFx[n].elapsed += LED_FX_TICK;
+			LedEffectAdvance(n);
+			running |= ledFx[n].running;
+		}
+	}
+
+	if (!running) {
+		__HAL_TIM_DISABLE_IT(&htim3, TIM_IT_UPDATE);
+	}
+}
+
+// Effects are changed from I2C command handlers and main loop, with interrupts masked so TIM3 update
+// and other writer do not see half changed effect. Update interrupt is enabled while any effect runs.
+static void LedEffectStop(uint8_t n) {
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	if (ledFx[n].running) {
+		ledFx[n].running = 0;
+		LedSetRGB(n, leds[n].r, leds[n].g, leds[n].b);
+		if (!ledFx[0].running && !ledFx[1].running) __HAL_TIM_DISABLE_IT(&htim3, TIM_IT_UPDATE);
+	}
+	__set_PRIMASK(primask);
+}
+
+static void LedEffectStart(uint8_t n, const uint8_t data[], uint8_t stepsNum) {
+	uint32_t primask = __get_PRIMASK();
+	uint8_t wasRunning;
+	uint8_t i;
+
+	__disable_irq();
+	wasRunning = ledFx[0].running || ledFx[1].running;
+
+	for (i = 0; i < stepsNum; i++, data += LED_FX_STEP_LEN) {
+		ledFx[n].steps[i].op = data[0];
+		ledFx[n].steps[i].r = data[1];
+		ledFx[n].steps[i].g = data[2];
+		ledFx[n].steps[i].b = data[3];
+		ledFx[n].steps[i].time = data[4] | ((uint16_t)data[5] << 8);
+		ledFx[n].loops[i] = 0;
+	}
+	ledFx[n].stepsNum = stepsNum;
+	ledFx[n].step = 0;
+	ledFx[n].elapsed = 0;
+	ledFx[n].from[0] = leds[n].r;
+	ledFx[n].from[1] = leds[n].g;
+	ledFx[n].from[2] = leds[n].b;
+	ledFx[n].running = 1;
+
+	// effect takes over from blink
+	leds[n].blinkRepeat = 0;
+	leds[n].blinkCount = 0;
+
+	// first values are displayed from next update
+	LedEffectAdvance(n);
+
+	if (ledFx[n].running) {
+		// update flag is set each period, pending one would advance new effect before it is displayed
+		if (!wasRunning) __HAL_TIM_CLEAR_IT(&htim3, TIM_IT_UPDATE);
+		__HAL_TIM_ENABLE_IT(&htim3, TIM_IT_UPDATE);
+	}
+	__set_PRIMASK(primask);
+}
+
 void LedFunctionSetRGB(LedFunction_T func, uint8_t r, uint8_t g, uint8_t b) {
+	uint32_t primask = __get_PRIMASK();
+
+	// effect can not start or end between check and LED set
+	__disable_irq();
 	if (leds[0].func == func) {
 		leds[0].r = r;
 		leds[0].g = g;
 		leds[0].b = b;
 		leds[0].blinkRepeat = 0;
 		leds[0].blinkCount = 0;
-		LedSetRGB(LED1, r, g, b);
+		// running effect keeps LED, color is restored when it ends
+		if (!ledFx[0].running) LedSetRGB(LED1, r, g, b);
 	}
 
 	if (leds[1].func == func) {
@@ -347,8 +512,9 @@ void LedFunctionSetRGB(LedFunction_T func, uint8_t r, uint8_t g, uint8_t b) {
 		leds[1].b = b;
 		leds[1].blinkRepeat = 0;
 		leds[1].blinkCount = 0;
-		LedSetRGB(LED2, r, g, b);
+		if (!ledFx[1].running) LedSetRGB(LED2, r, g, b);
 	}
+	__set_PRIMASK(primask);
 }
 
 void LedStop(void) {
@@ -386,6 +552,7 @@ void LedStart(void) {
 void LedSetConfiguarion(uint8_t led, uint8_t data[], uint8_t len) {
 	if (led > 1) return;
 	uint16_t var = 0;
+	LedEffectStop(led);
 	if (led == 0) {
 		NvWriteVariableU8(NV_LED_FUNC_1, data[0]);
 		NvWriteVariableU8(NV_LED_PARAM_R_1, data[1]);
@@ -454,8 +621,22 @@ void LedGetConfiguarion(uint8_t led, uint8_t data[], uint16_t *len) {
 	*len = 4;
 }
 
+// Sets LED color as its state, running blink is cancelled so LedTask does not overwrite it
+// Power policy LED action, it stops effect as host LED commands do
+void LedSetState(uint8_t led, uint8_t r, uint8_t g, uint8_t b) {
+	if (led > 1) return;
+	LedEffectStop(led);
+	leds[led].blinkRepeat = 0;
+	leds[led].blinkCount = 0;
+	leds[led].r = r;
+	leds[led].g = g;
+	leds[led].b = b;
+	LedSetRGB(led, r, g, b);
+}
+
 void LedCmdSetState(uint8_t led, uint8_t data[], uint8_t len) {
 	if (led > 1 || leds[led].func != LED_USER_LED) return;
+	LedEffectStop(led);
 	leds[led].r = data[0];
 	leds[led].g = data[1];
 	leds[led].b = data[2];
@@ -473,6 +654,7 @@ void LedCmdGetState(uint8_t led, uint8_t data[], uint16_t *len) {
 void LedCmdSetBlink(uint8_t led, uint8_t data[], uint8_t len) {
 	if (led > 1 || leds[led].func == LED_NOT_USED) return;
 
+	LedEffectStop(led);
 	leds[led].blinkRepeat = data[0];
 	leds[led].blinkCount = data[0];
 	leds[led].blinkCount <<= 1; // *=2
@@ -521,3 +703,40 @@ void LedCmdGetBlink(uint8_t led, uint8_t data[], uint16_t *len) {
 	data[8] = leds[led].blinkPeriod2 / 10;
 	*len = 9;
 }
+
+// data[0]: LED, alone selects LED for read, data[1]: control,
+// LED_FX_CTRL_START loads steps from data[2] and starts effect
+void LedEffectsWriteCmd(uint8_t data[], uint16_t len) {
+	uint16_t stepsNum;
+
+	if (len < 1 || data[0] > 1) return;
+	ledFxSelect = data[0];
+	if (len < 2) return;
+
+	if (data[1] == LED_FX_CTRL_STOP) {
+		LedEffectStop(data[0]);
+	} else if (data[1] == LED_FX_CTRL_START) {
+		stepsNum = (len - 2) / LED_FX_STEP_LEN;
+		if (leds[data[0]].func == LED_NOT_USED || stepsNum == 0 || stepsNum > LED_FX_STEPS_MAX) return;
+		LedEffectStart(data[0], &data[2], stepsNum);
+	}
+}
+
+void LedEffectsReadCmd(uint8_t data[], uint16_t *len) {
+	LedFx_T *fx = &ledFx[ledFxSelect];
+	uint8_t i;
+
+	data[0] = ledFxSelect;
+	data[1] = fx->running;
+	data[2] = fx->step;
+	data[3] = fx->stepsNum;
+	for (i = 0; i < fx->stepsNum; i++) {
+		data[4 + i * LED_FX_STEP_LEN] = fx->steps[i].op;
+		data[5 + i * LED_FX_STEP_LEN] = fx->steps[i].r;
+		data[6 + i * LED_FX_STEP_LEN] = fx->steps[i].g;
+		data[7 + i * LED_FX_STEP_LEN] = fx->steps[i].b;
+		data[8 + i * LED_FX_STEP_LEN] = fx->steps[i].time;
+		data[9 + i * LED_FX_STEP_LEN] = fx->steps[i].time >> 8;
+	}
+	*len = 4 + fx->stepsNum * LED_FX_STEP_LEN;
+}
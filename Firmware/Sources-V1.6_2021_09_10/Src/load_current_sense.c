@@ -34,20 +34,97 @@ static const osThreadAttr_t currSenseTask_attributes = {
 
 // Table of poly coefficients of approximated PMOS drain current dependence on temperature and drain to gate voltage
 						 	 	 	 	  //{-0.0188,-0.0191,-0.0185,-0.0175,-0.0161,-0.0144,-0.0125,-0.0103,-0.008,-0.0055,-0.0029,0.0001,0.003,0.0058,0.0086,0.011,0.0135,0.0158,0.0173,0.0189,0.0198,0.0203,0.0199,0.019,0.0173,0.015,0.0113,0.0068,0.0011,-0.0056,-0.0137,-0.0231,-0.0339,-0.0463,-0.0603,-0.0763,-0.0938,-0.1126,-0.1336,-0.1558,-0.1802,-0.1558,-0.1558};
-static const float a[ID_T_POLY_COEFF_LEN] = {0.00672, 0.0065, 0.00628, 0.00606, 0.00584, 0.00562, 0.0054, 0.00518, 0.00496, 0.00474, 0.00452, 0.0043, 0.00408, 0.00386, 0.00364, 0.00342, 0.0032, 0.00298, 0.00276, 0.00254, 0.00232, 0.0021, 0.00188, 0.00166, 0.00144, 0.00122, 0.001, 0.00065, 0.0003, 0,-0.0051,-0.0092,-0.0139,-0.0193,-0.0254,-0.0323,-0.0399,-0.0483,-0.0576,-0.0677,-0.0788,-0.0909,-0.104,-0.1181,-0.1311,-0.1458,-0.1612,-0.1774,-0.1945,-0.2123,-0.231,-0.2506,-0.271,-0.2922,-0.3144,-0.3374,-0.3614};
 		//{ 0.0103, 0.0099, 0.0095, 0.0091, 0.0087, 0.0083, 0.0079, 0.0075, 0.0071, 0.0067, 0.0063, 0.0059, 0.0055, 0.0051, 0.0047, 0.0043, 0.0039, 0.0035, 0.0031, 0.0027, 0.0023, 0.0019, 0.0015, 0.0011, 0.0007, 0.0003, -0.0001, -0.0005, -0.0009, -0.0013,-0.0051,-0.0092,-0.0139,-0.0193,-0.0254,-0.0323,-0.0399,-0.0483,-0.0576,-0.0677,-0.0788,-0.0909,-0.104,-0.1181,-0.1311,-0.1458,-0.1612,-0.1774,-0.1945,-0.2123,-0.231,-0.2506,-0.271,-0.2922,-0.3144,-0.3374,-0.3614};
 		//{ 0.018148, 0.01765, 0.017132, 0.016594, 0.016036, 0.015458, 0.01486, 0.014242, 0.013604, 0.012946, 0.012268, 0.01157, 0.010852, 0.010114, 0.009356, 0.008578, 0.00778, 0.006962, 0.006124, 0.005266, 0.004388, 0.00349, 0.002572, 0.001634, 0.000676, -0.000302, -0.0013, -0.002318, -0.003356, -0.004414,-0.0051,-0.0092,-0.0139,-0.0193,-0.0254,-0.0323,-0.0399,-0.0483,-0.0576,-0.0677,-0.0788,-0.0909,-0.104,-0.1181,-0.1311,-0.1458,-0.1612,-0.1774,-0.1945,-0.2123,-0.231,-0.2506,-0.271,-0.2922,-0.3144,-0.3374,-0.3614};
 		//{0.02796, 0.028, 0.02796, 0.02784, 0.02764, 0.02736, 0.027, 0.02656, 0.02604, 0.02544, 0.02476, 0.024, 0.02316, 0.02224, 0.02124, 0.02016, 0.019, 0.01776, 0.01644, 0.01504, 0.01356, 0.012, 0.01036, 0.00864, 0.00684, 0.00496, 0.003, 0.00096, -0.00116, -0.00336,-0.0051,-0.0092,-0.0139,-0.0193,-0.0254,-0.0323,-0.0399,-0.0483,-0.0576,-0.0677,-0.0788,-0.0909,-0.104,-0.1181,-0.1311,-0.1458,-0.1612,-0.1774,-0.1945,-0.2123,-0.231,-0.2506,-0.271,-0.2922,-0.3144,-0.3374,-0.3614};
 		//{0.03632, 0.03545, 0.03452, 0.03353, 0.03248, 0.03137, 0.0302, 0.02897, 0.02768, 0.02633, 0.02492, 0.02345, 0.02192, 0.02033, 0.01868, 0.01697, 0.0152, 0.01337, 0.01148, 0.00953, 0.00752, 0.00545, 0.00332, 0.00113, -0.00112, -0.00343, -0.0058, -0.00823, -0.01072, -0.01327,-0.0051,-0.0092,-0.0139,-0.0193,-0.0254,-0.0323,-0.0399,-0.0483,-0.0576,-0.0677,-0.0788,-0.0909,-0.104,-0.1181,-0.1311,-0.1458,-0.1612,-0.1774,-0.1945,-0.2123,-0.231,-0.2506,-0.271,-0.2922,-0.3144,-0.3374,-0.3614};
 //{0,0,0,0,0,0,0,0,0,0,0,0,0.0028,0.0031,0.0028,0.0026,0.0024,0.0024,0.0024,0.0024,0.0025,0.0025,0.0026,0.0026,0.0026,0.0026,0.0025,0.0023,0.002,0.0016,-0.0051,-0.0092,-0.0139,-0.0193,-0.0254,-0.0323,-0.0399,-0.0483,-0.0576,-0.0677,-0.0788,-0.0909,-0.104,-0.1181,-0.1311,-0.1458,-0.1612,-0.1774,-0.1945,-0.2123,-0.231,-0.2506,-0.271,-0.2922,-0.3144,-0.3374,-0.3614};
 						 	 	 	 	  //{2.1296,2.0782,1.9572,1.8184,1.6645,1.4981,1.3222,1.1398,0.9543,0.7691,0.588,0.3775,0.1915,0.0219,-0.1394,-0.2502,-0.3679,-0.4625,-0.479,-0.4989,-0.4544,-0.3769,-0.2106,0.0011,0.2771,0.6116,1.0613,1.5835,2.1978,2.8995,3.7209,4.6451,5.6802,6.8469,8.1411,9.5966,11.16,12.828,14.671,16.588,18.676,16.588,16.588};
-static const float b[ID_T_POLY_COEFF_LEN] = {0.2169,0.1571,0.1201,0.1042,0.1078,0.1295,0.1676,0.2207,0.2872,0.3655,0.4541,0.5514,0.3989,0.4694,0.5615,0.6495,0.7352,0.8204,0.9068,0.9962,1.0904,1.1911,1.3001,1.4193,1.5503,1.695,1.8551,2.0323,2.2286,2.4456,3.0549,3.5263,4.0515,4.6335,5.2757,5.981,6.7528,7.5942,8.5084,9.4986,10.568,11.719,12.957,14.282,15.501,16.858,18.278,19.763,21.312,22.926,24.607,26.354,28.169,30.052,32.004,34.025,36.117};
 									      //{-49.855,-47.355,-43.582,-39.622,-35.508,-31.274,-26.956,-22.594,-18.229,-13.905,-9.6695,-4.7774,-0.339,3.8561,8.0158,11.287,14.931,18.354,20.432,22.947,24.503,25.822,25.767,25.318,24.128,22.378,18.922,14.729,9.4428,3.2338,-4.5243,-13.402,-23.5,-35.189,-48.31,-63.502,-79.554,-96.315,-115.23,-134.03,-154.69,-134.05,-134.06};
-static const float c[ID_T_POLY_COEFF_LEN] = {-8.2299,-4.4796,-1.6241,0.4295,1.774,2.5026,2.708,2.4833,1.9213,1.115,0.1574,-0.8587,3.632,3.669,4.126,5.003,6.3,8.017,10.154,12.711,15.688,19.085,22.902,27.139,31.796,36.873,42.37,48.287,54.624,61.381,68.558,76.155,84.172,92.609,101.47,110.74,120.44,130.56,141.09,152.05,163.43,175.23,187.44,200.08,217.37,234.16,252.12,271.29,291.73,313.5,336.64,361.2,387.24,414.82,443.99,474.79,507.28};
+#define ID_T_POLY_COEFFS(X) \
+	X(0.00672, 0.2169, -8.2299) \
+	X(0.0065, 0.1571, -4.4796) \
+	X(0.00628, 0.1201, -1.6241) \
+	X(0.00606, 0.1042, 0.4295) \
+	X(0.00584, 0.1078, 1.774) \
+	X(0.00562, 0.1295, 2.5026) \
+	X(0.0054, 0.1676, 2.708) \
+	X(0.00518, 0.2207, 2.4833) \
+	X(0.00496, 0.2872, 1.9213) \
+	X(0.00474, 0.3655, 1.115) \
+	X(0.00452, 0.4541, 0.1574) \
+	X(0.0043, 0.5514, -0.8587) \
+	X(0.00408, 0.3989, 3.632) \
+	X(0.00386, 0.4694, 3.669) \
+	X(0.00364, 0.5615, 4.126) \
+	X(0.00342, 0.6495, 5.003) \
+	X(0.0032, 0.7352, 6.3) \
+	X(0.00298, 0.8204, 8.017) \
+	X(0.00276, 0.9068, 10.154) \
+	X(0.00254, 0.9962, 12.711) \
+	X(0.00232, 1.0904, 15.688) \
+	X(0.0021, 1.1911, 19.085) \
+	X(0.00188, 1.3001, 22.902) \
+	X(0.00166, 1.4193, 27.139) \
+	X(0.00144, 1.5503, 31.796) \
+	X(0.00122, 1.695, 36.873) \
+	X(0.001, 1.8551, 42.37) \
+	X(0.00065, 2.0323, 48.287) \
+	X(0.0003, 2.2286, 54.624) \
+	X(0, 2.4456, 61.381) \
+	X(-0.0051, 3.0549, 68.558) \
+	X(-0.0092, 3.5263, 76.155) \
+	X(-0.0139, 4.0515, 84.172) \
+	X(-0.0193, 4.6335, 92.609) \
+	X(-0.0254, 5.2757, 101.47) \
+	X(-0.0323, 5.981, 110.74) \
+	X(-0.0399, 6.7528, 120.44) \
+	X(-0.0483, 7.5942, 130.56) \
+	X(-0.0576, 8.5084, 141.09) \
+	X(-0.0677, 9.4986, 152.05) \
+	X(-0.0788, 10.568, 163.43) \
+	X(-0.0909, 11.719, 175.23) \
+	X(-0.104, 12.957, 187.44) \
+	X(-0.1181, 14.282, 200.08) \
+	X(-0.1311, 15.501, 217.37) \
+	X(-0.1458, 16.858, 234.16) \
+	X(-0.1612, 18.278, 252.12) \
+	X(-0.1774, 19.763, 271.29) \
+	X(-0.1945, 21.312, 291.73) \
+	X(-0.2123, 22.926, 313.5) \
+	X(-0.231, 24.607, 336.64) \
+	X(-0.2506, 26.354, 361.2) \
+	X(-0.271, 28.169, 387.24) \
+	X(-0.2922, 30.052, 414.82) \
+	X(-0.3144, 32.004, 443.99) \
+	X(-0.3374, 34.025, 474.79) \
+	X(-0.3614, 36.117, 507.28)
 // ID = a * T^2 + b * T + c
-// a = a[index], b = b[index], c = c[index]
+// a, b, c = X(a, b, c) row at index
 // index = (VDG - ID_T_POLY_COEFF_VDG_START) / ID_T_POLY_COEFF_VDG_INC
 
+// Drain current table evaluated by compiler from poly coefficients, in 1/16 mA, temperature from -40 to 88
+// degrees Celsius in 4 degrees steps, linearly interpolated over temperature. Negative currents are kept,
+// interpolation is not bent by clipping at zero.
+#define ID_T_TABLE_TEMP_START		(-40)
+#define ID_T_TABLE_TEMP_STEP_SHIFT	2
+#define ID_T_TABLE_TEMP_LEN			33
+
+#define ID_T_Q(a, b, c, t)	((a) * (t) * (t) + (b) * (t) + (c))
+#define ID_T_Q16(a, b, c, t)	((int16_t)(ID_T_Q(a, b, c, t) * 16 + (ID_T_Q(a, b, c, t) < 0 ? -0.5 : 0.5)))
+#define ID_T_TABLE_ROW(a, b, c)	{ \
+	ID_T_Q16(a, b, c, -40), ID_T_Q16(a, b, c, -36), ID_T_Q16(a, b, c, -32), ID_T_Q16(a, b, c, -28), \
+	ID_T_Q16(a, b, c, -24), ID_T_Q16(a, b, c, -20), ID_T_Q16(a, b, c, -16), ID_T_Q16(a, b, c, -12), \
+	ID_T_Q16(a, b, c, -8), ID_T_Q16(a, b, c, -4), ID_T_Q16(a, b, c, 0), ID_T_Q16(a, b, c, 4), \
+	ID_T_Q16(a, b, c, 8), ID_T_Q16(a, b, c, 12), ID_T_Q16(a, b, c, 16), ID_T_Q16(a, b, c, 20), \
+	ID_T_Q16(a, b, c, 24), ID_T_Q16(a, b, c, 28), ID_T_Q16(a, b, c, 32), ID_T_Q16(a, b, c, 36), \
+	ID_T_Q16(a, b, c, 40), ID_T_Q16(a, b, c, 44), ID_T_Q16(a, b, c, 48), ID_T_Q16(a, b, c, 52), \
+	ID_T_Q16(a, b, c, 56), ID_T_Q16(a, b, c, 60), ID_T_Q16(a, b, c, 64), ID_T_Q16(a, b, c, 68), \
+	ID_T_Q16(a, b, c, 72), ID_T_Q16(a, b, c, 76), ID_T_Q16(a, b, c, 80), ID_T_Q16(a, b, c, 84), \
+	ID_T_Q16(a, b, c, 88) },
+
+static const int16_t refLoadCurrTable[ID_T_POLY_COEFF_LEN][ID_T_TABLE_TEMP_LEN] = { ID_T_POLY_COEFFS(ID_T_TABLE_ROW) };
+
 uint8_t hardwareRev __attribute__((section("no_init")));
 uint8_t currSensorTypeDetCnt __attribute__((section("no_init")));
 
@@ -78,14 +155,29 @@ static int32_t GetLoadCurrentNCS() {
 	return current;
 }
 
-static float GetRefLoadCurrent() {
+static int16_t GetVdgIndex(void) {
 	int32_t vdg = 4790 - ((GetSample(POW_DET_SENS_CHN)*aVdd)>>11);//ANALOG_GET_VDG_AVG();
 	//vdg *= vdgCalibCoeff * mcuTemperature;
 	//vdg >>= 10;
 	int16_t i = vdg >= ID_T_POLY_COEFF_VDG_START ? (vdg - ID_T_POLY_COEFF_VDG_START + ID_T_POLY_COEFF_VDG_INC / 2) / ID_T_POLY_COEFF_VDG_INC : 0;
-	i = i >= ID_T_POLY_COEFF_LEN ? ID_T_POLY_COEFF_LEN - 1 : i;
+	return i >= ID_T_POLY_COEFF_LEN ? ID_T_POLY_COEFF_LEN - 1 : i;
+}
 
-	volatile float current = a[i] * mcuTemperature * mcuTemperature + b[i] * mcuTemperature + c[i];
+// Reference current in 1/64 mA
+static int32_t GetRefLoadCurrent(void) {
+	const int16_t *row = refLoadCurrTable[GetVdgIndex()];
+	int32_t t = mcuTemperature - ID_T_TABLE_TEMP_START;
+	int32_t j, f, current;
+
+	if (t < 0) t = 0;
+	if (t > ((ID_T_TABLE_TEMP_LEN - 1) << ID_T_TABLE_TEMP_STEP_SHIFT)) t = (ID_T_TABLE_TEMP_LEN - 1) << ID_T_TABLE_TEMP_STEP_SHIFT;
+	j = t >> ID_T_TABLE_TEMP_STEP_SHIFT;
+	f = t & ((1 << ID_T_TABLE_TEMP_STEP_SHIFT) - 1);
+	if (j == ID_T_TABLE_TEMP_LEN - 1) {
+		j--;
+		f = 1 << ID_T_TABLE_TEMP_STEP_SHIFT;
+	}
+	current = row[j] * (1 << ID_T_TABLE_TEMP_STEP_SHIFT) + (row[j+1] - row[j]) * f;
 	return current > 0 ? current : 0;
 }
 
@@ -134,8 +226,13 @@ int32_t GetLoadCurrent(void) {
 	}
 }
 
+// Offset of resistor sense current, subtracted also from scans in load current statistics
+int16_t GetLoadCurrentCalib(void) {
+	return resLoadCurrCalib;
+}
+
 void MeasurePMOSLoadCurrent(void) {
-	pow5vIoPMOSLoadCurrent = ((kta * mcuTemperature + (((uint16_t)ktb) << 8) ) * ((int32_t)(GetRefLoadCurrent()+0.5))) >> 13; //ktNorm * k12 * refCurr
+	pow5vIoPMOSLoadCurrent = ((kta * mcuTemperature + (((uint16_t)ktb) << 8) ) * ((GetRefLoadCurrent() + 32) >> 6)) >> 13; //ktNorm * k12 * refCurr
 }
 
 void GetCurrStat(uint8_t stat[]) {
@@ -304,7 +401,7 @@ int8_t CalibrateLoadCurrent(void) {
 	DelayUs(10000);
 	curr += GetRefLoadCurrent();
 	//if ( curr > (4*52) || curr < (52/4) ) return 2;
-	float k12 = (float)52 * 8 / (curr * ktNorm); // = k / ktNorm;
+	float k12 = (float)52 * 8 * 64 / (curr * ktNorm); // = k / ktNorm;
 	kta = 0.0052 * k12 * 1024 * 8;
 	ktb = 0.9376 * k12 * 32;
 	EE_WriteVariable(VDG_ILOAD_CALIB_KTA_NV_ADDR, kta | ((uint16_t)~kta<<8));
@@ -0,0 +1,299 @@
+/*
+ * load_current_stats.c
+ *
+ *  Created on: 19.10.2026.
+ */
+
+#include "load_current_stats.h"
+#include "stm32f0xx_hal.h"
+#include "analog.h"
+#include "load_current_sense.h"
+#include "rtc_ds1339_emu.h"
+
+#define LOAD_CURR_STATS_MIN	-3000 // mA, scan current is clipped to sensor range
+#define LOAD_CURR_STATS_MAX	4000
+#define LOAD_CURR_STATS_HALF_SCANS	(ADC_BUFFER_LENGTH / ADC_SCAN_CHANNELS / 2)
+#define LOAD_CURR_STATS_MS_TO_SCANS(ms)	(((uint32_t)(ms) * 1000 + LOAD_CURR_STATS_SCAN_US / 2) / LOAD_CURR_STATS_SCAN_US)
+
+#define LOAD_CURR_STATS_WRITE_RESET	0x01
+#define LOAD_CURR_STATS_WRITE_CONFIG	0x02
+
+typedef struct {
+	// window in progress
+	int64_t sum; // mA * scans
+	uint64_t sumSq;
+	uint32_t scans;
+	int16_t min;
+	int16_t max;
+	uint8_t windows; // lower level windows in sum
+	// last completed window, mA
+	uint32_t completed; // windows since reset
+	int16_t lastMin;
+	int16_t lastMax;
+	int16_t lastAvg;
+	int16_t lastRms;
+	uint32_t lastEnd; // ms tick
+	// highest window average since reset
+	int16_t peakAvg;
+	uint32_t peakEnd;
+} LoadCurrStatsLevel_T;
+
+static LoadCurrStatsLevel_T statsLevel[LOAD_CURR_STATS_LEVELS];
+static uint32_t statsHist[LOAD_CURR_STATS_HIST_BINS]; // scans per current bin since reset
+static uint8_t statsHistScale = 0; // counts were halved this many times to avoid overflow
+static int16_t statsPeak; // highest scan current since reset
+static uint32_t statsPeakTick;
+static uint8_t statsPeakValid = 0;
+
+static uint16_t statsBaseMs = 100; // 0 - statistics off
+static uint8_t statsWindows[LOAD_CURR_STATS_LEVELS-1] = {10, 60}; // lower level windows per window
+static uint8_t statsBinShift = 7; // 128 mA bins
+static uint16_t statsBaseScans = LOAD_CURR_STATS_MS_TO_SCANS(100);
+
+static uint16_t IntSqrt(uint32_t x) {
+	uint32_t r = 0, b = 0x40000000;
+	while (b > x) b >>= 2;
+	while (b) {
+		if (x >= r + b) {
+			x -= r + b;
+			r = (r >> 1) + b;
+		} else {
+			r >>= 1;
+		}
+		b >>= 2;
+	}
+	return r;
+}
+
+static void LoadCurrentStatsAdd(LoadCurrStatsLevel_T *l, int64_t sum, uint64_t sumSq, uint32_t scans, int16_t min, int16_t max) {
+	if (!l->scans || min < l->min) l->min = min;
+	if (!l->scans || max > l->max) l->max = max;
+	l->sum += sum;
+	l->sumSq += sumSq;
+	l->scans += scans;
+}
+
+// Completed window is added to next level window, which is closed after set count of them
+static void LoadCurrentStatsClose(uint8_t level, uint32_t tick) {
+	LoadCurrStatsLevel_T *l = &statsLevel[level];
+	int16_t avg = l->sum / (int32_t)l->scans;
+
+	l->lastMin = l->min;
+	l->lastMax = l->max;
+	l->lastAvg = avg;
+	l->lastRms = IntSqrt(l->sumSq / l->scans);
+	l->lastEnd = tick;
+	if (!l->completed || avg > l->peakAvg) {
+		l->peakAvg = avg;
+		l->peakEnd = tick;
+	}
+	l->completed++;
+
+	if (level + 1 < LOAD_CURR_STATS_LEVELS) {
+		LoadCurrStatsLevel_T *next = &statsLevel[level+1];
+		LoadCurrentStatsAdd(next, l->sum, l->sumSq, l->scans, l->min, l->max);
+		next->windows++;
+		if (next->windows >= statsWindows[level]) LoadCurrentStatsClose(level + 1, tick);
+	}
+
+	l->sum = 0;
+	l->sumSq = 0;
+	l->scans = 0;
+	l->windows = 0;
+}
+
+// Scans of completed DMA half buffer, called from DMA interrupt. Current of each scan uses
+// scaling of GetLoadCurrentNCS and GetResSenseCurrent without averaging.
+static void LoadCurrentStatsScans(const uint32_t *scan, uint16_t scans) {
+	uint32_t tick = HAL_GetTick();
+	int32_t k, offset = 0;
+	uint8_t ncs, i;
+
+	if (!statsBaseMs || hardwareRev == HARD_REV_UNKNOWN) return;
+
+	ncs = hardwareRev == HARD_REV_2_3_AND_ABOVE;
+	if (ncs) {
+		k = (int32_t)aVdd * 10;
+	} else {
+		k = (int32_t)aVdd * 25;
+		offset = GetLoadCurrentCalib();
+	}
+
+	while (scans) {
+		// segment ends with base window or buffer half, squares of up to half buffer scans fit 32 bit
+		uint16_t n = statsBaseScans - statsLevel[0].scans;
+		uint16_t j, maxInd = 0;
+		int32_t sum = 0;
+		uint32_t sumSq = 0;
+		int16_t min = INT16_MAX, max = INT16_MIN;
+
+		if (n > scans) n = scans;
+		for (j = 0; j < n; j++, scan += ADC_SCAN_CHANNELS) {
+			int32_t s0 = scan[0], s1 = scan[1], c, bin;
+			if (!ncs) {
+				c = (((s0 - s1) * k) >> 8) - offset;
+			} else if (s0 < 1500) {
+				c = 0; // 5V GPIO off
+			} else {
+				c = ((1469 + ((s0 * 138) >> 12) - s1) * k + 1) >> 14;
+			}
+			if (c > LOAD_CURR_STATS_MAX) c = LOAD_CURR_STATS_MAX;
+			if (c < LOAD_CURR_STATS_MIN) c = LOAD_CURR_STATS_MIN;
+
+			if (c < min) min = c;
+			if (c > max) {
+				max = c;
+				maxInd = j;
+			}
+			sum += c;
+			sumSq += c * c;
+			bin = c >> statsBinShift;
+			if (bin < 0) bin = 0;
+			if (bin >= LOAD_CURR_STATS_HIST_BINS) bin = LOAD_CURR_STATS_HIST_BINS - 1;
+			statsHist[bin]++;
+		}
+		scans -= n;
+
+		// callback comes after last scan of buffer half, earlier scans are dated back by scan period
+		if (!statsPeakValid || max > statsPeak) {
+			statsPeak = max;
+			statsPeakTick = tick - ((uint32_t)(scans + n - 1 - maxInd) * LOAD_CURR_STATS_SCAN_US + 500) / 1000;
+			statsPeakValid = 1;
+		}
+		LoadCurrentStatsAdd(&statsLevel[0], sum, sumSq, n, min, max);
+		if (statsLevel[0].scans >= statsBaseScans) {
+			LoadCurrentStatsClose(0, tick - ((uint32_t)scans * LOAD_CURR_STATS_SCAN_US + 500) / 1000);
+		}
+	}
+
+	for (i = 0; i < LOAD_CURR_STATS_HIST_BINS; i++) {
+		if (statsHist[i] & 0x80000000) {
+			for (i = 0; i < LOAD_CURR_STATS_HIST_BINS; i++) statsHist[i] >>= 1;
+			statsHistScale++;
+			break;
+		}
+	}
+}
+
+void HAL_ADC_ConvHalfCpltCallback(ADC_HandleTypeDef* hadc) {
+	LoadCurrentStatsScans(analogIn, LOAD_CURR_STATS_HALF_SCANS);
+}
+
+void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef* hadc) {
+	LoadCurrentStatsScans(analogIn + ADC_BUFFER_LENGTH / 2, LOAD_CURR_STATS_HALF_SCANS);
+}
+
+static void LoadCurrentStatsReset(void) {
+	uint8_t i;
+	for (i = 0; i < LOAD_CURR_STATS_LEVELS; i++) {
+		statsLevel[i].sum = 0;
+		statsLevel[i].sumSq = 0;
+		statsLevel[i].scans = 0;
+		statsLevel[i].windows = 0;
+		statsLevel[i].completed = 0;
+	}
+	for (i = 0; i < LOAD_CURR_STATS_HIST_BINS; i++) statsHist[i] = 0;
+	statsHistScale = 0;
+	statsPeakValid = 0;
+}
+
+static void PutInt16(uint8_t *p, int16_t v) {
+	p[0] = v;
+	p[1] = (uint16_t)v >> 8;
+}
+
+static void PutUint32(uint8_t *p, uint32_t v) {
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+// Tick time stamp is converted to seconds since 2000-01-01 and 1/256 s, 0 when not valid
+static void PutTime(uint8_t *p, uint32_t tick, uint32_t nowTick, uint32_t sec, uint8_t sub, uint8_t valid) {
+	uint32_t age = nowTick - tick;
+	uint32_t back = (age / 125) * 32 + ((age % 125) * 32 + 62) / 125; // 1/256 s
+	int16_t frac = (int16_t)sub - (back & 0xFF);
+
+	sec -= back >> 8;
+	if (frac < 0) {
+		frac += 256;
+		sec--;
+	}
+	PutUint32(p, valid ? sec : 0);
+	p[4] = valid ? frac : 0;
+}
+
+// Frame: flags (bit0 statistics running), base window ms, n1, n2, histogram bin shift, histogram
+// scale, per level: completed windows, min, max, average and rms current of last completed window in mA,
+// its end time, highest window average and its end time, then highest scan current and its time,
+// histogram scan counts of bins of 2^shift mA, first bin includes negative, last bin higher currents.
+// Times are seconds since 2000-01-01 and 1/256 s.
+void LoadCurrentStatsReadCmd(uint8_t data[], uint16_t *len) {
+	uint32_t primask, nowTick, sec;
+	uint8_t sub, valid, i;
+	uint8_t *p;
+
+	RtcReadLinearTime(&sec, &sub);
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+	nowTick = HAL_GetTick();
+	data[0] = statsBaseMs && hardwareRev != HARD_REV_UNKNOWN;
+	data[1] = statsBaseMs;
+	data[2] = statsBaseMs >> 8;
+	data[3] = statsWindows[0];
+	data[4] = statsWindows[1];
+	data[5] = statsBinShift;
+	data[6] = statsHistScale;
+
+	p = data + LOAD_CURR_STATS_READ_HEADER_LEN;
+	for (i = 0; i < LOAD_CURR_STATS_LEVELS; i++, p += LOAD_CURR_STATS_READ_LEVEL_LEN) {
+		LoadCurrStatsLevel_T *l = &statsLevel[i];
+		valid = l->completed != 0;
+		PutUint32(p, l->completed);
+		PutInt16(p + 4, valid ? l->lastMin : 0);
+		PutInt16(p + 6, valid ? l->lastMax : 0);
+		PutInt16(p + 8, valid ? l->lastAvg : 0);
+		PutInt16(p + 10, valid ? l->lastRms : 0);
+		PutTime(p + 12, l->lastEnd, nowTick, sec, sub, valid);
+		PutInt16(p + 17, valid ? l->peakAvg : 0);
+		PutTime(p + 19, l->peakEnd, nowTick, sec, sub, valid);
+	}
+
+	PutInt16(p, statsPeakValid ? statsPeak : 0);
+	PutTime(p + 2, statsPeakTick, nowTick, sec, sub, statsPeakValid);
+	p += LOAD_CURR_STATS_READ_PEAK_LEN;
+
+	for (i = 0; i < LOAD_CURR_STATS_HIST_BINS; i++, p += 4) PutUint32(p, statsHist[i]);
+	__set_PRIMASK(primask);
+
+	*len = LOAD_CURR_STATS_READ_LEN;
+}
+
+// data[0] bit0: reset statistics, bit1: set configuration from data[1..5]: base window ms (0 - off,
+// 10 - 1000), base windows per level 1 window, level 1 windows per level 2 window, histogram bin
+// shift (4 - 9). Configuration change also resets statistics.
+void LoadCurrentStatsWriteCmd(uint8_t data[], uint16_t len) {
+	uint32_t primask;
+	uint16_t baseMs;
+
+	if (len < 1) return;
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+	if ((data[0] & LOAD_CURR_STATS_WRITE_CONFIG) && len >= 6) {
+		baseMs = data[1] | ((uint16_t)data[2] << 8);
+		if ((baseMs == 0 || (baseMs >= LOAD_CURR_STATS_BASE_MS_MIN && baseMs <= LOAD_CURR_STATS_BASE_MS_MAX))
+				&& data[3] && data[4] && data[5] >= LOAD_CURR_STATS_BIN_SHIFT_MIN && data[5] <= LOAD_CURR_STATS_BIN_SHIFT_MAX) {
+			statsBaseMs = baseMs;
+			statsBaseScans = LOAD_CURR_STATS_MS_TO_SCANS(baseMs);
+			statsWindows[0] = data[3];
+			statsWindows[1] = data[4];
+			statsBinShift = data[5];
+			LoadCurrentStatsReset();
+		}
+	}
+	if (data[0] & LOAD_CURR_STATS_WRITE_RESET) LoadCurrentStatsReset();
+	__set_PRIMASK(primask);
+}
@@ -11,57 +11,292 @@
 #include "nv.h"
 
 #if defined LOGGING
+
+typedef struct {
+	uint32_t sec; // seconds since 2000-01-01
+	uint8_t sub; // 1/256 second
+} LogTime_T;
+
+typedef struct {
+	uint32_t refill; // time of last refill, 1/256 s
+	uint16_t suppressed; // records dropped since last LOG_REPEATED record
+	uint8_t tokens; // records class can put before next refill
+	uint8_t id; // id of last suppressed record
+} LogRate_T;
+
+// Record: id (bit 7 absolute time), payload length, time, payload
+// Time is unsigned LEB128 delta from previous record in 1/256 s, or 4 bytes seconds and 1 byte 1/256 s if absolute
 uint8_t log_buf[LOG_BUF_SIZE] __attribute__((section("no_init")));
-uint16_t log_last __attribute__((section("no_init"))); // index of the beginning of last message in buffer
-uint8_t log_last_seq_num __attribute__((section("no_init"))); // sequence number of last message in buffer
-uint16_t log_read_num __attribute__((section("no_init"))); // message to be read by host
+uint16_t log_head __attribute__((section("no_init"))); // index where next record is written
+uint16_t log_tail __attribute__((section("no_init"))); // index of oldest record
+uint16_t log_records __attribute__((section("no_init"))); // number of records in buffer
+uint16_t log_read __attribute__((section("no_init"))); // index of first record not read by host
+uint16_t log_unread __attribute__((section("no_init"))); // number of records not read by host
 uint8_t log_config __attribute__((section("no_init"))); // enable/disable configuration
 uint8_t log_read_flag = 0;
 
-#define LOG_INIT_FRAME(id) \
-	log_last -= LOG_BUF_FRAME_SIZE; \
-	log_last &= LOG_BUF_MASK; \
-	log_buf[log_last] = LOG_MSG_LEN; /* first byte in frame is message length */  \
-	log_buf[log_last+1] = ++log_last_seq_num; /* second byte in frame is sequence number */ \
-	log_buf[log_last+2] = id;   /* third byte in frame is log message id */ \
+static LogTime_T log_last_time; // time of newest record
+static LogTime_T log_tail_time; // time of oldest record
+static LogTime_T log_read_time; // time of first unread record
+static uint16_t log_frame_read; // read cursor at start of last drain frame, to repeat it
+static uint16_t log_frame_unread;
+static LogTime_T log_frame_time;
+static uint8_t log_frame_lost;
+static uint8_t log_frame_valid = 0; // 1 - last drain frame can be repeated, 2 - its first record was overwritten
+static uint8_t log_lost = 0; // unread records were overwritten since last drain frame
+static uint8_t log_drain_len = LOG_DRAIN_DEFAULT_LEN;
+static LogRate_T log_rate[LOG_CLASSES_NUM];
+
+// interval in 1/256 s at which class gets one more record once its burst is used, in log_config bits order
+static const uint16_t log_rate_interval[LOG_CLASSES_NUM] = {
+	64, // messages, values, alarm write
+	256, // 5V regulator on
+	256, // 5V regulator off
+	256, // wakeup event
+	256, // alarm event
+	256, // MCU reset
+	256
+};
+
+#define LOG_CLASS(id) ((id>3 && id<10) ? id-3 : 0)
+#define IS_LOG_ENABLED(id) (log_config&(0x01<<LOG_CLASS(id)))
+
+static void LoggingGetTime(LogTime_T *t) {
+	RtcReadLinearTime(&t->sec, &t->sub);
+}
+
+// Time in 1/256 s, wraps so only differences are used
+static uint32_t LoggingNow(void) {
+	LogTime_T t;
+	LoggingGetTime(&t);
+	return (t.sec << 8) | t.sub;
+}
+
+static void LoggingTimeAdd(LogTime_T *t, uint32_t delta) {
+	uint16_t sub = t->sub + (delta & 0xFF);
+	t->sec += (delta >> 8) + (sub >> 8);
+	t->sub = sub;
+}
+
+// Returns length of record at index, updates time t to record time if not NULL
+static uint16_t LoggingRecordTime(uint16_t ind, LogTime_T *t) {
+	uint8_t *p = log_buf + ind + LOG_RECORD_HEADER_LEN;
+	uint32_t delta = 0;
+	uint8_t n = 0;
+
+	if (log_buf[ind] & LOG_ID_ABS_TIME) {
+		if (t != NULL) {
+			t->sec = p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+			t->sub = p[4];
+		}
+		n = 5;
+	} else {
+		do {
+			delta |= (uint32_t)(p[n] & 0x7F) << (7 * n);
+		} while ((p[n++] & 0x80) && n < 5);
+		if (t != NULL) LoggingTimeAdd(t, delta);
+	}
+
+	return LOG_RECORD_HEADER_LEN + n + log_buf[ind + 1];
+}
+
+// Index of record following record at ind, end of buffer content is marked with NO_LOG id
+static uint16_t LoggingNextRecord(uint16_t ind, uint16_t len) {
+	ind += len;
+	if (ind >= LOG_BUF_SIZE || log_buf[ind] == NO_LOG) ind = 0;
+	return ind;
+}
+
+// Drop oldest record, read cursor is moved if it was pointing to it
+static void LoggingEvict(void) {
+	uint16_t len = LoggingRecordTime(log_tail, NULL);
+	uint8_t readAtTail = log_unread == log_records;
+
+	if (readAtTail) {
+		log_unread--;
+		log_lost = 1;
+	}
+	if (log_frame_valid == 1 && log_frame_unread == log_records) log_frame_valid = 2;
+
+	log_records--;
+	if (log_records) {
+		log_tail = LoggingNextRecord(log_tail, len);
+		LoggingRecordTime(log_tail, &log_tail_time);
+	} else {
+		log_tail = log_head;
+	}
+
+	if (readAtTail) {
+		log_read = log_tail;
+		log_read_time = log_tail_time;
+	}
+}
+
+// Appends record header and returns pointer to zeroed payload, must be called with interrupts disabled
+static uint8_t *LoggingReserve(LogMsgId_T id, uint8_t len) {
+	LogTime_T now;
+	uint8_t timeField[5];
+	uint8_t timeLen = 0;
+	uint32_t dsec, delta;
+	uint16_t size;
+	uint8_t *p;
+	uint8_t i;
+
+	LoggingGetTime(&now);
+
+	dsec = now.sec - log_last_time.sec;
+	if (log_records == 0 || now.sec < log_last_time.sec || dsec >= 0x00FFFFFF
+		|| (dsec == 0 && now.sub < log_last_time.sub)) {
+		// first record, time set back or gap too long for delta
+		id |= LOG_ID_ABS_TIME;
+		timeField[0] = now.sec;
+		timeField[1] = now.sec >> 8;
+		timeField[2] = now.sec >> 16;
+		timeField[3] = now.sec >> 24;
+		timeField[4] = now.sub;
+		timeLen = 5;
+	} else {
+		delta = (dsec << 8) + now.sub - log_last_time.sub;
+		do {
+			timeField[timeLen] = delta & 0x7F;
+			delta >>= 7;
+			if (delta) timeField[timeLen] |= 0x80;
+			timeLen++;
+		} while (delta);
+	}
+
+	size = LOG_RECORD_HEADER_LEN + timeLen + len;
+
+	if (log_head + size > LOG_BUF_SIZE) {
+		// keep record contiguous, mark end of content and continue from buffer start
+		while (log_records && log_tail >= log_head) LoggingEvict();
+		if (log_head < LOG_BUF_SIZE) log_buf[log_head] = NO_LOG;
+		log_head = 0;
+	}
+	while (log_records && log_tail >= log_head && log_tail < log_head + size) LoggingEvict();
+
+	if (log_records == 0) {
+		log_tail = log_head;
+		log_tail_time = now;
+	}
+	if (log_unread == 0) {
+		log_read = log_head;
+		log_read_time = now;
+	}
+
+	p = log_buf + log_head;
+	p[0] = id;
+	p[1] = len;
+	for (i = 0; i < timeLen; i++) p[LOG_RECORD_HEADER_LEN + i] = timeField[i];
+	p += LOG_RECORD_HEADER_LEN + timeLen;
+	for (i = 0; i < len; i++) p[i] = 0;
+
+	log_head += size;
+	if (log_head >= LOG_BUF_SIZE) log_head = 0;
+	log_records++;
+	log_unread++;
+	if (log_frame_valid == 1) log_frame_unread++;
+	log_last_time = now;
 
-#define IS_LOG_ENABLED(id) ((id>3 && id<10) ? log_config&(0x01<<(id-3)) : log_config&0x01)
+	return p;
+}
+
+static void LoggingRateRefill(LogRate_T *r, uint16_t interval, uint32_t now) {
+	uint32_t n;
+
+	if ((int32_t)(now - r->refill) < 0) {
+		// time set back
+		r->refill = now;
+		r->tokens = LOG_RATE_BURST;
+		return;
+	}
+	n = (now - r->refill) / interval;
+	if (r->tokens + n >= LOG_RATE_BURST) {
+		r->tokens = LOG_RATE_BURST;
+		r->refill = now;
+	} else {
+		r->tokens += n;
+		r->refill += n * interval;
+	}
+}
+
+// Must be called with interrupts disabled
+static void LoggingPutRepeated(LogRate_T *r) {
+	uint8_t *p = LoggingReserve(LOG_REPEATED, 3);
+	p[0] = r->id;
+	p[1] = r->suppressed;
+	p[2] = r->suppressed >> 8;
+	r->suppressed = 0;
+}
+
+uint8_t *LoggingInitMessage(LogMsgId_T id, uint8_t len) {
+	uint8_t *pBuf;
+	uint32_t primask;
+	LogRate_T *r;
 
-uint8_t *LoggingInitMessage(LogMsgId_T id) {
 	if (!IS_LOG_ENABLED(id)) return NULL;
-	// reserve message frame for later log
+	if (len > LOG_MSG_MAX_LEN) len = LOG_MSG_MAX_LEN;
+
+	// reserve record for later fill
 	// some log messages needs process to be completed in order to collect report data, like 5V regulator turn on
-	LOG_INIT_FRAME(id);
+	primask = __get_PRIMASK();
+	__disable_irq();
+	if (log_config & LOG_CONFIG_RATE_LIMIT) {
+		r = &log_rate[LOG_CLASS(id)];
+		LoggingRateRefill(r, log_rate_interval[LOG_CLASS(id)], LoggingNow());
+		if (r->tokens == 0) {
+			// counted and put later as single repeated record
+			if (r->suppressed < 0xFFFF) r->suppressed++;
+			r->id = id;
+			__set_PRIMASK(primask);
+			return NULL;
+		}
+		r->tokens--;
+		if (r->suppressed) LoggingPutRepeated(r);
+	}
+	pBuf = LoggingReserve(id, len);
+	__set_PRIMASK(primask);
 
-	// fill message data starting from fourth byte
-	uint8_t *pBuf = log_buf+log_last+3;
-	RtcReadTime(pBuf, 1);
-	return log_buf+log_last+11;
+	return pBuf;
 }
 
 void LogPut(LogMsgId_T id) {
-	switch (id) {
-	case LOG_5VREG_ON:
-		LOG_INIT_FRAME(LOG_5VREG_ON);
+	LoggingInitMessage(id, 0);
+}
 
-		// fill message data starting from fourth byte
-		uint8_t *pBuf = log_buf+log_last+3;
-		RtcReadTime(pBuf, 1);
+// Puts count of suppressed records when class was quiet for its whole burst
+void LoggingTask(void) {
+	uint32_t primask;
+	uint32_t now;
+	uint8_t i;
 
-		break;
-	default:
-		break;
+	for (i = 0; i < LOG_CLASSES_NUM; i++) {
+		if (!log_rate[i].suppressed) continue;
+		now = LoggingNow();
+		primask = __get_PRIMASK();
+		__disable_irq();
+		LoggingRateRefill(&log_rate[i], log_rate_interval[i], now);
+		if (log_rate[i].suppressed && log_rate[i].tokens == LOG_RATE_BURST) LoggingPutRepeated(&log_rate[i]);
+		__set_PRIMASK(primask);
 	}
 }
 
 void LoggingInit(void) {
 	//if ( executionState == EXECUTION_STATE_POWER_ON || executionState == EXECUTION_STATE_POWER_RESET) {
-	//volatile uint16_t mask = LOG_BUF_MASK;
 		int i = 0;
 		while(i < LOG_BUF_SIZE) log_buf[i++] = 0;
-		log_last = LOG_BUF_FRAME_SIZE;
-		log_last_seq_num = 0xFF;
-		log_read_num = 0;
+		for (i = 0; i < LOG_CLASSES_NUM; i++) {
+			log_rate[i].refill = 0;
+			log_rate[i].suppressed = 0;
+			log_rate[i].tokens = LOG_RATE_BURST;
+		}
+		log_head = 0;
+		log_tail = 0;
+		log_records = 0;
+		log_read = 0;
+		log_unread = 0;
+		log_frame_valid = 0;
+		log_lost = 0;
 
 		uint8_t cfg = 0xFF;
 		if (NvReadVariableU8(LOG_CONFIG_NV_ADDR, (uint8_t*)&cfg) != NV_READ_VARIABLE_SUCCESS ) {
@@ -70,45 +305,82 @@ void LoggingInit(void) {
 			log_config = ~cfg;
 		}
 	//}
+}
+
+// Drain frame: records bytes count, flags (bit0 more unread records, bit1 unread records lost),
+// time of first record as 4 bytes seconds since 2000-01-01 and 1 byte 1/256 s, followed by whole records
+static void LoggingReadFrame(uint8_t data[], uint16_t *len) {
+	uint16_t n = LOG_DRAIN_HEADER_LEN;
+	uint16_t recLen;
+	uint16_t i;
+
+	for (i = 0; i < log_drain_len; i++) data[i] = 0;
+
+	log_frame_read = log_read;
+	log_frame_unread = log_unread;
+	log_frame_time = log_read_time;
+	log_frame_lost = log_lost;
+	log_frame_valid = log_unread != 0;
+
+	data[2] = log_read_time.sec;
+	data[3] = log_read_time.sec >> 8;
+	data[4] = log_read_time.sec >> 16;
+	data[5] = log_read_time.sec >> 24;
+	data[6] = log_read_time.sub;
 
-	log_last &= LOG_BUF_MASK;
+	while (log_unread) {
+		recLen = LoggingRecordTime(log_read, NULL);
+		if (n + recLen > log_drain_len) break;
+		for (i = 0; i < recLen; i++) data[n + i] = log_buf[log_read + i];
+		n += recLen;
+
+		log_unread--;
+		if (log_unread) {
+			log_read = LoggingNextRecord(log_read, recLen);
+			LoggingRecordTime(log_read, &log_read_time);
+		} else {
+			log_read = log_head;
+		}
+	}
+
+	data[0] = n - LOG_DRAIN_HEADER_LEN;
+	data[1] = (log_unread ? 0x01 : 0) | (log_lost ? 0x02 : 0);
+	log_lost = 0;
+	*len = log_drain_len;
 }
 
 void LoggingReadMessageCmd(uint8_t data[], uint16_t *len) {
-	*len = LOG_MSG_LEN;
+	uint32_t primask;
 
 	if (log_config == 0 || log_read_flag == 1) {
 		int i = LOG_MSG_LEN;
 		while(i--) data[i] = 0;
 		data[2] = 0x01;
 		data[3] = log_config;
-		return;
-	}
-	if (log_read_num >= LOG_MAX_MESSAGES || log_buf[0] == 0) {
-		// NO MORE messages to read, send empty buffer so host is notified
-		int i = LOG_MSG_LEN;
-		while(i--) data[i] = 0;
-
 		*len = LOG_MSG_LEN;
-		log_read_num = 0;
 		return;
 	}
-	//data[0] = log_last_seq_num - log_read_num; // sequence number of currently read message
-	uint8_t *pBuf = &log_buf[(log_last+(uint16_t)log_read_num*LOG_BUF_FRAME_SIZE)&LOG_BUF_MASK]; // Get pointer to frame
 
-	pBuf ++; // skip first byte
-	int i = 0;
-	while(i < LOG_MSG_LEN) {
-		data[i] = pBuf[i]; // copy frame to message buffer
-		i++;
-	}
-
-	 log_read_num++;
+	primask = __get_PRIMASK();
+	__disable_irq();
+	LoggingReadFrame(data, len);
+	__set_PRIMASK(primask);
 }
 
+// data[0]: 0 - rewind read cursor to oldest record, 1 - write enable configuration data[1], 2 - read configuration,
+// 3 - set drain frame length data[1], 4 - repeat last drain frame
 int8_t LoggingWriteConfigCmd(uint8_t data[], uint16_t len) {
+	uint32_t primask;
+
 	if (data[0] == 0) {
-		log_read_num = 0; // reset read sequence number
+		primask = __get_PRIMASK();
+		__disable_irq();
+		log_read = log_tail;
+		log_unread = log_records;
+		log_read_time = log_tail_time;
+		log_lost = 0;
+		log_frame_valid = 0;
+		__set_PRIMASK(primask);
 		log_read_flag = 0;
 		return 0;
 	}
@@ -129,6 +401,32 @@ int8_t LoggingWriteConfigCmd(uint8_t data[], uint16_t len) {
 		log_read_flag = 1;
 		return 0;
 	}
+	if (data[0] == 0x03) {
+		log_read_flag = 0;
+		if (len < 2 || data[1] < LOG_DRAIN_MIN_LEN || data[1] > LOG_DRAIN_MAX_LEN) return 1;
+		log_drain_len = data[1];
+		log_frame_valid = 0;
+		return 0;
+	}
+	if (data[0] == 0x04) {
+		primask = __get_PRIMASK();
+		__disable_irq();
+		if (log_frame_valid == 1) {
+			log_read = log_frame_read;
+			log_unread = log_frame_unread;
+			log_read_time = log_frame_time;
+			log_lost = log_frame_lost;
+		} else if (log_frame_valid == 2) {
+			log_read = log_tail;
+			log_unread = log_records;
+			log_read_time = log_tail_time;
+			log_lost = 1;
+		}
+		log_frame_valid = 0;
+		__set_PRIMASK(primask);
+		log_read_flag = 0;
+		return 0;
+	}
 	log_read_flag = 0;
 	return 0;
 }
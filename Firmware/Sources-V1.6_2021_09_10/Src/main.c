@@ -45,10 +45,18 @@
 #include "time_count.h"
 #include "load_current_sense.h"
 #include "rtc_ds1339_emu.h"
+#include "rtc_calibration.h"
 #include "power_management.h"
 #include "io_control.h"
 #include "execution.h"
 #include "logging.h"
+#include "energy_accounting.h"
+#include "power_policy.h"
+#include "power_stats.h"
+#include "flash_log.h"
+#include "trace.h"
+#include "io_log.h"
+#include "io_counter.h"
 
 #define OWN1_I2C_ADDRESS		0x14
 #define OWN2_I2C_ADDRESS		0x68
@@ -84,6 +92,7 @@ TIM_HandleTypeDef htim15;
 TIM_HandleTypeDef htim17;
 
 uint8_t resetStatus = 0;
+static uint8_t mcuResetFlags = 0; // RCC reset flags, bits 24-31 of RCC_CSR
 
 /* USER CODE BEGIN PV */
 /* Private variables ---------------------------------------------------------*/
@@ -129,7 +138,7 @@ void MemInit(uint8_t *buffer, uint8_t val, int32_t size) {
 
 #if defined LOGGING
 __STATIC_INLINE void LOG_PM_MCU_RESET_EVENT() {
-	uint8_t *buf = LoggingInitMessage(MCU_RESET);
+	uint8_t *buf = LoggingInitMessage(MCU_RESET, 13);
 	if (buf == NULL) 	return;
 	switch(executionState) {
 		case EXECUTION_STATE_NORMAL:
@@ -180,6 +189,34 @@ __STATIC_INLINE void LOG_PM_MCU_RESET_EVENT() {
 #define LOG_PM_MCU_RESET_EVENT()
 #endif
 
+__STATIC_INLINE void FLASH_LOG_MCU_RESET_EVENT() {
+	uint8_t payload[FLASH_LOG_PAYLOAD_LEN];
+	switch(executionState) {
+		case EXECUTION_STATE_NORMAL:
+			payload[0] = 0;
+			break;
+		case EXECUTION_STATE_POWER_ON:
+			payload[0] = 1;
+			break;
+		case EXECUTION_STATE_POWER_RESET:
+			payload[0] = 2;
+			break;
+		case EXECUTION_STATE_UPDATE:
+			payload[0] = 3;
+			break;
+		case EXECUTION_STATE_CONFIG_RESET:
+			payload[0] = 4;
+			break;
+		default:
+			payload[0] = 0xff;
+			break;
+	}
+	payload[1] = mcuResetFlags;
+	payload[2] = batteryRsoc >> 2;
+	payload[3] = batteryVoltage < 255 * 20 ? batteryVoltage / 20 : 255;
+	FlashLogPut(FLASH_LOG_MCU_RESET, payload);
+}
+
 typedef  void (*pFunction)(void);
 pFunction Jump_To_Start;
 void ButtonDualLongPressEventCb(void) {
@@ -198,25 +235,41 @@ void ButtonDualLongPressEventCb(void) {
 }
 
 uint8_t extiFlag = 0;
+static volatile uint8_t stopWakeupSources = 0; // bit per PowerStatsWakeCause_T, collected during stop mode
+static volatile uint8_t stopIoEdgeCounted = 0; // IO2 edge only counted by pulse counter during stop mode
 void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin) {
   if (GPIO_Pin == GPIO_PIN_0)
   {
 	  // CH_INT
 	  chargerInterruptFlag = 1;
 	  extiFlag = 1;
+	  stopWakeupSources |= 0x01 << POWER_STATS_WAKE_CHARGER;
   } else if (GPIO_Pin == GPIO_PIN_7)
   {
-	  // I2C SDA
-	  extiFlag = 2;
+	  // I2C SDA in stop mode, IO1 heartbeat input otherwise
+	  if (IoEdgeEvent(1)) {
+		  extiFlag = 2;
+		  stopWakeupSources |= 0x01 << POWER_STATS_WAKE_I2C;
+	  }
   } else if (GPIO_Pin == GPIO_PIN_8) {
-	  extiFlag = 4;
-	  ioWakeupEvent = 1;
+	  if (IoEdgeEvent(2)) {
+		  extiFlag = 4;
+		  stopWakeupSources |= 0x01 << POWER_STATS_WAKE_IO;
+	  } else {
+		  stopIoEdgeCounted = 1;
+	  }
   } else {
 	  // SW1, SW2, SW3
 	  extiFlag = 3;
+	  stopWakeupSources |= 0x01 << POWER_STATS_WAKE_BUTTON;
+	  ButtonEdgeCb(GPIO_Pin);
   }
 }
 
+void HAL_RTCEx_WakeUpTimerEventCallback(RTC_HandleTypeDef *hrtc) {
+	stopWakeupSources |= 0x01 << POWER_STATS_WAKE_RTC_TIMER;
+}
+
 static uint16_t i2cAddrMatchCode = 0;
 volatile static uint8_t i2cTransferDirection = 0;
 static int16_t readCmdCode = 0;
@@ -275,7 +328,7 @@ void HAL_I2C_AddrCallback(I2C_HandleTypeDef *hi2c, uint8_t TransferDirection, ui
 		slaveTransmitBuffer[0]=readCmdCode;
 
 		if (AddrMatchCode == hi2c->Init.OwnAddress1 ) {
-			if (readCmdCode >= 0x80 && readCmdCode <= 0x8F) {
+			if (readCmdCode >= 0x80 && readCmdCode < 0x80 + RTC_MAP_LEN) {
 				RtcDs1339ProcessRequest(I2C_DIRECTION_RECEIVE, readCmdCode - 0x80, slaveTransmitBuffer, &dataLen);
 				RtcSetPointer(readCmdCode - 0x80 + dataLen);
 			} else {
@@ -283,7 +336,7 @@ void HAL_I2C_AddrCallback(I2C_HandleTypeDef *hi2c, uint8_t TransferDirection, ui
 			}
 			tstFlagi2c=11;
 		} else {
-			if ( readCmdCode <= 0x0F ) {
+			if ( readCmdCode < RTC_MAP_LEN ) {
 				RtcDs1339ProcessRequest(I2C_DIRECTION_RECEIVE, readCmdCode, slaveTransmitBuffer, &dataLen);
 				RtcSetPointer(readCmdCode + dataLen);
 			} else {
@@ -310,7 +363,7 @@ void HAL_I2C_ListenCpltCallback(I2C_HandleTypeDef *hi2c)
 		readCmdCode = aSlaveReceiveBuffer[0];
 		if ( dataLen > 1) {
 			if (i2cAddrMatchCode == (hi2c->Init.OwnAddress1 >>1)) {
-				if (readCmdCode >= 0x80 && readCmdCode <= 0x8F) {
+				if (readCmdCode >= 0x80 && readCmdCode < 0x80 + RTC_MAP_LEN) {
 					dataLen -= 1; // first is command
 					RtcDs1339ProcessRequest(I2C_DIRECTION_TRANSMIT, readCmdCode - 0x80, aSlaveReceiveBuffer + 1, &dataLen);
 				} else {
@@ -318,7 +371,7 @@ void HAL_I2C_ListenCpltCallback(I2C_HandleTypeDef *hi2c)
 					commandReceivedFlag = 1;
 				}
 			} else {
-				if ( readCmdCode <= 0x0F ) {
+				if ( readCmdCode < RTC_MAP_LEN ) {
 					// rtc emulation range
 					dataLen -= 1; // first is command
 					RtcDs1339ProcessRequest(I2C_DIRECTION_TRANSMIT, readCmdCode, aSlaveReceiveBuffer + 1, &dataLen);
@@ -484,6 +537,16 @@ eSleepModeStatus eSleepStatus;
     }
 }
 #endif
+
+static void PowerStatsCountWakeupSources(void) {
+	uint8_t i;
+	if (alarmEventFlag) stopWakeupSources |= 0x01 << POWER_STATS_WAKE_RTC_ALARM;
+	if (!stopWakeupSources) stopWakeupSources = 0x01 << POWER_STATS_WAKE_OTHER;
+	for (i = 0; i < POWER_STATS_WAKE_NUM; i++) {
+		if (stopWakeupSources & (0x01 << i)) PowerStatsWakeup(i);
+	}
+}
+
 void WaitInterrupt() {
 
 	commandReceivedFlag = 0;
@@ -498,12 +561,23 @@ void WaitInterrupt() {
 			Error_Handler();
 		}
 
+		IoControlStopEntry();
 		i2c_GPIO_InitStruct.Pin = GPIO_PIN_7;
 		i2c_GPIO_InitStruct.Mode = GPIO_MODE_IT_FALLING;
 		i2c_GPIO_InitStruct.Pull = GPIO_NOPULL;
 	    HAL_GPIO_Init(GPIOB, &i2c_GPIO_InitStruct);
 
-		HAL_PWR_EnterSTOPMode(PWR_MAINREGULATOR_ON, PWR_STOPENTRY_WFI);
+		stopWakeupSources = 0;
+		IoCounterStopEntry();
+		for (;;) {
+			stopIoEdgeCounted = 0;
+			PowerStatsStopEntry();
+			HAL_PWR_EnterSTOPMode(PWR_MAINREGULATOR_ON, PWR_STOPENTRY_WFI);
+			// wake-up by pulse counter edge only, no need to restart peripherals
+			if (!stopIoEdgeCounted || stopWakeupSources || alarmEventFlag) break;
+			PowerStatsWakeup(POWER_STATS_WAKE_IO_COUNTER);
+		}
+		PowerStatsCountWakeupSources();
 		//HAL_PWR_EnterSLEEPMode(PWR_MAINREGULATOR_ON, PWR_SLEEPENTRY_WFI);
 
 		i2c_GPIO_InitStruct.Pin       = GPIO_PIN_7;
@@ -512,6 +586,7 @@ void WaitInterrupt() {
 		i2c_GPIO_InitStruct.Speed     = GPIO_SPEED_FREQ_HIGH;
 		i2c_GPIO_InitStruct.Alternate = GPIO_AF1_I2C1;
 		HAL_GPIO_Init(GPIOB, &i2c_GPIO_InitStruct);
+		IoControlStopExit();
 		//DelayUs(1000);
 		HAL_RTCEx_DeactivateWakeUpTimer(&hrtc);
 
@@ -628,6 +703,7 @@ int main(void)
 			executionState = EXECUTION_STATE_UPDATE;
 		} // else if (__HAL_RCC_GET_FLAG(RCC_FLAG_IWDGRST) {
 	}
+	mcuResetFlags = RCC->CSR >> 24;
 	__HAL_RCC_CLEAR_RESET_FLAGS();
 
 	if ( executionState == EXECUTION_STATE_NORMAL ) {
@@ -643,6 +719,8 @@ int main(void)
 
 	NvInit();
 
+	FlashLogInit();
+
 	// Configure the system clock
 	SystemClock_Config();
 
@@ -698,7 +776,12 @@ int main(void)
 	LedInit();
 	ButtonInit();
 	RtcInit();
+	RtcCalibrationInit();
 	IoControlInit();
+	EnergyAccountingInit();
+	PowerPolicyInit();
+	PowerStatsInit();
+	TraceInit();
 
 	NvSetDataInitialized();
 #if defined LOGGING
@@ -728,6 +811,7 @@ int main(void)
 	HAL_I2C_EnableListen_IT(&hi2c1);
 
 	LOG_PM_MCU_RESET_EVENT();
+	FLASH_LOG_MCU_RESET_EVENT();
 
 	executionState = EXECUTION_STATE_NORMAL; // after initialization indicate it for future wd resets
 
@@ -761,6 +845,16 @@ int main(void)
 			ButtonTask();
 			LoadCurrentSenseTask();
 			PowerManagementTask();
+			EnergyAccountingTask();
+			PowerPolicyTask();
+			IoControlTask();
+			IoLogTask();
+			NvTask();
+			FlashLogTask();
+			TraceTask();
+#if defined LOGGING
+			LoggingTask();
+#endif
 
 		//}
 		if ( (hi2c2.ErrorCode&(HAL_I2C_ERROR_TIMEOUT | HAL_I2C_ERROR_BERR | HAL_I2C_ERROR_ARLO)) || hi2c2.State != HAL_I2C_STATE_READY || hi2c2.XferCount) {
@@ -774,19 +868,25 @@ int main(void)
 			chargerI2cErrorCounter = 1;
 		}
 
+		uint16_t lowPowerRefuse = 0;
+		if ( !((GetLoadCurrent() <= 50 ) || (Get5vIoVoltage() < 4600 && !POW_VSYS_OUTPUT_EN_STATUS())) ) lowPowerRefuse |= 0x01 << LOW_POWER_REFUSE_LOAD;
+		if ( MS_TIME_COUNT(lastHostCommandTimer) <= 5000 ) lowPowerRefuse |= 0x01 << LOW_POWER_REFUSE_HOST_COMMAND;
+		if ( MS_TIME_COUNT(lastWakeupTimer) <= 20000 ) lowPowerRefuse |= 0x01 << LOW_POWER_REFUSE_WAKEUP;
+		if ( chargerStatus != CHG_NO_VALID_SOURCE ) lowPowerRefuse |= 0x01 << LOW_POWER_REFUSE_CHARGER;
+		if ( IsButtonActive() ) lowPowerRefuse |= 0x01 << LOW_POWER_REFUSE_BUTTON;
+		if ( TraceIsSampling() ) lowPowerRefuse |= 0x01 << LOW_POWER_REFUSE_TRACE;
+		if ( IoLogIsSampling() ) lowPowerRefuse |= 0x01 << LOW_POWER_REFUSE_IO_LOG;
+		if ( IoCounterIsCapturing() ) lowPowerRefuse |= 0x01 << LOW_POWER_REFUSE_IO_COUNTER;
+
 		if ( NEED_EVENT_POLL() ) {
 			state = STATE_RUN;
-		} else if ( ((GetLoadCurrent() <= 50 ) || (Get5vIoVoltage() < 4600 && !POW_VSYS_OUTPUT_EN_STATUS()) )
-				&& MS_TIME_COUNT(lastHostCommandTimer) > 5000
-				&& MS_TIME_COUNT(lowPowerDealyTimer) >= 22
-				&& MS_TIME_COUNT(lastWakeupTimer) > 20000
-				&& chargerStatus == CHG_NO_VALID_SOURCE
-				&& !IsButtonActive()
-				) {
+			lowPowerRefuse |= 0x01 << LOW_POWER_REFUSE_EVENT_POLL;
+		} else if ( !lowPowerRefuse && MS_TIME_COUNT(lowPowerDealyTimer) >= 22 ) {
 			state = STATE_LOWPOWER;
 		} else {
 			state = STATE_NORMAL;
 		}
+		PowerStatsUpdate(state, lowPowerRefuse);
 
 		if ( extiFlag == 2 ) {
 			MS_TIME_COUNTER_INIT(lastHostCommandTimer);
@@ -1333,13 +1433,13 @@ static void MX_GPIO_Init(void)
 
   // Configure GPIO pins : PB2, PB12 as button inputs
   GPIO_InitStruct.Pin = GPIO_PIN_2 | GPIO_PIN_12;
-  GPIO_InitStruct.Mode = GPIO_MODE_IT_RISING;//GPIO_MODE_INPUT;
+  GPIO_InitStruct.Mode = GPIO_MODE_IT_RISING_FALLING; // both edges are timestamped for button decoding
   GPIO_InitStruct.Pull = GPIO_PULLDOWN;
   HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
 
   // Configure GPIO pins : PC13 - SW2(power button)
   GPIO_InitStruct.Pin = GPIO_PIN_13;
-  GPIO_InitStruct.Mode = GPIO_MODE_IT_RISING;//GPIO_MODE_INPUT;
+  GPIO_InitStruct.Mode = GPIO_MODE_IT_RISING_FALLING;
   GPIO_InitStruct.Pull = GPIO_PULLDOWN;
   HAL_GPIO_Init(GPIOC, &GPIO_InitStruct);
 
@@ -5,11 +5,34 @@
  *      Author: milan
  */
 #include "nv.h"
+#include "time_count.h"
+
+#define NV_SAVE_STATUS_FLUSH	0x01
+#define NV_SAVE_STATUS_RESET	0x80
 
-static int16_t nvSaveParmeterReq = -1;
-static uint16_t nvSaveParmeterValue = 0xFFFF;
 uint16_t nvInitFlag = 0xFFFF;
 
+static uint16_t nvSaveQueueAddr[NV_SAVE_QUEUE_SIZE];
+static uint16_t nvSaveQueueData[NV_SAVE_QUEUE_SIZE];
+static uint8_t nvSaveQueueHead = 0;
+static uint8_t nvSaveQueueCount = 0;
+static uint8_t nvSaveQueueMaxCount = 0;
+static uint8_t nvSaveFlushReq = 0;
+static uint16_t nvSaveDropped = 0;
+static uint16_t nvSaveFailed = 0;
+static uint16_t nvSaveLastFailedAddr = 0xFFFF;
+static uint32_t nvSaveTimer;
+
+// Transaction staging of main loop and of interrupt handlers, transactions in interrupt context
+// are used by I2C command handlers only and do not nest
+#define NV_TRANSACTION_CONTEXTS	2
+#define NV_TRANSACTION_CONTEXT()	(__get_IPSR() != 0)
+
+static uint16_t nvTransactionAddr[NV_TRANSACTION_CONTEXTS][EE_TRANSACTION_MAX_VARS];
+static uint16_t nvTransactionData[NV_TRANSACTION_CONTEXTS][EE_TRANSACTION_MAX_VARS];
+static uint8_t nvTransactionCount[NV_TRANSACTION_CONTEXTS] = {0};
+static uint8_t nvTransactionOverflow[NV_TRANSACTION_CONTEXTS] = {0};
+
 uint16_t VirtAddVarTab[NV_VAR_NUM] = {
 	NV_VAR_LIST
 };
@@ -22,6 +45,8 @@ void NvInit(void){
 	EE_Init();
 
 	EE_ReadVariable(NV_START_ID, &nvInitFlag);
+
+	MS_TIME_COUNTER_INIT(nvSaveTimer);
 }
 
 void NvEreaseAllVariables(void) {
@@ -44,15 +69,102 @@ void NvSetDataInitialized(void) {
 
 void NvTask(void) {
 
-	if (nvSaveParmeterReq >= 0) {
-		EE_WriteVariable(BAT_PROFILE_NV_ADDR, nvSaveParmeterValue);
-		nvSaveParmeterReq = -1;
+	uint16_t stored, addr, data;
+	uint32_t primask;
+
+	// background eeprom page transfer and erase
+	EE_Task();
+
+	if (nvSaveQueueCount == 0) {
+		nvSaveFlushReq = 0;
+		return;
+	}
+
+	// one queued save per period, unless host requested flush
+	if (!nvSaveFlushReq && MS_TIME_COUNT(nvSaveTimer) < NV_SAVE_PERIOD_MS) return;
+	MS_TIME_COUNTER_INIT(nvSaveTimer);
+
+	// requests come from interrupt handlers, entry is taken out before it is written so new
+	// request for the same variable is queued again instead of replacing written value
+	primask = __get_PRIMASK();
+	__disable_irq();
+	addr = nvSaveQueueAddr[nvSaveQueueHead];
+	data = nvSaveQueueData[nvSaveQueueHead];
+	nvSaveQueueHead = (nvSaveQueueHead + 1) % NV_SAVE_QUEUE_SIZE;
+	nvSaveQueueCount--;
+	__set_PRIMASK(primask);
+
+	if (EE_ReadVariable(addr, &stored) != 0 || stored != data) {
+		if (EE_WriteVariable(addr, data) != HAL_OK) {
+			primask = __get_PRIMASK();
+			__disable_irq();
+			nvSaveFailed++;
+			nvSaveLastFailedAddr = addr;
+			__set_PRIMASK(primask);
+		}
 	}
 }
 
-void NvSaveParameterReq(NvVarId_T id, uint16_t value) {
-	nvSaveParmeterReq = id;
-	nvSaveParmeterValue = value;
+// Queue variable save to be done from NvTask, request for already queued variable replaces its value
+// Returns 0 on success, 1 if queue is full and request is dropped
+uint8_t NvSaveParameterReq(NvVarId_T id, uint16_t value) {
+	uint32_t primask = __get_PRIMASK();
+	uint8_t i, k, result = 0;
+
+	__disable_irq();
+	for (i = 0; i < nvSaveQueueCount; i++) {
+		k = (nvSaveQueueHead + i) % NV_SAVE_QUEUE_SIZE;
+		if (nvSaveQueueAddr[k] == id) {
+			nvSaveQueueData[k] = value;
+			__set_PRIMASK(primask);
+			return 0;
+		}
+	}
+
+	if (nvSaveQueueCount >= NV_SAVE_QUEUE_SIZE) {
+		nvSaveDropped++;
+		result = 1;
+	} else {
+		k = (nvSaveQueueHead + nvSaveQueueCount) % NV_SAVE_QUEUE_SIZE;
+		nvSaveQueueAddr[k] = id;
+		nvSaveQueueData[k] = value;
+		nvSaveQueueCount++;
+		if (nvSaveQueueCount > nvSaveQueueMaxCount) nvSaveQueueMaxCount = nvSaveQueueCount;
+	}
+	__set_PRIMASK(primask);
+	return result;
+}
+
+// data[0]: bit0 - write all queued saves without rate limit, bit7 - reset statistics
+void NvSaveStatusSetCmd(uint8_t data[], uint16_t len) {
+	uint32_t primask;
+
+	if (len < 1) return;
+	if (data[0] & NV_SAVE_STATUS_FLUSH) nvSaveFlushReq = 1;
+	if (data[0] & NV_SAVE_STATUS_RESET) {
+		primask = __get_PRIMASK();
+		__disable_irq();
+		nvSaveQueueMaxCount = nvSaveQueueCount;
+		nvSaveDropped = 0;
+		nvSaveFailed = 0;
+		nvSaveLastFailedAddr = 0xFFFF;
+		__set_PRIMASK(primask);
+	}
+}
+
+// queue depth with eeprom writes waiting for room, max depth, queue size, dropped requests, failed writes,
+// last failed address, 16 bit little endian
+void NvSaveStatusGetCmd(uint8_t data[], uint16_t *len) {
+	data[0] = nvSaveQueueCount + EE_PendingWrites();
+	data[1] = nvSaveQueueMaxCount;
+	data[2] = NV_SAVE_QUEUE_SIZE;
+	data[3] = nvSaveDropped;
+	data[4] = nvSaveDropped >> 8;
+	data[5] = nvSaveFailed;
+	data[6] = nvSaveFailed >> 8;
+	data[7] = nvSaveLastFailedAddr;
+	data[8] = nvSaveLastFailedAddr >> 8;
+	*len = 9;
 }
 
 uint16_t NvReadVariableU8(uint16_t VirtAddress, uint8_t *pVar) {
@@ -70,3 +182,46 @@ uint16_t NvReadVariableU8(uint16_t VirtAddress, uint8_t *pVar) {
 		return succ;
 	}
 }
+
+void NvTransactionBegin(void) {
+	uint8_t c = NV_TRANSACTION_CONTEXT();
+	nvTransactionCount[c] = 0;
+	nvTransactionOverflow[c] = 0;
+}
+
+// Stage variable for commit, variables equal to stored value are skipped
+void NvTransactionStage(uint16_t VirtAddress, uint16_t var) {
+	uint8_t c = NV_TRANSACTION_CONTEXT();
+	uint16_t stored;
+	uint8_t i;
+
+	for (i = 0; i < nvTransactionCount[c]; i++) {
+		if (nvTransactionAddr[c][i] == VirtAddress) {
+			nvTransactionData[c][i] = var;
+			return;
+		}
+	}
+
+	if (EE_ReadVariable(VirtAddress, &stored) == 0 && stored == var) return;
+
+	if (nvTransactionCount[c] >= EE_TRANSACTION_MAX_VARS) {
+		nvTransactionOverflow[c] = 1;
+		return;
+	}
+
+	nvTransactionAddr[c][nvTransactionCount[c]] = VirtAddress;
+	nvTransactionData[c][nvTransactionCount[c]] = var;
+	nvTransactionCount[c]++;
+}
+
+// Writes staged variables in one pass, after power loss either all or none are stored
+uint16_t NvTransactionCommit(void) {
+	uint8_t c = NV_TRANSACTION_CONTEXT();
+	uint16_t status = PAGE_FULL;
+	if (!nvTransactionOverflow[c]) {
+		status = EE_WriteVariables(nvTransactionAddr[c], nvTransactionData[c], nvTransactionCount[c]);
+	}
+	nvTransactionCount[c] = 0;
+	nvTransactionOverflow[c] = 0;
+	return status;
+}
@@ -14,6 +14,9 @@
 #include "button.h"
 //#include "led.h"
 #include "logging.h"
+#include "flash_log.h"
+#include "analog.h"
+#include "load_current_sense.h"
 
 #if defined(RTOS_FREERTOS)
 #include "cmsis_os.h"
@@ -49,14 +52,50 @@ uint32_t delayedPowerOffCounter __attribute__((section("no_init")));
 
 uint16_t watchdogConfig __attribute__((section("no_init")));
 uint32_t watchdogExpirePeriod __attribute__((section("no_init"))); // 0 - disabled, 1-255 expiration time minutes
+uint16_t watchdogPeriodSec __attribute__((section("no_init"))); // stored period in seconds, 0 - watchdogConfig minutes apply
 uint32_t watchdogTimer __attribute__((section("no_init")));
 uint8_t watchdogExpiredFlag __attribute__((section("no_init")));
+uint8_t watchdogExtConfig __attribute__((section("no_init"))); // bit0 - refreshed by heartbeat input only
+uint32_t watchdogWarnTime __attribute__((section("no_init"))); // ms before expiration to raise warning, 0 - disabled
+uint32_t watchdogHeartbeatTimer __attribute__((section("no_init")));
+uint8_t watchdogWarningFlag __attribute__((section("no_init")));
+
+// watchdog expiration is counted from last host command, or from last heartbeat edge in heartbeat only mode
+#define WATCHDOG_BASE_TIMER()	((watchdogExtConfig & 0x01) ? watchdogHeartbeatTimer : lastHostCommandTimer)
 
 uint8_t rtcWakeupEventFlag __attribute__((section("no_init")));
 uint8_t powerOffBtnEventFlag __attribute__((section("no_init")));
 
 uint8_t ioWakeupEvent = 0;
 
+typedef struct {
+	uint16_t count;
+	uint16_t last; // ms
+	uint16_t min; // ms
+	uint16_t max; // ms
+	uint32_t sum; // ms
+} WakeupLatency_T;
+
+static WakeupLatency_T wakeupLatency[WAKEUP_TRIGGER_NUM] __attribute__((section("no_init")));
+static uint32_t wakeupTriggerTime[WAKEUP_TRIGGER_NUM] __attribute__((section("no_init")));
+static uint8_t wakeupTriggerPending __attribute__((section("no_init"))); // bit per trigger posted and waiting for 5V turn on
+static uint8_t wakeupLatencySel = 0;
+static uint8_t wakeupOnChargeLevel = 0; // last state of wake-up on charge condition, trigger is posted on its rising edge
+
+// 5V boost is on or Pi supplies 5V GPIO rail, host may be running
+#define HOST_IS_POWERED()	(POW_5V_BOOST_EN_STATUS() || power5vIoStatus != POW_SOURCE_NOT_PRESENT)
+
+static void PowerMngmtResetWakeupLatency(void) {
+	uint8_t i;
+	for (i = 0; i < WAKEUP_TRIGGER_NUM; i++) {
+		wakeupLatency[i].count = 0;
+		wakeupLatency[i].last = 0;
+		wakeupLatency[i].min = 0xFFFF;
+		wakeupLatency[i].max = 0;
+		wakeupLatency[i].sum = 0;
+	}
+}
+
 extern uint8_t resetStatus;
 
 extern uint8_t noBatteryTurnOn;
@@ -93,13 +132,32 @@ void PowerManagementInit(void) {
 			watchdogConfig  = 0;
 		}
 
+		if (EE_ReadVariable(WATCHDOG_PERIOD_SEC_NV_ADDR, &watchdogPeriodSec) != 0 || watchdogPeriodSec == 0xFFFF) {
+			watchdogPeriodSec = 0;
+		}
+
+		watchdogExtConfig = 0;
+		watchdogWarnTime = 0;
+		if (NvReadVariableU8(WATCHDOG_EXT_CONFIG_NV_ADDR, &watchdogExtConfig) == NV_READ_VARIABLE_SUCCESS) {
+			uint8_t warn = 0;
+			NvReadVariableU8(WATCHDOG_WARN_NV_ADDR, &warn);
+			watchdogWarnTime = warn * (uint32_t)1000;
+		} else {
+			watchdogExtConfig = 0;
+		}
+
 		delayedPowerOffCounter = 0;
 		watchdogExpirePeriod = 0;
 		watchdogTimer = 0;
 		watchdogExpiredFlag = 0;
+		watchdogWarningFlag = 0;
+		MS_TIME_COUNTER_INIT(watchdogHeartbeatTimer);
 		rtcWakeupEventFlag = 0;
 		ioWakeupEvent = 0;
 		powerOffBtnEventFlag = 0;
+
+		wakeupTriggerPending = 0;
+		PowerMngmtResetWakeupLatency();
 	}
 
 	MS_TIME_COUNTER_INIT(powerMngmtTaskMsCounter);
@@ -110,7 +168,8 @@ void PowerManagementInit(void) {
 }
 #if defined LOGGING
 __STATIC_INLINE void LOG_PM_WAKEUP_EVENT(uint8_t triggers) {
-	uint8_t *buf = LoggingInitMessage(WAKEUP_EVT);
+	FlashLogPutStatus(FLASH_LOG_WAKEUP, triggers);
+	uint8_t *buf = LoggingInitMessage(WAKEUP_EVT, 13);
 	if (buf == NULL) 	return;
 	buf[0] = triggers;
 
@@ -138,9 +197,65 @@ __STATIC_INLINE void LOG_PM_WAKEUP_EVENT(uint8_t triggers) {
 	buf[12] = curr>>8;
 }
 #else
-#define LOG_PM_WAKEUP_EVENT(triggers)
+#define LOG_PM_WAKEUP_EVENT(triggers) FlashLogPutStatus(FLASH_LOG_WAKEUP, triggers)
 #endif
 
+// Called from main loop and interrupts (RTC alarm, IO edge, pulse counter)
+void PowerMngmtPostWakeupEvent(WakeupTrigger_T trigger) {
+	uint32_t primask;
+
+	if (trigger >= WAKEUP_TRIGGER_NUM) return;
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+	if (!(wakeupTriggerPending & (0x01 << trigger))) {
+		// keep time of first trigger occurrence, repeated posts do not restart latency measurement
+		MS_TIME_COUNTER_INIT(wakeupTriggerTime[trigger]);
+		wakeupTriggerPending |= 0x01 << trigger;
+	}
+	__set_PRIMASK(primask);
+
+	if (trigger == WAKEUP_TRIGGER_RTC) {
+		rtcWakeupEventFlag = 1;
+	} else if (trigger == WAKEUP_TRIGGER_IO || trigger == WAKEUP_TRIGGER_POLICY) {
+		// power policy wake-up shares io wake-up path
+		ioWakeupEvent = 1;
+	}
+}
+
+// Called after host wake-up succeeded. Latency is recorded only when 5V was off and
+// is turned on by wake-up, reset or power cycle of powered host is not counted.
+static void PowerMngmtWakeupDone(uint8_t hostWasPowered) {
+	uint32_t primask;
+	uint32_t triggerTime[WAKEUP_TRIGGER_NUM];
+	uint8_t pending;
+	uint8_t i;
+
+	// take and clear posted triggers at once, trigger posted later starts new measurement
+	primask = __get_PRIMASK();
+	__disable_irq();
+	pending = wakeupTriggerPending;
+	for (i = 0; i < WAKEUP_TRIGGER_NUM; i++) triggerTime[i] = wakeupTriggerTime[i];
+	wakeupTriggerPending = 0;
+	__set_PRIMASK(primask);
+
+	if (hostWasPowered) return;
+
+	for (i = 0; i < WAKEUP_TRIGGER_NUM; i++) {
+		if (pending & (0x01 << i)) {
+			uint32_t t = MS_TIME_COUNT(triggerTime[i]);
+			uint16_t lat = t < 0xFFFF ? t : 0xFFFF;
+			wakeupLatency[i].last = lat;
+			if (lat < wakeupLatency[i].min) wakeupLatency[i].min = lat;
+			if (lat > wakeupLatency[i].max) wakeupLatency[i].max = lat;
+			if (wakeupLatency[i].count < 0xFFFF) {
+				wakeupLatency[i].count ++;
+				wakeupLatency[i].sum += lat;
+			}
+		}
+	}
+}
+
 int8_t ResetHost(void) {
 	if ( (POW_5V_BOOST_EN_STATUS() || power5vIoStatus != POW_SOURCE_NOT_PRESENT) && runPinInstallationStatus == RUN_PIN_INSTALLED ) {
 		Turn5vBoost(1);
@@ -200,14 +315,17 @@ int8_t ResetHost(void) {
 
 void PowerOnButtonEventCb(uint8_t b, ButtonEvent_T event) {
 	//if ( event == BUTTON_EVENT_SINGLE_PRESS ) {
-		if ( (!POW_5V_BOOST_EN_STATUS() && power5vIoStatus == POW_SOURCE_NOT_PRESENT)
+		uint8_t hostPowered = HOST_IS_POWERED();
+		if ( !hostPowered
 				|| (MS_TIME_COUNT(lastWakeupTimer) > 12000/*15000*/ && MS_TIME_COUNT(lastHostCommandTimer) > 11000)  ) {
 			LOG_PM_WAKEUP_EVENT(0x10);
+			PowerMngmtPostWakeupEvent(WAKEUP_TRIGGER_BUTTON);
 			if (ResetHost() == 0) {//if (ResetHost() == 0) {
 				wakeupOnCharge = 0xFFFF;
 				rtcWakeupEventFlag = 0;
 				ioWakeupEvent = 0;
 				delayedPowerOffCounter = 0;
+				PowerMngmtWakeupDone(hostPowered);
 			}
 		}
 		ButtonRemoveEvent(b);
@@ -239,7 +357,34 @@ void ButtonEventFuncPowerResetCb(uint8_t b, ButtonEvent_T event) {
 void PowerMngmtHostPollEvent(void) {
 	rtcWakeupEventFlag = 0;
 	ioWakeupEvent = 0;
-	watchdogTimer = watchdogExpirePeriod;
+	// host is running, triggers are consumed
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	wakeupTriggerPending = 0;
+	if (!(watchdogExtConfig & 0x01)) {
+		watchdogTimer = watchdogExpirePeriod;
+		watchdogWarningFlag = 0;
+	}
+	__set_PRIMASK(primask);
+}
+
+// Restarts watchdog expiration period from now. Timer is updated from main loop, I2C and EXTI
+// interrupts, read-modify-write is done with interrupts disabled.
+static void PowerMngmtWatchdogRestart(void) {
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	watchdogTimer = MS_TIME_COUNT(WATCHDOG_BASE_TIMER()) + watchdogExpirePeriod;
+	watchdogWarningFlag = 0;
+	__set_PRIMASK(primask);
+}
+
+// Called on heartbeat input edge, may be called from interrupt
+void PowerMngmtWatchdogHeartbeat(void) {
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	MS_TIME_COUNTER_INIT(watchdogHeartbeatTimer);
+	PowerMngmtWatchdogRestart();
+	__set_PRIMASK(primask);
 }
 
 #if defined(RTOS_FREERTOS)
@@ -291,50 +436,80 @@ static void PowerManagementTask(void *argument) {
 #else
 void PowerManagementTask(void) {
 
-	if (MS_TIME_COUNT(powerMngmtTaskMsCounter) >= 500) {
-		//LogPut(LOG_5VREG_ON);
-		MS_TIME_COUNTER_INIT(powerMngmtTaskMsCounter);
+	// Wake-up triggers are evaluated on every pass, so posted events are handled on the next loop iteration
+	volatile int isWakeupOnCharge = batteryRsoc >= wakeupOnCharge && CHARGER_IS_INPUT_PRESENT() && CHARGER_IS_BATTERY_PRESENT();
+	if (isWakeupOnCharge && !wakeupOnChargeLevel) {
+		PowerMngmtPostWakeupEvent(WAKEUP_TRIGGER_ON_CHARGE);
+	}
+	wakeupOnChargeLevel = isWakeupOnCharge;
 
-		volatile int isWakeupOnCharge = batteryRsoc >= wakeupOnCharge && CHARGER_IS_INPUT_PRESENT() && CHARGER_IS_BATTERY_PRESENT();
-		if ( 		( isWakeupOnCharge || rtcWakeupEventFlag || ioWakeupEvent) // there is wake-up trigger
-				&& 	!delayedPowerOffCounter // deny wake-up during shutdown
-				&& 	!delayedTurnOnFlag
-				&& 	( (MS_TIME_COUNT(lastHostCommandTimer) > 15000 && MS_TIME_COUNT(lastWakeupTimer) > 30000)
-						//|| (!POW_5V_BOOST_EN_STATUS() && power5vIoStatus == POW_SOURCE_NOT_PRESENT) //  Host is non powered
-		   ) ) {
+	uint8_t hostPowered = HOST_IS_POWERED();
+	if ( 		( isWakeupOnCharge || rtcWakeupEventFlag || ioWakeupEvent) // there is wake-up trigger
+			&& 	!delayedPowerOffCounter // deny wake-up during shutdown
+			&& 	!delayedTurnOnFlag
+			// Host without power is woken at once. Powered host may be running, it is reset only when
+			// it did not send command for 15s and not within 30s after last wake-up, while Pi boots
+			// and PiJuice service does not talk yet.
+			&& 	( !hostPowered || (MS_TIME_COUNT(lastHostCommandTimer) > 15000 && MS_TIME_COUNT(lastWakeupTimer) > 30000) )
+	   ) {
 
-			LOG_PM_WAKEUP_EVENT((isWakeupOnCharge&0x01) | ((rtcWakeupEventFlag<<1)&0x02) | ((ioWakeupEvent<<2)&0x04));
+		LOG_PM_WAKEUP_EVENT((isWakeupOnCharge&0x01) | ((rtcWakeupEventFlag<<1)&0x02) | ((ioWakeupEvent<<2)&0x04));
 
-			if ( ResetHost() == 0 ) { //if ( WakeUpHost() == 0 ) {
-				wakeupOnCharge = 0xFFFF;
-				rtcWakeupEventFlag = 0;
-				ioWakeupEvent = 0;
-				delayedPowerOffCounter = 0;
-
-				if (watchdogConfig) {
-					// activate watchdog after wake-up if watchdog config has restore flag
-					watchdogExpirePeriod = watchdogConfig * (uint32_t)60000;
-				    watchdogTimer = MS_TIME_COUNT(lastHostCommandTimer); //lastHostCommandTimer;
-				    watchdogTimer += watchdogExpirePeriod;
-				}
+		if ( ResetHost() == 0 ) { //if ( WakeUpHost() == 0 ) {
+			wakeupOnCharge = 0xFFFF;
+			rtcWakeupEventFlag = 0;
+			ioWakeupEvent = 0;
+			delayedPowerOffCounter = 0;
+
+			if (watchdogConfig) {
+				// activate watchdog after wake-up if watchdog config has restore flag, in unit period was set
+				watchdogExpirePeriod = watchdogPeriodSec ? watchdogPeriodSec * (uint32_t)1000 : watchdogConfig * (uint32_t)60000;
+				PowerMngmtWatchdogRestart();
 			}
 
+			PowerMngmtWakeupDone(hostPowered);
 		}
 
-		if (watchdogExpirePeriod && MS_TIME_COUNT(lastHostCommandTimer) > watchdogTimer) {
+	}
+
+	if (MS_TIME_COUNT(powerMngmtTaskMsCounter) >= 500) {
+		//LogPut(LOG_5VREG_ON);
+		MS_TIME_COUNTER_INIT(powerMngmtTaskMsCounter);
+
+		// heartbeat or host command interrupt may refresh timer between compare and update
+		uint32_t primask = __get_PRIMASK();
+		__disable_irq();
+		uint32_t watchdogElapsed = MS_TIME_COUNT(WATCHDOG_BASE_TIMER());
+		if (watchdogExpirePeriod && watchdogWarnTime && !watchdogWarningFlag
+				&& watchdogElapsed + watchdogWarnTime > watchdogTimer) {
+			// pre-reset warning, host can still refresh watchdog
+			watchdogWarningFlag = 1;
+		}
+		uint8_t watchdogExpired = watchdogExpirePeriod && watchdogElapsed > watchdogTimer;
+		if (watchdogExpired) {
+			watchdogTimer += watchdogExpirePeriod;
+			watchdogWarningFlag = 0;
+		}
+		__set_PRIMASK(primask);
+
+		if (watchdogExpired) {
 			LOG_PM_WAKEUP_EVENT(0x08);
 
+			PowerMngmtPostWakeupEvent(WAKEUP_TRIGGER_WATCHDOG);
+			hostPowered = HOST_IS_POWERED();
 			if ( ResetHost() == 0 ) {
 				wakeupOnCharge = 0xFFFF;
 				watchdogExpiredFlag = 1;
 				rtcWakeupEventFlag = 0;
 				ioWakeupEvent = 0;
 				delayedPowerOffCounter = 0;
+				PowerMngmtWakeupDone(hostPowered);
 			}
-			watchdogTimer += watchdogExpirePeriod;
 		}
 	}
 
+	// 5V stays off for 100ms in power cycle of powered host, rail has to drop for Pi to reset.
+	// Wake-up of host without power does not take this path.
 	if ( delayedTurnOnFlag && MS_TIME_COUNT(delayedTurnOnTimer) >= 100 ) {
 		Turn5vBoost(1);
 		delayedTurnOnFlag = 0;
@@ -414,6 +589,9 @@ void PowerMngmtConfigureWatchdogCmd(uint8_t data[], uint16_t len) {
 		watchdogConfig = d;
 		NvWriteVariableU8(WATCHDOG_CONFIGL_NV_ADDR, watchdogConfig);
 		NvWriteVariableU8(WATCHDOG_CONFIGH_NV_ADDR, watchdogConfig>>8);
+		// stored period in minutes replaces stored period in seconds
+		watchdogPeriodSec = 0;
+		EE_WriteVariable(WATCHDOG_PERIOD_SEC_NV_ADDR, 0);
 
 		if (NvReadVariableU8(WATCHDOG_CONFIGL_NV_ADDR, (uint8_t*)&watchdogConfig) != NV_READ_VARIABLE_SUCCESS
 		 || NvReadVariableU8(WATCHDOG_CONFIGH_NV_ADDR, (uint8_t*)&watchdogConfig+1) != NV_READ_VARIABLE_SUCCESS
@@ -427,12 +605,55 @@ void PowerMngmtConfigureWatchdogCmd(uint8_t data[], uint16_t len) {
 		}
 	} else {
 		watchdogExpirePeriod = d * (uint32_t)60000;
-		watchdogTimer = MS_TIME_COUNT(lastHostCommandTimer);
-		watchdogTimer += watchdogExpirePeriod;
+		PowerMngmtWatchdogRestart();
 	}
 
 }
 
+// data[0] bit0 - refreshed by heartbeat input only, bit7 - store flags and warning time to nv
+// data[1] warning time seconds before expiration, 0 - disabled
+// data[2-3] optional expiration period in seconds, activates watchdog with sub-minute resolution, 0 - no change.
+// With bit7 it is stored and used when watchdog with restore flag is activated after wake-up
+void PowerMngmtSetWatchdogExtConfigCmd(uint8_t data[], uint16_t len) {
+	if (len < 2) return;
+
+	watchdogExtConfig = data[0] & 0x01;
+	watchdogWarnTime = data[1] * (uint32_t)1000;
+	if (data[0] & 0x80) {
+		NvWriteVariableU8(WATCHDOG_EXT_CONFIG_NV_ADDR, watchdogExtConfig);
+		NvWriteVariableU8(WATCHDOG_WARN_NV_ADDR, data[1]);
+	}
+
+	if (len >= 4 && (data[2] || data[3])) {
+		watchdogExpirePeriod = (data[2] | ((uint32_t)data[3] << 8)) * 1000;
+		if (data[0] & 0x80) {
+			watchdogPeriodSec = data[2] | ((uint16_t)data[3] << 8);
+			EE_WriteVariable(WATCHDOG_PERIOD_SEC_NV_ADDR, watchdogPeriodSec);
+		}
+	}
+	// period restarts from now in both modes, as on heartbeat edge
+	PowerMngmtWatchdogHeartbeat();
+}
+
+void PowerMngmtGetWatchdogExtConfigCmd(uint8_t data[], uint16_t *len) {
+	uint32_t period = watchdogExpirePeriod / 1000;
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	uint32_t elapsed = MS_TIME_COUNT(WATCHDOG_BASE_TIMER());
+	uint32_t timer = watchdogTimer;
+	__set_PRIMASK(primask);
+	uint32_t remaining = (watchdogExpirePeriod && timer > elapsed) ? (timer - elapsed) / 1000 : 0;
+	if (period > 0xFFFF) period = 0xFFFF;
+	if (remaining > 0xFFFF) remaining = 0xFFFF;
+	data[0] = watchdogExtConfig | (watchdogWarningFlag << 6);
+	data[1] = watchdogWarnTime / 1000;
+	data[2] = period;
+	data[3] = period >> 8;
+	data[4] = remaining;
+	data[5] = remaining >> 8;
+	*len = 6;
+}
+
 void PowerMngmtGetWatchdogConfigurationCmd(uint8_t data[], uint16_t *len) {
 	if (watchdogConfig) {
 		uint16_t d = watchdogConfig;
@@ -440,7 +661,8 @@ void PowerMngmtGetWatchdogConfigurationCmd(uint8_t data[], uint16_t *len) {
 		data[0] = d;
 		data[1] = (d >> 8) | 0x80;
 	} else {
-		 uint16_t d = watchdogExpirePeriod / 60000;
+		 // sub-minute period set in seconds is rounded up, active watchdog does not read back as disabled
+		 uint16_t d = (watchdogExpirePeriod + 59999) / 60000;
 		 if (d >= 0x4000) d = (d >> 2) | 0x4000;
 		 data[0] = d;
 		 data[1] = d >> 8;
@@ -474,3 +696,35 @@ void PowerMngmtGetWakeupOnChargeCmd(uint8_t data[], uint16_t *len)  {
 
 	*len = 1;
 }
+
+void PowerMngmtSetWakeupLatencyCmd(uint8_t data[], uint16_t len) {
+	if (len < 1) return;
+
+	if (data[0] & 0x80) {
+		// reset statistics of all triggers
+		PowerMngmtResetWakeupLatency();
+	}
+
+	if ((data[0]&0x7F) < WAKEUP_TRIGGER_NUM) {
+		wakeupLatencySel = data[0]&0x7F;
+	}
+}
+
+void PowerMngmtGetWakeupLatencyCmd(uint8_t data[], uint16_t *len) {
+	WakeupLatency_T *lat = &wakeupLatency[wakeupLatencySel];
+	uint16_t avg = lat->count ? lat->sum / lat->count : 0;
+	uint16_t min = lat->count ? lat->min : 0;
+
+	data[0] = wakeupLatencySel;
+	data[1] = lat->count;
+	data[2] = lat->count >> 8;
+	data[3] = lat->last;
+	data[4] = lat->last >> 8;
+	data[5] = min;
+	data[6] = min >> 8;
+	data[7] = lat->max;
+	data[8] = lat->max >> 8;
+	data[9] = avg;
+	data[10] = avg >> 8;
+	*len = 11;
+}
@@ -0,0 +1,230 @@
+/*
+ * power_policy.c
+ *
+ *  Created on: 19.10.2026.
+ */
+
+#include "power_policy.h"
+#include "nv.h"
+#include "time_count.h"
+#include "battery.h"
+#include "fuel_gauge_lc709203f.h"
+#include "load_current_sense.h"
+#include "power_source.h"
+#include "power_management.h"
+#include "button.h"
+#include "led.h"
+
+#define POLICY_RULE_SOURCE(r)	((r).condition & 0x0F)
+#define POLICY_RULE_OPERATOR(r)	(((r).condition >> 4) & 0x07)
+#define POLICY_RULE_IS_CHAINED(r)	((r).condition & 0x80)
+#define POLICY_RULE_ACTION(r)	((r).action & 0x0F)
+#define POLICY_RULE_ACTION_PARAM(r)	((r).action >> 4)
+#define POLICY_RULE_HOLD_MS(r)	((uint32_t)((r).hold & 0x7F) * (((r).hold & 0x80) ? 60000 : 1000))
+
+#define POLICY_STATE_CONDITION	0x01
+#define POLICY_STATE_FIRED	0x02
+#define POLICY_STATE_WRITE_PENDING	0x04 // reported only, written rule waits for main loop store
+
+extern uint32_t lastHostCommandTimer;
+extern uint8_t resetStatus;
+
+uint8_t policyShutdownFlag __attribute__((section("no_init")));
+
+static PowerPolicyRule_T policyRules[POWER_POLICY_RULES_NUM];
+static uint8_t policyRuleState[POWER_POLICY_RULES_NUM];
+static uint32_t policyHoldTimer[POWER_POLICY_RULES_NUM];
+static uint32_t policyButtonIdleTimer;
+static uint8_t policyRuleSel = 0;
+// rules written by host, stored and applied from main loop
+static PowerPolicyRule_T policyRuleWrite[POWER_POLICY_RULES_NUM];
+static volatile uint8_t policyRuleWriteReq = 0; // bit per rule
+
+static uint8_t PowerPolicyIsRuleValid(PowerPolicyRule_T *rule) {
+	return POLICY_RULE_SOURCE(*rule) != POLICY_SRC_NONE
+		&& POLICY_RULE_SOURCE(*rule) < POLICY_SRC_NUM
+		&& POLICY_RULE_OPERATOR(*rule) < POLICY_OP_NUM
+		&& POLICY_RULE_ACTION(*rule) < POLICY_ACT_NUM;
+}
+
+static int16_t PowerPolicyGetSourceValue(PowerPolicySource_T src) {
+	int32_t val;
+	switch (src) {
+	case POLICY_SRC_CHARGE:
+		return batteryRsoc / 10;
+	case POLICY_SRC_BAT_VOLTAGE:
+		return batteryVoltage / 20;
+	case POLICY_SRC_POWER_INPUT:
+		return powerInStatus >= POW_SOURCE_WEAK || power5vIoStatus >= POW_SOURCE_WEAK;
+	case POLICY_SRC_LOAD_CURRENT:
+		val = GetLoadCurrent() / 10;
+		return val < 0 ? 0 : (val > 255 ? 255 : val);
+	case POLICY_SRC_BAT_TEMP:
+		return batteryTemp;
+	case POLICY_SRC_BUTTON_IDLE:
+		val = MS_TIME_COUNT(policyButtonIdleTimer) / 60000;
+		return val > 255 ? 255 : val;
+	case POLICY_SRC_HOST_IDLE:
+		val = MS_TIME_COUNT(lastHostCommandTimer) / 60000;
+		return val > 255 ? 255 : val;
+	case POLICY_SRC_5V_REG:
+		return POW_5V_BOOST_EN_STATUS();
+	case POLICY_SRC_BAT_PRESENT:
+		return batteryStatus != BAT_STATUS_NOT_PRESENT;
+	default:
+		return 0;
+	}
+}
+
+static uint8_t PowerPolicyEvalCondition(PowerPolicyRule_T *rule) {
+	int16_t val = PowerPolicyGetSourceValue(POLICY_RULE_SOURCE(*rule));
+	int16_t th = POLICY_RULE_SOURCE(*rule) == POLICY_SRC_BAT_TEMP ? (int8_t)rule->threshold : rule->threshold;
+	switch (POLICY_RULE_OPERATOR(*rule)) {
+	case POLICY_OP_LT: return val < th;
+	case POLICY_OP_GT: return val > th;
+	case POLICY_OP_EQ: return val == th;
+	case POLICY_OP_NE: return val != th;
+	default: return 0;
+	}
+}
+
+static void PowerPolicyExecuteAction(PowerPolicyRule_T *rule) {
+	uint8_t param = POLICY_RULE_ACTION_PARAM(*rule);
+	switch (POLICY_RULE_ACTION(*rule)) {
+	case POLICY_ACT_HOST_SHUTDOWN:
+		policyShutdownFlag = 1;
+		break;
+	case POLICY_ACT_5V_OFF:
+		if (PowerMngmtGetPowerOffCounter() == 0xFF) PowerMngmtSchedulePowerOff(param * 8);
+		break;
+	case POLICY_ACT_WAKEUP:
+		PowerMngmtPostWakeupEvent(WAKEUP_TRIGGER_POLICY);
+		break;
+	case POLICY_ACT_LED:
+		LedSetState((param & 0x08) ? LED2 : LED1, (param & 0x01) ? 127 : 0, (param & 0x02) ? 127 : 0, (param & 0x04) ? 127 : 0);
+		break;
+	default:
+		break;
+	}
+}
+
+static void PowerPolicyReadRule(uint8_t i) {
+	uint16_t var;
+	policyRules[i].condition = 0;
+	if (EE_ReadVariable(POWER_POLICY_RULE0_COND_NV_ADDR + 2 * i, &var) == 0) {
+		policyRules[i].condition = var & 0xFF;
+		policyRules[i].threshold = var >> 8;
+		if (EE_ReadVariable(POWER_POLICY_RULE0_ACT_NV_ADDR + 2 * i, &var) == 0) {
+			policyRules[i].action = var & 0xFF;
+			policyRules[i].hold = var >> 8;
+		} else {
+			policyRules[i].condition = 0;
+		}
+	}
+	if (!PowerPolicyIsRuleValid(&policyRules[i])) {
+		policyRules[i].condition = POLICY_SRC_NONE;
+		policyRules[i].threshold = 0;
+		policyRules[i].action = POLICY_ACT_NONE;
+		policyRules[i].hold = 0;
+	}
+	policyRuleState[i] = 0;
+}
+
+void PowerPolicyInit(void) {
+	uint8_t i;
+	for (i = 0; i < POWER_POLICY_RULES_NUM; i++) {
+		PowerPolicyReadRule(i);
+	}
+	if (!resetStatus) {
+		policyShutdownFlag = 0;
+	}
+	MS_TIME_COUNTER_INIT(policyButtonIdleTimer);
+}
+
+static void PowerPolicyStoreRule(uint8_t i) {
+	PowerPolicyRule_T rule;
+	uint32_t primask;
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+	rule = policyRuleWrite[i];
+	policyRuleWriteReq &= ~(0x01 << i);
+	__set_PRIMASK(primask);
+
+	// condition and action words are committed together, rule is never half updated
+	NvTransactionBegin();
+	NvTransactionStage(POWER_POLICY_RULE0_COND_NV_ADDR + 2 * i, rule.condition | ((uint16_t)rule.threshold << 8));
+	NvTransactionStage(POWER_POLICY_RULE0_ACT_NV_ADDR + 2 * i, rule.action | ((uint16_t)rule.hold << 8));
+	NvTransactionCommit();
+	PowerPolicyReadRule(i);
+}
+
+void PowerPolicyTask(void) {
+	uint8_t i;
+	uint8_t cond = 1;
+
+	for (i = 0; i < POWER_POLICY_RULES_NUM; i++) {
+		if (policyRuleWriteReq & (0x01 << i)) PowerPolicyStoreRule(i);
+	}
+
+	if (IsButtonActive()) MS_TIME_COUNTER_INIT(policyButtonIdleTimer);
+
+	for (i = 0; i < POWER_POLICY_RULES_NUM; i++) {
+		if (POLICY_RULE_SOURCE(policyRules[i]) == POLICY_SRC_NONE) {
+			cond = 1;
+			continue;
+		}
+
+		cond = PowerPolicyEvalCondition(&policyRules[i]) && cond;
+		if (POLICY_RULE_IS_CHAINED(policyRules[i]) && i < POWER_POLICY_RULES_NUM - 1) {
+			// conditions of chained rules are AND-ed, action and hold time are taken from last rule in chain
+			continue;
+		}
+
+		if (cond) {
+			if (!(policyRuleState[i] & POLICY_STATE_CONDITION)) {
+				MS_TIME_COUNTER_INIT(policyHoldTimer[i]);
+				policyRuleState[i] |= POLICY_STATE_CONDITION;
+			}
+			// action fires once per condition entry, rule is re-armed when condition clears
+			if (!(policyRuleState[i] & POLICY_STATE_FIRED) && MS_TIME_COUNT(policyHoldTimer[i]) >= POLICY_RULE_HOLD_MS(policyRules[i])) {
+				PowerPolicyExecuteAction(&policyRules[i]);
+				policyRuleState[i] |= POLICY_STATE_FIRED;
+			}
+		} else {
+			policyRuleState[i] = 0;
+		}
+
+		cond = 1;
+	}
+}
+
+// data[0] rule index, followed by condition, threshold, action, hold to write rule, or index only to select rule for read
+void PowerPolicySetRuleCmd(uint8_t data[], uint16_t len) {
+	PowerPolicyRule_T rule;
+	if (len < 1 || data[0] >= POWER_POLICY_RULES_NUM) return;
+	policyRuleSel = data[0];
+	if (len < 5) return;
+
+	rule.condition = data[1];
+	rule.threshold = data[2];
+	rule.action = data[3];
+	rule.hold = data[4];
+	if (POLICY_RULE_SOURCE(rule) != POLICY_SRC_NONE && !PowerPolicyIsRuleValid(&rule)) return;
+
+	policyRuleWrite[policyRuleSel] = rule;
+	policyRuleWriteReq |= 0x01 << policyRuleSel;
+}
+
+void PowerPolicyGetRuleCmd(uint8_t data[], uint16_t *len) {
+	// stored rule as reloaded from nv is reported, host verifies write after pending flag clears
+	PowerPolicyRule_T *rule = &policyRules[policyRuleSel];
+	data[0] = policyRuleSel;
+	data[1] = rule->condition;
+	data[2] = rule->threshold;
+	data[3] = rule->action;
+	data[4] = rule->hold;
+	data[5] = policyRuleState[policyRuleSel];
+	if (policyRuleWriteReq & (0x01 << policyRuleSel)) data[5] |= POLICY_STATE_WRITE_PENDING;
+	*len = 6;
+}
@@ -15,6 +15,7 @@
 #include "load_current_sense.h"
 #include "execution.h"
 #include "logging.h"
+#include "flash_log.h"
 
 #define POW_5V_IO_DET_ADC_THRESHOLD		2950
 #define VBAT_TURNOFF_ADC_THRESHOLD		0 // mV unit
@@ -135,7 +136,7 @@ int8_t Turn5vBoost(uint8_t onOff) {
 		int status;
 		if ( batteryVoltage > vbatPowOffTresh || POW_SOURCE_PRESENT()/*chargerStatus != CHG_NO_VALID_SOURCE*/) {
 #if defined LOGGING
-			log5vonMsgBuf = LoggingInitMessage(LOG_5VREG_ON);
+			log5vonMsgBuf = LoggingInitMessage(LOG_5VREG_ON, 21);
 #endif
 			POW_5V_DET_LDO_ENABLE(0);
 			AnalogAdcWDGEnable(DISABLE);
@@ -175,6 +176,7 @@ int8_t Turn5vBoost(uint8_t onOff) {
 #endif
 		return status;
 	} else {
+		if (POW_5V_BOOST_EN_STATUS()) FlashLogPutStatus(FLASH_LOG_5VREG_OFF, 0);
 		POW_5V_DET_LDO_ENABLE(0);
 		AnalogAdcWDGEnable(DISABLE);
 		HAL_GPIO_WritePin(GPIOA, GPIO_PIN_10, GPIO_PIN_RESET);
@@ -187,8 +189,9 @@ int8_t Turn5vBoost(uint8_t onOff) {
 #if defined LOGGING
 /*__STATIC_INLINE*/ void LOG_5VREG_FORCED_OFF(uint32_t adcPos) {
 	forcedPowerOffFlag = 1;
-	uint8_t *buf = LoggingInitMessage(LOG_5VREG_OFF);
-	if (log5vonMsgBuf == NULL) 	return;
+	FlashLogPutStatus(FLASH_LOG_FORCED_POWER_OFF, adcPos != 0xFFFFFFFF); // 1 - 5V regulator fault, 0 - low battery
+	uint8_t *buf = LoggingInitMessage(LOG_5VREG_OFF, 21);
+	if (buf == NULL) 	return;
 	buf[0] = 0;
 	buf[0] |= (batteryStatus << 2);
 	buf[0] |= (powerInStatus << 4);
@@ -203,7 +206,7 @@ int8_t Turn5vBoost(uint8_t onOff) {
 
 }
 #else
-#define LOG_5VREG_FORCED_OFF(adcPos) (forcedPowerOffFlag = 1)
+#define LOG_5VREG_FORCED_OFF(adcPos) do { forcedPowerOffFlag = 1; FlashLogPutStatus(FLASH_LOG_FORCED_POWER_OFF, (adcPos) != 0xFFFFFFFF); } while (0)
 #endif
 
 __STATIC_INLINE void TurnVSysOutput(uint8_t onOff){
@@ -0,0 +1,124 @@
+/*
+ * power_stats.c
+ *
+ *  Created on: 19.10.2026.
+ */
+
+#include "power_stats.h"
+#include "time_count.h"
+
+// Statistics are read in pages of page number and values, with checksum they fit 32 byte SMBus block read
+#define POWER_STATS_PAGE_VALUES	7
+#define POWER_STATS_VALUES_NUM	(POWER_STATS_STATES_NUM + 1 + POWER_STATS_WAKE_NUM + LOW_POWER_REFUSE_NUM)
+#define POWER_STATS_PAGES_NUM	((POWER_STATS_VALUES_NUM + POWER_STATS_PAGE_VALUES - 1) / POWER_STATS_PAGE_VALUES)
+
+typedef struct {
+	uint32_t seconds;
+	uint16_t ms;
+} PowerStatsTime_T;
+
+extern uint8_t resetStatus;
+
+static PowerStatsTime_T stateResidency[POWER_STATS_STATES_NUM] __attribute__((section("no_init")));
+static PowerStatsTime_T refuseTime[LOW_POWER_REFUSE_NUM] __attribute__((section("no_init")));
+static uint32_t stopEntries __attribute__((section("no_init")));
+static uint32_t wakeCauses[POWER_STATS_WAKE_NUM] __attribute__((section("no_init")));
+static uint32_t powerStatsTimer;
+static PowerState_T prevState = STATE_INIT;
+static uint16_t prevRefuseMask = 0;
+static uint8_t powerStatsPage = 0;
+
+static void PowerStatsAddTime(PowerStatsTime_T *t, uint32_t dt) {
+	dt += t->ms;
+	t->seconds += dt / 1000;
+	t->ms = dt % 1000;
+}
+
+static void PowerStatsReset(void) {
+	uint8_t i;
+	for (i = 0; i < POWER_STATS_STATES_NUM; i++) {
+		stateResidency[i].seconds = 0;
+		stateResidency[i].ms = 0;
+	}
+	for (i = 0; i < LOW_POWER_REFUSE_NUM; i++) {
+		refuseTime[i].seconds = 0;
+		refuseTime[i].ms = 0;
+	}
+	for (i = 0; i < POWER_STATS_WAKE_NUM; i++) {
+		wakeCauses[i] = 0;
+	}
+	stopEntries = 0;
+}
+
+void PowerStatsInit(void) {
+	if (!resetStatus) {
+		PowerStatsReset();
+	}
+	MS_TIME_COUNTER_INIT(powerStatsTimer);
+}
+
+// Called every main loop pass with new state decision, elapsed time is accounted to previous decision
+void PowerStatsUpdate(PowerState_T state, uint16_t refuseMask) {
+	uint8_t i;
+	uint32_t dt = MS_TIME_COUNT(powerStatsTimer);
+	MS_TIME_COUNTER_INIT(powerStatsTimer);
+
+	if (prevState >= STATE_NORMAL && prevState <= STATE_LOWPOWER) {
+		PowerStatsAddTime(&stateResidency[prevState - STATE_NORMAL], dt);
+	}
+	if (prevState != STATE_LOWPOWER) {
+		for (i = 0; i < LOW_POWER_REFUSE_NUM; i++) {
+			if (prevRefuseMask & (0x01 << i)) PowerStatsAddTime(&refuseTime[i], dt);
+		}
+	}
+
+	prevState = state;
+	prevRefuseMask = refuseMask;
+}
+
+void PowerStatsStopEntry(void) {
+	stopEntries++;
+}
+
+void PowerStatsWakeup(PowerStatsWakeCause_T cause) {
+	if (cause < POWER_STATS_WAKE_NUM) wakeCauses[cause]++;
+}
+
+// data[0]: bit7 - reset statistics, bits 0-3 page to read
+void PowerStatsSetCmd(uint8_t data[], uint16_t len) {
+	if (len < 1) return;
+	if (data[0] & 0x80) PowerStatsReset();
+	if ((data[0] & 0x0F) < POWER_STATS_PAGES_NUM) powerStatsPage = data[0] & 0x0F;
+}
+
+static uint8_t *PowerStatsPutU32(uint8_t *buf, uint32_t val) {
+	buf[0] = val;
+	buf[1] = val >> 8;
+	buf[2] = val >> 16;
+	buf[3] = val >> 24;
+	return buf + 4;
+}
+
+// Values in order: seconds in normal, run, low power state, stop mode entries, wake-up causes count
+// in PowerStatsWakeCause_T order, seconds low power was refused for each reason in PowerStatsRefuse_T order
+static uint32_t PowerStatsGetValue(uint8_t i) {
+	if (i < POWER_STATS_STATES_NUM) return stateResidency[i].seconds;
+	i -= POWER_STATS_STATES_NUM;
+	if (i == 0) return stopEntries;
+	i--;
+	if (i < POWER_STATS_WAKE_NUM) return wakeCauses[i];
+	i -= POWER_STATS_WAKE_NUM;
+	if (i < LOW_POWER_REFUSE_NUM) return refuseTime[i].seconds;
+	return 0;
+}
+
+// Page number, then POWER_STATS_PAGE_VALUES values from page * POWER_STATS_PAGE_VALUES, 0 past last value
+void PowerStatsGetCmd(uint8_t data[], uint16_t *len) {
+	uint8_t i;
+	uint8_t *buf = data + 1;
+	data[0] = powerStatsPage;
+	for (i = 0; i < POWER_STATS_PAGE_VALUES; i++) {
+		buf = PowerStatsPutU32(buf, PowerStatsGetValue(powerStatsPage * POWER_STATS_PAGE_VALUES + i));
+	}
+	*len = buf - data;
+}
@@ -0,0 +1,159 @@
+/*
+ * rtc_calibration.c
+ *
+ *  Created on: 19.10.2026.
+ */
+
+#include "rtc_calibration.h"
+#include "rtc_ds1339_emu.h"
+#include "stm32f0xx_hal.h"
+#include "nv.h"
+
+// Offsets are RTC time minus host reference time in 1/256 s. Drift is measured from change of offset
+// since anchor submission, window grows with each submission so reference jitter averages out.
+// Calibration changes within window are accounted as if present calibration was applied from anchor.
+#define RTC_CALIB_MAX_OFFSET	(0x7FFFFFFF / 256) // s, larger offsets do not fit in 1/256 s units
+#define RTC_CALIB_MAX_INTERVAL	2592000 // s, 30 days, window restarts to follow aging
+
+extern RTC_HandleTypeDef hrtc;
+extern uint8_t resetStatus;
+
+static int16_t rtcCalib = 0; // smooth calibration, positive adds pulses and speeds up RTC
+
+// anchor survives watchdog reset, so drift is measured across it
+static uint32_t anchorRefSec __attribute__((section("no_init")));
+static int32_t anchorOffset __attribute__((section("no_init")));
+static uint32_t calibRefSec __attribute__((section("no_init"))); // reference time of last calibration change
+static int64_t calibSum __attribute__((section("no_init"))); // calibration integrated over window until calibRefSec, step * s
+static uint8_t calibStatus __attribute__((section("no_init")));
+static int32_t lastOffset __attribute__((section("no_init")));
+static uint32_t lastInterval __attribute__((section("no_init")));
+
+static void RtcCalibrationApply(void) {
+	if (rtcCalib > 0) {
+		HAL_RTCEx_SetSmoothCalib(&hrtc, RTC_SMOOTHCALIB_PERIOD_32SEC, RTC_SMOOTHCALIB_PLUSPULSES_SET, RTC_CALIB_MAX_STEP - rtcCalib);
+	} else {
+		HAL_RTCEx_SetSmoothCalib(&hrtc, RTC_SMOOTHCALIB_PERIOD_32SEC, RTC_SMOOTHCALIB_PLUSPULSES_RESET, -rtcCalib);
+	}
+}
+
+static void RtcCalibrationSet(int32_t calib) {
+	if (calib > RTC_CALIB_MAX_STEP) {
+		calib = RTC_CALIB_MAX_STEP;
+		calibStatus |= RTC_CALIB_STATUS_RANGE;
+	} else if (calib < RTC_CALIB_MIN_STEP) {
+		calib = RTC_CALIB_MIN_STEP;
+		calibStatus |= RTC_CALIB_STATUS_RANGE;
+	}
+	rtcCalib = calib;
+	RtcCalibrationApply();
+	EE_WriteVariable(RTC_CALIBRATION_NV_ADDR, (uint16_t)rtcCalib);
+}
+
+void RtcCalibrationInit(void) {
+	uint16_t var;
+
+	if (!resetStatus) {
+		calibStatus = 0;
+		lastOffset = 0;
+		lastInterval = 0;
+	}
+
+	rtcCalib = 0;
+	if (EE_ReadVariable(RTC_CALIBRATION_NV_ADDR, &var) == 0
+		&& (int16_t)var >= RTC_CALIB_MIN_STEP && (int16_t)var <= RTC_CALIB_MAX_STEP) {
+		rtcCalib = (int16_t)var;
+	}
+	RtcCalibrationApply();
+}
+
+// RTC time was written, offset to reference changed by delta in 1/256 s without drift
+void RtcCalibrationTimeStep(int32_t delta) {
+	anchorOffset += delta;
+}
+
+static void RtcCalibrationAnchor(uint32_t refSec) {
+	anchorRefSec = refSec;
+	anchorOffset = lastOffset;
+	calibRefSec = refSec;
+	calibSum = 0;
+	calibStatus |= RTC_CALIB_STATUS_ANCHOR;
+}
+
+// Host reference time as seconds since 2000-01-01 and 1/256 s, taken when transfer completes
+static void RtcCalibrationSubmit(uint32_t refSec, uint8_t refSub) {
+	uint32_t sec;
+	uint8_t sub;
+	int32_t diff;
+	int64_t num;
+	int32_t steps;
+
+	RtcReadLinearTime(&sec, &sub);
+	diff = sec - refSec;
+	calibStatus &= ~(RTC_CALIB_STATUS_APPLIED | RTC_CALIB_STATUS_RANGE);
+
+	if (diff > RTC_CALIB_MAX_OFFSET || diff < -RTC_CALIB_MAX_OFFSET) {
+		// RTC is not set, drift can not be measured from it
+		calibStatus &= ~RTC_CALIB_STATUS_ANCHOR;
+		return;
+	}
+	lastOffset = diff * 256 + sub - refSub;
+
+	if ( !(calibStatus & RTC_CALIB_STATUS_ANCHOR) || refSec < calibRefSec ) {
+		lastInterval = 0;
+		RtcCalibrationAnchor(refSec);
+		return;
+	}
+
+	lastInterval = refSec - anchorRefSec;
+	if (lastInterval < RTC_CALIB_MIN_INTERVAL) return;
+
+	// offset change in 2^-20 s units, as if present calibration was applied over whole window
+	num = (int64_t)(lastOffset - anchorOffset) * 4096
+		+ (int64_t)rtcCalib * lastInterval - (calibSum + (int64_t)rtcCalib * (refSec - calibRefSec));
+	// rounded steps that cancel it
+	steps = (-num + (num <= 0 ? (int64_t)lastInterval / 2 : -(int64_t)lastInterval / 2)) / (int64_t)lastInterval;
+
+	if (steps != 0) {
+		calibSum += (int64_t)rtcCalib * (refSec - calibRefSec);
+		calibRefSec = refSec;
+		RtcCalibrationSet(rtcCalib + steps);
+		calibStatus |= RTC_CALIB_STATUS_APPLIED;
+	}
+	if (lastInterval >= RTC_CALIB_MAX_INTERVAL) {
+		RtcCalibrationAnchor(refSec);
+	}
+}
+
+// Calibration in 2^-20 steps, last offset in 1/256 s, its interval from anchor in s, status
+void RtcCalibrationReadCmd(uint8_t data[], uint16_t *len) {
+	data[0] = rtcCalib;
+	data[1] = (uint16_t)rtcCalib >> 8;
+	data[2] = lastOffset;
+	data[3] = lastOffset >> 8;
+	data[4] = lastOffset >> 16;
+	data[5] = lastOffset >> 24;
+	data[6] = lastInterval;
+	data[7] = lastInterval >> 8;
+	data[8] = lastInterval >> 16;
+	data[9] = lastInterval >> 24;
+	data[10] = calibStatus;
+	*len = 11;
+}
+
+// data[0]: 0 - submit reference time, data[1..4] seconds since 2000-01-01, data[5] 1/256 s,
+// 1 - set calibration data[1..2] in 2^-20 steps, 2 - clear anchor so next submission starts new interval
+void RtcCalibrationWriteCmd(uint8_t data[], uint16_t len) {
+	if (len < 1) return;
+
+	if (data[0] == 0) {
+		if (len < 6) return;
+		RtcCalibrationSubmit(data[1] | ((uint32_t)data[2] << 8) | ((uint32_t)data[3] << 16) | ((uint32_t)data[4] << 24), data[5]);
+	} else if (data[0] == 1) {
+		if (len < 3) return;
+		calibStatus &= ~(RTC_CALIB_STATUS_APPLIED | RTC_CALIB_STATUS_RANGE | RTC_CALIB_STATUS_ANCHOR);
+		RtcCalibrationSet((int16_t)(data[1] | ((uint16_t)data[2] << 8)));
+	} else if (data[0] == 2) {
+		calibStatus &= ~RTC_CALIB_STATUS_ANCHOR;
+	}
+}
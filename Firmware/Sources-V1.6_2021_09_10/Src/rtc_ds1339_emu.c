@@ -6,30 +6,48 @@
  */
 // linux driver for rtc and alarm config.txt: dtoverlay=i2c-rtc,ds1339,wakeup-source
 #include "rtc_ds1339_emu.h"
-#include "stm32f0xx_hal.h"
+#include "main.h"
 #include "power_management.h"
 #include "power_source.h"
 #include "logging.h"
+#include "rtc_schedule.h"
+#include "nv.h"
+#include "rtc_calibration.h"
+#include "energy_accounting.h"
 
 #define RTC_REGISTERS_NUM	(0x3F+1) // free RAM reserved for compatibility with ds1307
+#define RTC_BCD2BIN(b)	((((b)>>4)&0x0F)*10 + ((b)&0x0F))
+#define RTC_BIN2BCD(b)	((((b)/10)<<4) | ((b)%10))
 
 extern RTC_HandleTypeDef hrtc;
 RTC_AlarmTypeDef sAlarm;
 
 static uint8_t rtc_buffer[RTC_REGISTERS_NUM] __attribute__((section("no_init")));//= {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x07, 0, 0}; // rtc_bufferisters used for i2c master access
 static uint8_t rtc_buffer_ptr __attribute__((section("no_init")));
+// RTC_TR and RTC_DR values time registers in rtc_buffer were decoded from, so BCD shadow changes on second tick
+static uint32_t rtcShadowTR;
+static uint32_t rtcShadowDR = 0; // date register is never 0, so first read decodes
 //volatile uint8_t testRegAdr[50] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
 //volatile uint8_t testRegAdrW = 0xFF;
 //volatile uint8_t testRegAdrI = 0;
 
 static const uint8_t binHour24ToBcd[24] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x20, 0x21, 0x22, 0x23};
 static const uint8_t binHour24ToBcdAmPm[24] = {0x12, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0x10, 0x11, 0x32, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28, 0x29, 0x30, 0x31};
+static const uint16_t rtcMonthDays[12] = {0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334};
 
-static uint8_t weekDaysSelection __attribute__((section("no_init")));
-static uint32_t hoursSelection __attribute__((section("no_init")));
-static uint8_t minutesStep __attribute__((section("no_init")));
+// Alarm 1 as written by host, RTC alarm A is programmed for its next match time
+static RtcSchedule_T alarmSchedule __attribute__((section("no_init")));
+static uint8_t alarmScheduleCheck __attribute__((section("no_init")));
+static RtcCalendar_T alarmTarget; // time RTC alarm A is programmed for
 uint8_t alarmEventFlag __attribute__((section("no_init")));
 
+// Wake-up schedules stored in NV, merged with alarm 1 into single RTC alarm A target
+static RtcSchedule_T wakeSchedules[RTC_WAKE_SCHEDULES_NUM];
+static uint8_t wakeScheduleSel = 0;
+// entries matching at last wake schedule fire and its time, kept for host to read after boot
+static uint8_t wakeScheduleFired __attribute__((section("no_init")));
+static RtcCalendar_T wakeScheduleFiredTime __attribute__((section("no_init")));
+
 extern uint8_t resetStatus;
 
 RtcCommand_T rtcCommands[] =
@@ -37,16 +55,187 @@ RtcCommand_T rtcCommands[] =
 		//RtcReadWriteTime
 };
 
+static uint8_t RtcAlarmScheduleCheck(void) {
+	uint8_t *p = (uint8_t*)&alarmSchedule;
+	uint8_t check = 0xA5;
+	uint8_t i;
+	for (i = 0; i < sizeof(alarmSchedule); i++) check = (check << 1 | check >> 7) ^ p[i];
+	return check;
+}
+
+static void RtcGetCalendar(RtcCalendar_T *t) {
+	RTC_TimeTypeDef sTime;
+	RTC_DateTypeDef dateConf;
+
+	HAL_RTC_GetTime(&hrtc, &sTime, RTC_FORMAT_BIN);
+	HAL_RTC_GetDate(&hrtc, &dateConf, RTC_FORMAT_BIN);
+	t->year = dateConf.Year;
+	t->month = dateConf.Month;
+	t->date = dateConf.Date;
+	t->weekDay = dateConf.WeekDay;
+	if (hrtc.Init.HourFormat == RTC_HOURFORMAT_12) {
+		t->hours = sTime.Hours % 12 + (sTime.TimeFormat == RTC_HOURFORMAT12_PM ? 12 : 0);
+	} else {
+		t->hours = sTime.Hours;
+	}
+	t->minutes = sTime.Minutes;
+	t->seconds = sTime.Seconds;
+}
+
+// Programs RTC alarm A for next time alarm 1 or any wake schedule matches, so MCU is woken only when one applies
+static void RtcAlarmUpdate(void) {
+	RtcCalendar_T now;
+	RtcCalendar_T wake;
+	uint8_t alarmResult, wakeResult;
+
+	RtcGetCalendar(&alarmTarget);
+	wake = alarmTarget;
+	alarmResult = RtcScheduleNext(&alarmSchedule, &alarmTarget);
+	wakeResult = RtcScheduleNextAny(wakeSchedules, RTC_WAKE_SCHEDULES_NUM, &wake);
+	if (wakeResult != RTC_SCHEDULE_NONE && (alarmResult == RTC_SCHEDULE_NONE || RtcCalendarCompare(&wake, &alarmTarget) < 0)) {
+		alarmTarget = wake;
+	} else if (alarmResult == RTC_SCHEDULE_NONE) {
+		HAL_RTC_DeactivateAlarm(&hrtc, RTC_ALARM_A);
+		return;
+	}
+
+	// target further than a month also matches earlier, that wake-up is ignored in EvaluateAlarm
+	sAlarm.Alarm = RTC_ALARM_A;
+	sAlarm.AlarmMask = RTC_ALARMMASK_NONE;
+	sAlarm.AlarmSubSecondMask = RTC_ALARMSUBSECONDMASK_ALL;
+	sAlarm.AlarmDateWeekDaySel = RTC_ALARMDATEWEEKDAYSEL_DATE;
+	sAlarm.AlarmDateWeekDay = alarmTarget.date;
+	if (hrtc.Init.HourFormat == RTC_HOURFORMAT_12) {
+		sAlarm.AlarmTime.Hours = alarmTarget.hours % 12 ? alarmTarget.hours % 12 : 12;
+		sAlarm.AlarmTime.TimeFormat = alarmTarget.hours >= 12 ? RTC_HOURFORMAT12_PM : RTC_HOURFORMAT12_AM;
+	} else {
+		sAlarm.AlarmTime.Hours = alarmTarget.hours;
+	}
+	sAlarm.AlarmTime.Minutes = alarmTarget.minutes;
+	sAlarm.AlarmTime.Seconds = alarmTarget.seconds;
+	sAlarm.AlarmTime.SubSeconds = 0;
+	HAL_RTC_SetAlarm_IT(&hrtc, &sAlarm, RTC_FORMAT_BIN);
+
+	// target second could pass while alarm was programmed
+	RtcGetCalendar(&now);
+	if (RtcCalendarCompare(&now, &alarmTarget) >= 0) alarmEventFlag = 1;
+}
+
+// DS1339 alarm 1 registers to schedule, hours converted to 24 hour format
+static void RtcScheduleFromRegisters(RtcSchedule_T *sch, const uint8_t *buffer, uint8_t extended) {
+	sch->seconds = RTC_BCD2BIN(buffer[0] & 0x7F) | (buffer[0] & 0x80);
+	sch->minutes = RTC_BCD2BIN(buffer[1] & 0x7F) | (buffer[1] & 0x80);
+	if (buffer[2] & 0x40) {
+		sch->hours = RTC_BCD2BIN(buffer[2] & 0x1F) % 12 + ((buffer[2] & 0x20) ? 12 : 0);
+	} else {
+		sch->hours = RTC_BCD2BIN(buffer[2] & 0x3F);
+	}
+	sch->hours |= buffer[2] & 0x80;
+	if (buffer[3] & 0x40) {
+		sch->day = (buffer[3] & 0x0F) | RTC_SCHEDULE_WEEKDAY;
+	} else {
+		sch->day = RTC_BCD2BIN(buffer[3] & 0x3F);
+	}
+	sch->day |= buffer[3] & 0x80;
+
+	if (extended) {
+		sch->hoursSelection = buffer[6];
+		sch->hoursSelection <<= 8;
+		sch->hoursSelection |= buffer[5];
+		sch->hoursSelection <<= 8;
+		sch->hoursSelection |= buffer[4];
+		sch->minutesStep = buffer[7];
+		sch->weekDaysSelection = buffer[8];
+		if (!(buffer[0] || buffer[1] || buffer[2] || buffer[3])) sch->day = 0; // disabled, date 0 never matches
+	} else {
+		sch->hoursSelection = 0xFFFFFFFF;
+		sch->minutesStep = 0;
+		sch->weekDaysSelection = 0xFF;
+	}
+}
+
+// Schedule to DS1339 alarm 1 registers, hours in format RTC is set to
+static void RtcScheduleToRegisters(const RtcSchedule_T *sch, uint8_t *buffer, uint8_t extended) {
+	buffer[0] = RTC_BIN2BCD(sch->seconds & 0x7F) | (sch->seconds & 0x80);
+	buffer[1] = RTC_BIN2BCD(sch->minutes & 0x7F) | (sch->minutes & 0x80);
+	if (hrtc.Init.HourFormat == RTC_HOURFORMAT_12) {
+		buffer[2] = binHour24ToBcdAmPm[(sch->hours & 0x1F) % 24] | 0x40;
+	} else {
+		buffer[2] = binHour24ToBcd[(sch->hours & 0x1F) % 24];
+	}
+	buffer[2] |= sch->hours & 0x80;
+	if (sch->day & RTC_SCHEDULE_WEEKDAY) {
+		buffer[3] = sch->day & 0x4F;
+	} else {
+		buffer[3] = RTC_BIN2BCD(sch->day & 0x3F);
+	}
+	buffer[3] |= sch->day & 0x80;
+
+	if (extended) {
+		buffer[4] = sch->hoursSelection;
+		buffer[5] = sch->hoursSelection >> 8;
+		buffer[6] = sch->hoursSelection >> 16;
+
+		buffer[7] = sch->minutesStep;
+		buffer[8] = sch->weekDaysSelection;
+	}
+}
+
+// Wake schedule in 5 NV words: seconds and minutes, hours and day, hours selection low 16 bits,
+// hours selection high 8 bits and minutes step, week days selection with its complement
+static void RtcWakeScheduleRead(uint8_t i) {
+	RtcSchedule_T *sch = &wakeSchedules[i];
+	uint16_t addr = RTC_WAKE_SCHEDULE0_TIME_NV_ADDR + RTC_WAKE_SCHEDULE_NV_VARS * i;
+	uint16_t var[RTC_WAKE_SCHEDULE_NV_VARS];
+	uint8_t k;
+
+	sch->day = 0; // disabled, date 0 never matches
+	for (k = 0; k < RTC_WAKE_SCHEDULE_NV_VARS; k++) {
+		if (EE_ReadVariable(addr + k, &var[k]) != 0) return;
+	}
+	if ( (var[4] & 0xFF) != (uint8_t)~(var[4] >> 8) ) return;
+
+	sch->seconds = var[0] & 0xFF;
+	sch->minutes = var[0] >> 8;
+	sch->hours = var[1] & 0xFF;
+	sch->hoursSelection = ((uint32_t)(var[3] & 0xFF) << 16) | var[2];
+	sch->minutesStep = var[3] >> 8;
+	sch->weekDaysSelection = var[4] & 0xFF;
+	sch->day = var[1] >> 8;
+}
+
 void RtcInit(void) {
 	//static  uint8_t rtcBufferInit[] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+	uint8_t alarm[4];
+	uint8_t i;
+
 	if (!resetStatus) {
-		weekDaysSelection = 0xFF;
-		hoursSelection = 0xFFFFFFFF;
-		minutesStep = 0;
 		alarmEventFlag = 0;
-		int i;
 		for (i = 0; i < 17; i++) rtc_buffer[i] = 0;//rtcBufferInit[i];
 	}
+
+	if (alarmScheduleCheck != RtcAlarmScheduleCheck()) {
+		// take alarm left in RTC, masks of previous firmware or time programmed for next match
+		HAL_RTC_GetAlarm(&hrtc, &sAlarm, RTC_ALARM_A, RTC_FORMAT_BCD);
+		alarm[0] = sAlarm.AlarmTime.Seconds | ((sAlarm.AlarmMask & RTC_ALARMMASK_SECONDS) ? 0x80 : 0);
+		alarm[1] = sAlarm.AlarmTime.Minutes | ((sAlarm.AlarmMask & RTC_ALARMMASK_MINUTES) ? 0x80 : 0);
+		alarm[2] = sAlarm.AlarmTime.Hours | ((sAlarm.AlarmMask & RTC_ALARMMASK_HOURS) ? 0x80 : 0);
+		if (hrtc.Init.HourFormat == RTC_HOURFORMAT_12) {
+			alarm[2] |= 0x40 | (sAlarm.AlarmTime.TimeFormat == RTC_HOURFORMAT12_PM ? 0x20 : 0);
+		}
+		alarm[3] = sAlarm.AlarmDateWeekDay | ((sAlarm.AlarmMask & RTC_ALARMMASK_DATEWEEKDAY) ? 0x80 : 0);
+		alarm[3] |= (sAlarm.AlarmDateWeekDaySel == RTC_ALARMDATEWEEKDAYSEL_WEEKDAY) ? 0x40 : 0;
+		if ( !(hrtc.Instance->CR & RTC_CR_ALRAE) ) alarm[3] = 0; // disabled, date 0 never matches
+		RtcScheduleFromRegisters(&alarmSchedule, alarm, 0);
+		alarmScheduleCheck = RtcAlarmScheduleCheck();
+	}
+
+	if (!resetStatus) {
+		wakeScheduleFired = 0;
+	}
+	for (i = 0; i < RTC_WAKE_SCHEDULES_NUM; i++) RtcWakeScheduleRead(i);
+
+	RtcAlarmUpdate();
 }
 
 /**
@@ -64,7 +253,7 @@ void HAL_RTC_AlarmAEventCallback(RTC_HandleTypeDef *phrtc)
 
 #if defined LOGGING
 __STATIC_INLINE void LOG_ALARM_EVENT() {
-	uint8_t *buf = LoggingInitMessage(ALARM_EVT);
+	uint8_t *buf = LoggingInitMessage(ALARM_EVT, 19);
 	if (buf == NULL) 	return;
 	buf[0] = rtc_buffer[0x0E];
 	buf[1] = rtc_buffer[0x0E + 1];
@@ -94,7 +283,7 @@ __STATIC_INLINE void LOG_ALARM_EVENT() {
 
 #if defined LOGGING
 __STATIC_INLINE void LOG_ALARM_WRITE() {
-	uint8_t *buf = LoggingInitMessage(ALARM_WRITE);
+	uint8_t *buf = LoggingInitMessage(ALARM_WRITE, 19);
 	if (buf == NULL) 	return;
 	buf[0] = rtc_buffer[0x0E];
 	buf[1] = rtc_buffer[0x0E + 1];
@@ -124,137 +313,97 @@ __STATIC_INLINE void LOG_ALARM_WRITE() {
 
 void EvaluateAlarm(void)
 {
-	static volatile RTC_TimeTypeDef sTime;
-	static RTC_DateTypeDef dateConf;
-	uint32_t tempReg;
-	//static volatile uint8_t min;
+	RtcCalendar_T now;
+	uint8_t fired = 0;
+	uint8_t i;
 
-	LOG_ALARM_EVENT();
+	RtcGetCalendar(&now);
+	// alarm for target more than a month ahead fires on same date in earlier month too
+	if ( RtcCalendarCompare(&now, &alarmTarget) < 0 ) {
+		RtcAlarmUpdate();
+		return;
+	}
 
-	// if alarm 1 interrupt enabled activate int signal
-	//if ( (rtc_buffer[0x0E]&0x04) && (rtc_buffer[0x0E]&0x01) )
-		//HAL_GPIO_WritePin(GPIOB, GPIO_PIN_13, GPIO_PIN_RESET);
+	if ( RtcScheduleMatch(&alarmSchedule, &alarmTarget) ) {
+		LOG_ALARM_EVENT();
+		if ( (rtc_buffer[0x0E]&0x04) && (rtc_buffer[0x0E]&0x01) ) PowerMngmtPostWakeupEvent(WAKEUP_TRIGGER_RTC);
+		rtc_buffer[0x0F] |= 0x01; // set alarm 1 flag
+	}
 
-		uint8_t weekDayMatch = 0;
-		if (weekDaysSelection != 0xFF || !(sAlarm.AlarmMask&0x80000000)) {
-			//HAL_RTC_GetDate(&hrtc, &dateConf, RTC_FORMAT_BIN);
-			tempReg = hrtc.Instance->DR;
-			tempReg = 0;
-			tempReg = hrtc.Instance->DR;
-			tempReg = 0;
-			tempReg = hrtc.Instance->DR;
-			dateConf.WeekDay = (tempReg >> 13)&0x07;
-			if ( (0x01 << (dateConf.WeekDay)) & weekDaysSelection ) {
-				weekDayMatch = 1;
-			}
-		} else {
-			weekDayMatch = 1;
-		}
+	for (i = 0; i < RTC_WAKE_SCHEDULES_NUM; i++) {
+		if ( RtcScheduleMatch(&wakeSchedules[i], &alarmTarget) ) fired |= 0x01 << i;
+	}
+	if (fired) {
+		wakeScheduleFired = fired;
+		wakeScheduleFiredTime = alarmTarget;
+		PowerMngmtPostWakeupEvent(WAKEUP_TRIGGER_RTC);
+	}
 
-		if (weekDayMatch) {
-			if (hoursSelection != 0xFFFFFFFF || minutesStep > 1) {
-				tempReg = hrtc.Instance->TR;
-				tempReg = 0;
-				tempReg = hrtc.Instance->TR;
-				tempReg = 0;
-				tempReg = hrtc.Instance->TR;
-				//HAL_RTC_GetTime(&hrtc, &sTime, RTC_FORMAT_BIN);
-				sTime.Minutes = ((tempReg >> 8)&0x0F) + ((tempReg >> 12)&0x07) * 10;
-				if ( minutesStep <= 1 || (sTime.Minutes % minutesStep) == 0 ) {
-					sTime.Hours = ((tempReg >> 16)&0x0F) + ((tempReg >> 20)&0x07) * 10;
-					sTime.TimeFormat = (uint8_t)((tempReg & (RTC_TR_PM)) >> 16);
-					if (hrtc.Init.HourFormat == RTC_HOURFORMAT_24) {
-						if ( (0x00000001 << sTime.Hours) & hoursSelection ) {
-							if ( (rtc_buffer[0x0E]&0x04) && (rtc_buffer[0x0E]&0x01) ) rtcWakeupEventFlag = 1;
-							rtc_buffer[0x0F] |= 0x01; // set alarm 1 flag
-						}
-					} else if ( sTime.TimeFormat == RTC_HOURFORMAT12_AM ) {
-						if (sTime.Hours < 12) {
-							if ( (0x00000001 << sTime.Hours) & hoursSelection ) {
-								if ( (rtc_buffer[0x0E]&0x04) && (rtc_buffer[0x0E]&0x01) ) rtcWakeupEventFlag = 1;
-								rtc_buffer[0x0F] |= 0x01; // set alarm 1 flag
-							}
-						} else if ( 0x00000001 & hoursSelection ) {
-							if ( (rtc_buffer[0x0E]&0x04) && (rtc_buffer[0x0E]&0x01) ) rtcWakeupEventFlag = 1;
-							rtc_buffer[0x0F] |= 0x01; // set alarm 1 flag
-						}
-					} else {
-						if (sTime.Hours < 12) {
-							if ( (0x00010000 << sTime.Hours) & hoursSelection ) {
-								if ( (rtc_buffer[0x0E]&0x04) && (rtc_buffer[0x0E]&0x01) ) rtcWakeupEventFlag = 1;
-								rtc_buffer[0x0F] |= 0x01; // set alarm 1 flag
-							}
-						} else if ( 0x00010000 & hoursSelection ) {
-							if ( (rtc_buffer[0x0E]&0x04) && (rtc_buffer[0x0E]&0x01) ) rtcWakeupEventFlag = 1;
-							rtc_buffer[0x0F] |= 0x01; // set alarm 1 flag
-						}
-					}
-				}
-			} else {
-				if ( (rtc_buffer[0x0E]&0x04) && (rtc_buffer[0x0E]&0x01) ) rtcWakeupEventFlag = 1;
-				rtc_buffer[0x0F] |= 0x01; // set alarm 1 flag
-			}
-		}
-	//}
+	RtcAlarmUpdate();
+}
+
+// Refreshes BCD time shadow registers from calendar, decoding only when RTC second has ticked,
+// sub-seconds register is taken on each call from same calendar snapshot
+static void RtcTimeShadowUpdate(void) {
+	uint32_t ss = hrtc.Instance->SSR; // locks TR and DR until DR is read
+	uint32_t tr = hrtc.Instance->TR;
+	uint32_t dr = hrtc.Instance->DR;
+
+	// sub seconds register counts down, after shift operation it can be above prescaler
+	rtc_buffer[RTC_SUBSECONDS_REG] = ss <= 255 ? 255 - ss : 0;
+
+	if (tr == rtcShadowTR && dr == rtcShadowDR) return;
+	rtcShadowTR = tr;
+	rtcShadowDR = dr;
+
+	rtc_buffer[0] = tr & (RTC_TR_ST | RTC_TR_SU);
+	rtc_buffer[1] = (tr & (RTC_TR_MNT | RTC_TR_MNU)) >> 8;
+	rtc_buffer[2] = (tr & (RTC_TR_HT | RTC_TR_HU)) >> 16;
+	if (hrtc.Init.HourFormat == RTC_HOURFORMAT_12) {
+		rtc_buffer[2] |= 0x40 | ((tr & RTC_TR_PM) ? 0x20 : 0);
+	}
+	rtc_buffer[3] = (dr & RTC_DR_WDU) >> 13;
+	rtc_buffer[4] = dr & (RTC_DR_DT | RTC_DR_DU);
+	rtc_buffer[5] = (dr & (RTC_DR_MT | RTC_DR_MU)) >> 8;
+	rtc_buffer[6] = (dr & (RTC_DR_YT | RTC_DR_YU)) >> 16;
+}
+
+// Registers from start to end of map, auto-increment read is served in one transfer
+static void RtcReadRegisters(uint8_t start, uint8_t *pData, uint16_t *dataLen) {
+	uint8_t i;
+
+	RtcTimeShadowUpdate();
+	if (start < 11) RtcReadAlarm1(&rtc_buffer[7], 0);
+	for (i = start; i < RTC_MAP_LEN; i++) pData[i - start] = rtc_buffer[i];
+	*dataLen = RTC_MAP_LEN - start;
 }
 
 void RtcDs1339ProcessRequest(uint8_t dir, uint8_t command, uint8_t *pData, uint16_t *dataLen) {
 	uint8_t i;
-	if (command == 0) {
-		if ( dir == I2C_DIRECTION_RECEIVE ) {
-			//testRegAdr[0] = pData[0]; // debug only
-			RtcReadTime(rtc_buffer, 0);
-			i = 7;
-			while (i--) pData[i] = rtc_buffer[i];
-			*dataLen = 7;
-		} else {
-			//testRegAdrW = pData[0]; // debug only
-			i = *dataLen;
-			while (i--) rtc_buffer[i] = pData[i];
-			RtcWriteTime(rtc_buffer, 0);
-		}
+	if ( command < RTC_MAP_LEN && dir == I2C_DIRECTION_RECEIVE ) {
+		RtcReadRegisters(command, pData, dataLen);
+	} else if (command == 0) {
+		//testRegAdrW = pData[0]; // debug only
+		i = *dataLen;
+		while (i--) rtc_buffer[i] = pData[i];
+		RtcWriteTime(rtc_buffer, 0);
 	} else if (command == 7) {
-		if ( dir == I2C_DIRECTION_RECEIVE ) {
-			RtcReadAlarm1(&rtc_buffer[7], 0);
-			i = 9;
-			while (i--) pData[i] = rtc_buffer[i + 7];
-			*dataLen = 9;
-		} else {
-				i = *dataLen;
-				while (i--)
-					if (i<9) rtc_buffer[i + 7] = pData[i];
-					/*else if (i==8) {
-						rtc_buffer[i + 7] &= pData[i] | 0xFC;
-					}*/
-				RtcWriteAlarm1(&rtc_buffer[7], 0);
-			}
+		i = *dataLen;
+		while (i--)
+			if (i<9) rtc_buffer[i + 7] = pData[i];
+			/*else if (i==8) {
+				rtc_buffer[i + 7] &= pData[i] | 0xFC;
+			}*/
+		RtcWriteAlarm1(&rtc_buffer[7], 0);
 	} else if (command == 0x0E) { // control register
-			if ( dir == I2C_DIRECTION_RECEIVE ) {
-				RtcReadControlStatus(pData, dataLen);
-//				pData[0] = rtc_buffer[command];
-//				pData[1] = rtc_buffer[command+1];
-//				*dataLen = 2;
-			} else {
-				RtcWriteControlStatus(pData, *dataLen);
-//				rtc_buffer[command] = pData[0];
-//				if (*dataLen > 1) {
-//					//if ((pData[1]&0x01) == 0x00) // deactivate alarm interrupt signal
-//						//HAL_GPIO_WritePin(GPIOB, GPIO_PIN_13, GPIO_PIN_SET);
-//					rtc_buffer[command+1] = rtc_buffer[command+1]&(pData[1] | 0xFC); // clear A1F, A2F
-//				}
-			}
+		RtcWriteControlStatus(pData, *dataLen);
 	} else if (command == 0x0F) {
-		if ( dir == I2C_DIRECTION_RECEIVE ) {
-			pData[0] = rtc_buffer[command];
-			*dataLen = 1;
-		} else {
-			//if ((pData[0]&0x01) == 0x00) // deactivate alarm interrupt signal
-				//HAL_GPIO_WritePin(GPIOB, GPIO_PIN_13, GPIO_PIN_SET);
-			rtc_buffer[command] = rtc_buffer[command] & (pData[0] | 0xFC); // clear A1F, A2F
-		}
-	} else 	if (command >=0 && command < RTC_REGISTERS_NUM ){
+		//if ((pData[0]&0x01) == 0x00) // deactivate alarm interrupt signal
+			//HAL_GPIO_WritePin(GPIOB, GPIO_PIN_13, GPIO_PIN_SET);
+		rtc_buffer[command] = rtc_buffer[command] & (pData[0] | 0xFC); // clear A1F, A2F
+	} else 	if (command < RTC_REGISTERS_NUM ){
 		if (dir == I2C_DIRECTION_TRANSMIT) {
-			rtc_buffer[command] = pData[0];
+			if (command != RTC_SUBSECONDS_REG) rtc_buffer[command] = pData[0];
 		} else {
 			pData[0] = rtc_buffer[command];
 			*dataLen = 1;
@@ -270,12 +419,17 @@ uint8_t RtcGetPointer() {
 }
 
 uint8_t RtcSetPointer(uint8_t val) {
-	if (val <= 0x0F)
-		rtc_buffer_ptr = val;
+	// wraps at end of map as in DS1339
+	rtc_buffer_ptr = val < RTC_MAP_LEN ? val : 0;
+	return rtc_buffer_ptr;
 }
 
 void RtcWriteTime(uint8_t *buffer, uint8_t extended) {
 	RTC_TimeTypeDef sTime;
+	uint32_t sec, newSec;
+	uint8_t sub, newSub;
+
+	RtcReadLinearTime(&sec, &sub);
 
 	sTime.SecondFraction = 127; // 1s / 256 resolution
 	sTime.Seconds = buffer[0]&0x7F;
@@ -325,6 +479,14 @@ void RtcWriteTime(uint8_t *buffer, uint8_t extended) {
 
 	HAL_RTC_SetTime(&hrtc, &sTime, RTC_FORMAT_BCD);
 	HAL_RTC_SetDate(&hrtc, &dateConf, RTC_FORMAT_BCD);
+	rtcShadowDR = 0; // time registers hold written bytes, decode again on next read
+
+	// time step is not drift, keep it out of calibration measurement
+	RtcReadLinearTime(&newSec, &newSub);
+	RtcCalibrationTimeStep((int32_t)(newSec - sec) * 256 + newSub - sub);
+	EnergyAccountingTimeStep((int32_t)(newSec - sec) * 256 + newSub - sub);
+
+	RtcAlarmUpdate();
 }
 
 void RtcReadTime(uint8_t *buffer, uint8_t extended) {
@@ -359,95 +521,86 @@ void RtcReadTime(uint8_t *buffer, uint8_t extended) {
 	}
 }
 
-void RtcReadAlarm1(uint8_t *buffer, uint8_t extended) {
-	HAL_RTC_GetAlarm(&hrtc, &sAlarm, RTC_ALARM_A, RTC_FORMAT_BCD);
-	buffer[0] = sAlarm.AlarmTime.Seconds | (sAlarm.AlarmMask&0x80);
-	sAlarm.AlarmMask >>= 8;
-	buffer[1] = sAlarm.AlarmTime.Minutes | (sAlarm.AlarmMask&0x80);
-	sAlarm.AlarmMask >>= 8;
-	if (hrtc.Init.HourFormat == RTC_HOURFORMAT_12) {
-		buffer[2] = sAlarm.AlarmTime.Hours;
-		buffer[2] |= sAlarm.AlarmTime.TimeFormat == RTC_HOURFORMAT12_PM ? 0x20 : 0;
-		buffer[2] |= 0x40 | (sAlarm.AlarmMask&0x80);
+// Time as seconds since 2000-01-01 and 1/256 s, for log records
+void RtcReadLinearTime(uint32_t *sec, uint8_t *sub) {
+	uint8_t rtc[9];
+	uint8_t year, month, date, hours;
+	uint32_t days;
+
+	RtcReadTime(rtc, 1);
+	year = RTC_BCD2BIN(rtc[6]);
+	month = RTC_BCD2BIN(rtc[5] & 0x1F);
+	date = RTC_BCD2BIN(rtc[4] & 0x3F);
+	if (month < 1 || month > 12) month = 1;
+	if (date < 1) date = 1;
+	if (rtc[2] & 0x40) {
+		// 12 hour format
+		hours = RTC_BCD2BIN(rtc[2] & 0x1F) % 12 + ((rtc[2] & 0x20) ? 12 : 0);
 	} else {
-		buffer[2] = sAlarm.AlarmTime.Hours | (sAlarm.AlarmMask&0x80);
+		hours = RTC_BCD2BIN(rtc[2] & 0x3F);
 	}
-	sAlarm.AlarmMask >>= 8;
-	buffer[3] = sAlarm.AlarmDateWeekDay;
-	buffer[3] |= (sAlarm.AlarmDateWeekDaySel == RTC_ALARMDATEWEEKDAYSEL_WEEKDAY) ? 0x40 : 0;
-	buffer[3] |= (sAlarm.AlarmMask&0x80);
 
-	if (extended) {
-		buffer[4] = hoursSelection;
-		buffer[5] = hoursSelection >> 8;
-		buffer[6] = hoursSelection >> 16;
+	days = 365UL * year + (year + 3) / 4 + rtcMonthDays[month - 1] + date - 1;
+	if (month > 2 && (year & 0x03) == 0) days++;
 
-		buffer[7] = minutesStep;
-		buffer[8] = weekDaysSelection;
-	}
+	*sec = ((days * 24 + hours) * 60 + RTC_BCD2BIN(rtc[1] & 0x7F)) * 60 + RTC_BCD2BIN(rtc[0] & 0x7F);
+	*sub = 255 - rtc[7]; // sub seconds register counts down
+}
+
+void RtcReadAlarm1(uint8_t *buffer, uint8_t extended) {
+	RtcScheduleToRegisters(&alarmSchedule, buffer, extended);
 }
 
 void RtcWriteAlarm1(uint8_t *buffer, uint8_t extended) {
-	sAlarm.AlarmTime.Seconds = buffer[0] & 0x7F;
-	sAlarm.AlarmTime.Minutes = buffer[1] & 0x7F;
-	if (buffer[2] & 0x40) {
-		if (hrtc.Init.HourFormat != RTC_HOURFORMAT_12) {
-			// convert hour format to 24 if different
-			uint8_t binHours = (buffer[2]&0x0F) + ((buffer[2]&0x10)?10:0);
-			if (buffer[2]&0x20) {
-				if (binHours < 12) binHours += 12;
-			} else {
-				if (binHours > 11) binHours = 0;
-			}
-			sAlarm.AlarmTime.Hours = binHour24ToBcd[binHours];
-		} else {
-			sAlarm.AlarmTime.Hours = buffer[2] & 0x1F;
-			sAlarm.AlarmTime.TimeFormat = buffer[2] & 0x20 ? RTC_HOURFORMAT12_PM : RTC_HOURFORMAT12_AM;
-		}
-	} else {
-		if (hrtc.Init.HourFormat != RTC_HOURFORMAT_24) {
-			// convert hour format to 12 if different
-			uint8_t binHours = (buffer[2]&0x0F) + ((buffer[2]&0x10)?10:0) + ((buffer[2]&0x20)?10:0);
-			uint8_t h = binHour24ToBcdAmPm[binHours];
-			sAlarm.AlarmTime.Hours = h & 0x1F;
-			sAlarm.AlarmTime.TimeFormat = h & 0x20 ? RTC_HOURFORMAT12_PM : RTC_HOURFORMAT12_AM;
-		} else {
-			sAlarm.AlarmTime.Hours = buffer[2]&0x3F;
-		}
-	}
-	sAlarm.AlarmDateWeekDaySel = (buffer[3] & 0x40) ? RTC_ALARMDATEWEEKDAYSEL_WEEKDAY : RTC_ALARMDATEWEEKDAYSEL_DATE;
-	sAlarm.AlarmDateWeekDay = buffer[3] & 0x3F;
+	RtcScheduleFromRegisters(&alarmSchedule, buffer, extended);
+	alarmScheduleCheck = RtcAlarmScheduleCheck();
+	RtcAlarmUpdate();
 
-	sAlarm.AlarmMask = buffer[3]&0x80;
-	sAlarm.AlarmMask <<= 8;
-	sAlarm.AlarmMask |= buffer[2]&0x80;
-	sAlarm.AlarmMask <<= 8;
-	sAlarm.AlarmMask |= buffer[1]&0x80;
-	sAlarm.AlarmMask <<= 8;
-	sAlarm.AlarmMask |= buffer[0]&0x80;
+	LOG_ALARM_WRITE();
+}
 
-	if (extended) {
-		hoursSelection = buffer[6];
-		hoursSelection <<= 8;
-		hoursSelection |= buffer[5];
-		hoursSelection <<= 8;
-		hoursSelection |= buffer[4];
-		minutesStep = buffer[7];
-		weekDaysSelection = buffer[8];
-
-		if (!(buffer[0] || buffer[1] || buffer[2] || buffer[3])) {
-			HAL_RTC_DeactivateAlarm(&hrtc, RTC_ALARM_A);
-		}
+// data[0] schedule index, followed by 9 bytes in extended alarm 1 format to write schedule,
+// or index only to select schedule for read. Index 0xFF clears record of fired schedules.
+void RtcWakeScheduleWriteCmd(uint8_t data[], uint16_t len) {
+	RtcSchedule_T sch;
+	uint16_t addr;
 
-	} else {
-		hoursSelection = 0xFFFFFFFF;
-		weekDaysSelection = 0xFF;
-		minutesStep = 0;
+	if (len < 1) return;
+	if (data[0] == 0xFF) {
+		wakeScheduleFired = 0;
+		return;
 	}
+	if (data[0] >= RTC_WAKE_SCHEDULES_NUM) return;
+	wakeScheduleSel = data[0];
+	if (len < 10) return;
+
+	RtcScheduleFromRegisters(&sch, data + 1, 1);
+	addr = RTC_WAKE_SCHEDULE0_TIME_NV_ADDR + RTC_WAKE_SCHEDULE_NV_VARS * wakeScheduleSel;
+	NvTransactionBegin();
+	NvTransactionStage(addr, sch.seconds | ((uint16_t)sch.minutes << 8));
+	NvTransactionStage(addr + 1, sch.hours | ((uint16_t)sch.day << 8));
+	NvTransactionStage(addr + 2, sch.hoursSelection & 0xFFFF);
+	NvTransactionStage(addr + 3, ((sch.hoursSelection >> 16) & 0xFF) | ((uint16_t)sch.minutesStep << 8));
+	NvTransactionStageU8(addr + 4, sch.weekDaysSelection);
+	NvTransactionCommit();
+
+	RtcWakeScheduleRead(wakeScheduleSel);
+	RtcAlarmUpdate();
+}
 
-	HAL_RTC_SetAlarm_IT(&hrtc, &sAlarm, RTC_FORMAT_BCD);
-
-	LOG_ALARM_WRITE();
+// Selected schedule index and its 9 bytes, mask of schedules fired last and their time:
+// year, month, date, hours in 24 hour format, minutes, seconds in binary
+void RtcWakeScheduleReadCmd(uint8_t data[], uint16_t *len) {
+	data[0] = wakeScheduleSel;
+	RtcScheduleToRegisters(&wakeSchedules[wakeScheduleSel], data + 1, 1);
+	data[10] = wakeScheduleFired;
+	data[11] = wakeScheduleFired ? wakeScheduleFiredTime.year : 0;
+	data[12] = wakeScheduleFired ? wakeScheduleFiredTime.month : 0;
+	data[13] = wakeScheduleFired ? wakeScheduleFiredTime.date : 0;
+	data[14] = wakeScheduleFired ? wakeScheduleFiredTime.hours : 0;
+	data[15] = wakeScheduleFired ? wakeScheduleFiredTime.minutes : 0;
+	data[16] = wakeScheduleFired ? wakeScheduleFiredTime.seconds : 0;
+	*len = 17;
 }
 
 void RtcWriteControlStatus(uint8_t *buffer, uint16_t dataLen) {
@@ -0,0 +1,122 @@
+/*
+ * rtc_schedule.c
+ *
+ *  Created on: 19.10.2026.
+ */
+
+#include "rtc_schedule.h"
+
+static const uint8_t rtcMonthLength[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+
+static uint8_t RtcScheduleDayMatch(const RtcSchedule_T *s, const RtcCalendar_T *t) {
+	if ( !((s->weekDaysSelection >> t->weekDay) & 0x01) ) return 0;
+	if (s->day & RTC_SCHEDULE_ANY) return 1;
+	if (s->day & RTC_SCHEDULE_WEEKDAY) return (s->day & 0x0F) == t->weekDay;
+	return (s->day & 0x3F) == t->date;
+}
+
+static uint8_t RtcScheduleHourMatch(const RtcSchedule_T *s, uint8_t hours) {
+	return ((s->hoursSelection >> hours) & 0x01) && ((s->hours & RTC_SCHEDULE_ANY) || s->hours == hours);
+}
+
+static uint8_t RtcScheduleMinuteMatch(const RtcSchedule_T *s, uint8_t minutes) {
+	return (s->minutesStep <= 1 || (minutes % s->minutesStep) == 0)
+		&& ((s->minutes & RTC_SCHEDULE_ANY) || s->minutes == minutes);
+}
+
+uint8_t RtcScheduleMatch(const RtcSchedule_T *s, const RtcCalendar_T *t) {
+	return RtcScheduleDayMatch(s, t) && RtcScheduleHourMatch(s, t->hours) && RtcScheduleMinuteMatch(s, t->minutes)
+		&& ((s->seconds & RTC_SCHEDULE_ANY) || s->seconds == t->seconds);
+}
+
+// Advances t to first time after it that matches schedule
+uint8_t RtcScheduleNext(const RtcSchedule_T *s, RtcCalendar_T *t) {
+	uint8_t h = t->hours;
+	uint8_t m = t->minutes;
+	uint8_t sec = t->seconds + 1;
+	uint8_t monthLength;
+	uint16_t day;
+
+	if ( !(s->day & RTC_SCHEDULE_ANY) && ((s->day & RTC_SCHEDULE_WEEKDAY) ? (s->day & 0x0F) > 7 || (s->day & 0x0F) == 0
+		: (s->day & 0x3F) > 31 || (s->day & 0x3F) == 0) ) {
+		return RTC_SCHEDULE_NONE;
+	}
+	if ( !(s->seconds & RTC_SCHEDULE_ANY) && s->seconds > 59 ) return RTC_SCHEDULE_NONE;
+	// selections that exclude every day, hour or minute would scan whole horizon on each call
+	if ( !(s->weekDaysSelection & 0xFE) || !(s->hoursSelection & 0x00FFFFFF) ) return RTC_SCHEDULE_NONE;
+	if ( (s->day & (RTC_SCHEDULE_ANY | RTC_SCHEDULE_WEEKDAY)) == RTC_SCHEDULE_WEEKDAY
+		&& !((s->weekDaysSelection >> (s->day & 0x0F)) & 0x01) ) return RTC_SCHEDULE_NONE;
+	if ( !(s->hours & RTC_SCHEDULE_ANY) && (s->hours > 23 || !RtcScheduleHourMatch(s, s->hours)) ) return RTC_SCHEDULE_NONE;
+	if ( !(s->minutes & RTC_SCHEDULE_ANY) && (s->minutes > 59 || !RtcScheduleMinuteMatch(s, s->minutes)) ) return RTC_SCHEDULE_NONE;
+
+	for (day = 0; day < RTC_SCHEDULE_HORIZON_DAYS; day++) {
+		if (RtcScheduleDayMatch(s, t)) {
+			for (; h < 24; h++, m = 0, sec = 0) {
+				if (!RtcScheduleHourMatch(s, h)) continue;
+				for (; m < 60; m++, sec = 0) {
+					if (!RtcScheduleMinuteMatch(s, m)) continue;
+					if (s->seconds & RTC_SCHEDULE_ANY) {
+						if (sec > 59) continue;
+					} else if (s->seconds >= sec) {
+						sec = s->seconds;
+					} else {
+						continue;
+					}
+					t->hours = h;
+					t->minutes = m;
+					t->seconds = sec;
+					return RTC_SCHEDULE_FOUND;
+				}
+			}
+		}
+
+		h = 0;
+		m = 0;
+		sec = 0;
+		monthLength = (t->month == 2 && (t->year & 0x03) == 0) ? 29 : rtcMonthLength[(t->month - 1) % 12];
+		t->weekDay = t->weekDay % 7 + 1;
+		if (++t->date > monthLength) {
+			t->date = 1;
+			if (++t->month > 12) {
+				t->month = 1;
+				t->year = (t->year + 1) % 100;
+			}
+		}
+	}
+
+	t->hours = 0;
+	t->minutes = 0;
+	t->seconds = 0;
+	return RTC_SCHEDULE_HORIZON;
+}
+
+// Advances t to first time after it that matches any of n schedules, result of earliest one
+uint8_t RtcScheduleNextAny(const RtcSchedule_T s[], uint8_t n, RtcCalendar_T *t) {
+	RtcCalendar_T c, best = *t;
+	uint8_t result = RTC_SCHEDULE_NONE;
+	uint8_t r, i;
+
+	for (i = 0; i < n; i++) {
+		c = *t;
+		r = RtcScheduleNext(&s[i], &c);
+		// horizon time is always after any found time
+		if (r != RTC_SCHEDULE_NONE && (result == RTC_SCHEDULE_NONE || RtcCalendarCompare(&c, &best) < 0)) {
+			best = c;
+			result = r;
+		}
+	}
+
+	*t = best;
+	return result;
+}
+
+int8_t RtcCalendarCompare(const RtcCalendar_T *a, const RtcCalendar_T *b) {
+	uint32_t da = ((uint32_t)a->year << 9) | ((uint32_t)a->month << 5) | a->date;
+	uint32_t db = ((uint32_t)b->year << 9) | ((uint32_t)b->month << 5) | b->date;
+	uint32_t sa = ((uint32_t)a->hours * 60 + a->minutes) * 60 + a->seconds;
+	uint32_t sb = ((uint32_t)b->hours * 60 + b->minutes) * 60 + b->seconds;
+
+	if (da != db) return da < db ? -1 : 1;
+	if (sa != sb) return sa < sb ? -1 : 1;
+	return 0;
+}
@@ -34,6 +34,8 @@
 #include "stm32f0xx_hal.h"
 #include "stm32f0xx.h"
 #include "stm32f0xx_it.h"
+#include "led.h"
+#include "io_counter.h"
 
 /* USER CODE BEGIN 0 */
 extern void SysTickCb();
@@ -50,6 +52,7 @@ extern RTC_HandleTypeDef hrtc;
 extern ADC_HandleTypeDef hadc;
 //extern WWDG_HandleTypeDef hwwdg;
 extern TIM_HandleTypeDef htim6;
+extern TIM_HandleTypeDef htim3;
 /******************************************************************************/
 /*            Cortex-M0 Processor Interruption and Exception Handlers         */
 /******************************************************************************/
@@ -223,6 +226,30 @@ void ADC1_IRQHandler(void)
 	HAL_ADC_IRQHandler(&hadc);
 }
 
+/**
+  * @brief  This function handles TIM3 update interrupt, advances LED effects.
+  * @param  None
+  * @retval None
+  */
+void TIM3_IRQHandler(void)
+{
+  if (__HAL_TIM_GET_FLAG(&htim3, TIM_FLAG_UPDATE) != RESET)
+  {
+    __HAL_TIM_CLEAR_IT(&htim3, TIM_IT_UPDATE);
+    LedEffectsTimerCb();
+  }
+}
+
+/**
+  * @brief  This function handles TIM14 capture interrupt, counts IO1 pulses.
+  * @param  None
+  * @retval None
+  */
+void TIM14_IRQHandler(void)
+{
+  IoCounterCaptureCb();
+}
+
 /**
   * @brief  This function handles external line 0 interrupt request.
   * @param  None
@@ -103,6 +103,18 @@ void HAL_ResumeTick(void)
   /* Enable TIM6 Update interrupt */
   __HAL_TIM_ENABLE_IT(&htim6, TIM_IT_UPDATE);
 }
+
+uint32_t TimeTickFine(void) {
+	return HAL_GetTick();
+}
+
+uint32_t TimeTickFineUs(void) {
+	return HAL_GetTick() * 1000;
+}
+
+uint8_t TimeTickIsSuspended(void) {
+	return !__HAL_TIM_GET_IT_SOURCE(&htim6, TIM_IT_UPDATE);
+}
 #else //if defined(RTOS_NORTOS)
 
 HAL_StatusTypeDef HAL_InitTick(uint32_t TickPriority)
@@ -127,6 +139,41 @@ uint32_t HAL_GetTick(void)
 {
   return msTickCnt;
 }
+
+// Tick time and SysTick counts elapsed in current tick period
+static uint32_t TimeTickRead(uint32_t *elapsed) {
+	uint32_t ms, val;
+
+	do {
+		ms = msTickCnt;
+		val = SysTick->VAL;
+	} while (ms != msTickCnt);
+
+	// reload that has not been counted yet, when interrupts are disabled
+	if ((SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) && val > (SysTick->LOAD >> 1)) ms += TICK_PERIOD_MS;
+
+	*elapsed = SysTick->LOAD - val;
+	return ms;
+}
+
+// Tick time with elapsed part of SysTick period, for timestamps finer than tick period
+uint32_t TimeTickFine(void) {
+	uint32_t elapsed;
+	uint32_t ms = TimeTickRead(&elapsed);
+	return ms + elapsed * TICK_PERIOD_MS / (SysTick->LOAD + 1);
+}
+
+// Fine tick time in us, wraps after 71 minutes, for time differences only
+uint32_t TimeTickFineUs(void) {
+	uint32_t elapsed;
+	uint32_t ms = TimeTickRead(&elapsed);
+	return ms * 1000 + elapsed * (TICK_PERIOD_MS * 1000) / (SysTick->LOAD + 1);
+}
+
+// Tick does not count while suspended for stop mode, time is stepped on wake-up
+uint8_t TimeTickIsSuspended(void) {
+	return !(SysTick->CTRL & SysTick_CTRL_TICKINT_Msk);
+}
 #endif
 void HAL_Delay(__IO uint32_t Delay)
 {
@@ -0,0 +1,318 @@
+/*
+ * trace.c
+ *
+ *  Created on: 19.10.2026.
+ */
+
+#include "trace.h"
+#include "rtc_ds1339_emu.h"
+#include "time_count.h"
+#include "power_source.h"
+#include "charger_bq2416x.h"
+#include "fuel_gauge_lc709203f.h"
+#include "load_current_sense.h"
+
+// Chunk: length, samples count, time of first sample as 4 bytes seconds since 2000-01-01 and 1 byte 1/256 s,
+// first sample as 16 bit values of enabled signals, then for each next sample bitmap of changed signals
+// followed by their deltas, zigzag encoded as unsigned LEB128. Samples in chunk are trace period apart.
+#define TRACE_SAMPLE_MAX_LEN	(1 + 3 * TRACE_SIGNALS_NUM)
+
+#define TRACE_READ_FLAG_MORE	0x01
+#define TRACE_READ_FLAG_LOST	0x02
+
+#define TRACE_HOST_OFF()	(!POW_5V_BOOST_EN_STATUS() && power5vIoStatus == POW_SOURCE_NOT_PRESENT)
+
+static uint8_t trace_buf[TRACE_BUF_SIZE];
+static uint16_t trace_head; // index of open chunk, or where next chunk is started
+static uint16_t trace_tail; // index of oldest closed chunk
+static uint16_t trace_chunks; // number of closed chunks in buffer
+static uint16_t trace_read; // index of first chunk not read by host
+static uint16_t trace_unread; // number of closed chunks not read by host
+static uint8_t trace_open = 0; // chunk at head is being filled
+static uint8_t trace_lost = 0; // unread chunks were overwritten since last drain frame
+static uint16_t trace_frame_read; // read cursor at start of last drain frame, to repeat it
+static uint16_t trace_frame_unread;
+static uint8_t trace_frame_lost;
+static uint8_t trace_frame_valid = 0; // 1 - last drain frame can be repeated, 2 - its first chunk was overwritten
+static int16_t trace_prev[TRACE_SIGNALS_NUM]; // last sample values, deltas base
+static uint32_t trace_timer;
+
+// configuration survives watchdog reset, so trace resumes after it
+static uint8_t trace_mask __attribute__((section("no_init"))); // enabled signals, 0 - trace stopped
+static uint16_t trace_period __attribute__((section("no_init"))); // ms
+static uint8_t trace_flags __attribute__((section("no_init")));
+
+extern uint8_t resetStatus;
+
+static void TraceGetSignals(int16_t v[TRACE_SIGNALS_NUM]) {
+	v[TRACE_SIGNAL_VBAT] = batteryVoltage;
+	v[TRACE_SIGNAL_IBAT] = batteryCurrent;
+	v[TRACE_SIGNAL_IIO] = GetLoadCurrent();
+	v[TRACE_SIGNAL_TEMP] = batteryTemp;
+	v[TRACE_SIGNAL_SOC] = batteryRsoc;
+	v[TRACE_SIGNAL_CHARGER] = chargerStatus;
+}
+
+// Index of chunk following chunk at ind, end of buffer content is marked with zero length
+static uint16_t TraceNextChunk(uint16_t ind) {
+	ind += trace_buf[ind];
+	if (ind >= TRACE_BUF_SIZE || trace_buf[ind] == 0) ind = 0;
+	return ind;
+}
+
+// Drop oldest chunk, read cursor is moved if it was pointing to it
+static void TraceEvict(void) {
+	uint8_t readAtTail = trace_unread == trace_chunks;
+
+	if (readAtTail) {
+		trace_unread--;
+		trace_lost = 1;
+	}
+	if (trace_frame_valid == 1 && trace_frame_unread == trace_chunks) trace_frame_valid = 2;
+
+	trace_chunks--;
+	trace_tail = trace_chunks ? TraceNextChunk(trace_tail) : trace_head;
+
+	if (readAtTail) trace_read = trace_tail;
+}
+
+// Must be called with interrupts disabled
+static void TraceCloseChunk(void) {
+	if (!trace_open) return;
+
+	trace_open = 0;
+	trace_head += trace_buf[trace_head];
+	if (trace_head >= TRACE_BUF_SIZE) trace_head = 0;
+	trace_chunks++;
+	trace_unread++;
+	if (trace_frame_valid == 1) trace_frame_unread++;
+}
+
+// Reserves space for largest chunk at head, must be called with interrupts disabled
+static uint8_t *TraceOpenChunk(void) {
+	uint32_t sec;
+	uint8_t sub;
+	uint8_t *p;
+
+	if (trace_head + TRACE_CHUNK_MAX_LEN > TRACE_BUF_SIZE) {
+		// keep chunk contiguous, mark end of content and continue from buffer start
+		while (trace_chunks && trace_tail >= trace_head) TraceEvict();
+		trace_buf[trace_head] = 0;
+		trace_head = 0;
+	}
+	while (trace_chunks && trace_tail >= trace_head && trace_tail < trace_head + TRACE_CHUNK_MAX_LEN) TraceEvict();
+
+	if (trace_chunks == 0) trace_tail = trace_head;
+	if (trace_unread == 0) trace_read = trace_head;
+
+	RtcReadLinearTime(&sec, &sub);
+	p = trace_buf + trace_head;
+	p[0] = TRACE_CHUNK_HEADER_LEN;
+	p[1] = 0;
+	p[2] = sec;
+	p[3] = sec >> 8;
+	p[4] = sec >> 16;
+	p[5] = sec >> 24;
+	p[6] = sub;
+	trace_open = 1;
+
+	return p;
+}
+
+static void TraceSample(void) {
+	int16_t v[TRACE_SIGNALS_NUM];
+	uint8_t *chunk, *p, *changed;
+	uint16_t delta;
+	uint8_t i, bit = 0x01;
+	uint32_t primask;
+
+	TraceGetSignals(v);
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+
+	chunk = trace_buf + trace_head;
+	if (trace_open && (chunk[0] + TRACE_SAMPLE_MAX_LEN > TRACE_CHUNK_MAX_LEN || chunk[1] == 0xFF)) TraceCloseChunk();
+
+	if (!trace_open) {
+		chunk = TraceOpenChunk();
+		p = chunk + chunk[0];
+		for (i = 0; i < TRACE_SIGNALS_NUM; i++) {
+			if (!(trace_mask & (0x01 << i))) continue;
+			*p++ = v[i];
+			*p++ = (uint16_t)v[i] >> 8;
+			trace_prev[i] = v[i];
+		}
+	} else {
+		p = chunk + chunk[0];
+		changed = p++;
+		*changed = 0;
+		for (i = 0; i < TRACE_SIGNALS_NUM; i++) {
+			if (!(trace_mask & (0x01 << i))) continue;
+			if (v[i] != trace_prev[i]) {
+				*changed |= bit;
+				delta = v[i] - trace_prev[i];
+				delta = (delta << 1) ^ ((delta & 0x8000) ? 0xFFFF : 0);
+				do {
+					*p = delta & 0x7F;
+					delta >>= 7;
+					if (delta) *p |= 0x80;
+					p++;
+				} while (delta);
+				trace_prev[i] = v[i];
+			}
+			bit <<= 1;
+		}
+	}
+
+	chunk[0] = p - chunk;
+	chunk[1]++;
+
+	__set_PRIMASK(primask);
+}
+
+static void TraceReset(void) {
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	trace_head = 0;
+	trace_tail = 0;
+	trace_chunks = 0;
+	trace_read = 0;
+	trace_unread = 0;
+	trace_open = 0;
+	trace_lost = 0;
+	trace_frame_valid = 0;
+	__set_PRIMASK(primask);
+	MS_TIME_COUNTER_INIT(trace_timer);
+}
+
+void TraceInit(void) {
+	if (!resetStatus || trace_period < TRACE_MIN_PERIOD_MS) {
+		trace_mask = 0;
+		trace_period = 1000;
+		trace_flags = 0;
+	}
+	TraceReset();
+}
+
+// Sampling keeps main loop out of low power mode, tick does not run while in stop
+uint8_t TraceIsSampling(void) {
+	return trace_mask && ((trace_flags & TRACE_FLAG_HOST_OFF) || !TRACE_HOST_OFF());
+}
+
+void TraceTask(void) {
+	uint32_t primask;
+	uint32_t elapsed;
+
+	if (!TraceIsSampling()) {
+		if (trace_open) {
+			primask = __get_PRIMASK();
+			__disable_irq();
+			TraceCloseChunk();
+			__set_PRIMASK(primask);
+		}
+		MS_TIME_COUNTER_INIT(trace_timer);
+		return;
+	}
+
+	elapsed = MS_TIME_COUNT(trace_timer);
+	if (elapsed < trace_period) return;
+
+	if (elapsed >= 2 * (uint32_t)trace_period) {
+		// samples missed, continue in new chunk with its own time
+		primask = __get_PRIMASK();
+		__disable_irq();
+		TraceCloseChunk();
+		__set_PRIMASK(primask);
+		MS_TIME_COUNTER_INIT(trace_timer);
+	} else {
+		trace_timer += trace_period;
+	}
+
+	TraceSample();
+}
+
+// Drain frame: chunks bytes count, flags (bit0 more unread chunks, bit1 unread chunks lost),
+// signal mask, period in ms, configuration flags, followed by whole chunks
+static void TraceReadFrame(uint8_t data[], uint16_t *len) {
+	uint16_t n = TRACE_DRAIN_HEADER_LEN;
+	uint16_t chunkLen;
+	uint16_t i;
+
+	for (i = 0; i < TRACE_DRAIN_LEN; i++) data[i] = 0;
+
+	// host has read everything else, return samples collected so far
+	if (trace_unread == 0) TraceCloseChunk();
+
+	trace_frame_read = trace_read;
+	trace_frame_unread = trace_unread;
+	trace_frame_lost = trace_lost;
+	trace_frame_valid = trace_unread != 0;
+
+	while (trace_unread) {
+		chunkLen = trace_buf[trace_read];
+		if (n + chunkLen > TRACE_DRAIN_LEN) break;
+		for (i = 0; i < chunkLen; i++) data[n + i] = trace_buf[trace_read + i];
+		n += chunkLen;
+
+		trace_unread--;
+		trace_read = trace_unread ? TraceNextChunk(trace_read) : trace_head;
+	}
+
+	data[0] = n - TRACE_DRAIN_HEADER_LEN;
+	data[1] = (trace_unread ? TRACE_READ_FLAG_MORE : 0) | (trace_lost ? TRACE_READ_FLAG_LOST : 0);
+	data[2] = trace_mask;
+	data[3] = trace_period;
+	data[4] = trace_period >> 8;
+	data[5] = trace_flags;
+	trace_lost = 0;
+	*len = TRACE_DRAIN_LEN;
+}
+
+void TraceReadCmd(uint8_t data[], uint16_t *len) {
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	TraceReadFrame(data, len);
+	__set_PRIMASK(primask);
+}
+
+// data[0]: 0 - start trace with signal mask data[1], period data[2..3] in ms and flags data[4], mask 0 stops,
+// 1 - rewind read cursor to oldest chunk, 2 - repeat last drain frame
+void TraceWriteCmd(uint8_t data[], uint16_t len) {
+	uint32_t primask;
+	uint16_t period;
+
+	if (len < 1) return;
+
+	if (data[0] == 0) {
+		if (len < 5) return;
+		period = data[2] | ((uint16_t)data[3] << 8);
+		if (period < TRACE_MIN_PERIOD_MS) period = TRACE_MIN_PERIOD_MS;
+		trace_mask = data[1] & ((0x01 << TRACE_SIGNALS_NUM) - 1);
+		trace_period = period;
+		trace_flags = data[4];
+		TraceReset();
+	} else if (data[0] == 1) {
+		primask = __get_PRIMASK();
+		__disable_irq();
+		trace_read = trace_tail;
+		trace_unread = trace_chunks;
+		trace_lost = 0;
+		trace_frame_valid = 0;
+		__set_PRIMASK(primask);
+	} else if (data[0] == 2) {
+		primask = __get_PRIMASK();
+		__disable_irq();
+		if (trace_frame_valid == 1) {
+			trace_read = trace_frame_read;
+			trace_unread = trace_frame_unread;
+			trace_lost = trace_frame_lost;
+		} else if (trace_frame_valid == 2) {
+			trace_read = trace_tail;
+			trace_unread = trace_chunks;
+			trace_lost = 1;
+		}
+		trace_frame_valid = 0;
+		__set_PRIMASK(primask);
+	}
+}
@@ -2,6 +2,7 @@
 __version__ = "1.8"
 
 import ctypes
+import fcntl
 import sys
 import threading
 import time
@@ -12,6 +13,19 @@ pijuice_hard_functions = ['HARD_FUNC_POWER_ON', 'HARD_FUNC_POWER_OFF', 'HARD_FUN
 pijuice_sys_functions = ['SYS_FUNC_HALT', 'SYS_FUNC_HALT_POW_OFF', 'SYS_FUNC_SYS_OFF_HALT', 'SYS_FUNC_REBOOT']
 pijuice_user_functions = ['USER_EVENT'] + ['USER_FUNC' + str(i+1) for i in range(0, 15)]
 
+# Combined write and read transfer of Linux i2c-dev, not limited to 32 bytes as SMBus block read
+I2C_RDWR = 0x0707
+I2C_M_RD = 0x0001
+
+
+class I2cMsg(ctypes.Structure):
+    _fields_ = [('addr', ctypes.c_uint16), ('flags', ctypes.c_uint16),
+                ('len', ctypes.c_uint16), ('buf', ctypes.POINTER(ctypes.c_uint8))]
+
+
+class I2cRdwrIoctlData(ctypes.Structure):
+    _fields_ = [('msgs', ctypes.POINTER(I2cMsg)), ('nmsgs', ctypes.c_uint32)]
+
 
 class PiJuiceInterface(object):
     def __init__(self, bus=1, address=0x14):
@@ -21,6 +35,7 @@ class PiJuiceInterface(object):
         called to open the bus.
         """
         self.i2cbus = SMBus(bus)
+        self.bus = bus
         self.addr = address
         self.t = None
         self.comError = False
@@ -59,6 +74,23 @@ class PiJuiceInterface(object):
             self.errTime = time.time()
             self.d = None
 
+    def _Rdwr(self, msgs):
+        with open('/dev/i2c-' + str(self.bus), 'r+b', buffering=0) as f:
+            fcntl.ioctl(f.fileno(), I2C_RDWR, I2cRdwrIoctlData(msgs, len(msgs)))
+
+    def _ReadLong(self):
+        wbuf = (ctypes.c_uint8 * 1)(self.cmd)
+        rbuf = (ctypes.c_uint8 * self.length)()
+        msgs = (I2cMsg * 2)(I2cMsg(self.addr, 0, 1, wbuf), I2cMsg(self.addr, I2C_M_RD, self.length, rbuf))
+        try:
+            self._Rdwr(msgs)
+            self.d = list(rbuf)
+            self.comError = False
+        except:  # IOError:
+            self.comError = True
+            self.errTime = time.time()
+            self.d = None
+
     def _Write(self):
         try:
             self.i2cbus.write_i2c_block_data(self.addr, self.cmd, self.d)
@@ -67,6 +99,15 @@ class PiJuiceInterface(object):
             self.comError = True
             self.errTime = time.time()
 
+    def _WriteLong(self):
+        wbuf = (ctypes.c_uint8 * (len(self.d) + 1))(self.cmd, *self.d)
+        try:
+            self._Rdwr((I2cMsg * 1)(I2cMsg(self.addr, 0, len(wbuf), wbuf)))
+            self.comError = False
+        except:  # IOError:
+            self.comError = True
+            self.errTime = time.time()
+
     def _DoTransfer(self, oper):
         if (self.t != None and self.t.is_alive()) or (self.comError and (time.time()-self.errTime) < 4):
             return False
@@ -85,11 +126,19 @@ class PiJuiceInterface(object):
         return True
 
     def ReadData(self, cmd, length):
+        return self._ReadData(cmd, length, self._Read)
+
+    def ReadDataLong(self, cmd, length):
+        """Read of data with checksum over 32 bytes, SMBus block read limit,
+        in one I2C_RDWR transfer."""
+        return self._ReadData(cmd, length, self._ReadLong)
+
+    def _ReadData(self, cmd, length, oper):
         d = []
 
         self.cmd = cmd
         self.length = length + 1
-        if not self._DoTransfer(self._Read):
+        if not self._DoTransfer(oper):
             return {'error': 'COMMUNICATION_ERROR'}
 
         d = self.d
@@ -106,13 +155,21 @@ class PiJuiceInterface(object):
         return {'data': d, 'error': 'NO_ERROR'}
 
     def WriteData(self, cmd, data):
+        return self._WriteData(cmd, data, self._Write)
+
+    def WriteDataLong(self, cmd, data):
+        """Write of data with checksum over 32 bytes, SMBus block write limit,
+        in one I2C_RDWR transfer."""
+        return self._WriteData(cmd, data, self._WriteLong)
+
+    def _WriteData(self, cmd, data, oper):
         fcs = self._GetChecksum(data)
         d = data[:]
         d.append(fcs)
 
         self.cmd = cmd
         self.d = d
-        if not self._DoTransfer(self._Write):
+        if not self._DoTransfer(oper):
             return {'error': 'COMMUNICATION_ERROR'}
 
         return {'error': 'NO_ERROR'}
@@ -151,6 +208,11 @@ class PiJuiceStatus(object):
     LED_STATE_CMD = 0x66
     LED_BLINK_CMD = 0x68
     IO_PIN_ACCESS_CMD = 0x75
+    LED_EFFECTS_CMD = 0xCC
+    IO_LOG_CMD = 0xCD
+    IO_CURRENT_STATS_CMD = 0xCE
+    IO_LOG_READ_RECORDS = 32
+    LED_EFFECT_STEPS_MAX = 16
 
     def __init__(self, interface):
         self.interface = interface
@@ -188,10 +250,17 @@ class PiJuiceStatus(object):
 
 
     faultEvents = ['button_power_off', 'forced_power_off',
-                   'forced_sys_power_off', 'watchdog_reset']
+                   'forced_sys_power_off', 'watchdog_reset', 'policy_shutdown']
     faults = ['battery_profile_invalid', 'charging_temperature_fault']
+    # Firmware version >= 1.7 returns event byte, its checksum and extended byte with
+    # watchdog warning in bit 0. Event byte and its checksum are valid one byte read.
     def GetFaultStatus(self):
-        result = self.interface.ReadData(self.FAULT_EVENT_CMD, 1)
+        ext = 0
+        result = self.interface.ReadData(self.FAULT_EVENT_CMD, 3)
+        if result['error'] == 'NO_ERROR' and result['data'][1] == result['data'][0] ^ 0xFF and result['data'][2] <= 0x01:
+            ext = result['data'][2]
+        else:
+            result = self.interface.ReadData(self.FAULT_EVENT_CMD, 1)
         if result['error'] != 'NO_ERROR':
             return result
         else:
@@ -205,11 +274,15 @@ class PiJuiceStatus(object):
                 fault['forced_sys_power_off'] = True
             if d & 0x08:
                 fault['watchdog_reset'] = True
+            if d & 0x10:
+                fault['policy_shutdown'] = True
             if d & 0x20:
                 fault['battery_profile_invalid'] = True
             batChargingTempEnum = ['NORMAL', 'SUSPEND', 'COOL', 'WARM']
             if (d >> 6) & 0x03:
                 fault['charging_temperature_fault'] = batChargingTempEnum[(d >> 6) & 0x03]
+            if ext & 0x01:
+                fault['watchdog_warning'] = True
             return {'data': fault, 'error': 'NO_ERROR'}
 
     def ResetFaultFlags(self, flags):
@@ -304,6 +377,59 @@ class PiJuiceStatus(object):
                 i = i - (1 << 16)
             return {'data': i, 'error': 'NO_ERROR'}
 
+    # Load current statistics at ADC scan rate in mA: last completed window and highest window
+    # average of three nested windows, highest scan current with time and histogram of scans per
+    # current bin, firmware version >= 1.7
+    def GetIoCurrentStats(self):
+        ret = self.interface.ReadDataLong(self.IO_CURRENT_STATS_CMD, 150)
+        if ret['error'] != 'NO_ERROR':
+            return ret
+        d = ret['data']
+
+        def s16(k):
+            v = d[k] | (d[k+1] << 8)
+            return v - (1 << 16) if v & (1 << 15) else v
+
+        def u32(k):
+            return d[k] | (d[k+1] << 8) | (d[k+2] << 16) | (d[k+3] << 24)
+
+        def t(k):
+            sec = u32(k)
+            return sec + 946684800 + d[k+4] / 256.0 if sec else None
+
+        baseMs = d[1] | (d[2] << 8)
+        lengths = [baseMs, baseMs * d[3], baseMs * d[3] * d[4]]
+        windows = []
+        for k in range(3):
+            p = 7 + k * 24
+            windows.append({'length': lengths[k], 'count': u32(p),
+                            'min': s16(p+4), 'max': s16(p+6), 'avg': s16(p+8), 'rms': s16(p+10), 'end': t(p+12),
+                            'peakAvg': s16(p+17), 'peakTime': t(p+19)})
+        bins = [u32(86 + k * 4) << d[6] for k in range(16)]
+        return {'data': {'running': bool(d[0] & 0x01), 'windows': windows,
+                         'peak': s16(79), 'peakTime': t(81),
+                         'histogramBin': 1 << d[5], 'histogram': bins}, 'error': 'NO_ERROR'}
+
+    def ResetIoCurrentStats(self):
+        return self.interface.WriteData(self.IO_CURRENT_STATS_CMD, [0x01])
+
+    # Window lengths in ms, each a multiple of previous one, base window 10 - 1000 ms or 0 to turn
+    # statistics off, histogram bin width 16 - 512 mA power of 2. Statistics are reset.
+    def SetIoCurrentStatsConfig(self, windows=[100, 1000, 60000], binWidth=128):
+        try:
+            base = int(windows[0])
+            n1 = int(windows[1]) // base if base else 1
+            n2 = int(windows[2]) // int(windows[1]) if base else 1
+            shift = int(binWidth).bit_length() - 1
+        except:
+            return {'error': 'BAD_ARGUMENT'}
+        if base and (base < 10 or base > 1000 or windows[1] != base * n1 or windows[2] != windows[1] * n2
+                     or n1 < 1 or n1 > 255 or n2 < 1 or n2 > 255):
+            return {'error': 'BAD_ARGUMENT'}
+        if binWidth != (1 << shift) or shift < 4 or shift > 9:
+            return {'error': 'BAD_ARGUMENT'}
+        return self.interface.WriteData(self.IO_CURRENT_STATS_CMD, [0x02, base & 0xFF, base >> 8, n1, n2, shift])
+
     leds = ['D1', 'D2']
     def SetLedState(self, led, rgb):
         i = None
@@ -353,6 +479,85 @@ class PiJuiceStatus(object):
                     },
                 'error': 'NO_ERROR'
             }
+
+    # LED effects run from firmware timer, firmware version >= 1.7
+    # Step is dictionary with 'op' and its arguments:
+    # 'SET' and 'RAMP' - 'rgb' and 'time' in ms, ramp goes from previous color to 'rgb',
+    # 'LOOP' - jump 'to' step 'count' times (0 - forever), with 'level' count is battery
+    # charge level in 'count' segments, 'END' - LED returns to color set by its function.
+    ledEffectOps = ['SET', 'RAMP', 'LOOP', 'END']
+    def SetLedEffect(self, led, steps):
+        d = []
+        try:
+            i = self.leds.index(led)
+            if len(steps) < 1 or len(steps) > self.LED_EFFECT_STEPS_MAX:
+                return {'error': 'BAD_ARGUMENT'}
+            for step in steps:
+                op = self.ledEffectOps.index(step['op'])
+                if step['op'] == 'LOOP':
+                    d += [op, int(step['to']) & 0xFF, int(step.get('count', 0)) & 0xFF, 0x01 if step.get('level', False) else 0x00, 0, 0]
+                elif step['op'] == 'END':
+                    d += [op, 0, 0, 0, 0, 0]
+                else:
+                    t = int(step['time'])
+                    if t < 0 or t > 0xFFFF:
+                        return {'error': 'BAD_ARGUMENT'}
+                    d += [op] + [int(c) & 0xFF for c in step['rgb'][0:3]] + [t & 0xFF, (t >> 8) & 0xFF]
+        except:
+            return {'error': 'BAD_ARGUMENT'}
+        return self.interface.WriteDataLong(self.LED_EFFECTS_CMD, [i, 1] + d)
+
+    def StopLedEffect(self, led):
+        try:
+            i = self.leds.index(led)
+        except:
+            return {'error': 'BAD_ARGUMENT'}
+        return self.interface.WriteData(self.LED_EFFECTS_CMD, [i, 0])
+
+    def GetLedEffect(self, led):
+        try:
+            i = self.leds.index(led)
+        except:
+            return {'error': 'BAD_ARGUMENT'}
+        ret = self.interface.WriteData(self.LED_EFFECTS_CMD, [i])
+        if ret['error'] != 'NO_ERROR':
+            return ret
+        time.sleep(0.01)
+        ret = self.interface.ReadDataLong(self.LED_EFFECTS_CMD, 4 + self.LED_EFFECT_STEPS_MAX * 6)
+        if ret['error'] != 'NO_ERROR':
+            return ret
+        d = ret['data']
+        steps = []
+        for k in range(min(d[3], self.LED_EFFECT_STEPS_MAX)):
+            s = d[4 + k * 6:10 + k * 6]
+            op = self.ledEffectOps[s[0]] if s[0] < len(self.ledEffectOps) else 'END'
+            if op == 'LOOP':
+                steps.append({'op': op, 'to': s[1], 'count': s[2], 'level': bool(s[3] & 0x01)})
+            elif op == 'END':
+                steps.append({'op': op})
+            else:
+                steps.append({'op': op, 'rgb': s[1:4], 'time': s[4] | (s[5] << 8)})
+        return {'data': {'running': bool(d[1]), 'step': d[2], 'steps': steps}, 'error': 'NO_ERROR'}
+
+    def LedEffectBreathing(self, rgb, period=3000, count=0):
+        return [{'op': 'RAMP', 'rgb': rgb, 'time': period // 2},
+                {'op': 'RAMP', 'rgb': [0, 0, 0], 'time': period - period // 2},
+                {'op': 'LOOP', 'to': 0, 'count': count}]
+
+    def LedEffectBlinkSequence(self, rgb, blinks=3, on=100, off=150, pause=1000, count=0):
+        return [{'op': 'SET', 'rgb': rgb, 'time': on},
+                {'op': 'SET', 'rgb': [0, 0, 0], 'time': off},
+                {'op': 'LOOP', 'to': 0, 'count': blinks},
+                {'op': 'SET', 'rgb': [0, 0, 0], 'time': pause},
+                {'op': 'LOOP', 'to': 0, 'count': count}]
+
+    # Blinks once per charge level segment
+    def LedEffectChargeBar(self, rgb, segments=5, on=200, off=300, pause=1500, count=0):
+        return [{'op': 'SET', 'rgb': rgb, 'time': on},
+                {'op': 'SET', 'rgb': [0, 0, 0], 'time': off},
+                {'op': 'LOOP', 'to': 0, 'count': segments, 'level': True},
+                {'op': 'SET', 'rgb': [0, 0, 0], 'time': pause},
+                {'op': 'LOOP', 'to': 0, 'count': count}]
     
     def GetIoDigitalInput(self, pin):
         if not (pin == 1 or pin == 2):
@@ -393,6 +598,50 @@ class PiJuiceStatus(object):
             d = ret['data']
             return {'data': (d[1] << 8) | d[0], 'error': 'NO_ERROR'}
 
+    # Records logged from IO1 analog input since last read, time as seconds since epoch and voltage
+    # in mV, firmware version >= 1.7. Records overwritten before read are in flash log if spill is set.
+    def GetIoAnalogLog(self):
+        records = []
+        lost = False
+        while True:
+            ret = self.interface.ReadDataLong(self.IO_LOG_CMD, 6 + self.IO_LOG_READ_RECORDS * 7)
+            if ret['error'] != 'NO_ERROR':
+                return ret
+            d = ret['data']
+            lost = lost or bool(d[1] & 0x02)
+            for k in range(min(d[0], self.IO_LOG_READ_RECORDS)):
+                r = d[6 + k * 7:13 + k * 7]
+                t = (r[0] | (r[1] << 8) | (r[2] << 16) | (r[3] << 24)) + 946684800 + r[4] / 256.0
+                records.append({'time': t, 'voltage': (r[5] | (r[6] << 8)) / 16.0})
+            if not d[1] & 0x01:
+                break
+        return {'data': {'records': records, 'lost': lost}, 'error': 'NO_ERROR'}
+
+    # Rewinds read cursor so records still in RAM are read again
+    def RewindIoAnalogLog(self):
+        return self.interface.WriteData(self.IO_LOG_CMD, [0])
+
+    def ClearIoAnalogLog(self):
+        return self.interface.WriteData(self.IO_LOG_CMD, [2])
+
+    # Edges counted in PULSE_COUNTER mode and input frequency in Hz, firmware version >= 1.7
+    def GetIoPulseCounter(self, pin):
+        if not (pin == 1 or pin == 2):
+            return {'error': 'BAD_ARGUMENT'}
+        ret = self.interface.ReadData(self.IO_PIN_ACCESS_CMD + (pin-1)*5, 8)
+        if ret['error'] != 'NO_ERROR':
+            return ret
+        else:
+            d = ret['data']
+            count = d[0] | (d[1] << 8) | (d[2] << 16) | (d[3] << 24)
+            freq = (d[4] | (d[5] << 8) | (d[6] << 16) | (d[7] << 24)) / 1000.0
+            return {'data': {'count': count, 'frequency': freq}, 'error': 'NO_ERROR'}
+
+    def ResetIoPulseCounter(self, pin):
+        if not (pin == 1 or pin == 2):
+            return {'error': 'BAD_ARGUMENT'}
+        return self.interface.WriteData(self.IO_PIN_ACCESS_CMD + (pin-1)*5, [0x01, 0x00])
+
     def SetIoPWM(self, pin, dutyCycle):
         if not (pin == 1 or pin == 2):
             return {'error': 'BAD_ARGUMENT'}
@@ -427,6 +676,10 @@ class PiJuiceRtcAlarm(object):
     RTC_ALARM_CMD = 0xB9
     RTC_TIME_CMD = 0xB0
     RTC_CTRL_STATUS_CMD = 0xC2
+    RTC_WAKE_SCHEDULE_CMD = 0xCA
+    RTC_WAKE_SCHEDULES_NUM = 8
+    RTC_CALIBRATION_CMD = 0xCB
+    RTC_CALIBRATION_STEP_PPM = 1000000.0 / 1048576
 
     def __init__(self, interface):
         self.interface = interface
@@ -667,7 +920,10 @@ class PiJuiceRtcAlarm(object):
         ret = self.interface.ReadData(self.RTC_ALARM_CMD, 9)
         if ret['error'] != 'NO_ERROR':
             return ret
-        d = ret['data']
+        return {'data': self._DecodeAlarm(ret['data']), 'error': 'NO_ERROR'}
+
+    # Registers in extended DS1339 alarm 1 format to alarm dictionary
+    def _DecodeAlarm(self, d):
         alarm = {}
         if (d[0] & 0x80) == 0x00:
             alarm['second'] = ((d[0] >> 4) & 0x07) * 10 + (d[0] & 0x0F)
@@ -730,13 +986,14 @@ class PiJuiceRtcAlarm(object):
             else:
                 alarm['day'] = 'EVERY_DAY'
 
-        return {'data': alarm, 'error': 'NO_ERROR'}
+        return alarm
 
-    def SetAlarm(self, alarm):
+    # Alarm dictionary to registers in extended DS1339 alarm 1 format
+    def _EncodeAlarm(self, alarm):
         d = [0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0xFF, 0x00, 0xFF]
         if alarm == None or alarm == {}:
-            #disable alarm
-            return self.interface.WriteDataVerify(self.RTC_ALARM_CMD, d, 0.2)
+            # disabled
+            return {'data': d, 'error': 'NO_ERROR'}
 
         if 'second' in alarm:
             try:
@@ -875,6 +1132,17 @@ class PiJuiceRtcAlarm(object):
         else:
             d[3] = 0x80  # every day
 
+        return {'data': d, 'error': 'NO_ERROR'}
+
+    def SetAlarm(self, alarm):
+        ret = self._EncodeAlarm(alarm)
+        if ret['error'] != 'NO_ERROR':
+            return ret
+        d = ret['data']
+        if alarm == None or alarm == {}:
+            #disable alarm
+            return self.interface.WriteDataVerify(self.RTC_ALARM_CMD, d, 0.2)
+
         ret = self.interface.WriteData(self.RTC_ALARM_CMD, d)
         if ret['error'] != 'NO_ERROR':
             return ret
@@ -907,6 +1175,124 @@ class PiJuiceRtcAlarm(object):
             else:
                 return {'error': 'WRITE_FAILED'}
 
+    # Wake-up schedules stored in PiJuice, firmware version >= 1.7
+    # Each schedule uses alarm dictionary format, empty dictionary disables it.
+    # Any schedule match wakes up Raspberry Pi regardless of alarm wake-up enable.
+    def SetWakeSchedule(self, index, schedule):
+        try:
+            i = int(index)
+        except:
+            return {'error': 'BAD_ARGUMENT'}
+        if i < 0 or i >= self.RTC_WAKE_SCHEDULES_NUM:
+            return {'error': 'BAD_ARGUMENT'}
+        ret = self._EncodeAlarm(schedule)
+        if ret['error'] != 'NO_ERROR':
+            return ret
+        d = ret['data']
+        ret = self.interface.WriteData(self.RTC_WAKE_SCHEDULE_CMD, [i] + d)
+        if ret['error'] != 'NO_ERROR':
+            return ret
+        # verify, hours are read back in format RTC is set to
+        time.sleep(0.2)
+        ret = self._ReadWakeSchedule(i)
+        if ret['error'] != 'NO_ERROR':
+            return ret
+        r = ret['data'][1:10]
+        if (d[3] == 0) != (r[3] == 0) or (d[3] != 0 and (d[0:2] + d[3:] != r[0:2] + r[3:] or self._AlarmHour24(d[2]) != self._AlarmHour24(r[2]))):
+            return {'error': 'WRITE_FAILED'}
+        return {'error': 'NO_ERROR'}
+
+    def _AlarmHour24(self, h):
+        if h & 0x40:
+            hBin = ((h >> 4) & 0x01) * 10 + (h & 0x0F)
+            hBin = (hBin if hBin < 12 else 0) + (12 if h & 0x20 else 0)
+        else:
+            hBin = ((h >> 4) & 0x03) * 10 + (h & 0x0F)
+        return hBin | (h & 0x80)
+
+    def _ReadWakeSchedule(self, index):
+        ret = self.interface.WriteData(self.RTC_WAKE_SCHEDULE_CMD, [int(index)])
+        if ret['error'] != 'NO_ERROR':
+            return ret
+        time.sleep(0.01)
+        return self.interface.ReadData(self.RTC_WAKE_SCHEDULE_CMD, 17)
+
+    def GetWakeSchedule(self, index):
+        ret = self._ReadWakeSchedule(index)
+        if ret['error'] != 'NO_ERROR':
+            return ret
+        d = ret['data']
+        if d[4] == 0:
+            # disabled
+            return {'data': {}, 'error': 'NO_ERROR'}
+        return {'data': self._DecodeAlarm(d[1:10]), 'error': 'NO_ERROR'}
+
+    # Schedules that fired last and their time, kept until cleared or PiJuice loses power
+    def GetWakeScheduleFired(self):
+        ret = self._ReadWakeSchedule(0)
+        if ret['error'] != 'NO_ERROR':
+            return ret
+        d = ret['data']
+        if d[10] == 0:
+            return {'data': {'schedules': [], 'time': None}, 'error': 'NO_ERROR'}
+        return {'data': {
+            'schedules': [i for i in range(self.RTC_WAKE_SCHEDULES_NUM) if d[10] & (0x01 << i)],
+            'time': {'year': 2000 + d[11], 'month': d[12], 'day': d[13], 'hour': d[14], 'minute': d[15], 'second': d[16]}},
+            'error': 'NO_ERROR'}
+
+    def ClearWakeScheduleFired(self):
+        return self.interface.WriteData(self.RTC_WAKE_SCHEDULE_CMD, [0xFF])
+
+    # RTC drift calibration from host reference time, firmware version >= 1.7
+    # Submit reference periodically while host time is synchronized (NTP), firmware
+    # measures drift over at least 8 hours and programs RTC smooth calibration.
+    def SubmitRtcReference(self, reference=None):
+        # constant delay between reference and firmware time snapshot does not affect drift
+        t = time.time() if reference is None else float(reference)
+        t = t - 946684800  # since 2000-01-01 UTC
+        if t < 0 or t >= 0x100000000:
+            return {'error': 'BAD_ARGUMENT'}
+        sec = int(t)
+        sub = int((t - sec) * 256)
+        return self.interface.WriteData(self.RTC_CALIBRATION_CMD, [0, sec & 0xFF, (sec >> 8) & 0xFF,
+                                        (sec >> 16) & 0xFF, (sec >> 24) & 0xFF, sub])
+
+    def GetRtcCalibration(self):
+        ret = self.interface.ReadData(self.RTC_CALIBRATION_CMD, 11)
+        if ret['error'] != 'NO_ERROR':
+            return ret
+        d = ret['data']
+        calib = ctypes.c_int16(d[0] | (d[1] << 8)).value
+        offset = ctypes.c_int32(d[2] | (d[3] << 8) | (d[4] << 16) | (d[5] << 24)).value
+        return {'data': {
+            'ppm': round(calib * self.RTC_CALIBRATION_STEP_PPM, 3),
+            'offset': offset / 256.0,
+            'interval': d[6] | (d[7] << 8) | (d[8] << 16) | (d[9] << 24),
+            'anchor': bool(d[10] & 0x01),
+            'applied': bool(d[10] & 0x02),
+            'range': bool(d[10] & 0x04)},
+            'error': 'NO_ERROR'}
+
+    # Sets calibration directly in ppm, positive value speeds up RTC, range -487.3 to 488.3
+    def SetRtcCalibration(self, ppm):
+        try:
+            calib = int(round(float(ppm) / self.RTC_CALIBRATION_STEP_PPM))
+        except:
+            return {'error': 'BAD_ARGUMENT'}
+        if calib < -511 or calib > 512:
+            return {'error': 'BAD_ARGUMENT'}
+        calib = calib & 0xFFFF
+        ret = self.interface.WriteData(self.RTC_CALIBRATION_CMD, [1, calib & 0xFF, (calib >> 8) & 0xFF])
+        if ret['error'] != 'NO_ERROR':
+            return ret
+        time.sleep(0.05)
+        ret = self.interface.ReadData(self.RTC_CALIBRATION_CMD, 11)
+        if ret['error'] != 'NO_ERROR':
+            return ret
+        if ret['data'][0] | (ret['data'][1] << 8) != calib:
+            return {'error': 'WRITE_FAILED'}
+        return {'error': 'NO_ERROR'}
+
 
 class PiJuicePower(object):
 
@@ -914,6 +1300,18 @@ class PiJuicePower(object):
     POWER_OFF_CMD = 0x62
     WAKEUP_ON_CHARGE_CMD = 0x63
     SYSTEM_POWER_SWITCH_CTRL_CMD = 0x64
+    WAKEUP_LATENCY_CMD = 0x65
+    ENERGY_COUNTERS_CMD = 0xC3
+    WATCHDOG_EXT_CONFIG_CMD = 0xC5
+    POWER_STATS_CMD = 0xC6
+
+    wakeupTriggers = ['ON_CHARGE', 'RTC', 'IO', 'WATCHDOG', 'BUTTON', 'POLICY']
+    energyCounters = ['toPiWh', 'batteryOutWh', 'batteryInWh', 'fromInWh', 'from5vIoWh',
+                      'batteryOutAh', 'batteryInAh']
+    powerStates = ['NORMAL', 'RUN', 'LOW_POWER']
+    wakeupCauses = ['RTC_TIMER', 'RTC_ALARM', 'BUTTON', 'CHARGER', 'I2C', 'IO', 'OTHER', 'IO_COUNTER']
+    lowPowerRefuseReasons = ['LOAD', 'HOST_COMMAND', 'CHARGER', 'BUTTON', 'WAKEUP', 'EVENT_POLL', 'TRACE', 'IO_LOG',
+                             'IO_COUNTER']
 
     def __init__(self, interface):
         self.interface = interface
@@ -989,6 +1387,107 @@ class PiJuicePower(object):
         else:
             return {'data': ret['data'][0] * 100, 'error': 'NO_ERROR'}
 
+    # Heartbeat only mode: watchdog is refreshed by IO heartbeat input edges only, not by I2C commands.
+    # warning: seconds before expiration to raise pre-reset warning, period: optional expiration period in seconds
+    # firmware version >= 1.7
+    def SetWatchdogExtConfig(self, heartbeat_only=False, warning=0, period=0, non_volatile=False):
+        try:
+            d0 = (0x01 if heartbeat_only else 0x00) | (0x80 if non_volatile else 0x00)
+            w = int(warning)
+            p = int(period)
+            if w < 0 or w > 255 or p < 0 or p > 65535:
+                return {'error': 'BAD_ARGUMENT'}
+        except:
+            return {'error': 'BAD_ARGUMENT'}
+        return self.interface.WriteData(self.WATCHDOG_EXT_CONFIG_CMD, [d0, w, p & 0xFF, (p >> 8) & 0xFF])
+
+    def GetWatchdogExtConfig(self):
+        ret = self.interface.ReadData(self.WATCHDOG_EXT_CONFIG_CMD, 6)
+        if ret['error'] != 'NO_ERROR':
+            return ret
+        d = ret['data']
+        return {'data': {
+            'heartbeat_only': bool(d[0] & 0x01),
+            'warning_active': bool(d[0] & 0x40),
+            'warning': d[1],
+            'period': (d[3] << 8) | d[2],
+            'remaining': (d[5] << 8) | d[4]},
+            'error': 'NO_ERROR'}
+
+    # Trigger to 5V on latency statistics in milliseconds, firmware version >= 1.7
+    def GetWakeupLatency(self, trigger):
+        if trigger not in self.wakeupTriggers:
+            return {'error': 'BAD_ARGUMENT'}
+        ret = self.interface.WriteData(self.WAKEUP_LATENCY_CMD, [self.wakeupTriggers.index(trigger)])
+        if ret['error'] != 'NO_ERROR':
+            return ret
+        time.sleep(0.01)
+        ret = self.interface.ReadData(self.WAKEUP_LATENCY_CMD, 11)
+        if ret['error'] != 'NO_ERROR':
+            return ret
+        d = ret['data']
+        count = (d[2] << 8) | d[1]
+        # min, max and average are not defined before first wake-up
+        return {'data': {
+            'trigger': self.wakeupTriggers[d[0]] if d[0] < len(self.wakeupTriggers) else d[0],
+            'count': count,
+            'last': (d[4] << 8) | d[3] if count else None,
+            'min': (d[6] << 8) | d[5] if count else None,
+            'max': (d[8] << 8) | d[7] if count else None,
+            'average': (d[10] << 8) | d[9] if count else None},
+            'error': 'NO_ERROR'}
+
+    def ResetWakeupLatency(self):
+        return self.interface.WriteData(self.WAKEUP_LATENCY_CMD, [0x80])
+
+    # Accumulated energy counters in Wh and battery charge throughput in Ah, firmware version >= 1.7
+    def GetEnergyCounters(self):
+        ret = self.interface.ReadData(self.ENERGY_COUNTERS_CMD, 30)
+        if ret['error'] != 'NO_ERROR':
+            return ret
+        d = ret['data']
+        counters = {}
+        for i, name in enumerate(self.energyCounters):
+            counters[name] = ((d[i*4+3] << 24) | (d[i*4+2] << 16) | (d[i*4+1] << 8) | d[i*4]) / 1000.0
+        counters['batteryCycles'] = ((d[29] << 8) | d[28]) / 100.0
+        return {'data': counters, 'error': 'NO_ERROR'}
+
+    # Stores counters to non volatile memory, counters are otherwise checkpointed every 6 hours
+    def SaveEnergyCounters(self):
+        return self.interface.WriteData(self.ENERGY_COUNTERS_CMD, [0x01])
+
+    def ResetEnergyCounters(self):
+        return self.interface.WriteData(self.ENERGY_COUNTERS_CMD, [0x80])
+
+    # Seconds spent in each power state, stop mode entries, wake-up causes and seconds low power
+    # state was refused per reason, firmware version >= 1.7
+    def GetPowerStats(self):
+        # pages of 7 values fit SMBus block read: residency, stop entries, wake-up causes, refuse reasons
+        n = len(self.powerStates) + 1 + len(self.wakeupCauses) + len(self.lowPowerRefuseReasons)
+        v = []
+        for page in range(0, (n + 6) // 7):
+            ret = self.interface.WriteData(self.POWER_STATS_CMD, [page])
+            if ret['error'] != 'NO_ERROR':
+                return ret
+            time.sleep(0.01)
+            ret = self.interface.ReadData(self.POWER_STATS_CMD, 29)
+            if ret['error'] != 'NO_ERROR':
+                return ret
+            d = ret['data']
+            if d[0] != page:
+                return {'error': 'DATA_CORRUPTED'}
+            v += [(d[i+3] << 24) | (d[i+2] << 16) | (d[i+1] << 8) | d[i] for i in range(1, 29, 4)]
+        k = len(self.powerStates) + 1
+        return {'data': {
+            'residency': dict(zip(self.powerStates, v)),
+            'stopEntries': v[k-1],
+            'wakeupCauses': dict(zip(self.wakeupCauses, v[k:])),
+            'lowPowerRefused': dict(zip(self.lowPowerRefuseReasons, v[k+len(self.wakeupCauses):]))},
+            'error': 'NO_ERROR'}
+
+    def ResetPowerStats(self):
+        return self.interface.WriteData(self.POWER_STATS_CMD, [0x80])
+
 
 class PiJuiceConfig(object):
 
@@ -1006,6 +1505,8 @@ class PiJuiceConfig(object):
     I2C_ADDRESS_CMD = 0x7C
     ID_EEPROM_WRITE_PROTECT_CTRL_CMD = 0x7E
     ID_EEPROM_ADDRESS_CMD = 0x7F
+    POWER_POLICY_RULE_CMD = 0xC4
+    NV_SAVE_STATUS_CMD = 0xC7
     RESET_TO_DEFAULT_CMD = 0xF0
     FIRMWARE_VERSION_CMD = 0xFD
 
@@ -1414,24 +1915,122 @@ class PiJuiceConfig(object):
             return {'error': 'BAD_ARGUMENT'}
         return self.interface.WriteDataVerify(self.RUN_PIN_CONFIG_CMD, [ind])
 
+    policySources = ['NONE', 'CHARGE', 'BATTERY_VOLTAGE', 'POWER_INPUT', 'IO_CURRENT', 'BATTERY_TEMPERATURE',
+                     'BUTTON_IDLE', 'HOST_IDLE', 'REGULATOR_5V', 'BATTERY_PRESENT']
+    policySourceScale = {'BATTERY_VOLTAGE': 20, 'IO_CURRENT': 10}  # threshold units mV, mA
+    policyOperators = ['<', '>', '==', '!=']
+    policyActions = ['NONE', 'HOST_SHUTDOWN', 'POWER_OFF_5V', 'WAKEUP', 'LED']
+    POWER_POLICY_RULES_NUM = 8
+
+    # Power policy rule evaluated by firmware, firmware version >= 1.7
+    # rule: {'source', 'operator', 'threshold', 'action', 'parameter', 'hold' (seconds), 'and_next'}
+    def SetPowerPolicyRule(self, index, rule):
+        try:
+            i = int(index)
+            if i < 0 or i >= self.POWER_POLICY_RULES_NUM:
+                return {'error': 'BAD_ARGUMENT'}
+            src = self.policySources.index(rule['source'])
+            if src == 0:
+                d = [i, 0, 0, 0, 0]
+            else:
+                cond = src | (self.policyOperators.index(rule['operator']) << 4)
+                if rule.get('and_next', False):
+                    cond |= 0x80
+                th = int(rule['threshold']) // self.policySourceScale.get(rule['source'], 1)
+                if th < -128 or th > 255:
+                    return {'error': 'BAD_ARGUMENT'}
+                act = self.policyActions.index(rule.get('action', 'NONE')) | ((int(rule.get('parameter', 0)) & 0x0F) << 4)
+                hold = int(rule.get('hold', 0))
+                if hold > 127:
+                    hold = 0x80 | min(hold // 60, 127)  # minutes resolution
+                d = [i, cond, th & 0xFF, act, hold]
+        except:
+            return {'error': 'BAD_ARGUMENT'}
+        ret = self.interface.WriteData(self.POWER_POLICY_RULE_CMD, d)
+        if ret['error'] != 'NO_ERROR':
+            return ret
+        # firmware main loop stores rule to NV and reloads it, read reports stored rule once write is not pending
+        for k in range(10):
+            time.sleep(0.05)
+            ret = self._ReadPowerPolicyRule(i)
+            if ret['error'] != 'NO_ERROR':
+                return ret
+            if not (ret['data'][5] & 0x04):
+                break
+        return {'error': 'NO_ERROR'} if ret['data'][0:5] == d else {'error': 'WRITE_FAILED'}
+
+    def _ReadPowerPolicyRule(self, index):
+        ret = self.interface.WriteData(self.POWER_POLICY_RULE_CMD, [int(index)])
+        if ret['error'] != 'NO_ERROR':
+            return ret
+        time.sleep(0.01)
+        return self.interface.ReadData(self.POWER_POLICY_RULE_CMD, 6)
+
+    def GetPowerPolicyRule(self, index):
+        ret = self._ReadPowerPolicyRule(index)
+        if ret['error'] != 'NO_ERROR':
+            return ret
+        d = ret['data']
+        src = self.policySources[d[1] & 0x0F] if (d[1] & 0x0F) < len(self.policySources) else 'NONE'
+        th = d[2] - 256 if (src == 'BATTERY_TEMPERATURE' and d[2] > 127) else d[2]
+        return {'data': {
+            'source': src,
+            'operator': self.policyOperators[(d[1] >> 4) & 0x03],
+            'threshold': th * self.policySourceScale.get(src, 1),
+            'and_next': bool(d[1] & 0x80),
+            'action': self.policyActions[d[3] & 0x0F] if (d[3] & 0x0F) < len(self.policyActions) else 'NONE',
+            'parameter': d[3] >> 4,
+            'hold': (d[4] & 0x7F) * (60 if d[4] & 0x80 else 1),
+            'active': bool(d[5] & 0x01),
+            'fired': bool(d[5] & 0x02),
+            'pending': bool(d[5] & 0x04)},
+            'error': 'NO_ERROR'}
+
+    def GetNvSaveStatus(self):
+        ret = self.interface.ReadData(self.NV_SAVE_STATUS_CMD, 9)
+        if ret['error'] != 'NO_ERROR':
+            return ret
+        d = ret['data']
+        return {'data': {
+            'pending': d[0],
+            'maxPending': d[1],
+            'queueSize': d[2],
+            'dropped': (d[4] << 8) | d[3],
+            'failed': (d[6] << 8) | d[5],
+            'lastFailedAddress': None if d[7] == 0xFF and d[8] == 0xFF else (d[8] << 8) | d[7]},
+            'error': 'NO_ERROR'}
+
+    def FlushNvSaveQueue(self):
+        return self.interface.WriteData(self.NV_SAVE_STATUS_CMD, [0x01])
+
+    def ResetNvSaveStatus(self):
+        return self.interface.WriteData(self.NV_SAVE_STATUS_CMD, [0x80])
+
     ioModes = ['NOT_USED', 'ANALOG_IN', 'DIGITAL_IN', 'DIGITAL_OUT_PUSHPULL',
-               'DIGITAL_IO_OPEN_DRAIN', 'PWM_OUT_PUSHPULL', 'PWM_OUT_OPEN_DRAIN']
+               'DIGITAL_IO_OPEN_DRAIN', 'PWM_OUT_PUSHPULL', 'PWM_OUT_OPEN_DRAIN', 'PULSE_COUNTER']
     ioSupportedModes = {
             1: ['NOT_USED', 'ANALOG_IN', 'DIGITAL_IN', 'DIGITAL_OUT_PUSHPULL',
-                'DIGITAL_IO_OPEN_DRAIN', 'PWM_OUT_PUSHPULL', 'PWM_OUT_OPEN_DRAIN'],
+                'DIGITAL_IO_OPEN_DRAIN', 'PWM_OUT_PUSHPULL', 'PWM_OUT_OPEN_DRAIN', 'PULSE_COUNTER'],
 
             2: ['NOT_USED', 'DIGITAL_IN', 'DIGITAL_OUT_PUSHPULL',
-                'DIGITAL_IO_OPEN_DRAIN', 'PWM_OUT_PUSHPULL', 'PWM_OUT_OPEN_DRAIN']
+                'DIGITAL_IO_OPEN_DRAIN', 'PWM_OUT_PUSHPULL', 'PWM_OUT_OPEN_DRAIN', 'PULSE_COUNTER']
         }
     ioPullOptions = ['NOPULL', 'PULLDOWN', 'PULLUP']
     ioConfigParams = {
-        'DIGITAL_IN': [{'name': 'wakeup', 'type': 'enum', 'options':['NO_WAKEUP', 'FALLING_EDGE', 'RISING_EDGE']}],
+        'ANALOG_IN': [{'name': 'log_interval', 'unit': 's', 'type': 'int', 'min': 0, 'max': 65535},
+                      {'name': 'log_oversampling', 'type': 'int', 'min': 1, 'max': 256},
+                      {'name': 'log_flash_spill', 'type': 'int', 'min': 0, 'max': 1}],
+        'DIGITAL_IN': [{'name': 'wakeup', 'type': 'enum', 'options':['NO_WAKEUP', 'FALLING_EDGE', 'RISING_EDGE']},
+                       {'name': 'heartbeat', 'type': 'int', 'min': 0, 'max': 1}],
         'DIGITAL_OUT_PUSHPULL': [{'name': 'value', 'type': 'int', 'min': 0, 'max': 1}],
         'DIGITAL_IO_OPEN_DRAIN': [{'name': 'value', 'type': 'int', 'min': 0, 'max': 1}],
         'PWM_OUT_PUSHPULL': [{'name': 'period', 'unit': 'us', 'type': 'int', 'min': 2, 'max': 65536 * 2},
                              {'name': 'duty_cycle', 'unit': '%', 'type': 'float', 'min': 0, 'max': 100}],
         'PWM_OUT_OPEN_DRAIN': [{'name': 'period', 'unit': 'us', 'type': 'int', 'min': 2, 'max': 65536 * 2},
-                               {'name': 'duty_cycle', 'unit': '%', 'type': 'float', 'min': 0, 'max': 100}]
+                               {'name': 'duty_cycle', 'unit': '%', 'type': 'float', 'min': 0, 'max': 100}],
+        'PULSE_COUNTER': [{'name': 'debounce', 'unit': 'ms', 'type': 'int', 'min': 0, 'max': 255},
+                          {'name': 'wakeup_count', 'type': 'int', 'min': 0, 'max': 65535},
+                          {'name': 'edge', 'type': 'enum', 'options': ['RISING', 'FALLING', 'BOTH']}]
     }
 
     def SetIoConfiguration(self, io_pin, config, non_volatile=False):
@@ -1442,11 +2041,33 @@ class PiJuiceConfig(object):
             nv = 0x80 if non_volatile == True else 0x00
             d[0] = (mode & 0x0F) | ((pull & 0x03) << 4) | nv
 
-            if config['mode'] == 'DIGITAL_IN':
+            if config['mode'] == 'ANALOG_IN':
+                # IO1 logging while host is off, interval 0 disables it, firmware version >= 1.7
+                interval = int(config.get('log_interval', 0) or 0)
+                oversampling = int(config.get('log_oversampling', 1) or 1)
+                if interval < 0 or interval > 65535 or oversampling < 1 or oversampling > 256:
+                    return {'error': 'INVALID_CONFIG'}
+                d[1] = interval & 0xFF
+                d[2] = (interval >> 8) & 0xFF
+                d[3] = oversampling.bit_length() - 1  # log2, rounded down to power of 2
+                d[4] = 0x01 if int(config.get('log_flash_spill', 0) or 0) else 0x00
+            elif config['mode'] == 'DIGITAL_IN':
                 wup = config['wakeup'] if config['wakeup'] else 'NO_WAKEUP'
                 d[1] = self.ioConfigParams['DIGITAL_IN'][0]['options'].index(wup) & 0x03
+                if int(config.get('heartbeat', 0) or 0):
+                    d[1] |= 0x04  # edges refresh watchdog, firmware version >= 1.7
             elif config['mode'] == 'DIGITAL_OUT_PUSHPULL' or config['mode'] == 'DIGITAL_IO_OPEN_DRAIN':
                 d[1] = int(config['value']) & 0x01  # output value
+            elif config['mode'] == 'PULSE_COUNTER':
+                # firmware version >= 1.7, wakeup_count 0 disables wake-up
+                debounce = int(config.get('debounce', 0) or 0)
+                count = int(config.get('wakeup_count', 0) or 0)
+                if debounce < 0 or debounce > 255 or count < 0 or count > 65535:
+                    return {'error': 'INVALID_CONFIG'}
+                d[1] = [0, 1, 3][self.ioConfigParams['PULSE_COUNTER'][2]['options'].index(config.get('edge') or 'RISING')]
+                d[2] = debounce
+                d[3] = count & 0xFF
+                d[4] = (count >> 8) & 0xFF
             elif config['mode'] == 'PWM_OUT_PUSHPULL' or config['mode'] == 'PWM_OUT_OPEN_DRAIN':
                 p = int(config['period'])
                 if p >= 2:
@@ -1477,7 +2098,16 @@ class PiJuiceConfig(object):
             nv = bool(d[0] & 0x80)
             mode = self.ioModes[d[0] & 0x0F] if ((d[0] & 0x0F) < len(self.ioModes)) else 'UNKNOWN'
             pull = self.ioPullOptions[(d[0] >> 4) & 0x03] if (((d[0] >> 4) & 0x03) < len(self.ioPullOptions)) else 'UNKNOWN'
-            if mode == 'DIGITAL_OUT_PUSHPULL' or mode == 'DIGITAL_IO_OPEN_DRAIN':
+            if mode == 'ANALOG_IN':
+                return {'data': {'mode': mode, 'pull': pull, 'log_interval': d[1] | (d[2] << 8),
+                                 'log_oversampling': 1 << min(d[3], 8), 'log_flash_spill': d[4] & 0x01},
+                        'non_volatile': nv, 'error': 'NO_ERROR'}
+            elif mode == 'PULSE_COUNTER':
+                edge = {1: 'FALLING', 3: 'BOTH'}.get(d[1] & 0x03, 'RISING')
+                return {'data': {'mode': mode, 'pull': pull, 'debounce': d[2], 'wakeup_count': d[3] | (d[4] << 8),
+                                 'edge': edge},
+                        'non_volatile': nv, 'error': 'NO_ERROR'}
+            elif mode == 'DIGITAL_OUT_PUSHPULL' or mode == 'DIGITAL_IO_OPEN_DRAIN':
                 return {'data': {'mode': mode, 'pull': pull, 'value': int(d[1])},
                         'non_volatile': nv, 'error': 'NO_ERROR'}
             elif mode == 'PWM_OUT_PUSHPULL' or mode == 'PWM_OUT_OPEN_DRAIN':
@@ -1488,7 +2118,7 @@ class PiJuiceConfig(object):
                         'non_volatile': nv, 'error': 'NO_ERROR'}
             else:
                 wup = self.ioConfigParams['DIGITAL_IN'][0]['options'][d[1]&0x03] if d[1]&0x03 < len(self.ioConfigParams['DIGITAL_IN'][0]['options']) else ''
-                return {'data': {'mode': mode, 'pull': pull, 'wakeup': wup},
+                return {'data': {'mode': mode, 'pull': pull, 'wakeup': wup, 'heartbeat': (d[1] >> 2) & 0x01},
                         'non_volatile': nv, 'error': 'NO_ERROR'}
 
     def GetAddress(self, slave):
@@ -247,12 +247,21 @@ class StatusTab(object):
             fault = fault_info['error']
         
         sys_sw_status = pijuice.power.GetSystemPowerSwitch().get('data', None)
+
+        energy = pijuice.power.GetEnergyCounters()
+        if energy['error'] == 'NO_ERROR':
+            e = energy['data']
+            energy_info = "to Pi %.3fWh, battery out %.3fWh, in %.3fWh, %.2f cycles" % (
+                e['toPiWh'], e['batteryOutWh'], e['batteryInWh'], e['batteryCycles'])
+        else:
+            energy_info = 'N/A'
         return {
             "battery": general_info,
             "gpio": gpio_info,
             "usb": str(usb_power),
             "fault": str(fault),
-            "sys_sw": (str(sys_sw_status) + "mA") if sys_sw_status != 0 else "Off"
+            "sys_sw": (str(sys_sw_status) + "mA") if sys_sw_status != 0 else "Off",
+            "energy": energy_info
         }
 
     def update_status(self, obj, text):
@@ -260,7 +269,7 @@ class StatusTab(object):
         text.set_text("HAT status\n\n"
                       "Battery: {battery}\nGPIO power input: {gpio}\n"
                       "USB Micro power input: {usb}\nFault: {fault}\n"
-                      "System switch: {sys_sw}\n".format(**status_args))
+                      "System switch: {sys_sw}\nEnergy: {energy}\n".format(**status_args))
         self.alarm_handle = loop.set_alarm_in(1, self.update_status, text)
         #self.alarm_handle = loop.set_alarm_in(6, self.update_status, text)
 
@@ -270,7 +279,7 @@ class StatusTab(object):
         text = urwid.Text("HAT status\n\n"
                         "Battery: {battery}\nGPIO power input: {gpio}\n"
                         "USB Micro power input: {usb}\nFault: {fault}\n"
-                        "System switch: {sys_sw}\n".format(**status_args))
+                        "System switch: {sys_sw}\nEnergy: {energy}\n".format(**status_args))
         #refresh_btn = urwid.Padding(attrmap(urwid.Button('Refresh', on_press=self.main)), width=24)
         main_menu_btn = urwid.Padding(attrmap(urwid.Button('Back', on_press=self._goto_main_menu)), width=24)
         pwr_switch_btn = urwid.Padding(attrmap(urwid.Button('Change Power switch', on_press=self.change_power_switch)), width=24)
@@ -1852,9 +1861,9 @@ class SystemTaskTab(object):
 
 class SystemEventsTab(object):
     EVENTS = ['low_charge', 'low_battery_voltage', 'no_power', 'power', 'watchdog_reset', 'button_power_off', 'forced_power_off',
-              'forced_sys_power_off', 'sys_start', 'sys_stop']
+              'forced_sys_power_off', 'sys_start', 'sys_stop', 'policy_shutdown']
     EVTTXT = ['Low charge', 'Low battery voltage', 'No power', 'Power present', 'Watchdog reset', 'Button power off', 'Forced power off',
-              'Forced sys power off', 'System start', 'System stop']
+              'Forced sys power off', 'System start', 'System stop', 'Power policy shutdown']
     FUNCTIONS1 = ['NO_FUNC'] + pijuice_sys_functions + pijuice_user_functions
     FUNCTIONS2 = ['NO_FUNC'] + pijuice_user_functions
 
@@ -1913,7 +1922,7 @@ class SystemEventsTab(object):
         func = data[1]
         elements = [urwid.Text("Select function for '"+self.EVTTXT[index]+"'"),
                     urwid.Divider()]
-        self.functions = self.FUNCTIONS1 if index < 3 else self.FUNCTIONS2
+        self.functions = self.FUNCTIONS1 if (index < 3 or self.EVENTS[index] == 'policy_shutdown') else self.FUNCTIONS2
         self.bgroup = []
         for function in self.functions:
             button = attrmap(urwid.RadioButton(self.bgroup, function))
@@ -1639,7 +1639,7 @@ class PiJuiceSysEventConfig(object):
     def __init__(self, master):
         self.frame = Frame(master, name='system_events')
         self.frame.grid(row=0, column=0, sticky=W)
-        self.frame.rowconfigure(11, weight=1)
+        self.frame.rowconfigure(12, weight=1)
         self.frame.columnconfigure(0, weight=0, minsize=175)
         self.frame.columnconfigure(1, weight=10, uniform=1)
         self.frame.columnconfigure(2, weight=1, uniform=1)
@@ -1655,7 +1655,8 @@ class PiJuiceSysEventConfig(object):
         {'id':'forced_power_off', 'name':'Forced power off', 'funcList':(['NO_FUNC']+pijuice_user_functions)},
         {'id':'forced_sys_power_off', 'name':'Forced sys power off', 'funcList':(['NO_FUNC']+pijuice_user_functions)},
         {'id':'sys_start', 'name':'System start', 'funcList':(['NO_FUNC']+pijuice_user_functions)},
-        {'id':'sys_stop', 'name':'System stop', 'funcList':(['NO_FUNC']+pijuice_user_functions)}
+        {'id':'sys_stop', 'name':'System stop', 'funcList':(['NO_FUNC']+pijuice_user_functions)},
+        {'id':'policy_shutdown', 'name':'Power policy shutdown', 'funcList':self.eventFunctions}
         ]
         global pijuiceConfigData
         self.sysEventEnable = []
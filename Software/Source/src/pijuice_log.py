@@ -13,99 +13,108 @@
 # to file, otherwise will only print to screen
 # Usage: 
 # 	Enable: python3 pijuice_log.py --enable "OTHER|5VREG_ON|5VREG_OFF|WAKEUP_EVT|ALARM_EVT|MCU_RESET"
+#	Enable with rate limiting, firmware version >= 1.7: python3 pijuice_log.py --enable "5VREG_ON|5VREG_OFF|RATE_LIMIT"
 #	Read: python3 pijuice_log.py
+#	Read only messages not read before: python3 pijuice_log.py --unread
 #	Read to file: python3 pijuice_log.py ./pijuice_log.txt
+#	Read events kept in flash over power loss, firmware version >= 1.7: python3 pijuice_log.py --flash
 #	Disable logging: python3 pijuice_log.py --disable
 
 from pijuice import PiJuice, PiJuiceInterface
 import time, datetime, sys
 
+I2C_BUS = 1
+I2C_ADDRESS = 0x14
 LOGGING_CMD = 0xF6 #246
 LOG_MSG_FRAME_SIZE = 31
 LOG_READ_MSG_SIZE =	LOG_MSG_FRAME_SIZE + 1
+LOG_DRAIN_FRAME_SIZE = 240
+LOG_DRAIN_HEADER_SIZE = 7
+LOG_ID_ABS_TIME = 0x80
+LOG_TIME_BASE = datetime.datetime(2000, 1, 1)
+FLASH_LOG_CMD = 0xC8 #200
+FLASH_LOG_FRAME_SIZE = 114
+FLASH_LOG_RECORD_SIZE = 14
 
 vbat = lambda x:((x << 3) | 0x0800)/4096 * 3.3 * 137.4/100
 
-def Parse_5VREG_ON(data):
-	t = GetDateTime(data[2:])
+def Parse_5VREG_ON(hdr, data):
 	v5v = lambda x:(x << 4)/4096 * 3.3 * 2
 	#v = vbat(ret['data'][10])#d/4096 * 3.3 * 137.4/100
-	bat = ["{0:.3f}".format(vbat(b)) for b in data[11:21]]
-	reg5v = ["{0:.3f}".format(v5v(b)) for b in data[21:31]]
-	logStr = str(data[0]) + ' ' + LOG_MSG_DEFS[data[1]]['name'] + ' ' + str(t) + ', ' + ['SUCCESS,', 'NO ENOUGHR POWER'][data[10]&0X01] + '\n' \
+	bat = ["{0:.3f}".format(vbat(b)) for b in data[1:11]]
+	reg5v = ["{0:.3f}".format(v5v(b)) for b in data[11:21]]
+	logStr = hdr + ', ' + ['SUCCESS,', 'NO ENOUGHR POWER'][data[0]&0X01] + '\n' \
 	+ '	-battery: ' + str(bat) + '\n' \
 	+ '	-5V GPIO: ' + str(reg5v) + '\n'
 	return logStr
 
-def Parse_5VREG_OFF(data):
-	t = GetDateTime(data[2:])
+def Parse_5VREG_OFF(hdr, data):
 	v5v = lambda x:(x << 4)/4096 * 3.3 * 2 
 	curr = lambda x: ((x&0x7F)<<4)/4096*3.3*1000/50/8 if (x&0x80) else x/4096 * 2 * 3.3 * 100#(((x * 3300 * 25) >> 8)/1000) # else (( 1469 + ((2048*138)>>12) - (2048-((x&0x7F)<<4)) )*3300*10+1)>>14
 	
-	curr5Vgpio =  0 if (data[13] & 0x80) else (data[13] << 5)/1000#((-data[13]-256) << 5)/1000 if (data[13] & 0x80) else (data[13] << 5)/1000
-	gpio5V = "{0:.3f}".format(v5v(data[14]))
-	batSignal = ["{0:.3f}".format(vbat(b)) for b in data[15:23]]
-	curr5vSignal = ["{0:.3f}".format(curr(b)) for b in data[23:31]]
-	logStr = str(data[0]) + ' ' + LOG_MSG_DEFS[data[1]]['name'] +' '+str(t) + ', SoC:'+str((data[11]<<2)/10)+'%, ' + str(data[12])+ 'C, GPIO_5V: '+str(gpio5V)+'V, ' +str(curr5Vgpio)+'A'+ '\n' \
+	curr5Vgpio =  0 if (data[3] & 0x80) else (data[3] << 5)/1000#((-data[3]-256) << 5)/1000 if (data[3] & 0x80) else (data[3] << 5)/1000
+	gpio5V = "{0:.3f}".format(v5v(data[4]))
+	batSignal = ["{0:.3f}".format(vbat(b)) for b in data[5:13]]
+	curr5vSignal = ["{0:.3f}".format(curr(b)) for b in data[13:21]]
+	logStr = hdr + ', SoC:'+str((data[1]<<2)/10)+'%, ' + str(data[2])+ 'C, GPIO_5V: '+str(gpio5V)+'V, ' +str(curr5Vgpio)+'A'+ '\n' \
 	+ '	-battery: ' + str(batSignal) + '\n' \
 	+ '	-current: ' + str(curr5vSignal) + '\n'
 	return logStr
 	
-def Parse_WAKEUP_EVT(data):
-	t = GetDateTime(data[2:])
+def Parse_WAKEUP_EVT(hdr, data):
+	status = GetStatus(data[1])
 	
-	status = GetStatus(data[11])
-	
-	gpio5V = "{0:.3f}".format(((data[20] << 8) | data[19])/1000)
-	batVolt = "{0:.3f}".format(((data[18] << 8) | data[17])/1000)
-	i = (data[22] << 8) | data[21]
+	gpio5V = "{0:.3f}".format(((data[10] << 8) | data[9])/1000)
+	batVolt = "{0:.3f}".format(((data[8] << 8) | data[7])/1000)
+	i = (data[12] << 8) | data[11]
 	if (i & (1 << 15)):
 		i = i - (1 << 16)
 	curr5Vgpio = "{0:.3f}".format(i/1000)
-	wkupOnChargeCfg = (data[14] << 8) | data[13]
+	wkupOnChargeCfg = (data[4] << 8) | data[3]
 
-	logStr = str(data[0]) + ' ' + LOG_MSG_DEFS[data[1]]['name'] +' '+str(t) + ', Battery: '+str((data[15]<<2)/10)+'%, ' +str(batVolt)+'V, ' + str(data[16])+ 'C, '+status['battery'] + '\n' \
-	+ '	GPIO_5V: REGULATOR: ' + ('ON, ' if((data[12]&0x01)) else 'OFF, ')+str(gpio5V)+'V, ' +str(curr5Vgpio)+'A, '+ status['powerInput5vIo'] + '\n' \
-	+ '	TRIGGERS: ' + ('POWER_BUTTON'if(data[10]&0x10) else '') + (' WATCHDOG'if(data[10]&0x08) else '') + (' IO'if(data[10]&0x04) else '') + (' RTC'if(data[10]&0x02) else '') + (' ON_CHARGE'if(data[10]&0x01) else '') + '\n' \
+	logStr = hdr + ', Battery: '+str((data[5]<<2)/10)+'%, ' +str(batVolt)+'V, ' + str(data[6])+ 'C, '+status['battery'] + '\n' \
+	+ '	GPIO_5V: REGULATOR: ' + ('ON, ' if((data[2]&0x01)) else 'OFF, ')+str(gpio5V)+'V, ' +str(curr5Vgpio)+'A, '+ status['powerInput5vIo'] + '\n' \
+	+ '	TRIGGERS: ' + ('POWER_BUTTON'if(data[0]&0x10) else '') + (' WATCHDOG'if(data[0]&0x08) else '') + (' IO'if(data[0]&0x04) else '') + (' RTC'if(data[0]&0x02) else '') + (' ON_CHARGE'if(data[0]&0x01) else '') + '\n' \
 	+ '	WAKEUP_ON_CHARGE: ' + (str(wkupOnChargeCfg)if wkupOnChargeCfg!=0xFFFF else 'DISABLED') + '\n'
 	
 	return logStr
 
-def Parse_ALARM_EVT(data):
-	t = GetDateTime(data[2:])
-	
-	status = GetStatus(data[13])
+def Parse_ALARM_EVT(hdr, data):
+	status = GetStatus(data[3])
 
-	batVolt = "{0:.3f}".format(((data[17] << 8) | data[16])/1000)
-	alarm = GetAlarm(data[20:])
-	alarmStatus = GetAlarmStatus(data[10:])
+	batVolt = "{0:.3f}".format(((data[7] << 8) | data[6])/1000)
+	alarm = GetAlarm(data[10:])
+	alarmStatus = GetAlarmStatus(data)
 
-	logStr = str(data[0]) + ' ' + LOG_MSG_DEFS[data[1]]['name'] +' '+str(t) + ', Battery: '+str((data[14]<<2)/10)+'%, ' +str(batVolt)+'V, ' + str(data[15])+ 'C, '+status['battery'] + '\n' \
+	logStr = hdr + ', Battery: '+str((data[4]<<2)/10)+'%, ' +str(batVolt)+'V, ' + str(data[5])+ 'C, '+status['battery'] + '\n' \
 	+ '	GPIO_INPUT: '+ str(status['powerInput5vIo'])+', USB_MICRO_INPUT: '+ str(status['powerInput']) + '\n' \
 	+ '	STATUS: '+ str(alarmStatus) + '\n' \
 	+ '	CONFIG: ' + str(alarm) + '\n'
 	
 	return logStr
 	
-def Parse_MCU_RESET(data):
-	t = GetDateTime(data[2:])
-	
-	status = GetStatus(data[11])
+def Parse_MCU_RESET(hdr, data):
+	status = GetStatus(data[1])
 	
-	gpio5V = "{0:.3f}".format(((data[20] << 8) | data[19])/1000)
-	batVolt = "{0:.3f}".format(((data[18] << 8) | data[17])/1000)
-	i = (data[22] << 8) | data[21]
+	gpio5V = "{0:.3f}".format(((data[10] << 8) | data[9])/1000)
+	batVolt = "{0:.3f}".format(((data[8] << 8) | data[7])/1000)
+	i = (data[12] << 8) | data[11]
 	if (i & (1 << 15)):
 		i = i - (1 << 16)
 	curr5Vgpio = "{0:.3f}".format(i/1000)
-	wkupOnChargeCfg = (data[14] << 8) | data[13]
+	wkupOnChargeCfg = (data[4] << 8) | data[3]
 
-	logStr = str(data[0]) + ' ' + LOG_MSG_DEFS[data[1]]['name'] +' '+str(t) + ', Battery: '+str((data[15]<<2)/10)+'%, ' +str(batVolt)+'V, ' + str(data[16])+ 'C, '+status['battery'] + '\n' \
-	+ '	GPIO_5V: REGULATOR: ' + ('ON, ' if((data[12]&0x01)) else 'OFF, ')+str(gpio5V)+'V, ' +str(curr5Vgpio)+'A, '+ status['powerInput5vIo'] + '\n' \
-	+ '	STATE: ' + ['NORMAL', 'POWER_ON', 'POWER_RESET', 'UPDATE', 'CONFIG_RESET', 'UNKNOWN'][data[10]] + '\n' \
+	logStr = hdr + ', Battery: '+str((data[5]<<2)/10)+'%, ' +str(batVolt)+'V, ' + str(data[6])+ 'C, '+status['battery'] + '\n' \
+	+ '	GPIO_5V: REGULATOR: ' + ('ON, ' if((data[2]&0x01)) else 'OFF, ')+str(gpio5V)+'V, ' +str(curr5Vgpio)+'A, '+ status['powerInput5vIo'] + '\n' \
+	+ '	STATE: ' + ['NORMAL', 'POWER_ON', 'POWER_RESET', 'UPDATE', 'CONFIG_RESET', 'UNKNOWN'][data[0]] + '\n' \
 	+ '	WAKEUP_ON_CHARGE: ' + (str(wkupOnChargeCfg)if wkupOnChargeCfg!=0xFFFF else 'DISABLED') + '\n'
 	
 	return logStr
+
+def Parse_REPEATED(hdr, data):
+	id = data[0]
+	name = LOG_MSG_DEFS[id]['name'].strip() if id < len(LOG_MSG_DEFS) else 'UNKNOWN'
+	return hdr + ', ' + name + ' suppressed ' + str(data[1] | (data[2] << 8)) + ' times\n'
 	
 LOG_MSG_DEFS = [{'name':'NO_LOG   ', 'parser':{}}, 
 				{'name':'MESSAGE  ', 'parser':{}},
@@ -117,9 +126,12 @@ LOG_MSG_DEFS = [{'name':'NO_LOG   ', 'parser':{}},
 				{'name':'ALARM_EVT  ', 'parser':Parse_ALARM_EVT},
 				{'name':'MCU_RESET  ', 'parser':Parse_MCU_RESET},
 				{'name':'RESERVED1', 'parser':{}},
-				{'name':'ALARM_WRITE  ', 'parser':Parse_ALARM_EVT}]
+				{'name':'ALARM_WRITE  ', 'parser':Parse_ALARM_EVT},
+				{'name':'REPEATED  ', 'parser':Parse_REPEATED}]
 
-LOG_ENABLE_LIST = ['OTHER', '5VREG_ON', '5VREG_OFF', 'WAKEUP_EVT', 'ALARM_EVT', 'MCU_RESET', 'RESERVED2']
+# RATE_LIMIT: at most 4 records at once per enable class, then one per second (four per second for OTHER),
+# suppressed records are reported as REPEATED record with their count
+LOG_ENABLE_LIST = ['OTHER', '5VREG_ON', '5VREG_OFF', 'WAKEUP_EVT', 'ALARM_EVT', 'MCU_RESET', 'RESERVED2', 'RATE_LIMIT']
 
 def GetStatus(d):
 	status = {}
@@ -210,60 +222,142 @@ def GetAlarm(d):
 
 	return alarm
 
-def GetDateTime(buf):
-	#ret = self.interface.ReadData(self.RTC_TIME_CMD, 9)
-	#if ret['error'] != 'NO_ERROR':
-	#	return ret
-	d = buf#ret['data']
-	dt = {}
-	dt['second'] = ((d[0] >> 4) & 0x07) * 10 + (d[0] & 0x0F)
-
-	dt['minute'] = ((d[1] >> 4) & 0x07) * 10 + (d[1] & 0x0F)
+ifs = PiJuiceInterface(I2C_BUS, I2C_ADDRESS)
 
-	if (d[2] & 0x40):
-		# hourFormat = '12'
-		ampm = 'PM' if (d[2] & 0x20) else 'AM'
-		dt['hour'] = str(((d[2] >> 4) & 0x01) * 10 + (d[2] & 0x0F)) + ' ' + ampm
-	else:
-		# hourFormat = '24'
-		dt['hour'] = ((d[2] >> 4) & 0x03) * 10 + (d[2] & 0x0F)
+def ReadLogFrame(ifs, cmd=LOGGING_CMD, size=LOG_DRAIN_FRAME_SIZE):
+	return ifs.ReadDataLong(cmd, size)
 
-	dt['weekday'] = d[3] & 0x07
-	dt['day'] = ((d[4] >> 4) & 0x03) * 10 + (d[4] & 0x0F)
+def ParseLogRecords(frame, n, logStrOut):
+	sec = frame[2] | (frame[3] << 8) | (frame[4] << 16) | (frame[5] << 24)
+	t = sec * 256 + frame[6] # time of first record in frame, 1/256 s
+	pos = LOG_DRAIN_HEADER_SIZE
+	end = LOG_DRAIN_HEADER_SIZE + frame[0]
+	first = True
+	while pos < end:
+		id = frame[pos] & ~LOG_ID_ABS_TIME
+		length = frame[pos+1]
+		pos += 2
+		if frame[pos-2] & LOG_ID_ABS_TIME:
+			abst = ((frame[pos] | (frame[pos+1] << 8) | (frame[pos+2] << 16) | (frame[pos+3] << 24)) << 8) | frame[pos+4]
+			pos += 5
+		else:
+			abst = None
+			delta = 0
+			shift = 0
+			while True:
+				delta |= (frame[pos] & 0x7F) << shift
+				shift += 7
+				pos += 1
+				if not (frame[pos-1] & 0x80): break
+		if not first:
+			t = abst if abst != None else t + delta
+		first = False
+		ts = LOG_TIME_BASE + datetime.timedelta(seconds=t/256)
+		data = frame[pos:pos+length]
+		pos += length
+		name = LOG_MSG_DEFS[id]['name'] if id < len(LOG_MSG_DEFS) else 'UNKNOWN'
+		hdr = str(len(logStrOut) + 1) + ' ' + name + ' ' + str(ts)
+		try:
+			logStrOut.append(LOG_MSG_DEFS[id]['parser'](hdr, data))
+		except (IndexError, TypeError):
+			# unknown message or message without data
+			logStrOut.append(hdr + ' ' + str(data) + '\n')
 
-	dt['month'] = ((d[5] >> 4) & 0x01) * 10 + (d[5] & 0x0F)
+def GetPiJuiceLog(ifs, unreadOnly=False):
+	logStrOut = []
+	if not unreadOnly:
+		# rewind read cursor to oldest message
+		ifs.WriteData(LOGGING_CMD, [0])
+		time.sleep(0.01)
+	ifs.WriteData(LOGGING_CMD, [0x03, LOG_DRAIN_FRAME_SIZE])
+	time.sleep(0.01)
+	retries = 0
+	while True:
+		ret = ReadLogFrame(ifs)
+		if ret['error'] != 'NO_ERROR':
+			retries += 1
+			if retries > 3:
+				print(ret)
+				return ret
+			# firmware repeats last frame
+			time.sleep(0.01)
+			ifs.WriteData(LOGGING_CMD, [0x04])
+			time.sleep(0.01)
+			continue
+		retries = 0
+		d = ret['data']
+		if d[1] & 0x02:
+			logStrOut.append('-- messages lost, log overwritten before read --\n')
+		ParseLogRecords(d, d[0], logStrOut)
+		if not (d[1] & 0x01):
+			return {'data':logStrOut, 'error':'NO_ERROR'}
 
-	dt['year'] = ((d[6] >> 4) & 0x0F) * 10 + (d[6] & 0x0F) + 2000
+FLASH_LOG_NAMES = ['NONE', 'MCU_RESET', '5VREG_OFF', 'FORCED_POWER_OFF', 'WAKEUP', 'FAULT']
+FLASH_LOG_FAULTS = ['CHARGER_FAULT0', 'CHARGER_FAULT1', 'CHARGER_FAULT2', 'FUEL_GAUGE_I2C', 'TEMP_SENSE',
+					'CHARGER_TEMP0', 'CHARGER_TEMP1', 'WATCHDOG_EXPIRED', 'VSYS_FORCED_OFF']
 
-	dt['subsecond'] = d[7] / 256
-		 
-	try:
-		ts = datetime.datetime(dt['year'], dt['month'], dt['day'], dt['hour'], dt['minute'], dt['second'], int(d[7] *1000000 / 256))
-	except:
-		#print('error parsing time', dt)
-		ts=dt
-	
-	return ts
-	
-ifs = PiJuiceInterface(1,0x14)
+def ParseFlashLogRecord(r):
+	seq = r[0] | (r[1] << 8) | (r[2] << 16) | (r[3] << 24)
+	sec = r[4] | (r[5] << 8) | (r[6] << 16) | (r[7] << 24)
+	ts = LOG_TIME_BASE + datetime.timedelta(seconds=sec + r[8]/256)
+	id = r[9]
+	d = r[10:14]
+	name = FLASH_LOG_NAMES[id] if id < len(FLASH_LOG_NAMES) else 'UNKNOWN'
+	logStr = str(seq) + ' ' + name + ' ' + str(ts)
+	if id == 1:
+		logStr += ', STATE: ' + (['NORMAL', 'POWER_ON', 'POWER_RESET', 'UPDATE', 'CONFIG_RESET'][d[0]] if d[0] < 5 else 'UNKNOWN') \
+		+ ', RESET_FLAGS: ' + hex(d[1]) + ', Battery: ' + str((d[2]<<2)/10) + '%, ' + "{0:.2f}".format(d[3]*0.02) + 'V'
+	elif id >= 2 and id <= 4:
+		status = GetStatus(d[1])
+		if id == 3:
+			logStr += ', ' + ['LOW_BATTERY', 'REGULATOR_FAULT'][d[0]&0x01]
+		elif id == 4:
+			logStr += ', TRIGGERS: ' + hex(d[0])
+		logStr += ', Battery: ' + str((d[2]<<2)/10) + '%, ' + "{0:.2f}".format(d[3]*0.02) + 'V, ' + status['battery']
+	elif id == 5:
+		faults = d[0] | (d[1] << 8)
+		newFaults = d[2] | (d[3] << 8)
+		logStr += ', NEW: ' + str([FLASH_LOG_FAULTS[i] for i in range(len(FLASH_LOG_FAULTS)) if newFaults & (1 << i)]) \
+		+ ', ACTIVE: ' + str([FLASH_LOG_FAULTS[i] for i in range(len(FLASH_LOG_FAULTS)) if faults & (1 << i)])
+	else:
+		logStr += ' ' + str(d)
+	return logStr
 
-def GetPiJuiceLog(ifs):
+def GetPiJuiceFlashLog(ifs):
 	logStrOut = []
-	#end = False
-	i = 0
+	nextSeq = 0
+	ifs.WriteData(FLASH_LOG_CMD, [0])
+	time.sleep(0.01)
+	retries = 0
 	while True:
-		ret = ifs.ReadData(LOGGING_CMD, 31)
-		if ret['error'] == 'NO_ERROR': 
-			if (ret['data'][1] == 0): return {'data':logStrOut, 'error':'NO_ERROR'}
-			  
-			s = LOG_MSG_DEFS[ret['data'][1]]['parser'](ret['data'])
-			logStrOut.insert(0,s)
-			#print(s)
-
+		ret = ReadLogFrame(ifs, FLASH_LOG_CMD, FLASH_LOG_FRAME_SIZE)
+		if ret['error'] != 'NO_ERROR':
+			retries += 1
+			if retries > 3:
+				print(ret)
+				return ret
+			# read cursor is sequence number, set it back to repeat records
+			time.sleep(0.01)
+			ifs.WriteData(FLASH_LOG_CMD, [0x01, nextSeq & 0xFF, (nextSeq >> 8) & 0xFF, (nextSeq >> 16) & 0xFF, (nextSeq >> 24) & 0xFF])
 			time.sleep(0.01)
-		else: #elif ret['error'] == 'COMMUNICATION_ERROR':
-			print(ret)
-			return ret
+			continue
+		d = ret['data']
+		if d[1] & 0x08:
+			# firmware prepares next frame in its main loop
+			retries += 1
+			if retries > 10:
+				return {'error':'COMMUNICATION_ERROR'}
+			time.sleep(0.02)
+			continue
+		retries = 0
+		if d[1] & 0x04:
+			logStrOut.append('-- events dropped, not written to flash --')
+		for i in range(0, d[0]):
+			r = d[2 + i*FLASH_LOG_RECORD_SIZE:2 + (i+1)*FLASH_LOG_RECORD_SIZE]
+			logStrOut.append(ParseFlashLogRecord(r))
+			nextSeq = (r[0] | (r[1] << 8) | (r[2] << 16) | (r[3] << 24)) + 1
+		if not (d[1] & 0x01):
+			return {'data':logStrOut, 'error':'NO_ERROR'}
 
 if '--enable' in sys.argv:
 	ci = sys.argv.index('--enable')+1
@@ -300,7 +394,7 @@ if '--get_config' in sys.argv:
 		msk = 0x01
 		strOut = ''
 		#print(ret['data'][3])
-		for i in range(0, 7):
+		for i in range(0, len(LOG_ENABLE_LIST)):
 			if msk&ret['data'][3]: strOut += ('|'if strOut else '') + LOG_ENABLE_LIST[i]
 			msk <<= 1
 		print(strOut)
@@ -323,18 +417,19 @@ if '--disable' in sys.argv:
 			print ('Failed to disable logging')
 			exit(-1)
 
-ifs.WriteData(LOGGING_CMD, [0])
-time.sleep(0.01)
-ret = GetPiJuiceLog(ifs)
-if ret['error'] != 'NO_ERROR': 
-	time.sleep(0.5)
-	ifs.WriteData(LOGGING_CMD, [0])
-	time.sleep(0.01)
-	ret = GetPiJuiceLog(ifs)
+unreadOnly = '--unread' in sys.argv
+args = [a for a in sys.argv[1:] if not a.startswith('--')]
+if '--flash' in sys.argv:
+	ret = GetPiJuiceFlashLog(ifs)
+else:
+	ret = GetPiJuiceLog(ifs, unreadOnly)
+	if ret['error'] != 'NO_ERROR': 
+		time.sleep(0.5)
+		ret = GetPiJuiceLog(ifs, unreadOnly)
 	
 if ret['error'] == 'NO_ERROR': 
-	if len(sys.argv)>1:
-		fp = sys.argv[1]
+	if len(args)>0:
+		fp = args[0]
 		#print(fp)
 		with open(fp, 'a') as file:
 			for s in (ret['data']):
@@ -0,0 +1,181 @@
+#!/usr/bin/env python3
+#
+# Author: Milan Neskovic, Pi Supply, 2021, https://github.com/mmilann
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+
+# Usage:
+# Use to start telemetry trace on PiJuice and read its samples, firmware version >= 1.7
+# Firmware samples enabled signals with fixed period into RAM buffer, host reads it in bulk.
+# If there is file path as input argument samples are appended to it as CSV,
+# otherwise they are printed to screen.
+# Usage:
+#	Start: python3 pijuice_trace.py --start "VBAT|IBAT|IIO|TEMP|SOC|CHARGER" --period 100
+#	Keep sampling while Raspberry Pi is powered off: add --host_off
+#	Read: python3 pijuice_trace.py ./trace.csv
+#	Read continuously: python3 pijuice_trace.py ./trace.csv --follow
+#	Read all samples still in buffer: python3 pijuice_trace.py --rewind
+#	Stop: python3 pijuice_trace.py --stop
+
+from pijuice import PiJuiceInterface
+import time, datetime, sys
+
+I2C_BUS = 1
+I2C_ADDRESS = 0x14
+TRACE_CMD = 0xC9 #201
+TRACE_DRAIN_FRAME_SIZE = 240
+TRACE_DRAIN_HEADER_SIZE = 6
+TRACE_CHUNK_HEADER_SIZE = 7
+TRACE_TIME_BASE = datetime.datetime(2000, 1, 1)
+TRACE_SIGNALS = ['VBAT', 'IBAT', 'IIO', 'TEMP', 'SOC', 'CHARGER']
+TRACE_SIGNAL_UNITS = ['mV', 'mA', 'mA', 'C', '0.1%', '']
+TRACE_FLAG_HOST_OFF = 0x01
+
+ifs = PiJuiceInterface(I2C_BUS, I2C_ADDRESS)
+
+def ReadTraceFrame(ifs):
+	return ifs.ReadDataLong(TRACE_CMD, TRACE_DRAIN_FRAME_SIZE)
+
+def SignedU16(v):
+	return v - 0x10000 if v & 0x8000 else v
+
+# Chunk: length, samples count, time of first sample, first sample as 16 bit values,
+# next samples as bitmap of changed signals and zigzag LEB128 deltas
+def ParseTraceChunks(frame, samplesOut):
+	mask = frame[2]
+	period = frame[3] | (frame[4] << 8)
+	signals = [i for i in range(len(TRACE_SIGNALS)) if mask & (1 << i)]
+	pos = TRACE_DRAIN_HEADER_SIZE
+	end = TRACE_DRAIN_HEADER_SIZE + frame[0]
+	while pos < end:
+		length = frame[pos]
+		count = frame[pos+1]
+		sec = frame[pos+2] | (frame[pos+3] << 8) | (frame[pos+4] << 16) | (frame[pos+5] << 24)
+		t = sec + frame[pos+6]/256
+		p = pos + TRACE_CHUNK_HEADER_SIZE
+		values = [0] * len(signals)
+		for s in range(0, count):
+			if s == 0:
+				for k in range(0, len(signals)):
+					values[k] = frame[p] | (frame[p+1] << 8)
+					p += 2
+			else:
+				changed = frame[p]
+				p += 1
+				for k in range(0, len(signals)):
+					if changed & (1 << k):
+						z = 0
+						shift = 0
+						while True:
+							z |= (frame[p] & 0x7F) << shift
+							shift += 7
+							p += 1
+							if not (frame[p-1] & 0x80): break
+						delta = (z >> 1) ^ -(z & 1)
+						values[k] = (values[k] + delta) & 0xFFFF
+			ts = TRACE_TIME_BASE + datetime.timedelta(seconds=t + s*period/1000)
+			samplesOut.append([ts] + [SignedU16(v) for v in values])
+		pos += length
+	return [TRACE_SIGNALS[i] for i in signals]
+
+def GetPiJuiceTrace(ifs):
+	samplesOut = []
+	signals = []
+	retries = 0
+	lost = False
+	while True:
+		ret = ReadTraceFrame(ifs)
+		if ret['error'] != 'NO_ERROR':
+			retries += 1
+			if retries > 3:
+				return ret
+			# firmware repeats last frame
+			time.sleep(0.01)
+			ifs.WriteData(TRACE_CMD, [0x02])
+			time.sleep(0.01)
+			continue
+		retries = 0
+		d = ret['data']
+		if d[1] & 0x02:
+			lost = True
+		signals = ParseTraceChunks(d, samplesOut)
+		if not (d[1] & 0x01):
+			return {'data':{'signals':signals, 'samples':samplesOut, 'lost':lost}, 'error':'NO_ERROR'}
+
+if '--start' in sys.argv:
+	ci = sys.argv.index('--start')+1
+	if len(sys.argv) <= ci:
+		print('Missing parameter')
+		exit(-1)
+	sigList = sys.argv[ci].split('|')
+	mask = 0x00
+	for i in range(0, len(TRACE_SIGNALS)):
+		if TRACE_SIGNALS[i] in sigList:
+			mask |= 0x01 << i
+	if mask == 0x00:
+		print('Invalid parameter')
+		exit(-1)
+	period = 1000
+	if '--period' in sys.argv and len(sys.argv) > sys.argv.index('--period')+1:
+		period = int(sys.argv[sys.argv.index('--period')+1])
+	if period < 20 or period > 0xFFFF:
+		print('Period must be 20 to 65535 ms')
+		exit(-1)
+	flags = TRACE_FLAG_HOST_OFF if '--host_off' in sys.argv else 0
+	ret = ifs.WriteData(TRACE_CMD, [0x00, mask, period & 0xFF, (period >> 8) & 0xFF, flags])
+	if ret['error'] != 'NO_ERROR':
+		print(ret)
+		exit(-1)
+	print('Trace started', hex(mask), str(period) + 'ms')
+	exit(0)
+
+if '--stop' in sys.argv:
+	ret = ifs.WriteData(TRACE_CMD, [0x00, 0x00, 0x00, 0x00, 0x00])
+	if ret['error'] != 'NO_ERROR':
+		print(ret)
+		exit(-1)
+	print('Trace stopped')
+	exit(0)
+
+if '--rewind' in sys.argv:
+	ifs.WriteData(TRACE_CMD, [0x01])
+	time.sleep(0.01)
+
+fileName = None
+for arg in sys.argv[1:]:
+	if not arg.startswith('--'):
+		fileName = arg
+
+header = True
+if fileName:
+	try:
+		with open(fileName, 'r') as f:
+			header = f.read(1) == ''
+	except IOError:
+		pass
+
+while True:
+	ret = GetPiJuiceTrace(ifs)
+	if ret['error'] != 'NO_ERROR':
+		print(ret)
+		exit(-1)
+	trace = ret['data']
+	lines = []
+	if header:
+		lines.append(','.join(['time'] + [s + (' ' + TRACE_SIGNAL_UNITS[TRACE_SIGNALS.index(s)] if TRACE_SIGNAL_UNITS[TRACE_SIGNALS.index(s)] else '') for s in trace['signals']]))
+		header = False
+	if trace['lost']:
+		lines.append('# samples lost, trace buffer overwritten before read')
+	for s in trace['samples']:
+		lines.append(','.join([str(s[0])] + [str(v) for v in s[1:]]))
+	if fileName:
+		with open(fileName, 'a') as f:
+			for l in lines: f.write(l + '\n')
+	else:
+		for l in lines: print(l)
+	if not '--follow' in sys.argv:
+		break
+	time.sleep(1)
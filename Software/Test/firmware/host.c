@@ -0,0 +1,354 @@
+// ----------------------------------------------------------------------------
+/*!
+ * @file         host.c
+ * @date       19 October 2026
+ * @brief       Host peripherals, flash and RTC emulation and HAL functions
+ *                  used by firmware modules under test.
+ */
+// ----------------------------------------------------------------------------
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "host.h"
+
+uint32_t hostPrimask = 0;
+uint32_t hostIpsr = 0;
+
+FLASH_TypeDef hostFLASH;
+TIM_TypeDef hostTIM1, hostTIM3, hostTIM14, hostTIM15, hostTIM16, hostTIM17;
+EXTI_TypeDef hostEXTI;
+GPIO_TypeDef hostGPIOA, hostGPIOB, hostGPIOC, hostGPIOF;
+ADC_TypeDef hostADC1;
+RTC_TypeDef hostRTC;
+PWR_TypeDef hostPWR;
+RCC_TypeDef hostRCC;
+
+uint32_t SystemCoreClock = 8000000;
+uint32_t hostTick = 0;
+
+uint32_t hostFlashPrograms = 0;
+uint32_t hostFlashErases = 0;
+uint32_t hostFlashErrors = 0;
+uint32_t hostFlashBusyUs = 0;
+uint32_t hostFlashReads = 0;
+int32_t hostFlashCutIn = -1;
+jmp_buf hostFlashCut;
+uint8_t hostFlashCutPartial = 1;
+void (*hostFlashOpCb)(void) = NULL;
+
+uint32_t hostChecks = 0;
+uint32_t hostFails = 0;
+
+static uint8_t *hostFlashCopy;
+
+#define HOST_FLASH_TRACK_SIZE	(HOST_FLASH_BASE + HOST_FLASH_SIZE - HOST_FLASH_TRACK_START)
+
+void HostFlashInit(void) {
+	void *m = mmap((void *)HOST_FLASH_BASE, HOST_FLASH_SIZE, PROT_READ | PROT_WRITE,
+			MAP_FIXED | MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (m == MAP_FAILED) {
+		perror("mmap flash");
+		exit(2);
+	}
+	memset(m, 0xFF, HOST_FLASH_SIZE);
+	if (hostFlashCopy == NULL) hostFlashCopy = malloc(HOST_FLASH_TRACK_SIZE);
+	memset(hostFlashCopy, 0xFF, HOST_FLASH_TRACK_SIZE);
+}
+
+// Erases area directly, for test setup
+void HostFlashErase(uint32_t address, uint32_t size) {
+	memset((void *)(uintptr_t)address, 0xFF, size);
+	memcpy(hostFlashCopy + (address - HOST_FLASH_TRACK_START), (void *)(uintptr_t)address, size);
+}
+
+// Programs half word directly, for test setup of existing flash content
+void HostFlashWrite(uint32_t address, uint16_t data) {
+	*(uint16_t *)(uintptr_t)address = data;
+	*(uint16_t *)(hostFlashCopy + (address - HOST_FLASH_TRACK_START)) = data;
+}
+
+static uint8_t HostFlashIsCut(void) {
+	if (hostFlashCutIn < 0) return 0;
+	if (hostFlashCutIn-- == 0) {
+		// flash interface and interrupt mask are reset with power
+		FLASH->CR = 0;
+		hostPrimask = 0;
+		hostIpsr = 0;
+		return 1;
+	}
+	return 0;
+}
+
+static void HostFlashEraseOp(uint32_t address) {
+	uint8_t *p = (uint8_t *)(uintptr_t)address;
+	uint8_t *c = hostFlashCopy + (address - HOST_FLASH_TRACK_START);
+
+	hostFlashErases++;
+	hostFlashBusyUs += 40000;
+	if (HostFlashIsCut()) {
+		// interrupted erase leaves part of page erased
+		memset(p, 0xFF, rand() % HOST_FLASH_PAGE_SIZE);
+		memcpy(c, p, HOST_FLASH_PAGE_SIZE);
+		longjmp(hostFlashCut, 1);
+	}
+	memset(p, 0xFF, HOST_FLASH_PAGE_SIZE);
+	memcpy(c, p, HOST_FLASH_PAGE_SIZE);
+}
+
+static HAL_StatusTypeDef HostFlashProgramOp(void) {
+	uint16_t *p = (uint16_t *)(uintptr_t)HOST_FLASH_TRACK_START;
+	uint16_t *c = (uint16_t *)hostFlashCopy;
+	uint32_t i, n = HOST_FLASH_TRACK_SIZE / 2;
+	uint16_t old, val;
+
+	// find half word stored by firmware since last operation
+	for (i = 0; i < n; i += 32) {
+		if (memcmp(p + i, c + i, 64)) break;
+	}
+	for (; i < n && p[i] == c[i]; i++);
+	if (i >= n) {
+		// same value programmed again
+		hostFlashPrograms++;
+		return HAL_OK;
+	}
+
+	old = c[i];
+	val = p[i];
+	hostFlashPrograms++;
+	hostFlashBusyUs += 50;
+	if (old != 0xFFFF && val != 0x0000) {
+		// STM32F0 sets PGERR and leaves half word unchanged
+		hostFlashErrors++;
+		p[i] = old;
+		return HAL_ERROR;
+	}
+	if (HostFlashIsCut()) {
+		// interrupted program clears some of the bits
+		p[i] = hostFlashCutPartial ? old & (val | (uint16_t)rand()) : old;
+		c[i] = p[i];
+		longjmp(hostFlashCut, 1);
+	}
+	p[i] = old & val;
+	c[i] = p[i];
+	return HAL_OK;
+}
+
+// Firmware programs and erases through FLASH registers and waits for completion here
+HAL_StatusTypeDef FLASH_WaitForLastOperation(uint32_t Timeout) {
+	(void)Timeout;
+	if (hostFlashOpCb && (FLASH->CR & (FLASH_CR_PER | FLASH_CR_PG))) hostFlashOpCb();
+	if ((FLASH->CR & FLASH_CR_PER) && (FLASH->CR & FLASH_CR_STRT)) {
+		FLASH->CR &= ~FLASH_CR_STRT;
+		if (FLASH->AR < HOST_FLASH_TRACK_START || FLASH->AR >= HOST_FLASH_BASE + HOST_FLASH_SIZE
+				|| (FLASH->AR & (HOST_FLASH_PAGE_SIZE - 1))) {
+			hostFlashErrors++;
+			return HAL_ERROR;
+		}
+		HostFlashEraseOp(FLASH->AR);
+	} else if (FLASH->CR & FLASH_CR_PG) {
+		return HostFlashProgramOp();
+	}
+	return HAL_OK;
+}
+
+uint32_t HAL_GetTick(void) {
+	return hostTick;
+}
+
+void HAL_Delay(uint32_t Delay) {
+	hostTick += Delay;
+}
+
+void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority) {
+	(void)IRQn;
+	(void)PreemptPriority;
+	(void)SubPriority;
+}
+
+void HAL_NVIC_EnableIRQ(IRQn_Type IRQn) {
+	(void)IRQn;
+}
+
+void HAL_NVIC_DisableIRQ(IRQn_Type IRQn) {
+	(void)IRQn;
+}
+
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin) {
+	return (GPIOx->IDR & GPIO_Pin) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+}
+
+void HAL_GPIO_WritePin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState) {
+	if (PinState == GPIO_PIN_SET) {
+		GPIOx->ODR |= GPIO_Pin;
+	} else {
+		GPIOx->ODR &= ~GPIO_Pin;
+	}
+}
+
+RTC_HandleTypeDef hrtc = {.Instance = RTC, .Init = {.HourFormat = RTC_HOURFORMAT_24, .AsynchPrediv = 127, .SynchPrediv = 255}};
+uint32_t hostRtcReads = 0;
+
+uint8_t RTC_ByteToBcd2(uint8_t Value) {
+	return ((Value / 10) << 4) | (Value % 10);
+}
+
+uint8_t RTC_Bcd2ToByte(uint8_t Value) {
+	return (Value >> 4) * 10 + (Value & 0x0F);
+}
+
+void HostRtcSet(time_t t, uint8_t sub) {
+	struct tm tm;
+	uint8_t h;
+
+	gmtime_r(&t, &tm);
+	h = tm.tm_hour;
+	if (hrtc.Init.HourFormat == RTC_HOURFORMAT_12) h = h % 12 ? h % 12 : 12;
+	RTC->TR = RTC_ByteToBcd2(tm.tm_sec) | (RTC_ByteToBcd2(tm.tm_min) << 8) | (RTC_ByteToBcd2(h) << 16)
+		| ((hrtc.Init.HourFormat == RTC_HOURFORMAT_12 && tm.tm_hour >= 12) ? RTC_TR_PM : 0);
+	RTC->DR = RTC_ByteToBcd2(tm.tm_mday) | (RTC_ByteToBcd2(tm.tm_mon + 1) << 8) | ((tm.tm_wday ? tm.tm_wday : 7) << 13)
+		| (RTC_ByteToBcd2(tm.tm_year - 100) << 16);
+	RTC->SSR = 255 - sub; // counts down from synchronous prescaler
+}
+
+time_t HostRtcGet(void) {
+	struct tm tm = {0};
+
+	tm.tm_sec = RTC_Bcd2ToByte(RTC->TR & 0x7F);
+	tm.tm_min = RTC_Bcd2ToByte((RTC->TR >> 8) & 0x7F);
+	tm.tm_hour = RTC_Bcd2ToByte((RTC->TR >> 16) & 0x3F);
+	if (hrtc.Init.HourFormat == RTC_HOURFORMAT_12) tm.tm_hour = tm.tm_hour % 12 + ((RTC->TR & RTC_TR_PM) ? 12 : 0);
+	tm.tm_mday = RTC_Bcd2ToByte(RTC->DR & 0x3F);
+	tm.tm_mon = RTC_Bcd2ToByte((RTC->DR >> 8) & 0x1F) - 1;
+	tm.tm_year = RTC_Bcd2ToByte((RTC->DR >> 16) & 0xFF) + 100;
+	return timegm(&tm);
+}
+
+uint8_t HostRtcAlarm(void) {
+	uint32_t a = RTC->ALRMAR;
+
+	if (!(RTC->CR & RTC_CR_ALRAE)) return 0;
+	if (!(a & RTC_ALRMAR_MSK1) && (a & 0x7F) != (RTC->TR & 0x7F)) return 0;
+	if (!(a & RTC_ALRMAR_MSK2) && ((a >> 8) & 0x7F) != ((RTC->TR >> 8) & 0x7F)) return 0;
+	if (!(a & RTC_ALRMAR_MSK3) && (((a >> 16) & 0x3F) != ((RTC->TR >> 16) & 0x3F)
+		|| !(a & RTC_ALRMAR_PM) != !(RTC->TR & RTC_TR_PM))) return 0;
+	if (a & RTC_ALRMAR_MSK4) return 1;
+	if (a & RTC_ALRMAR_WDSEL) return ((a >> 24) & 0x0F) == ((RTC->DR >> 13) & 0x07);
+	return ((a >> 24) & 0x3F) == (RTC->DR & 0x3F);
+}
+
+HAL_StatusTypeDef HAL_RTC_Init(RTC_HandleTypeDef *hrtc) {
+	(void)hrtc;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_RTC_GetTime(RTC_HandleTypeDef *hrtc, RTC_TimeTypeDef *sTime, uint32_t Format) {
+	uint32_t tr = hrtc->Instance->TR;
+
+	hostRtcReads++;
+	sTime->SubSeconds = hrtc->Instance->SSR;
+	sTime->SecondFraction = hrtc->Init.SynchPrediv;
+	sTime->Seconds = tr & 0x7F;
+	sTime->Minutes = (tr >> 8) & 0x7F;
+	sTime->Hours = (tr >> 16) & 0x3F;
+	sTime->TimeFormat = (tr & RTC_TR_PM) ? RTC_HOURFORMAT12_PM : RTC_HOURFORMAT12_AM;
+	sTime->DayLightSaving = 0;
+	sTime->StoreOperation = 0;
+	if (Format == RTC_FORMAT_BIN) {
+		sTime->Seconds = RTC_Bcd2ToByte(sTime->Seconds);
+		sTime->Minutes = RTC_Bcd2ToByte(sTime->Minutes);
+		sTime->Hours = RTC_Bcd2ToByte(sTime->Hours);
+	}
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_RTC_GetDate(RTC_HandleTypeDef *hrtc, RTC_DateTypeDef *sDate, uint32_t Format) {
+	uint32_t dr = hrtc->Instance->DR;
+
+	hostRtcReads++;
+	sDate->Year = (dr >> 16) & 0xFF;
+	sDate->Month = (dr >> 8) & 0x1F;
+	sDate->Date = dr & 0x3F;
+	sDate->WeekDay = (dr >> 13) & 0x07;
+	if (Format == RTC_FORMAT_BIN) {
+		sDate->Year = RTC_Bcd2ToByte(sDate->Year);
+		sDate->Month = RTC_Bcd2ToByte(sDate->Month);
+		sDate->Date = RTC_Bcd2ToByte(sDate->Date);
+	}
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_RTC_SetTime(RTC_HandleTypeDef *hrtc, RTC_TimeTypeDef *sTime, uint32_t Format) {
+	uint8_t h = sTime->Hours, m = sTime->Minutes, s = sTime->Seconds;
+
+	if (Format == RTC_FORMAT_BIN) {
+		h = RTC_ByteToBcd2(h);
+		m = RTC_ByteToBcd2(m);
+		s = RTC_ByteToBcd2(s);
+	}
+	hrtc->Instance->TR = (s | (m << 8) | (h << 16)
+		| ((hrtc->Init.HourFormat == RTC_HOURFORMAT_12 && sTime->TimeFormat == RTC_HOURFORMAT12_PM) ? RTC_TR_PM : 0))
+		& RTC_TR_RESERVED_MASK;
+	hrtc->Instance->SSR = hrtc->Init.SynchPrediv;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_RTC_SetDate(RTC_HandleTypeDef *hrtc, RTC_DateTypeDef *sDate, uint32_t Format) {
+	uint8_t y = sDate->Year, m = sDate->Month, d = sDate->Date;
+
+	if (Format == RTC_FORMAT_BIN) {
+		y = RTC_ByteToBcd2(y);
+		m = RTC_ByteToBcd2(m);
+		d = RTC_ByteToBcd2(d);
+	}
+	hrtc->Instance->DR = (d | (m << 8) | (sDate->WeekDay << 13) | (y << 16)) & RTC_DR_RESERVED_MASK;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_RTC_SetAlarm_IT(RTC_HandleTypeDef *hrtc, RTC_AlarmTypeDef *sAlarm, uint32_t Format) {
+	RTC_TimeTypeDef *t = &sAlarm->AlarmTime;
+	uint8_t h = t->Hours, m = t->Minutes, s = t->Seconds, d = sAlarm->AlarmDateWeekDay;
+
+	if (Format == RTC_FORMAT_BIN) {
+		h = RTC_ByteToBcd2(h);
+		m = RTC_ByteToBcd2(m);
+		s = RTC_ByteToBcd2(s);
+		d = RTC_ByteToBcd2(d);
+	}
+	hrtc->Instance->ALRMAR = s | (m << 8) | (h << 16) | ((uint32_t)d << 24)
+		| ((hrtc->Init.HourFormat == RTC_HOURFORMAT_12 && t->TimeFormat == RTC_HOURFORMAT12_PM) ? RTC_ALRMAR_PM : 0)
+		| sAlarm->AlarmDateWeekDaySel | sAlarm->AlarmMask;
+	hrtc->Instance->CR |= RTC_CR_ALRAE | RTC_CR_ALRAIE;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_RTC_GetAlarm(RTC_HandleTypeDef *hrtc, RTC_AlarmTypeDef *sAlarm, uint32_t Alarm, uint32_t Format) {
+	uint32_t a = hrtc->Instance->ALRMAR;
+
+	sAlarm->Alarm = Alarm;
+	sAlarm->AlarmTime.Seconds = a & 0x7F;
+	sAlarm->AlarmTime.Minutes = (a >> 8) & 0x7F;
+	sAlarm->AlarmTime.Hours = (a >> 16) & 0x3F;
+	sAlarm->AlarmTime.TimeFormat = (a & RTC_ALRMAR_PM) ? RTC_HOURFORMAT12_PM : RTC_HOURFORMAT12_AM;
+	sAlarm->AlarmDateWeekDay = (a >> 24) & 0x3F;
+	sAlarm->AlarmDateWeekDaySel = a & RTC_ALRMAR_WDSEL;
+	sAlarm->AlarmMask = a & RTC_ALARMMASK_ALL;
+	if (Format == RTC_FORMAT_BIN) {
+		sAlarm->AlarmTime.Seconds = RTC_Bcd2ToByte(sAlarm->AlarmTime.Seconds);
+		sAlarm->AlarmTime.Minutes = RTC_Bcd2ToByte(sAlarm->AlarmTime.Minutes);
+		sAlarm->AlarmTime.Hours = RTC_Bcd2ToByte(sAlarm->AlarmTime.Hours);
+		sAlarm->AlarmDateWeekDay = RTC_Bcd2ToByte(sAlarm->AlarmDateWeekDay);
+	}
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_RTC_DeactivateAlarm(RTC_HandleTypeDef *hrtc, uint32_t Alarm) {
+	(void)Alarm;
+	hrtc->Instance->CR &= ~(RTC_CR_ALRAE | RTC_CR_ALRAIE);
+	return HAL_OK;
+}
+
+int HostReport(const char *name) {
+	printf("%s: %u checks, %u failed\n", name, hostChecks, hostFails);
+	return hostFails ? 1 : 0;
+}
@@ -0,0 +1,146 @@
+// ----------------------------------------------------------------------------
+/*!
+ * @file         host.h
+ * @date       19 October 2026
+ * @brief       Host build of firmware modules for tests. Force included
+ *                  (gcc -include host.h) before firmware sources, it pulls
+ *                  in HAL headers and replaces Cortex-M intrinsics and
+ *                  peripheral pointers with host variables, so sources
+ *                  are compiled unchanged. Emulated flash is mapped at its
+ *                  real address by HostFlashInit.
+ */
+// ----------------------------------------------------------------------------
+
+#ifndef HOST_H_
+#define HOST_H_
+
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include "stm32f0xx_hal.h"
+
+// Interrupt mask and context, tests set hostIpsr to run code as interrupt handler
+extern uint32_t hostPrimask;
+extern uint32_t hostIpsr;
+
+#undef __disable_irq
+#undef __enable_irq
+#undef __get_PRIMASK
+#undef __set_PRIMASK
+#undef __get_IPSR
+#undef __NOP
+#undef __WFI
+#define __disable_irq()	(hostPrimask = 1)
+#define __enable_irq()	(hostPrimask = 0)
+#define __get_PRIMASK()	(hostPrimask)
+#define __set_PRIMASK(m)	(hostPrimask = (m))
+#define __get_IPSR()	(hostIpsr)
+#define __NOP()	((void)0)
+#define __WFI()	((void)0)
+
+// Peripherals
+extern FLASH_TypeDef hostFLASH;
+extern TIM_TypeDef hostTIM1, hostTIM3, hostTIM14, hostTIM15, hostTIM16, hostTIM17;
+extern EXTI_TypeDef hostEXTI;
+extern GPIO_TypeDef hostGPIOA, hostGPIOB, hostGPIOC, hostGPIOF;
+extern ADC_TypeDef hostADC1;
+extern RTC_TypeDef hostRTC;
+extern PWR_TypeDef hostPWR;
+extern RCC_TypeDef hostRCC;
+
+#undef FLASH
+#undef TIM1
+#undef TIM3
+#undef TIM14
+#undef TIM15
+#undef TIM16
+#undef TIM17
+#undef EXTI
+#undef GPIOA
+#undef GPIOB
+#undef GPIOC
+#undef GPIOF
+#undef ADC1
+#undef RTC
+#undef PWR
+#undef RCC
+#define FLASH	(&hostFLASH)
+#define TIM1	(&hostTIM1)
+#define TIM3	(&hostTIM3)
+#define TIM14	(&hostTIM14)
+#define TIM15	(&hostTIM15)
+#define TIM16	(&hostTIM16)
+#define TIM17	(&hostTIM17)
+#define EXTI	(&hostEXTI)
+#define GPIOA	(&hostGPIOA)
+#define GPIOB	(&hostGPIOB)
+#define GPIOC	(&hostGPIOC)
+#define GPIOF	(&hostGPIOF)
+#define ADC1	(&hostADC1)
+#define RTC	(&hostRTC)
+#define PWR	(&hostPWR)
+#define RCC	(&hostRCC)
+
+// System tick in ms returned by HAL_GetTick
+extern uint32_t hostTick;
+
+// Flash emulation: program sets only cleared bits, non erased half word can only
+// be programmed to 0 as on STM32F0, erase is per 2K page
+#define HOST_FLASH_BASE	0x08000000
+#define HOST_FLASH_SIZE	0x42000 // 256K of target and room for 8 eeprom pages
+#define HOST_FLASH_PAGE_SIZE	0x800
+// programmed half word is found by comparing this area with copy made at last operation
+#define HOST_FLASH_TRACK_START	0x08038000
+
+extern uint32_t hostFlashPrograms;
+extern uint32_t hostFlashErases;
+extern uint32_t hostFlashErrors;
+extern uint32_t hostFlashBusyUs; // time flash operations would take on target
+// Power cut: after hostFlashCutIn more operations the next one is interrupted and
+// HostFlashCut is long jumped to, -1 disables
+extern int32_t hostFlashCutIn;
+extern jmp_buf hostFlashCut;
+// Interrupted program leaves random bits of half word unprogrammed if set, otherwise
+// half word is unchanged. Single records of emulated eeprom are not protected against
+// partially programmed virtual address, tests of them clear it.
+extern uint8_t hostFlashCutPartial;
+
+// Reads of emulated eeprom, counted by its flash read macros
+extern uint32_t hostFlashReads;
+#define EE_READ_HALFWORD(address)	(hostFlashReads++, *(volatile uint16_t *)(uintptr_t)(address))
+#define EE_READ_WORD(address)	(hostFlashReads++, *(volatile uint32_t *)(uintptr_t)(address))
+
+// Called at each flash program and erase, tests run interrupt handlers from it
+extern void (*hostFlashOpCb)(void);
+
+void HostFlashInit(void);
+void HostFlashErase(uint32_t address, uint32_t size);
+void HostFlashWrite(uint32_t address, uint16_t data);
+
+// RTC calendar in BCD TR, DR and SSR registers as on STM32F0, HAL RTC functions read and
+// set them and program alarm A in ALRMAR. Time is seconds since 1970 in UTC, sub in 1/256 s.
+extern RTC_HandleTypeDef hrtc;
+extern uint32_t hostRtcReads; // HAL_RTC_GetTime and HAL_RTC_GetDate calls
+
+void HostRtcSet(time_t t, uint8_t sub);
+time_t HostRtcGet(void);
+uint8_t HostRtcAlarm(void); // 1 if alarm A is enabled and matches calendar
+
+// Test result helpers
+extern uint32_t hostChecks;
+extern uint32_t hostFails;
+
+#define HOST_CHECK(cond, ...) do { \
+		hostChecks++; \
+		if (!(cond)) { \
+			hostFails++; \
+			printf("%s:%d: check failed: %s: ", __FILE__, __LINE__, #cond); \
+			printf(__VA_ARGS__); \
+			printf("\n"); \
+		} \
+	} while (0)
+
+int HostReport(const char *name);
+
+#endif /* HOST_H_ */
@@ -0,0 +1,78 @@
+#!/bin/bash
+# Builds firmware modules for host with test harness and runs tests.
+# Usage: run_tests.sh [test_name...]
+# Tests taking random seed argument are run with each of SEEDS.
+
+cd "$(dirname "$0")"
+ONLY="$*"
+
+FW=../../../Firmware/Sources-V1.6_2021_09_10
+BUILD=build
+SEEDS=${SEEDS:-"1 2 3 4"}
+CC=${CC:-gcc}
+# 64 bit host truncates ~UL register masks, missing prototypes and return paths fail the build
+CFLAGS="-std=gnu11 -O1 -g -Wall -Wno-unused-function -Wno-int-to-pointer-cast -Wno-overflow \
+	-Werror=implicit-function-declaration -Werror=return-type \
+	-DUSE_HAL_DRIVER -DSTM32F030xC -DLOGGING \
+	-include host.h -I. -I$FW/Inc -I$FW/Drivers/STM32F0xx_HAL_Driver/Inc \
+	-I$FW/Drivers/CMSIS/Device/ST/STM32F0xx/Include -I$FW/Drivers/CMSIS/Include"
+
+# test name, firmware sources it is linked with and defines of build variant
+TESTS=(
+	"test_eeprom Src/eeprom.c"
+	"test_eeprom Src/eeprom.c -DEE_PAGES_NUM=2"
+	"test_eeprom Src/eeprom.c -DEE_PAGES_NUM=8"
+	"test_nv Src/nv.c Src/eeprom.c"
+	"test_flash_log Src/flash_log.c Src/eeprom.c"
+	"test_trace Src/trace.c"
+	"test_load_current_stats Src/load_current_stats.c"
+	"test_io_log Src/io_log.c"
+	"test_io_counter Src/io_counter.c"
+	"test_power_stats Src/power_stats.c"
+	"test_led_effects Src/led.c"
+	"test_logging Src/logging.c"
+	"test_rtc_schedule Src/rtc_schedule.c"
+	"test_rtc_ds1339_emu Src/rtc_ds1339_emu.c Src/rtc_schedule.c"
+	"test_button Src/button.c"
+	"test_load_current_sense Src/load_current_sense.c"
+	"test_rtc_calibration Src/rtc_calibration.c"
+	"test_energy_accounting Src/energy_accounting.c"
+	"test_power_management Src/power_management.c"
+	"test_watchdog Src/power_management.c Src/io_control.c"
+	"test_power_policy Src/power_policy.c"
+)
+
+mkdir -p $BUILD
+failed=0
+for t in "${TESTS[@]}"; do
+	set -- $t
+	name=$1
+	shift
+	if [ -n "$ONLY" ] && ! [[ " $ONLY " == *" $name "* ]]; then
+		continue
+	fi
+	srcs=""
+	defs=""
+	bin=$name
+	for s in "$@"; do
+		if [[ $s == -D* ]]; then
+			defs="$defs $s"
+			bin="${bin}_${s#-D}"
+		else
+			srcs="$srcs $FW/$s"
+		fi
+	done
+	bin=${bin//=/_}
+	if ! $CC $CFLAGS $defs -o $BUILD/$bin $name.c host.c $srcs -lm; then
+		echo "$bin: build failed"
+		failed=1
+		continue
+	fi
+	for seed in $SEEDS; do
+		if ! ./$BUILD/$bin $seed; then
+			failed=1
+		fi
+	done
+done
+
+exit $failed
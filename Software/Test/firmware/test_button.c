@@ -0,0 +1,364 @@
+// ----------------------------------------------------------------------------
+/*!
+ * @file         test_button.c
+ * @date       19 October 2026
+ * @brief       Button decoding tests: random press sequences with bounce
+ *                  bursts fed as timestamped edge interrupts, MCU stopped
+ *                  while no button is active, events compared with previous
+ *                  20 ms pin polling decoder on same press timing, also for
+ *                  random configurations written over NV. Edges in stop
+ *                  mode, edge queue overflow, dual long press and single
+ *                  press time limit with chatter.
+ *                  Usage: test_button [seed]
+ */
+// ----------------------------------------------------------------------------
+// Include section - add all #includes here:
+
+#include <stdlib.h>
+#include <string.h>
+#include "button.h"
+#include "nv.h"
+
+// ----------------------------------------------------------------------------
+// Defines section - add all #defines here:
+
+#define TEST_POLL_PERIOD	20 // ms, previous ButtonTask period
+#define TEST_MARGIN	50 // ms, press timing is kept clear of thresholds for poll quantization
+#define TEST_EVENT_DELAY	100 // ms, poll period, bounce and debounce
+#define TEST_PRESSES_MAX	8
+#define TEST_EDGES_MAX	(TEST_PRESSES_MAX * 2 * 7)
+#define TEST_EVENTS_MAX	(TEST_PRESSES_MAX * 4)
+#define TEST_SCENARIOS_NUM	300
+#define TEST_TIMEOUT	30000 // ms, event timeout of decoder
+
+// ----------------------------------------------------------------------------
+// Variables section - add all global variables here:
+
+typedef struct {
+	uint32_t time;
+	GPIO_PinState level;
+} TestEdge_T;
+
+typedef struct {
+	uint32_t time;
+	uint8_t b;
+	ButtonEvent_T event;
+} TestEvent_T;
+
+static GPIO_TypeDef * const pinPorts[3] = {GPIOC, GPIOB, GPIOB};
+static const uint16_t pins[3] = {GPIO_PIN_13, GPIO_PIN_12, GPIO_PIN_2};
+
+static uint32_t now; // tick time in ms returned by TimeTickFine
+static uint8_t tickSuspended;
+static uint32_t dualLongPresses;
+
+static uint16_t nvVar[NV_VAR_NUM];
+static uint8_t nvValid[NV_VAR_NUM];
+
+static TestEdge_T edges[TEST_EDGES_MAX];
+static TestEvent_T refEvents[TEST_EVENTS_MAX], newEvents[TEST_EVENTS_MAX];
+static uint16_t refEventsNum, newEventsNum;
+
+// ----------------------------------------------------------------------------
+// Function section - add all local functions here:
+
+void ProcessButton(uint8_t b, GPIO_PinState pinState, uint32_t time);
+
+uint32_t TimeTickFine(void) {
+	return now;
+}
+
+uint8_t TimeTickIsSuspended(void) {
+	return tickSuspended;
+}
+
+uint16_t EE_ReadVariable(uint16_t VirtAddress, uint16_t *Data) {
+	if (VirtAddress >= NV_VAR_NUM || !nvValid[VirtAddress]) return 1;
+	*Data = nvVar[VirtAddress];
+	return 0;
+}
+
+void NvTransactionBegin(void) {
+}
+
+void NvTransactionStage(uint16_t VirtAddress, uint16_t var) {
+	HOST_CHECK(VirtAddress >= BUTTON_PRESS_FUNC_SW1 && VirtAddress < BUTTON_PRESS_FUNC_SW1
+			+ 3 * (BUTTON_PRESS_FUNC_SW2 - BUTTON_PRESS_FUNC_SW1), "nv address %u", VirtAddress);
+	nvVar[VirtAddress] = var;
+	nvValid[VirtAddress] = 1;
+}
+
+uint16_t NvTransactionCommit(void) {
+	return 0;
+}
+
+void ButtonDualLongPressEventCb(void) {
+	dualLongPresses++;
+}
+
+static void SetPin(uint8_t b, GPIO_PinState level) {
+	if (level == GPIO_PIN_SET) pinPorts[b]->IDR |= pins[b];
+	else pinPorts[b]->IDR &= ~pins[b];
+}
+
+// Edge interrupt
+static void Edge(uint8_t b, GPIO_PinState level) {
+	SetPin(b, level);
+	ButtonEdgeCb(pins[b]);
+}
+
+// Events are taken and removed after each decoder run, as power management does
+static void Record(TestEvent_T ev[], uint16_t *n) {
+	uint8_t b;
+
+	for (b = 0; b < 3; b++) {
+		if (!GetButtonEvent(b)) continue;
+		if (*n < TEST_EVENTS_MAX) {
+			ev[*n].time = now;
+			ev[*n].b = b;
+			ev[*n].event = GetButtonEvent(b);
+			(*n)++;
+		}
+		ButtonRemoveEvent(b);
+	}
+}
+
+static void Task(void) {
+	ButtonTask();
+	Record(newEvents, &newEventsNum);
+}
+
+static uint8_t Near(uint32_t d, uint32_t threshold) {
+	return threshold && d + TEST_MARGIN > threshold && d < threshold + TEST_MARGIN;
+}
+
+// Clean press and release times from 0, timing close to thresholds of configuration is avoided
+static uint8_t RandomPresses(uint8_t b, uint32_t t[]) {
+	uint8_t data[12];
+	uint16_t len;
+	uint32_t duration, interval;
+	uint8_t n = 1 + rand() % TEST_PRESSES_MAX, k;
+
+	ButtonGetConfiguarion(b, data, &len);
+	t[0] = 0;
+	for (k = 0; k < n; k++) {
+		// interval is from press to next press
+		do {
+			duration = rand() % 4 ? 60 + rand() % 1500 : (rand() % 2 ? 60 + rand() % 6000 : 60 + rand() % 26000);
+			interval = duration + (rand() % 4 ? 60 + rand() % 1500 : 60 + rand() % 40000);
+		} while (Near(duration, data[5] * 100) || Near(duration, data[9] * 100) || Near(duration, data[11] * 100)
+				|| Near(duration, BUTTON_STATIC_LONG_PRESS_TIME) || Near(interval, data[7] * 100)
+				|| Near(interval, TEST_TIMEOUT));
+		t[2 * k + 1] = t[2 * k] + duration;
+		if (k + 1 < n) t[2 * k + 2] = t[2 * k] + interval;
+	}
+	return 2 * n;
+}
+
+// Previous decoder: pin level sampled every 20 ms
+static void RunPoll(uint8_t b, const uint32_t t[], uint8_t n, uint32_t start, uint32_t end) {
+	uint8_t k = 0;
+
+	refEventsNum = 0;
+	for (now = start; now < end; now += TEST_POLL_PERIOD) {
+		while (k < n && start + t[k] <= now) k++;
+		ProcessButton(b, (k & 0x01) ? GPIO_PIN_SET : GPIO_PIN_RESET, now);
+		Record(refEvents, &refEventsNum);
+	}
+}
+
+// Edges with bounce bursts, decoder runs at random steps while button is active, otherwise MCU is
+// stopped until next edge interrupt
+static void RunEdges(uint8_t b, const uint32_t t[], uint8_t n, uint32_t start, uint32_t end) {
+	uint16_t edgesNum = 0, i = 0;
+	uint32_t next, time, step;
+	uint8_t k, j, bounces, active;
+
+	for (k = 0; k < n; k++) {
+		time = start + t[k];
+		edges[edgesNum].time = time;
+		edges[edgesNum++].level = (k & 0x01) ? GPIO_PIN_RESET : GPIO_PIN_SET;
+		bounces = rand() % 4;
+		for (j = 0; j < 2 * bounces; j++) {
+			time += 1 + rand() % 2;
+			edges[edgesNum].time = time;
+			edges[edgesNum++].level = ((k + j) & 0x01) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+		}
+	}
+
+	newEventsNum = 0;
+	now = start;
+	while (now < end) {
+		active = IsButtonActive();
+		next = i < edgesNum ? edges[i].time : end;
+		step = 1 + rand() % TEST_POLL_PERIOD;
+		if (active && now + step < next) {
+			now += step;
+			Task();
+			continue;
+		}
+		now = next;
+		if (i < edgesNum) Edge(b, edges[i++].level);
+		// edge interrupt wakes MCU from stop
+		if (!active) Task();
+	}
+}
+
+static void Compare(uint8_t b, uint32_t refStart, uint32_t newStart) {
+	uint32_t refTime, newTime;
+	uint16_t k;
+
+	for (k = 0; k < refEventsNum && k < newEventsNum; k++) {
+		if (newEvents[k].b != refEvents[k].b || newEvents[k].event != refEvents[k].event) break;
+		refTime = refEvents[k].time - refStart;
+		newTime = newEvents[k].time - newStart;
+		HOST_CHECK(newTime <= refTime + TEST_EVENT_DELAY && refTime <= newTime + TEST_EVENT_DELAY,
+				"sw%u event %u at %u ms expected at %u ms", b + 1, newEvents[k].event, newTime, refTime);
+	}
+	if (k < refEventsNum || k < newEventsNum) {
+		HOST_CHECK(0, "sw%u: %u events expected %u, first differs at %u: %u expected %u", b + 1, newEventsNum,
+				refEventsNum, k, k < newEventsNum ? newEvents[k].event : 0, k < refEventsNum ? refEvents[k].event : 0);
+	}
+}
+
+static void TestSequences(void) {
+	uint32_t t[2 * TEST_PRESSES_MAX], start = now + 2 * TEST_TIMEOUT, span;
+	uint8_t data[12], check[12], b, n, k;
+	uint16_t s, len;
+
+	for (s = 0; s < TEST_SCENARIOS_NUM; s++) {
+		b = rand() % 3;
+		if (s >= TEST_SCENARIOS_NUM / 10 && rand() % 2) {
+			// user configuration written over NV, times in 100 ms
+			for (k = 0; k < 12; k += 2) {
+				data[k] = rand() % 3 ? BUTTON_EVENT_FUNC_USER_EVENT | (rand() % 16) : BUTTON_EVENT_NO_FUNC;
+			}
+			data[1] = 0;
+			data[3] = 0;
+			data[5] = 1 + rand() % 30;
+			data[7] = 1 + rand() % 30;
+			data[9] = 20 + rand() % 130;
+			data[11] = 150 + rand() % 100;
+			ButtonSetConfiguarion(b, data, sizeof(data));
+			Task();
+			ButtonGetConfiguarion(b, check, &len);
+			HOST_CHECK(len == sizeof(check) && memcmp(check, data, sizeof(data)) == 0, "sw%u configuration", b + 1);
+		}
+
+		// same press timing on both decoders, events are timed out between runs
+		n = RandomPresses(b, t);
+		ButtonGetConfiguarion(b, data, &len);
+		span = t[n - 1] + data[7] * 100 + 1000;
+		RunPoll(b, t, n, start, start + span);
+		start += span + 2 * TEST_TIMEOUT;
+		RunEdges(b, t, n, start, start + span);
+		Compare(b, start - span - 2 * TEST_TIMEOUT, start);
+		HOST_CHECK(!IsButtonActive(), "sw%u active after released for %u ms", b + 1, span - t[n - 1]);
+		start += span + 2 * TEST_TIMEOUT;
+	}
+}
+
+static void TestStop(void) {
+	// press while tick is suspended for stop mode is not timestamped, state is taken from pin after wake-up
+	newEventsNum = 0;
+	now += 1000;
+	Task();
+	tickSuspended = 1;
+	Edge(2, GPIO_PIN_SET);
+	now += 3000;
+	tickSuspended = 0;
+	Task();
+	HOST_CHECK(IsButtonActive(), "pressed button not active after wake-up");
+	now += BUTTON_DEBOUNCE_TIME;
+	Task();
+	now += 200;
+	Edge(2, GPIO_PIN_RESET);
+	Task();
+	now += BUTTON_DEBOUNCE_TIME;
+	Task();
+	HOST_CHECK(newEventsNum == 2 && newEvents[0].b == 2 && newEvents[0].event == BUTTON_EVENT_PRESS
+			&& newEvents[1].event == BUTTON_EVENT_RELEASE,
+			"%u events after stop mode", newEventsNum);
+}
+
+static void TestOverflow(void) {
+	uint16_t k, presses = 0, releases = 0;
+
+	// chatter longer than edge queue ends released, decoder follows pin after dropped edges
+	newEventsNum = 0;
+	now += 1000;
+	for (k = 0; k < 3 * BUTTON_EDGES_MAX; k++) {
+		now += rand() % 2;
+		Edge(2, (k & 0x01) ? GPIO_PIN_RESET : GPIO_PIN_SET);
+	}
+	for (k = 0; k < 20; k++) {
+		now += 5;
+		Task();
+	}
+	for (k = 0; k < newEventsNum; k++) {
+		if (newEvents[k].event == BUTTON_EVENT_PRESS) presses++;
+		if (newEvents[k].event == BUTTON_EVENT_RELEASE) releases++;
+	}
+	HOST_CHECK(!IsButtonActive() && presses == releases, "active %u after chatter, %u presses %u releases",
+			IsButtonActive(), presses, releases);
+}
+
+static void TestThreshold(void) {
+	uint32_t t[2] = {0, 0};
+	uint16_t d, k;
+
+	// single press of sw1 is shorter than 800 ms on default configuration, measured from first edges of chatter
+	for (k = 0; k < 20; k++) {
+		for (d = 799; d <= 800; d++) {
+			t[1] = d;
+			now += 2 * TEST_TIMEOUT;
+			RunEdges(0, t, 2, now, now + 1000);
+			HOST_CHECK(newEventsNum == (d < 800) && (newEventsNum == 0 || newEvents[0].event == BUTTON_EVENT_SINGLE_PRESS),
+					"%u ms press, %u events", d, newEventsNum);
+		}
+	}
+}
+
+static void TestDualLongPress(void) {
+	uint16_t k;
+
+	// sw1 and sw2 held together, sw1 long press events on default configuration
+	newEventsNum = 0;
+	dualLongPresses = 0;
+	now += 1000;
+	Edge(0, GPIO_PIN_SET);
+	Edge(1, GPIO_PIN_SET);
+	for (k = 0; k < 21000 / TEST_POLL_PERIOD; k++) {
+		now += TEST_POLL_PERIOD;
+		Task();
+	}
+	Edge(0, GPIO_PIN_RESET);
+	Edge(1, GPIO_PIN_RESET);
+	for (k = 0; k < 10; k++) {
+		now += TEST_POLL_PERIOD;
+		Task();
+	}
+	HOST_CHECK(dualLongPresses == 1, "%u dual long presses", dualLongPresses);
+	HOST_CHECK(newEventsNum == 2 && newEvents[0].b == 0 && newEvents[0].event == BUTTON_EVENT_LONG_PRESS1
+			&& newEvents[1].b == 0 && newEvents[1].event == BUTTON_EVENT_LONG_PRESS2, "%u events", newEventsNum);
+	HOST_CHECK(!IsButtonActive(), "active after release");
+}
+
+int main(int argc, char *argv[]) {
+	int seed = argc > 1 ? atoi(argv[1]) : 1;
+	char name[40];
+
+	srand(seed);
+
+	now = 1000;
+	ButtonInit();
+
+	TestStop();
+	TestOverflow();
+	TestDualLongPress();
+	TestThreshold();
+	TestSequences();
+
+	snprintf(name, sizeof(name), "test_button seed %d", seed);
+	return HostReport(name);
+}
@@ -0,0 +1,620 @@
+// ----------------------------------------------------------------------------
+/*!
+ * @file         test_eeprom.c
+ * @date       19 October 2026
+ * @brief       Emulated eeprom tests against reference model of variable
+ *                  values: RAM index lookups, index rebuild on init,
+ *                  flash reads of init and reads of all variables
+ *                  compared with two page layout scan,
+ *                  lookups of addresses outside index, writes and
+ *                  background page transfer interrupted by power loss,
+ *                  also again during recovery on init,
+ *                  migration of two page layout interrupted by power loss,
+ *                  writes from interrupt handlers during flash operations,
+ *                  flash time of each write and main loop pass within
+ *                  bound with page erase alone in its pass, writes
+ *                  buffered when head page has no room lost together
+ *                  with power. Built for EE_PAGES_NUM 2, 4 and 8, prints
+ *                  erases per 10000 variable writes and longest write.
+ *                  Usage: test_eeprom [seed]
+ */
+// ----------------------------------------------------------------------------
+// Include section - add all #includes here:
+
+#include <setjmp.h>
+#include <stdlib.h>
+#include <string.h>
+#include "eeprom.h"
+
+// ----------------------------------------------------------------------------
+// Defines section - add all #defines here:
+
+#define TEST_ITERATIONS	20000
+#define TEST_OUT_OF_INDEX_ADDR	0x7000
+#define TEST_MIGRATION_ROUNDS	200
+#define TEST_FULL_LOG_LAYOUTS	16
+#define TEST_RETRIES	1000
+#define TEST_PENDING_MAX	0x10000
+// flash time host charges per half word program and page erase
+#define TEST_PROGRAM_US	50
+#define TEST_ERASE_US	40000
+// longest flash time of write or EE_Task pass without erase: buffered group, own group and page opened,
+// or next page opened, buffered group, transfer chunk and oldest page marked obsolete
+#define TEST_PASS_MAX_US	((2 * (EE_TRANSACTION_MAX_VARS + 2) + 2) * TEST_PROGRAM_US)
+#define TEST_I2C_IRQ_IPSR	39 // exception number of I2C1 interrupt
+// other flash content sharing erase page with two page layout
+#define TEST_SHARED_PAGE_ADDR	0x0803B800
+
+// ----------------------------------------------------------------------------
+// Variables section - add all global variables here:
+
+static uint16_t refValue[NB_OF_VAR];
+static uint8_t refPresent[NB_OF_VAR];
+// writes acknowledged while eeprom buffered writes waiting for room, lost on power loss
+static uint16_t pendAddr[TEST_PENDING_MAX];
+static uint16_t pendData[TEST_PENDING_MAX];
+static uint32_t pendCount;
+
+// ----------------------------------------------------------------------------
+// Function section - add all local functions here:
+
+static void CheckModel(const char *step) {
+	uint16_t var, data, status;
+
+	for (var = 0; var < NB_OF_VAR; var++) {
+		data = 0;
+		status = EE_ReadVariable(var, &data);
+		if (refPresent[var]) {
+			HOST_CHECK(status == 0 && data == refValue[var], "%s: var %u status %u data 0x%04X expected 0x%04X",
+					step, var, status, data, refValue[var]);
+		} else {
+			HOST_CHECK(status == 1, "%s: var %u never written, status %u", step, var, status);
+		}
+	}
+}
+
+static void WriteRandom(void) {
+	uint16_t var = rand() % NB_OF_VAR;
+	uint16_t data = rand() % 4 ? (uint16_t)rand() : 0xFFFF;
+	uint16_t status = EE_WriteVariable(var, data);
+
+	HOST_CHECK(status == HAL_OK, "write var %u status %u", var, status);
+	refValue[var] = data;
+	refPresent[var] = 1;
+}
+
+// Two page layout of firmware up to V1.6: valid page, optionally receive page of interrupted transfer
+static void LegacyLayoutInit(uint8_t receive) {
+	uint32_t address;
+	uint16_t var, data;
+
+	memset(refPresent, 0, sizeof(refPresent));
+	HostFlashWrite(TEST_SHARED_PAGE_ADDR, 0x1234);
+
+	HostFlashWrite(EE_LEGACY_PAGE0_ADDRESS, VALID_PAGE);
+	for (address = EE_LEGACY_PAGE0_ADDRESS + 4; address < EE_LEGACY_PAGE0_ADDRESS + EE_LEGACY_PAGE_SIZE - 4 * (rand() % 64); address += 4) {
+		var = rand() % NB_OF_VAR;
+		data = (uint16_t)rand();
+		HostFlashWrite(address, data);
+		HostFlashWrite(address + 2, var);
+		refValue[var] = data;
+		refPresent[var] = 1;
+	}
+
+	if (!receive) return;
+
+	// receive page gets new value of variable first, then other variables are copied
+	HostFlashWrite(EE_LEGACY_PAGE1_ADDRESS, RECEIVE_DATA);
+	address = EE_LEGACY_PAGE1_ADDRESS + 4;
+	var = rand() % NB_OF_VAR;
+	data = (uint16_t)rand();
+	HostFlashWrite(address, data);
+	HostFlashWrite(address + 2, var);
+	refValue[var] = data;
+	refPresent[var] = 1;
+	for (var = 0; var < NB_OF_VAR && rand() % 8; var++) {
+		if (!refPresent[var]) continue;
+		address += 4;
+		HostFlashWrite(address, refValue[var]);
+		HostFlashWrite(address + 2, var);
+	}
+}
+
+// Two page layout read of firmware up to V1.6: both page headers, then valid page scanned from end
+static uint16_t OldReadVariable(uint16_t VirtAddress, uint16_t *Data) {
+	uint32_t address = EE_LEGACY_PAGE0_ADDRESS + EE_LEGACY_PAGE_SIZE - 2;
+
+	hostFlashReads += 2;
+	for (; address > EE_LEGACY_PAGE0_ADDRESS + 2; address -= 4) {
+		hostFlashReads++;
+		if (*(uint16_t *)(uintptr_t)address == VirtAddress) {
+			hostFlashReads++;
+			*Data = *(uint16_t *)(uintptr_t)(address - 2);
+			return 0;
+		}
+	}
+	return 1;
+}
+
+// Valid page of two page layout holding present variables after page transfer and random writes since
+static void OldLayoutInit(void) {
+	uint32_t address = EE_LEGACY_PAGE0_ADDRESS + 4;
+	uint32_t end = EE_LEGACY_PAGE0_ADDRESS + EE_LEGACY_PAGE_SIZE;
+	uint16_t var;
+
+	HostFlashWrite(EE_LEGACY_PAGE0_ADDRESS, VALID_PAGE);
+	for (var = 0; var < NB_OF_VAR; var++) {
+		if (!refPresent[var]) continue;
+		HostFlashWrite(address, refValue[var]);
+		HostFlashWrite(address + 2, var);
+		address += 4;
+	}
+	end -= 4 * (rand() % ((end - address) / 4 + 1));
+	for (; address < end; address += 4) {
+		do {
+			var = rand() % NB_OF_VAR;
+		} while (!refPresent[var]);
+		HostFlashWrite(address, refValue[var]);
+		HostFlashWrite(address + 2, var);
+	}
+}
+
+static uint32_t FlashOps(void) {
+	return hostFlashPrograms + hostFlashErases;
+}
+
+static void TestMigration(void) {
+	volatile uint32_t round;
+	volatile uint8_t cuts;
+	uint32_t ops, layoutSeed;
+	int32_t cut;
+	uint16_t status;
+
+	for (round = 0; round < TEST_MIGRATION_ROUNDS; round++) {
+		// flash operations of uninterrupted migration
+		layoutSeed = rand();
+		HostFlashInit();
+		srand(layoutSeed);
+		LegacyLayoutInit(round % 2);
+		ops = FlashOps();
+		HOST_CHECK(EE_Init() == HAL_OK, "migration");
+		ops = FlashOps() - ops;
+		CheckModel("migration");
+
+		// power loss at one of last operations marking old pages obsolete, or at random one,
+		// program interrupted with random bits of half word left unprogrammed
+		cut = round % 4 ? (int32_t)ops - 1 - (int32_t)(round % 4) : rand() % ops;
+		HostFlashInit();
+		srand(layoutSeed);
+		LegacyLayoutInit(round % 2);
+		srand(layoutSeed + round);
+
+		// migration interrupted by power loss is repeated on next init
+		for (cuts = 0; cuts < 3; cuts++) {
+			hostFlashCutIn = cut;
+			if (setjmp(hostFlashCut) == 0) {
+				EE_Init();
+				hostFlashCutIn = -1;
+				break;
+			}
+			cut = rand() % ops;
+		}
+		hostFlashCutIn = -1;
+
+		status = EE_Init();
+		HOST_CHECK(status == HAL_OK, "init after migration status %u", status);
+		CheckModel("interrupted migration");
+		HOST_CHECK(*(uint16_t *)(uintptr_t)(EE_LEGACY_PAGE0_ADDRESS + 2) != 0xFFFF, "valid page not marked obsolete");
+		HOST_CHECK(*(uint16_t *)(uintptr_t)TEST_SHARED_PAGE_ADDR == 0x1234, "shared erase page content lost");
+
+		// migrated values are not migrated again over new ones
+		WriteRandom();
+		WriteRandom();
+		HOST_CHECK(EE_Init() == HAL_OK, "reinit after migration");
+		CheckModel("after migration");
+	}
+}
+
+// I2C command handler writing variables while main loop writes flash
+static void IrqWriteCb(void) {
+	uint16_t addr[3], data[3], i, status;
+
+	if (rand() % 8) return;
+	hostIpsr = TEST_I2C_IRQ_IPSR;
+	for (i = 0; i < 3; i++) {
+		addr[i] = (rand() % (NB_OF_VAR / 3)) * 3 + i;
+		data[i] = (uint16_t)rand();
+	}
+	i = rand() % 2 ? 1 : 3;
+	status = EE_WriteVariables(addr, data, i);
+	if (status == HAL_OK) {
+		while (i--) {
+			refValue[addr[i]] = data[i];
+			refPresent[addr[i]] = 1;
+		}
+	} else {
+		HOST_CHECK(status == PAGE_FULL, "interrupt write status %u", status);
+	}
+	hostIpsr = 0;
+}
+
+static void TestInterruptWrites(void) {
+	uint32_t it, programs;
+	uint16_t var, data, i, status;
+
+	// flash is not written from interrupt handler, value is read before it is stored
+	hostIpsr = TEST_I2C_IRQ_IPSR;
+	programs = hostFlashPrograms;
+	HOST_CHECK(EE_WriteVariable(10, 0x1111) == HAL_OK, "interrupt write");
+	HOST_CHECK(EE_WriteVariable(11, 0x2222) == HAL_OK, "interrupt write");
+	HOST_CHECK(EE_WriteVariable(10, 0x3333) == HAL_OK, "interrupt write");
+	HOST_CHECK(hostFlashPrograms == programs, "flash programmed from interrupt");
+	HOST_CHECK(EE_ReadVariable(10, &data) == 0 && data == 0x3333, "deferred read in interrupt 0x%04X", data);
+	hostIpsr = 0;
+	HOST_CHECK(EE_ReadVariable(11, &data) == 0 && data == 0x2222, "deferred read 0x%04X", data);
+	refValue[10] = 0x3333;
+	refValue[11] = 0x2222;
+	refPresent[10] = refPresent[11] = 1;
+	EE_Task();
+	HOST_CHECK(hostFlashPrograms > programs, "deferred writes not stored");
+	HOST_CHECK(EE_Init() == HAL_OK, "reinit");
+	CheckModel("deferred stored");
+
+	// requests buffer full, new variables rejected, requested ones still replaced
+	hostIpsr = TEST_I2C_IRQ_IPSR;
+	for (i = 0; i < EE_TRANSACTION_MAX_VARS; i++) {
+		HOST_CHECK(EE_WriteVariable(i, i) == HAL_OK, "interrupt write %u", i);
+		refValue[i] = i;
+		refPresent[i] = 1;
+	}
+	HOST_CHECK(EE_WriteVariable(EE_TRANSACTION_MAX_VARS, 0) == PAGE_FULL, "full requests buffer accepted");
+	HOST_CHECK(EE_WriteVariable(0, 0x4444) == HAL_OK, "replace in full requests buffer");
+	refValue[0] = 0x4444;
+	hostIpsr = 0;
+	CheckModel("full requests buffer");
+
+	// main loop write waits after requested writes, full buffer is stored first
+	programs = hostFlashPrograms;
+	HOST_CHECK(EE_WriteVariable(0, 0x5555) == HAL_OK && hostFlashPrograms == programs, "main loop write");
+	HOST_CHECK(EE_WriteVariable(EE_TRANSACTION_MAX_VARS, 0x6666) == HAL_OK, "main loop write");
+	HOST_CHECK(hostFlashPrograms > programs && EE_PendingWrites() == 1, "%u writes buffered", EE_PendingWrites());
+	refValue[0] = 0x5555;
+	refValue[EE_TRANSACTION_MAX_VARS] = 0x6666;
+	refPresent[EE_TRANSACTION_MAX_VARS] = 1;
+	CheckModel("main loop write after requests");
+	EE_Task();
+	HOST_CHECK(EE_PendingWrites() == 0, "%u writes buffered", EE_PendingWrites());
+	HOST_CHECK(EE_Init() == HAL_OK, "reinit");
+	CheckModel("requests stored before main loop write");
+
+	// interrupt writes during main loop writes, page transfers and erases
+	hostFlashOpCb = IrqWriteCb;
+	for (it = 0; it < TEST_ITERATIONS; it++) {
+		var = rand() % NB_OF_VAR;
+		data = (uint16_t)rand();
+		refValue[var] = data;
+		refPresent[var] = 1;
+		status = EE_WriteVariable(var, data);
+		// buffer filled by interrupt writes waits for room, interrupt write of var during it is older
+		for (i = 0; i < TEST_RETRIES && status == PAGE_FULL && EE_PendingWrites(); i++) {
+			EE_Task();
+			refValue[var] = data;
+			status = EE_WriteVariable(var, data);
+		}
+		HOST_CHECK(status == HAL_OK, "main loop write status %u", status);
+		EE_Task();
+		if (it % 100 == 0) CheckModel("interrupt writes");
+	}
+	hostFlashOpCb = NULL;
+	for (it = 0; it < TEST_RETRIES && EE_PendingWrites(); it++) EE_Task();
+	HOST_CHECK(EE_Init() == HAL_OK, "reinit");
+	CheckModel("interrupt writes done");
+}
+
+static void TestEmpty(void) {
+	uint16_t data;
+
+	HOST_CHECK(EE_Init() == HAL_OK, "init of erased flash");
+	CheckModel("empty");
+	HOST_CHECK(EE_ReadVariable(TEST_OUT_OF_INDEX_ADDR, &data) == 1, "out of index address found in empty log");
+}
+
+static void TestIndex(void) {
+	uint32_t it, programs, reads, initReads, varReads, oldReads;
+	uint16_t var, data;
+
+	for (it = 0; it < TEST_ITERATIONS; it++) {
+		WriteRandom();
+		if (rand() % 4 == 0) EE_Task();
+		if (it % 1000 == 0) CheckModel("write");
+	}
+	CheckModel("writes done");
+
+	// index lookups do not scan or program flash
+	programs = hostFlashPrograms;
+	for (it = 0; it < 1000; it++) {
+		var = rand() % NB_OF_VAR;
+		EE_ReadVariable(var, &data);
+	}
+	HOST_CHECK(hostFlashPrograms == programs, "read programmed flash");
+
+	for (it = 0; it < 200; it++) EE_Task();
+	CheckModel("after transfers");
+	HOST_CHECK(hostFlashErases > EE_PAGES_NUM, "log did not wrap, %u erases", hostFlashErases);
+
+	// index rebuilt from log pages equals index updated by writes
+	reads = hostFlashReads;
+	HOST_CHECK(EE_Init() == HAL_OK, "reinit");
+	initReads = hostFlashReads - reads;
+	CheckModel("reinit");
+
+	// boot reading all variables as NvInit and modules do, against two page layout of same variables
+	reads = hostFlashReads;
+	for (var = 0; var < NB_OF_VAR; var++) EE_ReadVariable(var, &data);
+	varReads = hostFlashReads - reads;
+	OldLayoutInit();
+	reads = hostFlashReads;
+	for (var = 0; var < NB_OF_VAR; var++) {
+		HOST_CHECK(OldReadVariable(var, &data) == !refPresent[var], "two page layout var %u", var);
+	}
+	oldReads = hostFlashReads - reads + 2;
+	HostFlashErase(EE_LEGACY_PAGE0_ADDRESS, EE_LEGACY_PAGE_SIZE);
+	printf("flash reads of init %u and %u variables %u, two page layout %u\n", initReads, NB_OF_VAR, varReads, oldReads);
+	HOST_CHECK(varReads <= NB_OF_VAR, "%u reads of %u indexed variables", varReads, NB_OF_VAR);
+	HOST_CHECK(initReads + varReads < oldReads, "init and variables %u reads, two page layout %u",
+			initReads + varReads, oldReads);
+}
+
+static void TestOutOfIndex(void) {
+	uint16_t data = 0;
+
+	// address above variables table is found by log scan from newest record
+	HOST_CHECK(EE_WriteVariable(TEST_OUT_OF_INDEX_ADDR, 0x1234) == HAL_OK, "write out of index address");
+	HOST_CHECK(EE_WriteVariable(TEST_OUT_OF_INDEX_ADDR, 0x0234) == HAL_OK, "write out of index address");
+	HOST_CHECK(EE_ReadVariable(TEST_OUT_OF_INDEX_ADDR, &data) == 0 && data == 0x0234,
+			"out of index read 0x%04X", data);
+	CheckModel("out of index");
+}
+
+// Full log with transfer of oldest page left for init and transaction interrupted at end of head page
+static void FullLogInit(void) {
+	uint32_t address;
+	uint16_t slot, var, data, count;
+	uint8_t page;
+
+	HostFlashInit();
+	memset(refPresent, 0, sizeof(refPresent));
+	for (page = 1; page <= EE_PAGES_NUM; page++) {
+		address = EE_PAGE_ADDRESS(page % EE_PAGES_NUM);
+		HostFlashWrite(address, LOG_PAGE);
+		HostFlashWrite(address + 2, page);
+		for (slot = 1; slot < (page < EE_PAGES_NUM ? PAGE_SIZE / 4 : 1 + rand() % 128); slot++) {
+			var = rand() % NB_OF_VAR;
+			data = (uint16_t)rand();
+			HostFlashWrite(address + slot * 4, data);
+			HostFlashWrite(address + slot * 4 + 2, var);
+			refValue[var] = data;
+			refPresent[var] = 1;
+		}
+	}
+	count = 2 + rand() % (EE_TRANSACTION_MAX_VARS - 1);
+	HostFlashWrite(address + slot * 4, count);
+	HostFlashWrite(address + slot * 4 + 2, EE_TRANSACTION_VIRT_ADDR);
+	for (count = rand() % count; count; count--) {
+		slot++;
+		HostFlashWrite(address + slot * 4, (uint16_t)rand());
+		HostFlashWrite(address + slot * 4 + 2, rand() % NB_OF_VAR);
+	}
+}
+
+// Main loop passes writing single variables or groups, each call blocks for bounded flash time
+static void TestBlocking(void) {
+	uint32_t it, busy, programs, pageErases, erases, buffered = 0, written = 0, maxWrite = 0, maxTask = 0;
+	uint16_t addr[EE_TRANSACTION_MAX_VARS], data[EE_TRANSACTION_MAX_VARS];
+	uint16_t count, i, status;
+
+	erases = hostFlashErases;
+	for (it = 0; it < TEST_ITERATIONS; it++) {
+		if (rand() % 2) {
+			count = rand() % 4 ? 1 : 2 + rand() % (EE_TRANSACTION_MAX_VARS - 1);
+			for (i = 0; i < count; i++) {
+				addr[i] = rand() % NB_OF_VAR;
+				data[i] = (uint16_t)rand();
+			}
+			busy = hostFlashBusyUs;
+			pageErases = hostFlashErases;
+			status = EE_WriteVariables(addr, data, count);
+			HOST_CHECK(status == HAL_OK || (status == PAGE_FULL && EE_PendingWrites()), "write of %u status %u", count, status);
+			HOST_CHECK(hostFlashErases == pageErases, "write erased page");
+			busy = hostFlashBusyUs - busy;
+			if (busy > maxWrite) maxWrite = busy;
+			if (EE_PendingWrites()) buffered++;
+			if (status == HAL_OK) written += count;
+			for (i = 0; i < count && status == HAL_OK; i++) {
+				refValue[addr[i]] = data[i];
+				refPresent[addr[i]] = 1;
+			}
+		}
+
+		// bursts of writes between passes fill head page, page erase can not be split, it is alone in its pass
+		if (it % 1000 < 600) continue;
+		busy = hostFlashBusyUs;
+		programs = hostFlashPrograms;
+		pageErases = hostFlashErases;
+		EE_Task();
+		busy = hostFlashBusyUs - busy;
+		if (hostFlashErases != pageErases) {
+			HOST_CHECK(hostFlashPrograms == programs && busy == TEST_ERASE_US, "erase pass %u us, %u programs",
+					busy, hostFlashPrograms - programs);
+		} else if (busy > maxTask) {
+			maxTask = busy;
+		}
+		if (it % 1000 == 600) CheckModel("main loop");
+	}
+	CheckModel("main loop done");
+	HOST_CHECK(hostFlashErases - erases > 2 * EE_PAGES_NUM, "log did not wrap, %u erases", hostFlashErases - erases);
+	HOST_CHECK(buffered > 0, "no write buffered");
+	HOST_CHECK(maxWrite <= TEST_PASS_MAX_US, "write blocked %u us", maxWrite);
+	HOST_CHECK(maxTask <= TEST_PASS_MAX_US, "pass without erase blocked %u us", maxTask);
+	// wear and worst case latency compared between EE_PAGES_NUM builds
+	printf("%u pages: %u erases per 10000 variable writes, longest write %u us, pass without erase %u us, erase %u us\n",
+			EE_PAGES_NUM, (uint32_t)((uint64_t)(hostFlashErases - erases) * 10000 / written), maxWrite, maxTask, TEST_ERASE_US);
+	for (it = 0; it < TEST_RETRIES && EE_PendingWrites(); it++) EE_Task();
+	HOST_CHECK(EE_PendingWrites() == 0, "%u writes still buffered", EE_PendingWrites());
+	HOST_CHECK(EE_Init() == HAL_OK, "reinit");
+	CheckModel("main loop reinit");
+}
+
+static void AddPending(uint16_t var, uint16_t data) {
+	HOST_CHECK(pendCount < TEST_PENDING_MAX, "pending writes model full");
+	if (pendCount == TEST_PENDING_MAX) return;
+	pendAddr[pendCount] = var;
+	pendData[pendCount++] = data;
+}
+
+// All acknowledged writes are stored once none is buffered
+static void ResolvePending(void) {
+	uint32_t i;
+
+	for (i = 0; i < pendCount; i++) {
+		refValue[pendAddr[i]] = pendData[i];
+		refPresent[pendAddr[i]] = 1;
+	}
+	pendCount = 0;
+}
+
+static uint8_t IsPending(uint16_t var) {
+	uint32_t i;
+
+	for (i = 0; i < pendCount && pendAddr[i] != var; i++);
+	return i < pendCount;
+}
+
+// Variable read after power loss is last stored value, one acknowledged while writes were
+// buffered or one of interrupted write
+static void ResolveVariable(uint16_t var, uint8_t inWrite, uint16_t data) {
+	uint16_t stored = 0, status = EE_ReadVariable(var, &stored);
+	uint32_t i;
+
+	if (status == 1) {
+		HOST_CHECK(!refPresent[var], "var %u lost", var);
+		return;
+	}
+	for (i = 0; i < pendCount && !(pendAddr[i] == var && pendData[i] == stored); i++);
+	HOST_CHECK(status == 0 && ((refPresent[var] && stored == refValue[var]) || i < pendCount || (inWrite && stored == data)),
+			"var %u status %u data 0x%04X after power loss", var, status, stored);
+	refValue[var] = stored;
+	refPresent[var] = 1;
+}
+
+static void TestPowerLoss(void) {
+	volatile uint32_t it;
+	uint16_t addr[EE_TRANSACTION_MAX_VARS], data[EE_TRANSACTION_MAX_VARS];
+	uint16_t count, i, k, var, stored, status, written, changed;
+	volatile uint32_t cut;
+	uint32_t ops, layoutSeed;
+
+	hostFlashCutPartial = 0;
+	for (it = 0; it < TEST_ITERATIONS; it++) {
+		// single variable or group of distinct variables
+		count = rand() % 4 ? 1 : 2 + rand() % (EE_TRANSACTION_MAX_VARS - 1);
+		for (i = 0; i < count; i++) {
+			do {
+				addr[i] = rand() % NB_OF_VAR;
+				for (k = 0; k < i && addr[k] != addr[i]; k++);
+			} while (k < i);
+			data[i] = (uint16_t)rand();
+		}
+
+		hostFlashCutIn = rand() % 4 == 0 ? rand() % (2 * count + 8) : -1;
+		if (setjmp(hostFlashCut) == 0) {
+			// group not fitting in buffer with writes waiting for room is retried after main loop pass
+			status = EE_WriteVariables(addr, data, count);
+			for (k = 0; k < TEST_RETRIES && status == PAGE_FULL && EE_PendingWrites(); k++) {
+				EE_Task();
+				if (EE_PendingWrites() == 0) ResolvePending();
+				status = EE_WriteVariables(addr, data, count);
+			}
+			HOST_CHECK(status == HAL_OK, "write of %u status %u", count, status);
+			// main loop pass after every other write, or write burst filling log faster than transfer
+			if (it % 1000 < 500 && rand() % 2) EE_Task();
+			hostFlashCutIn = -1;
+			for (i = 0; i < count; i++) AddPending(addr[i], data[i]);
+			if (EE_PendingWrites() == 0) ResolvePending();
+			continue;
+		}
+
+		// power lost during write or background transfer, all or none of variables are written,
+		// also when power is lost again during first init closing transaction or continuing transfer
+		hostFlashCutIn = rand() % 2 ? rand() % 8 : -1;
+		if (setjmp(hostFlashCut) == 0) EE_Init();
+		hostFlashCutIn = -1;
+		status = EE_Init();
+		HOST_CHECK(status == HAL_OK, "init after power loss status %u", status);
+		written = 0;
+		changed = 0;
+		for (i = 0; i < count; i++) {
+			if ((refPresent[addr[i]] && refValue[addr[i]] == data[i]) || IsPending(addr[i])) continue;
+			changed++;
+			if (EE_ReadVariable(addr[i], &stored) == 0 && stored == data[i]) written++;
+		}
+		HOST_CHECK(written == 0 || written == changed, "%u of %u variables written", written, changed);
+
+		for (var = 0; var < NB_OF_VAR; var++) {
+			for (i = 0; i < count && addr[i] != var; i++);
+			if (i < count || IsPending(var)) ResolveVariable(var, i < count, i < count ? data[i] : 0);
+		}
+		pendCount = 0;
+		CheckModel("power loss");
+	}
+	hostFlashCutPartial = 1;
+
+	for (it = 0; it < TEST_RETRIES && EE_PendingWrites(); it++) EE_Task();
+	HOST_CHECK(EE_PendingWrites() == 0, "%u writes buffered", EE_PendingWrites());
+	ResolvePending();
+	HOST_CHECK(EE_Init() == HAL_OK, "reinit");
+	CheckModel("power loss done");
+
+	// power lost at each flash operation of init closing transaction and transferring oldest page
+	for (it = 0; it < TEST_FULL_LOG_LAYOUTS; it++) {
+		layoutSeed = rand();
+		srand(layoutSeed);
+		FullLogInit();
+		ops = FlashOps();
+		HOST_CHECK(EE_Init() == HAL_OK, "init of full log");
+		ops = FlashOps() - ops;
+		CheckModel("init of full log");
+		for (cut = 0; cut < ops; cut++) {
+			srand(layoutSeed);
+			FullLogInit();
+			hostFlashCutIn = cut;
+			if (setjmp(hostFlashCut) == 0) EE_Init();
+			hostFlashCutIn = -1;
+			status = EE_Init();
+			HOST_CHECK(status == HAL_OK, "init after power loss in init status %u", status);
+			CheckModel("power loss in init");
+		}
+		srand(layoutSeed + it);
+	}
+}
+
+int main(int argc, char *argv[]) {
+	int seed = argc > 1 ? atoi(argv[1]) : 1;
+	char name[40];
+
+	srand(seed);
+	FLASH_Unlock();
+
+	TestMigration();
+	HostFlashInit();
+	memset(refPresent, 0, sizeof(refPresent));
+	TestEmpty();
+	TestIndex();
+	TestOutOfIndex();
+	TestInterruptWrites();
+	TestBlocking();
+	TestPowerLoss();
+
+	snprintf(name, sizeof(name), "test_eeprom %u pages seed %d", EE_PAGES_NUM, seed);
+	return HostReport(name);
+}
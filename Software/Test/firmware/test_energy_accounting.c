@@ -0,0 +1,362 @@
+// ----------------------------------------------------------------------------
+/*!
+ * @file         test_energy_accounting.c
+ * @date       19 October 2026
+ * @brief       Energy accounting tests with known power profiles:
+ *                  constant load and charge, battery current ramp sampled
+ *                  every minute, hours in stop mode without tick, host
+ *                  clock set forward and back, Pi supplying 5V GPIO rail
+ *                  and random piecewise linear profiles with gaps up to
+ *                  6 hours, counters against exact integral within 1 unit.
+ *                  Checkpoint to NV, MCU reset and power up.
+ *                  Usage: test_energy_accounting [seed]
+ */
+// ----------------------------------------------------------------------------
+// Include section - add all #includes here:
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "energy_accounting.h"
+#include "battery.h"
+#include "fuel_gauge_lc709203f.h"
+#include "power_source.h"
+#include "nv.h"
+#include "time_count.h"
+
+// ----------------------------------------------------------------------------
+// Defines section - add all #defines here:
+
+#define TEST_I2C_IRQ_IPSR	39 // exception number of I2C1 interrupt
+#define TEST_START	820540800 // 2026-01-01 00:00:00 in seconds since 2000-01-01
+#define TEST_RANDOM_SAMPLES	20000
+#define TEST_GAP_MAX	21600 // s, longest stop mode in random profiles
+
+// ----------------------------------------------------------------------------
+// Variables section - add all global variables here:
+
+uint8_t resetStatus;
+uint16_t batteryVoltage;
+volatile int16_t batteryCurrent;
+PowerSourceStatus_T powerInStatus;
+BatteryProfile_T const *currentBatProfile;
+
+static int32_t loadCurrent;
+static int16_t ioVoltage;
+static uint64_t rtcTime; // 1/256 s since 2000-01-01
+
+static uint16_t nvVar[NV_VAR_NUM];
+static uint8_t nvValid[NV_VAR_NUM];
+static uint8_t nvTransaction;
+
+// ----------------------------------------------------------------------------
+// Function section - add all local functions here:
+
+int32_t GetLoadCurrent(void) {
+	return loadCurrent;
+}
+
+int16_t Get5vIoVoltage() {
+	return ioVoltage;
+}
+
+void RtcReadLinearTime(uint32_t *sec, uint8_t *sub) {
+	*sec = rtcTime >> 8;
+	*sub = rtcTime & 0xFF;
+}
+
+uint16_t EE_ReadVariable(uint16_t VirtAddress, uint16_t *Data) {
+	if (VirtAddress >= NV_VAR_NUM || !nvValid[VirtAddress]) return 1;
+	*Data = nvVar[VirtAddress];
+	return 0;
+}
+
+void NvTransactionBegin(void) {
+	nvTransaction = 1;
+}
+
+void NvTransactionStage(uint16_t VirtAddress, uint16_t var) {
+	HOST_CHECK(nvTransaction && VirtAddress >= ENERGY_TO_PI_L_NV_ADDR && VirtAddress < ENERGY_TO_PI_L_NV_ADDR + 2 * ENERGY_COUNTERS_NUM,
+			"staged nv address %u", VirtAddress);
+	nvVar[VirtAddress] = var;
+	nvValid[VirtAddress] = 1;
+}
+
+uint16_t NvTransactionCommit(void) {
+	nvTransaction = 0;
+	return HAL_OK;
+}
+
+static void Counters(uint32_t counters[ENERGY_COUNTERS_NUM]) {
+	uint8_t data[64];
+	uint16_t len = 0;
+	uint8_t i;
+
+	EnergyAccountingGetCmd(data, &len);
+	HOST_CHECK(len == ENERGY_COUNTERS_NUM * 4 + 2, "length %u", len);
+	for (i = 0; i < ENERGY_COUNTERS_NUM; i++) {
+		counters[i] = data[i*4] | (data[i*4+1] << 8) | (data[i*4+2] << 16) | ((uint32_t)data[i*4+3] << 24);
+	}
+}
+
+static void SetCmd(uint8_t d) {
+	hostIpsr = TEST_I2C_IRQ_IPSR;
+	EnergyAccountingSetCmd(&d, 1);
+	hostIpsr = 0;
+}
+
+// Sets telemetry: 5V GPIO rail mV and load mA, battery mV and mA positive when discharging
+static void Telemetry(int16_t io, int32_t load, uint16_t bat, int16_t current, PowerSourceStatus_T in) {
+	ioVoltage = io;
+	loadCurrent = load;
+	batteryVoltage = bat;
+	batteryCurrent = current;
+	powerInStatus = in;
+}
+
+// Main loop pass after dt in 1/256 s of RTC time and tickMs of system tick
+static void Pass(uint64_t dt, uint32_t tickMs) {
+	rtcTime += dt;
+	hostTick += tickMs;
+	EnergyAccountingTask();
+}
+
+// Host writes RTC time shifted by delta in 1/256 s over I2C
+static void ClockSet(int32_t delta) {
+	rtcTime += (int64_t)delta;
+	hostIpsr = TEST_I2C_IRQ_IPSR;
+	EnergyAccountingTimeStep(delta);
+	hostIpsr = 0;
+}
+
+// Checks counter increments since before against expected mWh or mAh
+static void Expect(const char *profile, const uint32_t before[ENERGY_COUNTERS_NUM], const double expected[ENERGY_COUNTERS_NUM]) {
+	uint32_t after[ENERGY_COUNTERS_NUM];
+	uint8_t i;
+
+	Counters(after);
+	for (i = 0; i < ENERGY_COUNTERS_NUM; i++) {
+		HOST_CHECK(fabs((double)(after[i] - before[i]) - expected[i]) <= 1, "%s: counter %u increased by %u, expected %.2f",
+				profile, i, after[i] - before[i], expected[i]);
+	}
+}
+
+static void Start(void) {
+	memset(nvValid, 0, sizeof(nvValid));
+	resetStatus = 0;
+	EnergyAccountingInit();
+	SetCmd(0x80);
+}
+
+static void TestConstant(void) {
+	uint32_t before[ENERGY_COUNTERS_NUM];
+	double expected[ENERGY_COUNTERS_NUM] = {0};
+	uint32_t k;
+
+	// Pi takes 5 W, micro USB input supplies it and charges battery with 2 W for 1 hour
+	Start();
+	Telemetry(5000, 1000, 4000, -500, POW_SOURCE_NORMAL);
+	Pass(0, TICK_PERIOD_MS);
+	Counters(before);
+	// passes of 5/256 s, close to tick period
+	for (k = 0; k < 3600 * 256 / 5; k++) Pass(5, TICK_PERIOD_MS);
+	expected[ENERGY_TO_PI] = 5000;
+	expected[ENERGY_BAT_IN] = 2000;
+	expected[CHARGE_BAT_IN] = 500;
+	expected[ENERGY_FROM_IN] = 7000;
+	Expect("constant", before, expected);
+}
+
+static void TestRamp(void) {
+	uint32_t before[ENERGY_COUNTERS_NUM];
+	double expected[ENERGY_COUNTERS_NUM] = {0};
+	uint32_t k;
+
+	// battery current rises from 0 to 3600 mA in 1 hour, samples every minute, rectangle
+	// rule from either end is off by 60 mAh
+	Start();
+	Telemetry(5000, 0, 4000, 0, POW_SOURCE_NOT_PRESENT);
+	Pass(0, TICK_PERIOD_MS);
+	Counters(before);
+	for (k = 1; k <= 60; k++) {
+		batteryCurrent = k * 60;
+		Pass(256 * 60, 60000);
+	}
+	expected[ENERGY_BAT_OUT] = 7200;
+	expected[CHARGE_BAT_OUT] = 1800;
+	Expect("ramp", before, expected);
+}
+
+static void TestStop(void) {
+	uint32_t before[ENERGY_COUNTERS_NUM];
+	double expected[ENERGY_COUNTERS_NUM] = {0};
+
+	// 5V off, 100 mW from battery through 4 hours of stop mode, tick does not run in stop
+	Start();
+	Telemetry(0, 0, 4000, 25, POW_SOURCE_NOT_PRESENT);
+	Pass(0, TICK_PERIOD_MS);
+	Counters(before);
+	Pass(256 * 4 * 3600, TICK_PERIOD_MS);
+	expected[ENERGY_BAT_OUT] = 400;
+	expected[CHARGE_BAT_OUT] = 100;
+	Expect("stop", before, expected);
+
+	// wake-up right after stop entry, sample is not integrated again
+	Counters(before);
+	Pass(0, TICK_PERIOD_MS);
+	memset(expected, 0, sizeof(expected));
+	Expect("stop wake-up", before, expected);
+}
+
+static void TestClockSet(void) {
+	uint32_t before[ENERGY_COUNTERS_NUM];
+	double expected[ENERGY_COUNTERS_NUM] = {0};
+
+	// 3.6 W for 1000 s with clock set day forward and day back midway
+	Start();
+	Telemetry(5000, 720, 4000, 0, POW_SOURCE_NOT_PRESENT);
+	Pass(0, TICK_PERIOD_MS);
+	Counters(before);
+	Pass(256 * 250, 250000);
+	ClockSet(256 * 86400 + 100);
+	Pass(256 * 250, 250000);
+	ClockSet(-256 * 86400 - 50);
+	Pass(256 * 500, 500000);
+	expected[ENERGY_TO_PI] = 1000;
+	Expect("clock set", before, expected);
+
+	// RTC reinitialized hour back without time step, interval going back is dropped
+	Counters(before);
+	rtcTime -= 256 * 3600;
+	Pass(0, TICK_PERIOD_MS);
+	Pass(256 * 1000, 1000000);
+	Expect("clock back", before, expected);
+}
+
+static void TestFrom5vIo(void) {
+	uint32_t before[ENERGY_COUNTERS_NUM];
+	double expected[ENERGY_COUNTERS_NUM] = {0};
+	uint32_t k;
+
+	// Pi supplies PiJuice over 5V GPIO rail with 2.5 W and charges battery with 2 W,
+	// micro USB input is present but does not count
+	Start();
+	Telemetry(5000, -500, 4000, -500, POW_SOURCE_WEAK);
+	Pass(0, TICK_PERIOD_MS);
+	Counters(before);
+	for (k = 0; k < 3600; k++) Pass(256, 1000);
+	expected[ENERGY_FROM_5V_IO] = 2500;
+	expected[ENERGY_BAT_IN] = 2000;
+	expected[CHARGE_BAT_IN] = 500;
+	Expect("5V GPIO", before, expected);
+}
+
+// Adds exact integral of sample sum a + b, linear between samples, to positive or negative counter
+static void RefAdd(double ref[ENERGY_COUNTERS_NUM], EnergyCounter_T pos, EnergyCounter_T neg, int32_t a, int32_t b, double hours) {
+	double e = (a + b) / 2.0 * hours;
+	if (e > 0) {
+		ref[pos] += e;
+	} else if (neg != pos) {
+		ref[neg] -= e;
+	}
+}
+
+static void TestRandom(void) {
+	uint32_t before[ENERGY_COUNTERS_NUM];
+	double ref[ENERGY_COUNTERS_NUM] = {0};
+	int32_t load, bat, current, in;
+	int32_t lastLoad = 0, lastBat = 0, lastCurrent = 0, lastIn = 0;
+	uint32_t dt, k;
+	double hours = 0;
+
+	// piecewise linear profile, power between samples is average of samples around it
+	Start();
+	for (k = 0; k <= TEST_RANDOM_SAMPLES; k++) {
+		Telemetry(4800 + rand() % 400, rand() % 3500 - 1000, 3000 + rand() % 1200, rand() % 5000 - 2000,
+				rand() % 2 ? POW_SOURCE_NORMAL : POW_SOURCE_NOT_PRESENT);
+		// -1 load current is no reading, counts as no load
+		load = loadCurrent == -1 ? 0 : ioVoltage * loadCurrent / 1000;
+		current = batteryCurrent;
+		bat = (int32_t)batteryVoltage * current / 1000;
+		in = powerInStatus != POW_SOURCE_NOT_PRESENT && load >= 0 ? load + (bat < 0 ? -bat : 0) : 0;
+
+		if (k == 0) {
+			Pass(0, TICK_PERIOD_MS);
+			Counters(before);
+		} else {
+			// tick period to minutes, every 100th sample after stop mode up to 6 hours
+			dt = k % 100 ? TICK_PERIOD_MS * 256 / 1000 + rand() % (256 * 600) : rand() % (256 * TEST_GAP_MAX);
+			hours = dt / (256.0 * 3600);
+			Pass(dt, TICK_PERIOD_MS);
+			RefAdd(ref, ENERGY_TO_PI, ENERGY_FROM_5V_IO, lastLoad, load, hours);
+			RefAdd(ref, ENERGY_BAT_OUT, ENERGY_BAT_IN, lastBat, bat, hours);
+			RefAdd(ref, CHARGE_BAT_OUT, CHARGE_BAT_IN, lastCurrent, current, hours);
+			RefAdd(ref, ENERGY_FROM_IN, ENERGY_FROM_IN, lastIn, in, hours);
+		}
+		lastLoad = load;
+		lastBat = bat;
+		lastCurrent = current;
+		lastIn = in;
+	}
+	Expect("random", before, ref);
+}
+
+static void TestReset(void) {
+	uint32_t before[ENERGY_COUNTERS_NUM], after[ENERGY_COUNTERS_NUM];
+	double expected[ENERGY_COUNTERS_NUM] = {0};
+	uint32_t k;
+
+	// 0.75 mWh and 0.25 mAh steps, fraction is kept in RAM over MCU reset
+	Start();
+	Telemetry(5000, 0, 3000, 1, POW_SOURCE_NOT_PRESENT);
+	Pass(0, TICK_PERIOD_MS);
+	Counters(before);
+	for (k = 0; k < 1000; k++) {
+		Pass(256 * 900, TICK_PERIOD_MS);
+		resetStatus = 1;
+		EnergyAccountingInit();
+		Pass(0, TICK_PERIOD_MS);
+	}
+	expected[ENERGY_BAT_OUT] = 750;
+	expected[CHARGE_BAT_OUT] = 250;
+	Expect("reset", before, expected);
+
+	// checkpoint on request, counters continue from it after power up
+	SetCmd(0x01);
+	Pass(0, TICK_PERIOD_MS);
+	Counters(before);
+	Pass(256 * 3600, TICK_PERIOD_MS);
+	resetStatus = 0;
+	EnergyAccountingInit();
+	Counters(after);
+	for (k = 0; k < ENERGY_COUNTERS_NUM; k++) {
+		HOST_CHECK(after[k] == before[k], "counter %u is %u after power up, checkpoint %u", k, after[k], before[k]);
+	}
+
+	// reset clears counters and their checkpoint
+	SetCmd(0x80);
+	Pass(0, TICK_PERIOD_MS);
+	resetStatus = 0;
+	EnergyAccountingInit();
+	Counters(after);
+	for (k = 0; k < ENERGY_COUNTERS_NUM; k++) HOST_CHECK(after[k] == 0, "counter %u is %u after reset", k, after[k]);
+}
+
+int main(int argc, char *argv[]) {
+	int seed = argc > 1 ? atoi(argv[1]) : 1;
+	char name[40];
+
+	srand(seed);
+	rtcTime = (uint64_t)TEST_START << 8;
+
+	TestConstant();
+	TestRamp();
+	TestStop();
+	TestClockSet();
+	TestFrom5vIo();
+	TestRandom();
+	TestReset();
+
+	snprintf(name, sizeof(name), "test_energy_accounting seed %d", seed);
+	return HostReport(name);
+}
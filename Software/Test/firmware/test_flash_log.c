@@ -0,0 +1,270 @@
+// ----------------------------------------------------------------------------
+/*!
+ * @file         test_flash_log.c
+ * @date       19 October 2026
+ * @brief       Flash event log tests: read frames from cursor, frame
+ *                  prepared in main loop only, no flash access from I2C
+ *                  handlers while records are written, page rotation
+ *                  with lost records flag, records kept over reinit and
+ *                  power loss during append.
+ *                  Usage: test_flash_log [seed]
+ */
+// ----------------------------------------------------------------------------
+// Include section - add all #includes here:
+
+#include <setjmp.h>
+#include <stdlib.h>
+#include <string.h>
+#include "flash_log.h"
+#include "battery.h"
+#include "power_source.h"
+#include "power_management.h"
+#include "charger_bq2416x.h"
+#include "fuel_gauge_lc709203f.h"
+#include "rtc_ds1339_emu.h"
+
+// ----------------------------------------------------------------------------
+// Defines section - add all #defines here:
+
+#define TEST_I2C_IRQ_IPSR	39 // exception number of I2C1 interrupt
+#define TEST_PAGE_RECORDS	(PAGE_SIZE / 16 - 1)
+#define TEST_FLAG_MORE	0x01
+#define TEST_FLAG_LOST	0x02
+#define TEST_FLAG_BUSY	0x08
+
+// ----------------------------------------------------------------------------
+// Variables section - add all global variables here:
+
+// modules flash log takes status from
+BatteryStatus_T batteryStatus;
+uint8_t regs[8];
+uint16_t batteryVoltage;
+uint16_t batteryRsoc;
+int8_t fuelGaugeI2cErrorCounter;
+uint16_t fgIcId;
+int8_t ntcFaultFlag;
+RsocMeasurementConfig_T rsocMeasurementConfig;
+uint8_t watchdogExpiredFlag;
+PowerSourceStatus_T powerInStatus;
+PowerSourceStatus_T power5vIoStatus;
+uint8_t forcedVSysOutputOffFlag;
+
+static uint32_t putCount; // events put since log was erased
+static uint32_t irqReads;
+static uint32_t irqServed;
+
+// ----------------------------------------------------------------------------
+// Function section - add all local functions here:
+
+void RtcReadLinearTime(uint32_t *sec, uint8_t *sub) {
+	*sec = hostTick / 1000;
+	*sub = (hostTick % 1000) * 256 / 1000;
+}
+
+static void Put(uint32_t n) {
+	uint8_t payload[FLASH_LOG_PAYLOAD_LEN];
+	uint32_t i;
+
+	for (i = 0; i < n; i++) {
+		putCount++;
+		payload[0] = putCount;
+		payload[1] = putCount >> 8;
+		payload[2] = putCount >> 16;
+		payload[3] = 0x5A;
+		FlashLogPut(FLASH_LOG_WAKEUP, payload);
+		if ((i + 1) % FLASH_LOG_QUEUE_SIZE == 0) FlashLogTask();
+	}
+	FlashLogTask();
+}
+
+static void Read(uint8_t data[FLASH_LOG_READ_LEN]) {
+	uint16_t len = 0;
+
+	hostIpsr = TEST_I2C_IRQ_IPSR;
+	FlashLogReadCmd(data, &len);
+	hostIpsr = 0;
+	HOST_CHECK(len == FLASH_LOG_READ_LEN, "frame length %u", len);
+}
+
+static void SetCursor(uint32_t seq) {
+	uint8_t cmd[5] = {seq != 0, seq, seq >> 8, seq >> 16, seq >> 24};
+
+	hostIpsr = TEST_I2C_IRQ_IPSR;
+	FlashLogWriteCmd(cmd, seq ? 5 : 1);
+	hostIpsr = 0;
+}
+
+static uint32_t RecordSeq(const uint8_t data[], uint8_t i) {
+	const uint8_t *r = data + FLASH_LOG_READ_HEADER_LEN + i * FLASH_LOG_READ_RECORD_LEN;
+	return r[0] | ((uint32_t)r[1] << 8) | ((uint32_t)r[2] << 16) | ((uint32_t)r[3] << 24);
+}
+
+static uint32_t RecordPayload(const uint8_t data[], uint8_t i) {
+	const uint8_t *r = data + FLASH_LOG_READ_HEADER_LEN + i * FLASH_LOG_READ_RECORD_LEN;
+	HOST_CHECK(r[9] == FLASH_LOG_WAKEUP && r[13] == 0x5A, "record id %u payload 0x%02X", r[9], r[13]);
+	return r[10] | ((uint32_t)r[11] << 8) | ((uint32_t)r[12] << 16);
+}
+
+// Reads all records from cursor as host does, returns their number, first is set to first sequence number
+static uint32_t ReadAll(uint32_t *first, uint8_t *lost) {
+	uint8_t data[FLASH_LOG_READ_LEN];
+	uint32_t n = 0, seq, last = 0;
+	uint8_t i;
+
+	*lost = 0;
+	do {
+		FlashLogTask();
+		Read(data);
+		HOST_CHECK(!(data[1] & TEST_FLAG_BUSY), "frame not prepared by task");
+		HOST_CHECK(data[0] <= FLASH_LOG_READ_RECORDS, "records %u", data[0]);
+		*lost |= (data[1] & TEST_FLAG_LOST) != 0;
+		for (i = 0; i < data[0]; i++) {
+			seq = RecordSeq(data, i);
+			if (n == 0) *first = seq;
+			HOST_CHECK(n == 0 || seq == last + 1, "sequence %u after %u", seq, last);
+			last = seq;
+			n++;
+		}
+	} while (data[1] & TEST_FLAG_MORE);
+	return n;
+}
+
+static void TestReadFrames(void) {
+	uint8_t data[FLASH_LOG_READ_LEN];
+	uint32_t seq;
+	uint8_t i, frame;
+
+	FlashLogInit();
+	FlashLogTask();
+	Read(data);
+	HOST_CHECK(data[0] == 0 && data[1] == 0, "empty log count %u flags 0x%02X", data[0], data[1]);
+
+	// frame prepared before events were put is not served
+	Put(20);
+	seq = 1;
+	for (frame = 0; frame < 3; frame++) {
+		Read(data);
+		HOST_CHECK(data[0] == (frame < 2 ? 8 : 4), "frame %u count %u", frame, data[0]);
+		HOST_CHECK(!!(data[1] & TEST_FLAG_MORE) == (frame < 2), "frame %u flags 0x%02X", frame, data[1]);
+		for (i = 0; i < data[0]; i++, seq++) {
+			HOST_CHECK(RecordSeq(data, i) == seq, "frame %u record %u seq %u", frame, i, RecordSeq(data, i));
+			HOST_CHECK(RecordPayload(data, i) == seq, "frame %u record %u payload", frame, i);
+		}
+		// next frame is prepared by main loop
+		Read(data);
+		HOST_CHECK(data[0] == 0 && data[1] == TEST_FLAG_BUSY, "frame served before task, flags 0x%02X", data[1]);
+		FlashLogTask();
+	}
+	Read(data);
+	HOST_CHECK(data[0] == 0 && !(data[1] & TEST_FLAG_MORE), "read past end count %u", data[0]);
+
+	// rewind and set cursor, frame of old cursor is discarded
+	FlashLogTask();
+	SetCursor(0);
+	Read(data);
+	HOST_CHECK(data[1] == TEST_FLAG_BUSY, "frame of old cursor served, flags 0x%02X", data[1]);
+	FlashLogTask();
+	Read(data);
+	HOST_CHECK(data[0] == 8 && RecordSeq(data, 0) == 1, "rewind count %u seq %u", data[0], RecordSeq(data, 0));
+	SetCursor(13);
+	FlashLogTask();
+	Read(data);
+	HOST_CHECK(data[0] == 8 && RecordSeq(data, 0) == 13, "cursor count %u seq %u", data[0], RecordSeq(data, 0));
+	FlashLogTask();
+}
+
+// I2C handler reading log while main loop writes records
+static void IrqReadCb(void) {
+	uint8_t data[FLASH_LOG_READ_LEN];
+
+	if (hostIpsr) return;
+	irqReads++;
+	Read(data);
+	if (!(data[1] & TEST_FLAG_BUSY)) irqServed++;
+	if (rand() % 4 == 0) SetCursor(0);
+}
+
+static void TestReadDuringWrite(void) {
+	uint32_t first, n;
+	uint8_t lost;
+
+	// enough records to erase and rotate pages
+	irqReads = 0;
+	irqServed = 0;
+	hostFlashOpCb = IrqReadCb;
+	Put(2 * TEST_PAGE_RECORDS + rand() % TEST_PAGE_RECORDS);
+	hostFlashOpCb = NULL;
+	HOST_CHECK(irqReads > 0, "no interrupt reads");
+	HOST_CHECK(irqServed == 0, "%u of %u frames served while flash was written", irqServed, irqReads);
+
+	SetCursor(0);
+	n = ReadAll(&first, &lost);
+	HOST_CHECK(first + n - 1 == putCount, "read %u of %u from %u", n, putCount, first);
+	HOST_CHECK(n >= 2 * TEST_PAGE_RECORDS, "only %u records kept", n);
+}
+
+static void TestRotation(void) {
+	uint32_t first, n, end;
+	uint8_t lost;
+
+	// oldest page is erased, cursor behind oldest record reports lost records
+	SetCursor(2);
+	Put(FLASH_LOG_PAGES_NUM * TEST_PAGE_RECORDS);
+	n = ReadAll(&first, &lost);
+	HOST_CHECK(lost, "lost records not reported");
+	HOST_CHECK(first > 2 && first + n - 1 == putCount, "read %u from %u of %u", n, first, putCount);
+	HOST_CHECK(n >= (FLASH_LOG_PAGES_NUM - 1) * TEST_PAGE_RECORDS, "only %u records kept", n);
+
+	// records and sequence numbers kept over reinit
+	end = putCount;
+	FlashLogInit();
+	Put(3);
+	SetCursor(end);
+	n = ReadAll(&first, &lost);
+	HOST_CHECK(n == 4 && first == end && !lost, "after reinit read %u from %u", n, first);
+}
+
+static void TestPowerLoss(void) {
+	uint32_t first, n, end, round;
+	volatile uint32_t before;
+	uint8_t lost;
+
+	// records written before cut are kept, interrupted one is skipped
+	for (round = 0; round < 100; round++) {
+		before = putCount;
+		hostFlashCutIn = rand() % 40;
+		if (setjmp(hostFlashCut) == 0) {
+			Put(1 + rand() % 8);
+		}
+		hostFlashCutIn = -1;
+		end = putCount;
+		FlashLogInit();
+
+		SetCursor(0);
+		n = ReadAll(&first, &lost);
+		HOST_CHECK(n >= TEST_PAGE_RECORDS && n <= FLASH_LOG_PAGES_NUM * TEST_PAGE_RECORDS, "round %u kept %u", round, n);
+		// log continues after last stored record, one more event makes it visible in sequence
+		putCount = end;
+		Put(1);
+		SetCursor(first + n - 1);
+		n = ReadAll(&first, &lost);
+		HOST_CHECK(n == 2, "round %u after cut read %u, put %u to %u", round, n, before, end);
+	}
+}
+
+int main(int argc, char *argv[]) {
+	int seed = argc > 1 ? atoi(argv[1]) : 1;
+	char name[40];
+
+	srand(seed);
+	HostFlashInit();
+	FLASH_Unlock();
+
+	TestReadFrames();
+	TestReadDuringWrite();
+	TestRotation();
+	TestPowerLoss();
+
+	snprintf(name, sizeof(name), "test_flash_log seed %d", seed);
+	return HostReport(name);
+}
@@ -0,0 +1,335 @@
+// ----------------------------------------------------------------------------
+/*!
+ * @file         test_io_counter.c
+ * @date       19 October 2026
+ * @brief       Pulse counter tests: counted edges, debounce of bouncing
+ *                  input while running and in stop mode on RTC time
+ *                  stamps, bounce continued over stop mode entry,
+ *                  reciprocal and stop mode frequency, wake-up after set
+ *                  count and interrupt mask kept by configuration calls.
+ *                  Usage: test_io_counter [seed]
+ */
+// ----------------------------------------------------------------------------
+// Include section - add all #includes here:
+
+#include <stdlib.h>
+#include "io_counter.h"
+#include "time_count.h"
+#include "power_management.h"
+#include "rtc_ds1339_emu.h"
+
+// ----------------------------------------------------------------------------
+// Defines section - add all #defines here:
+
+#define TEST_EXTI_IRQ_IPSR	23 // exception number of EXTI4_15 interrupt
+#define TEST_TIM14_IRQ_IPSR	35 // exception number of TIM14 interrupt
+#define TEST_EDGE_RISING	0
+#define TEST_EDGE_FALLING	1
+#define TEST_EDGE_BOTH	3
+
+// ----------------------------------------------------------------------------
+// Variables section - add all global variables here:
+
+static uint64_t hostUs; // fine tick and RTC time
+static uint8_t suspended; // tick suspended for stop mode
+static uint32_t wakeEvents;
+static uint32_t edgeWakeups; // edges that returned wake-up to caller
+
+// ----------------------------------------------------------------------------
+// Function section - add all local functions here:
+
+uint32_t TimeTickFineUs(void) {
+	return hostUs;
+}
+
+uint8_t TimeTickIsSuspended(void) {
+	return suspended;
+}
+
+void RtcReadLinearTime(uint32_t *sec, uint8_t *sub) {
+	*sec = hostUs / 1000000;
+	*sub = (hostUs % 1000000) * 256 / 1000000;
+}
+
+void PowerMngmtPostWakeupEvent(WakeupTrigger_T trigger) {
+	HOST_CHECK(trigger == WAKEUP_TRIGGER_IO, "wake-up trigger %u", trigger);
+	wakeEvents++;
+}
+
+static uint16_t PinMask(uint8_t pin) {
+	return pin == 1 ? GPIO_PIN_7 : GPIO_PIN_8;
+}
+
+static void SetLevel(uint8_t pin, uint8_t level) {
+	if (level) {
+		hostGPIOA.IDR |= PinMask(pin);
+	} else {
+		hostGPIOA.IDR &= ~PinMask(pin);
+	}
+}
+
+static uint8_t Level(uint8_t pin) {
+	return (hostGPIOA.IDR & PinMask(pin)) != 0;
+}
+
+// Pin changes level after us, its interrupt is served with random latency up to 20 us
+static void Edge(uint8_t pin, uint32_t us) {
+	uint16_t latency = rand() % 20;
+
+	hostUs += us;
+	SetLevel(pin, !Level(pin));
+	if (pin == 2) {
+		hostUs += latency;
+		hostIpsr = TEST_EXTI_IRQ_IPSR;
+		edgeWakeups += IoCounterEdge(2);
+		hostIpsr = 0;
+	} else {
+		hostTIM14.CCR1 = rand() & 0xFFFF;
+		hostTIM14.CNT = (hostTIM14.CCR1 + latency) & 0xFFFF;
+		hostTIM14.SR = TIM_SR_CC1IF;
+		hostUs += latency;
+		hostIpsr = TEST_TIM14_IRQ_IPSR;
+		IoCounterCaptureCb();
+		hostIpsr = 0;
+	}
+	hostUs -= latency;
+}
+
+static void Start(uint8_t pin, uint8_t edge, uint8_t debounce, uint16_t wake, uint8_t level) {
+	SetLevel(pin, level);
+	IoCounterStop(pin);
+	IoCounterStart(pin, edge | (debounce << 8), wake);
+	wakeEvents = 0;
+	edgeWakeups = 0;
+}
+
+static uint32_t Count(uint8_t pin) {
+	uint8_t data[IO_COUNTER_READ_LEN];
+	uint16_t len = 0;
+
+	IoCounterRead(pin, data, &len);
+	HOST_CHECK(len == IO_COUNTER_READ_LEN, "read length %u", len);
+	return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+static uint32_t Frequency(uint8_t pin) {
+	uint8_t data[IO_COUNTER_READ_LEN];
+	uint16_t len = 0;
+
+	IoCounterRead(pin, data, &len);
+	return data[4] | (data[5] << 8) | (data[6] << 16) | ((uint32_t)data[7] << 24);
+}
+
+static uint8_t Counted(uint8_t edge, uint8_t level) {
+	return edge == TEST_EDGE_BOTH || level == (edge != TEST_EDGE_FALLING);
+}
+
+// Level transition with bounce edges spaced shorter than debounce time, returns 1 if it is counted
+static uint8_t Transition(uint8_t pin, uint8_t edge, uint8_t debounce, uint32_t stableUs) {
+	uint8_t bounces = debounce ? 2 * (rand() % 4) : 0;
+	uint8_t level = !Level(pin);
+	uint8_t k;
+
+	Edge(pin, stableUs);
+	for (k = 0; k < bounces; k++) Edge(pin, 50 + rand() % (debounce * 1000 - 100));
+	return Counted(edge, level);
+}
+
+static void TestCount(uint8_t pin) {
+	uint8_t edge = rand() % 4;
+	uint32_t expected = 0, k;
+
+	// without debounce only selected edges interrupt
+	Start(pin, edge, 0, 0, 0);
+	for (k = 0; k < 1000; k++) {
+		hostUs += 10 + rand() % 10000;
+		SetLevel(pin, !Level(pin));
+		if (Counted(edge, Level(pin))) {
+			SetLevel(pin, !Level(pin));
+			Edge(pin, 0);
+			expected++;
+		}
+	}
+	HOST_CHECK(Count(pin) == expected, "IO%u edge %u count %u expected %u", pin, edge, Count(pin), expected);
+
+	// count is cleared on write
+	hostPrimask = 0;
+	IoCounterWrite(pin, (uint8_t[]){0x01}, 1);
+	HOST_CHECK(Count(pin) == 0, "IO%u count %u after clear", pin, Count(pin));
+	HOST_CHECK(hostPrimask == 0, "interrupts left disabled after clear");
+}
+
+static void TestDebounce(uint8_t pin) {
+	uint8_t edge = rand() % 4;
+	uint8_t debounce = 1 + rand() % 40;
+	uint32_t expected = 0, k;
+
+	// bouncing input, level is stable for debounce time before each transition
+	Start(pin, edge, debounce, 0, rand() % 2);
+	for (k = 0; k < 500; k++) {
+		expected += Transition(pin, edge, debounce, debounce * 1000 + 20 + rand() % 20000);
+	}
+	HOST_CHECK(Count(pin) == expected, "IO%u debounce %u ms edge %u count %u expected %u",
+			pin, debounce, edge, Count(pin), expected);
+
+	// pulses shorter than debounce time are not counted
+	expected = Count(pin);
+	for (k = 0; k < 100; k++) Edge(pin, 50 + rand() % (debounce * 1000 - 100));
+	HOST_CHECK(Count(pin) == expected, "IO%u short pulses counted %u", pin, Count(pin) - expected);
+}
+
+static void TestStopDebounce(void) {
+	uint8_t edge = rand() % 4;
+	uint8_t debounce = 1 + rand() % 255;
+	uint32_t expected = 0, k, tick;
+
+	// tick is suspended in stop mode, edges are debounced on RTC time stamps without delay
+	Start(2, edge, debounce, 0, rand() % 2);
+	hostUs += debounce * 1000;
+	suspended = 1;
+	IoCounterStopEntry();
+	tick = hostTick;
+	for (k = 0; k < 500; k++) {
+		// RTC stamps have 1/256 s steps
+		expected += Transition(2, edge, debounce, debounce * 1000 + 8000 + rand() % 20000);
+	}
+	HOST_CHECK(hostTick == tick, "busy wait in stop mode %u ms", hostTick - tick);
+	HOST_CHECK(Count(2) == expected, "stop mode debounce %u ms edge %u count %u expected %u",
+			debounce, edge, Count(2), expected);
+	suspended = 0;
+
+	// bounce started while running continues after stop mode entry
+	for (k = 0; k < 50; k++) {
+		Edge(2, debounce * 1000 + rand() % 20000);
+		expected = Count(2);
+		hostUs += 20 + rand() % (debounce * 500);
+		suspended = 1;
+		IoCounterStopEntry();
+		Edge(2, 10 + rand() % (debounce * 500 - 10 + 1));
+		HOST_CHECK(Count(2) == expected, "bounce after stop mode entry counted, debounce %u ms", debounce);
+		Edge(2, rand() % 500);
+		suspended = 0;
+	}
+
+	// stable level before stop mode entry, first edge in stop mode is counted
+	Start(2, TEST_EDGE_BOTH, debounce, 0, Level(2));
+	hostUs += debounce * 1000;
+	suspended = 1;
+	IoCounterStopEntry();
+	Edge(2, 1 + rand() % 1000);
+	HOST_CHECK(Count(2) == 1, "first stop mode edge count %u", Count(2));
+	suspended = 0;
+}
+
+static void TestFrequency(uint8_t pin) {
+	uint32_t period = 200 + rand() % 50000; // us
+	uint32_t expected = 1000000000ULL / period; // mHz
+	uint64_t start = hostUs;
+	uint32_t k, f;
+
+	// reciprocal counting, rising edges only
+	Start(pin, TEST_EDGE_RISING, 0, 0, 0);
+	while (hostUs - start < 3000000) {
+		SetLevel(pin, 0);
+		Edge(pin, period);
+		hostTick = hostUs / 1000;
+		IoCounterTask();
+	}
+	f = Frequency(pin);
+	HOST_CHECK(f + expected / 1000 + 1 >= expected && f <= expected + expected / 1000 + 1,
+			"IO%u period %u us frequency %u mHz expected %u", pin, period, f, expected);
+
+	// frequency is 0 after input stops
+	for (k = 0; k < 40; k++) {
+		hostUs += 100000;
+		hostTick = hostUs / 1000;
+		IoCounterTask();
+	}
+	HOST_CHECK(Frequency(pin) == 0, "IO%u frequency %u after input stopped", pin, Frequency(pin));
+}
+
+static void TestStopFrequency(void) {
+	uint32_t period = 10000 + rand() % 190000; // us
+	uint32_t expected = 1000000000ULL / period;
+	uint32_t k, f, wake;
+
+	// edges in stop mode, main loop runs on RTC wake-up every 4 s
+	Start(2, TEST_EDGE_RISING, 0, 0, 0);
+	wake = hostUs / 1000 + 4000;
+	for (k = 0; k < 90000000 / period; k++) {
+		suspended = 1;
+		SetLevel(2, 0);
+		Edge(2, period);
+		if (hostUs / 1000 >= wake) {
+			suspended = 0;
+			hostTick = hostUs / 1000;
+			IoCounterTask();
+			wake += 4000;
+		}
+	}
+	suspended = 0;
+	f = Frequency(2);
+	HOST_CHECK(f + expected / 50 >= expected && f <= expected + expected / 50,
+			"stop mode period %u us frequency %u mHz expected %u", period, f, expected);
+}
+
+static void TestWakeup(void) {
+	uint16_t wake = 1 + rand() % 50;
+	uint32_t k;
+
+	// every wake count edges post wake-up event, returned to EXTI callback
+	Start(2, TEST_EDGE_BOTH, 0, wake, 0);
+	for (k = 0; k < 1000; k++) Edge(2, 100 + rand() % 1000);
+	HOST_CHECK(wakeEvents == 1000 / wake && edgeWakeups == wakeEvents, "every %u: %u events, %u returned",
+			wake, wakeEvents, edgeWakeups);
+
+	// threshold counts again from zero after clear
+	IoCounterWrite(2, (uint8_t[]){0x01}, 1);
+	wakeEvents = 0;
+	for (k = 0; k < wake - 1; k++) Edge(2, 100);
+	HOST_CHECK(wakeEvents == 0, "wake-up before %u edges after clear", wake);
+	Edge(2, 100);
+	HOST_CHECK(wakeEvents == 1, "no wake-up after %u edges after clear", wake);
+}
+
+static void TestInterruptMask(void) {
+	// configuration called with interrupts disabled leaves them disabled
+	hostPrimask = 1;
+	IoCounterStart(2, TEST_EDGE_BOTH | (10 << 8), 0);
+	HOST_CHECK(hostPrimask == 1, "start enabled interrupts");
+	IoCounterWrite(2, (uint8_t[]){0x01}, 1);
+	HOST_CHECK(hostPrimask == 1, "clear enabled interrupts");
+	IoCounterTask();
+	HOST_CHECK(hostPrimask == 1, "task enabled interrupts");
+	IoCounterStopEntry();
+	HOST_CHECK(hostPrimask == 1, "stop mode entry enabled interrupts");
+	hostPrimask = 0;
+	IoCounterStopEntry();
+	IoCounterTask();
+	HOST_CHECK(hostPrimask == 0, "interrupts left disabled");
+	IoCounterStop(2);
+}
+
+int main(int argc, char *argv[]) {
+	int seed = argc > 1 ? atoi(argv[1]) : 1;
+	char name[40];
+	uint8_t pin;
+
+	srand(seed);
+	hostUs = 1000000000ULL + rand();
+	hostTick = hostUs / 1000;
+
+	for (pin = 1; pin <= 2; pin++) {
+		TestCount(pin);
+		TestDebounce(pin);
+		TestFrequency(pin);
+		IoCounterStop(pin);
+	}
+	TestStopDebounce();
+	TestStopFrequency();
+	TestWakeup();
+	TestInterruptMask();
+
+	snprintf(name, sizeof(name), "test_io_counter seed %d", seed);
+	return HostReport(name);
+}
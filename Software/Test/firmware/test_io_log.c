@@ -0,0 +1,293 @@
+// ----------------------------------------------------------------------------
+/*!
+ * @file         test_io_log.c
+ * @date       19 October 2026
+ * @brief       IO1 analog log tests: samples on interval multiples in
+ *                  RTC time, stop mode wake-ups and ADC scans wait,
+ *                  bulk read frames with cursor repeat, overwritten
+ *                  records reported lost and spilled to flash log.
+ *                  Usage: test_io_log [seed]
+ */
+// ----------------------------------------------------------------------------
+// Include section - add all #includes here:
+
+#include <stdlib.h>
+#include <string.h>
+#include "io_log.h"
+#include "analog.h"
+#include "flash_log.h"
+#include "rtc_ds1339_emu.h"
+
+// ----------------------------------------------------------------------------
+// Defines section - add all #defines here:
+
+#define TEST_I2C_IRQ_IPSR	39 // exception number of I2C1 interrupt
+#define TEST_RECORDS_MAX	4000
+#define TEST_FLAG_MORE	0x01
+#define TEST_FLAG_LOST	0x02
+
+// ----------------------------------------------------------------------------
+// Variables section - add all global variables here:
+
+static uint32_t rtcSec; // seconds since 2000-01-01
+static uint8_t rtcSub;
+static uint16_t scansReady;
+static uint16_t scansRequested;
+static uint16_t voltage; // 1/16 mV
+
+// records put into log, in order
+static uint32_t refSec[TEST_RECORDS_MAX];
+static uint16_t refValue[TEST_RECORDS_MAX];
+static uint32_t refCount;
+
+// records read from frames
+static uint32_t outSec[TEST_RECORDS_MAX];
+static uint16_t outValue[TEST_RECORDS_MAX];
+static uint32_t outCount;
+
+// records spilled to flash log
+static uint16_t spillValue[TEST_RECORDS_MAX];
+static uint32_t spillAge[TEST_RECORDS_MAX];
+static uint32_t spillCount;
+
+// ----------------------------------------------------------------------------
+// Function section - add all local functions here:
+
+void RtcReadLinearTime(uint32_t *sec, uint8_t *sub) {
+	*sec = rtcSec;
+	*sub = rtcSub;
+}
+
+uint16_t AnalogScansReady(void) {
+	return scansReady;
+}
+
+uint16_t GetAverageSampleVoltage(uint8_t channel, uint16_t scans) {
+	HOST_CHECK(channel == ADC_IO1_CHN, "channel %u", channel);
+	HOST_CHECK(scans <= scansReady, "averaged %u of %u scans", scans, scansReady);
+	scansRequested = scans;
+	if (refCount < TEST_RECORDS_MAX) {
+		refSec[refCount] = rtcSec;
+		refValue[refCount] = voltage;
+		refCount++;
+	}
+	return voltage;
+}
+
+void FlashLogPut(FlashLogEventId_T id, const uint8_t payload[FLASH_LOG_PAYLOAD_LEN]) {
+	HOST_CHECK(id == FLASH_LOG_IO_SAMPLE, "flash log id %u", id);
+	if (spillCount < TEST_RECORDS_MAX) {
+		spillValue[spillCount] = payload[0] | (payload[1] << 8);
+		spillAge[spillCount] = payload[2] | (payload[3] << 8);
+		spillCount++;
+	}
+}
+
+static void Command(uint8_t c, uint32_t seq) {
+	uint8_t cmd[5] = {c, seq, seq >> 8, seq >> 16, seq >> 24};
+
+	hostIpsr = TEST_I2C_IRQ_IPSR;
+	IoLogWriteCmd(cmd, 5);
+	hostIpsr = 0;
+}
+
+// Clears log and reference, RTC continues from sec
+static void Start(uint16_t interval, uint8_t oversampling, uint8_t flags, uint32_t sec) {
+	IoLogConfigure(0, 0, 0);
+	Command(2, 0);
+	IoLogConfigure(interval, oversampling, flags);
+	rtcSec = sec;
+	rtcSub = 0;
+	refCount = 0;
+	outCount = 0;
+	spillCount = 0;
+}
+
+// Advances RTC and runs main loop pass, ADC has all scans after run time
+static void Pass(uint32_t elapsed) {
+	rtcSec += elapsed;
+	rtcSub = rand();
+	voltage = rand();
+	scansReady = 256;
+	IoLogTask();
+}
+
+// Reads frame as host does, appends records to out, returns flags
+static uint8_t Read(uint8_t data[IO_LOG_READ_LEN], uint32_t *seq) {
+	uint16_t len = 0;
+	uint8_t k;
+	const uint8_t *r;
+
+	hostIpsr = TEST_I2C_IRQ_IPSR;
+	IoLogReadCmd(data, &len);
+	hostIpsr = 0;
+	HOST_CHECK(len == IO_LOG_READ_LEN, "frame length %u", len);
+	HOST_CHECK(data[0] <= IO_LOG_READ_RECORDS, "records %u", data[0]);
+	*seq = data[2] | (data[3] << 8) | (data[4] << 16) | ((uint32_t)data[5] << 24);
+	for (k = 0; k < data[0] && k < IO_LOG_READ_RECORDS; k++) {
+		r = data + IO_LOG_READ_HEADER_LEN + k * IO_LOG_READ_RECORD_LEN;
+		if (outCount < TEST_RECORDS_MAX) {
+			outSec[outCount] = r[0] | (r[1] << 8) | (r[2] << 16) | ((uint32_t)r[3] << 24);
+			outValue[outCount] = r[5] | (r[6] << 8);
+			outCount++;
+		}
+	}
+	return data[1];
+}
+
+static uint8_t ReadAll(void) {
+	uint8_t data[IO_LOG_READ_LEN];
+	uint8_t flags = 0, f;
+	uint32_t seq;
+
+	do {
+		f = Read(data, &seq);
+		flags |= f;
+	} while (f & TEST_FLAG_MORE);
+	return flags;
+}
+
+// Read records must be ref records from first, in order
+static void CheckRecords(const char *step, uint32_t first) {
+	uint32_t k;
+
+	HOST_CHECK(outCount == refCount - first, "%s: read %u records of %u", step, outCount, refCount - first);
+	for (k = 0; k < outCount && first + k < refCount; k++) {
+		if (outSec[k] != refSec[first + k] || outValue[k] != refValue[first + k]) {
+			HOST_CHECK(0, "%s: record %u time %u value %u expected %u %u", step, k,
+					outSec[k], outValue[k], refSec[first + k], refValue[first + k]);
+			return;
+		}
+	}
+}
+
+static void TestSchedule(void) {
+	uint16_t interval = 5 + rand() % 60;
+	uint32_t k;
+
+	// MCU running, main loop every second
+	Start(interval, rand() % (IO_LOG_OVERSAMPLING_MAX + 1), 0, 800000000 + rand() % 1000);
+	for (k = 0; k < 4000; k++) {
+		Pass(1);
+		if (rand() % 50 == 0 || k % 500 == 0) ReadAll();
+	}
+	HOST_CHECK(!(ReadAll() & TEST_FLAG_LOST), "records lost");
+	CheckRecords("running", 0);
+	HOST_CHECK(refCount >= 4000 / interval - 1 && refCount <= 4000 / interval + 1, "interval %u records %u", interval, refCount);
+	for (k = 0; k < refCount; k++) {
+		HOST_CHECK(refSec[k] % interval == 0, "record %u time %u interval %u", k, refSec[k], interval);
+	}
+	HOST_CHECK(IoLogIsSampling() == (interval < IO_LOG_STOP_PERIOD), "sampling outside due time");
+
+	// RTC set back, schedule restarts from new time
+	rtcSec -= 100000;
+	refCount = 0;
+	outCount = 0;
+	for (k = 0; k < 3 * interval; k++) Pass(1);
+	ReadAll();
+	CheckRecords("RTC set back", 0);
+	HOST_CHECK(refCount >= 2, "%u records after RTC set back", refCount);
+}
+
+static void TestStopMode(void) {
+	uint16_t interval = IO_LOG_STOP_PERIOD + rand() % 100;
+	uint32_t k, due, last = 0;
+
+	// wake-up every stop period, ADC scans are not ready right after wake-up
+	Start(interval, 4, 0, 700000000 + rand() % 1000);
+	// first wake-up schedules next multiple of interval
+	due = ((rtcSec + IO_LOG_STOP_PERIOD) / interval + 1) * interval;
+	for (k = 0; k < 3000; k++) {
+		rtcSec += IO_LOG_STOP_PERIOD;
+		scansReady = rand() % 8;
+		IoLogTask();
+		if ((int32_t)(rtcSec - due) >= 0) {
+			HOST_CHECK(refCount == last, "sample taken with %u scans", scansReady);
+			HOST_CHECK(IoLogIsSampling(), "low power allowed while sample waits for scans");
+			Pass(0);
+			HOST_CHECK(refCount == last + 1, "due sample not taken at %u", rtcSec);
+			HOST_CHECK(scansRequested == 16, "averaged %u scans", scansRequested);
+			HOST_CHECK(rtcSec - due < IO_LOG_STOP_PERIOD, "sample %u s late", rtcSec - due);
+			last = refCount;
+			due += interval;
+		} else {
+			HOST_CHECK(!IoLogIsSampling(), "low power refused before due time");
+		}
+		if (rand() % 20 == 0 || k % 64 == 0) ReadAll();
+	}
+	ReadAll();
+	CheckRecords("stop mode", 0);
+}
+
+static void TestRepeat(void) {
+	uint8_t first[IO_LOG_READ_LEN], again[IO_LOG_READ_LEN];
+	uint32_t k, seq, seqAgain;
+
+	Start(1, 0, 0, 600000000);
+	for (k = 0; k < 70; k++) Pass(1);
+
+	// frame received with error is read again from its sequence number
+	Read(first, &seq);
+	HOST_CHECK(first[0] == IO_LOG_READ_RECORDS && (first[1] & TEST_FLAG_MORE), "count %u flags 0x%02X", first[0], first[1]);
+	Pass(1);
+	Command(1, seq);
+	outCount = 0;
+	Read(again, &seqAgain);
+	HOST_CHECK(seqAgain == seq && memcmp(first, again, IO_LOG_READ_LEN) == 0, "repeated frame differs");
+	ReadAll();
+	CheckRecords("repeat", 0);
+
+	// rewind returns all records in RAM, clear removes them
+	Command(0, 0);
+	outCount = 0;
+	ReadAll();
+	CheckRecords("rewind", 0);
+	Command(2, 0);
+	outCount = 0;
+	HOST_CHECK(ReadAll() == 0 && outCount == 0, "%u records after clear", outCount);
+}
+
+static void TestOverwrite(void) {
+	uint32_t k, n, lost;
+
+	// records not read are overwritten, newest are kept
+	for (k = 0; k < 2; k++) {
+		Start(10, 0, k ? IO_LOG_FLAG_FLASH_SPILL : 0, 500000000);
+		n = IO_LOG_BUF_LEN + 1 + rand() % 500;
+		while (refCount < n) Pass(10);
+		lost = refCount - IO_LOG_BUF_LEN;
+		HOST_CHECK(ReadAll() & TEST_FLAG_LOST, "lost records not reported");
+		CheckRecords("overwrite", lost);
+		HOST_CHECK(!(ReadAll() & TEST_FLAG_LOST), "lost reported again");
+
+		// overwritten records are in flash log with age, when spill is set
+		HOST_CHECK(spillCount == (k ? lost : 0), "spill %u: %u records in flash log of %u", k, spillCount, lost);
+		for (n = 0; n < spillCount; n++) {
+			HOST_CHECK(spillValue[n] == refValue[n], "spilled record %u value %u expected %u", n, spillValue[n], refValue[n]);
+			HOST_CHECK(spillAge[n] == IO_LOG_BUF_LEN * 10, "spilled record %u age %u", n, spillAge[n]);
+		}
+	}
+
+	// read records are not spilled
+	Start(10, 0, IO_LOG_FLAG_FLASH_SPILL, 500000000);
+	for (k = 0; k < 3 * IO_LOG_BUF_LEN; k++) {
+		Pass(10);
+		if (k % 16 == 0) ReadAll();
+	}
+	HOST_CHECK(spillCount == 0, "%u read records spilled", spillCount);
+}
+
+int main(int argc, char *argv[]) {
+	int seed = argc > 1 ? atoi(argv[1]) : 1;
+	char name[32];
+
+	srand(seed);
+
+	TestSchedule();
+	TestStopMode();
+	TestRepeat();
+	TestOverwrite();
+
+	snprintf(name, sizeof(name), "test_io_log seed %d", seed);
+	return HostReport(name);
+}
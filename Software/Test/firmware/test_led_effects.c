@@ -0,0 +1,322 @@
+// ----------------------------------------------------------------------------
+/*!
+ * @file         test_led_effects.c
+ * @date       19 October 2026
+ * @brief       LED effects tests: colors from TIM3 update compared with
+ *                  effect evaluated from absolute time, charge level loop,
+ *                  effect upload and read back lengths, priority of host
+ *                  commands and power policy LED action over effect and
+ *                  interrupt mask kept by effect changes.
+ *                  Usage: test_led_effects [seed]
+ */
+// ----------------------------------------------------------------------------
+// Include section - add all #includes here:
+
+#include <stdlib.h>
+#include <string.h>
+#include "led.h"
+#include "nv.h"
+#include "fuel_gauge_lc709203f.h"
+
+// ----------------------------------------------------------------------------
+// Defines section - add all #defines here:
+
+#define TEST_I2C_IRQ_IPSR	39 // exception number of I2C1 interrupt
+#define TEST_TIM3_IRQ_IPSR	32 // exception number of TIM3 interrupt
+#define TEST_TICK_US	8192 // TIM3 update period
+#define TEST_READ_LEN	(4 + LED_FX_STEPS_MAX * LED_FX_STEP_LEN)
+
+// ----------------------------------------------------------------------------
+// Variables section - add all global variables here:
+
+TIM_HandleTypeDef htim3 = { .Instance = TIM3 };
+TIM_HandleTypeDef htim15 = { .Instance = TIM15 };
+TIM_HandleTypeDef htim17 = { .Instance = TIM17 };
+uint16_t batteryRsoc;
+
+static uint8_t brightness[65536]; // compare value to brightness index
+static uint32_t ticks; // TIM3 updates since effect start
+
+// ----------------------------------------------------------------------------
+// Function section - add all local functions here:
+
+uint16_t EE_ReadVariable(uint16_t VirtAddress, uint16_t *Data) {
+	(void)VirtAddress;
+	(void)Data;
+	return 1;
+}
+
+uint16_t EE_WriteVariable(uint16_t VirtAddress, uint16_t Data) {
+	(void)VirtAddress;
+	(void)Data;
+	return HAL_OK;
+}
+
+void Error_Handler(void) {
+	HOST_CHECK(0, "error handler");
+}
+
+HAL_StatusTypeDef HAL_TIM_PWM_Start(TIM_HandleTypeDef *htim, uint32_t Channel) {
+	(void)htim;
+	(void)Channel;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_PWM_Stop(TIM_HandleTypeDef *htim, uint32_t Channel) {
+	(void)htim;
+	(void)Channel;
+	return HAL_OK;
+}
+
+// LED color from compare registers
+static void Color(uint8_t led, uint8_t c[3]) {
+	if (led == LED1) {
+		c[0] = brightness[hostTIM3.CCR1];
+		c[1] = brightness[hostTIM3.CCR2];
+		c[2] = brightness[hostTIM3.CCR3];
+	} else {
+		c[0] = brightness[hostTIM15.CCR1];
+		c[1] = brightness[hostTIM15.CCR2];
+		c[2] = brightness[hostTIM17.CCR1];
+	}
+}
+
+static uint8_t IsColor(uint8_t led, uint8_t r, uint8_t g, uint8_t b) {
+	uint8_t c[3];
+	Color(led, c);
+	return c[0] == r && c[1] == g && c[2] == b;
+}
+
+// TIM3 update interrupt, as TIM3_IRQHandler
+static void Tick(uint32_t n) {
+	while (n--) {
+		hostTIM3.SR |= TIM_SR_UIF;
+		if ((hostTIM3.DIER & TIM_DIER_UIE) && (hostTIM3.SR & TIM_SR_UIF)) {
+			hostTIM3.SR &= ~TIM_SR_UIF;
+			hostIpsr = TEST_TIM3_IRQ_IPSR;
+			LedEffectsTimerCb();
+			hostIpsr = 0;
+		}
+		ticks++;
+	}
+}
+
+static void Step(uint8_t *d, uint8_t op, uint8_t r, uint8_t g, uint8_t b, uint16_t time) {
+	d[0] = op;
+	d[1] = r;
+	d[2] = g;
+	d[3] = b;
+	d[4] = time;
+	d[5] = time >> 8;
+}
+
+static void Write(const uint8_t data[], uint16_t len) {
+	uint8_t buf[2 + LED_FX_STEPS_MAX * LED_FX_STEP_LEN + LED_FX_STEP_LEN];
+
+	memcpy(buf, data, len);
+	hostIpsr = TEST_I2C_IRQ_IPSR;
+	LedEffectsWriteCmd(buf, len);
+	hostIpsr = 0;
+}
+
+static uint8_t Running(uint8_t led) {
+	uint8_t data[TEST_READ_LEN + 8];
+	uint16_t len = 0;
+
+	Write(&led, 1);
+	hostIpsr = TEST_I2C_IRQ_IPSR;
+	LedEffectsReadCmd(data, &len);
+	hostIpsr = 0;
+	return data[1];
+}
+
+// On off blink of period ms started on led
+static void StartBlink(uint8_t led, uint8_t r, uint16_t on, uint16_t off) {
+	uint8_t d[2 + 3 * LED_FX_STEP_LEN] = {led, LED_FX_CTRL_START};
+
+	Step(d + 2, LED_FX_OP_SET, r, 0, 0, on);
+	Step(d + 8, LED_FX_OP_SET, 0, 0, 0, off);
+	Step(d + 14, LED_FX_OP_LOOP, 0, 0, 0, 0);
+	Write(d, sizeof(d));
+	ticks = 0;
+}
+
+static void TestTiming(void) {
+	uint8_t d[2 + 4 * LED_FX_STEP_LEN] = {LED2, LED_FX_CTRL_START};
+	uint16_t on = 20 + rand() % 500, off = 20 + rand() % 500, ramp = 100 + rand() % 2000;
+	uint64_t t, period;
+	uint32_t k;
+	uint8_t c[3], expected;
+
+	// blink phase follows absolute time, leftover time carries to next step
+	StartBlink(LED2, 200, on, off);
+	period = (on + off) * 1000ULL;
+	for (k = 0; k < 5000; k++) {
+		t = (uint64_t)ticks * TEST_TICK_US % period;
+		Color(LED2, c);
+		expected = t < on * 1000ULL ? 200 : 0;
+		if (c[0] != expected) {
+			HOST_CHECK(0, "blink %u/%u ms at %u ms red %u expected %u", on, off, (uint32_t)(t / 1000), c[0], expected);
+			break;
+		}
+		Tick(1);
+	}
+
+	// ramp up and down, value is linear in brightness index
+	Step(d + 2, LED_FX_OP_SET, 0, 0, 0, 0);
+	Step(d + 8, LED_FX_OP_RAMP, 0, 255, 0, ramp);
+	Step(d + 14, LED_FX_OP_RAMP, 0, 0, 0, ramp);
+	Step(d + 20, LED_FX_OP_LOOP, 1, 0, 0, 0);
+	Write(d, sizeof(d));
+	ticks = 0;
+	period = 2000ULL * ramp;
+	for (k = 0; k < 3000; k++) {
+		t = (uint64_t)ticks * TEST_TICK_US % period;
+		expected = t < period / 2 ? 255 * t / (period / 2) : 255 - 255 * (t - period / 2) / (period / 2);
+		Color(LED2, c);
+		if (c[1] + 1 < expected || c[1] > expected + 1) {
+			HOST_CHECK(0, "ramp %u ms at %u ms green %u expected %u", ramp, (uint32_t)(t / 1000), c[1], expected);
+			break;
+		}
+		Tick(1);
+	}
+	Write((uint8_t[]){LED2, LED_FX_CTRL_STOP}, 2);
+}
+
+static void TestChargeLevel(void) {
+	uint8_t d[2 + 5 * LED_FX_STEP_LEN] = {LED2, LED_FX_CTRL_START};
+	uint8_t segments = 1 + rand() % 10;
+	uint32_t k, blinks = 0, expected;
+	uint8_t on = 0;
+
+	// blinks once per charge level segment, then ends
+	batteryRsoc = rand() % 1001;
+	expected = (batteryRsoc * segments + 999) / 1000;
+	if (expected == 0) expected = 1;
+	Step(d + 2, LED_FX_OP_SET, 100, 0, 0, 50);
+	Step(d + 8, LED_FX_OP_SET, 0, 0, 0, 50);
+	Step(d + 14, LED_FX_OP_LOOP, 0, segments, LED_FX_LOOP_LEVEL, 0);
+	Step(d + 20, LED_FX_OP_SET, 0, 0, 0, 500);
+	Step(d + 26, LED_FX_OP_END, 0, 0, 0, 0);
+	Write(d, sizeof(d));
+	for (k = 0; k < 500 && Running(LED2); k++) {
+		if (IsColor(LED2, 100, 0, 0) && !on) blinks++;
+		on = IsColor(LED2, 100, 0, 0);
+		Tick(1);
+	}
+	HOST_CHECK(!Running(LED2), "effect with end step still running");
+	HOST_CHECK(blinks == expected, "charge %u segments %u blinks %u expected %u", batteryRsoc, segments, blinks, expected);
+	HOST_CHECK(!(hostTIM3.DIER & TIM_DIER_UIE), "update interrupt left enabled");
+}
+
+static void TestUpload(void) {
+	uint8_t d[2 + (LED_FX_STEPS_MAX + 1) * LED_FX_STEP_LEN] = {LED2, LED_FX_CTRL_START};
+	uint8_t data[TEST_READ_LEN + 8];
+	uint16_t len = 0;
+	uint8_t i;
+
+	// longest effect is uploaded in one write and read back in one read
+	for (i = 0; i <= LED_FX_STEPS_MAX; i++) Step(d + 2 + i * LED_FX_STEP_LEN, LED_FX_OP_SET, i, 2 * i, 3 * i, 100 + i);
+	Write(d, 2 + LED_FX_STEPS_MAX * LED_FX_STEP_LEN);
+	Write((uint8_t[]){LED2}, 1);
+	hostIpsr = TEST_I2C_IRQ_IPSR;
+	LedEffectsReadCmd(data, &len);
+	hostIpsr = 0;
+	HOST_CHECK(len == TEST_READ_LEN, "read length %u", len);
+	HOST_CHECK(data[0] == LED2 && data[1] == 1 && data[3] == LED_FX_STEPS_MAX, "read LED %u running %u steps %u", data[0], data[1], data[3]);
+	HOST_CHECK(memcmp(data + 4, d + 2, LED_FX_STEPS_MAX * LED_FX_STEP_LEN) == 0, "steps read back differ");
+
+	// too many steps, no steps or LED without function are refused
+	Write((uint8_t[]){LED2, LED_FX_CTRL_STOP}, 2);
+	Write(d, sizeof(d));
+	HOST_CHECK(!Running(LED2), "effect with %u steps started", LED_FX_STEPS_MAX + 1);
+	Write(d, 2);
+	HOST_CHECK(!Running(LED2), "effect without steps started");
+}
+
+static void TestPriority(void) {
+	uint8_t state[3] = {10, 20, 30};
+	uint8_t blink[9] = {5, 100, 0, 0, 10, 0, 100, 0, 10};
+	uint8_t config[4] = {LED_USER_LED, 0, 0, 0};
+
+	// function color is kept while effect runs and shown when it stops
+	StartBlink(LED1, 200, 30, 30);
+	Tick(rand() % 20);
+	LedFunctionSetRGB(LED_CHARGE_STATUS, 1, 2, 3);
+	HOST_CHECK(Running(LED1) && !IsColor(LED1, 1, 2, 3), "function color overwrote effect");
+	Write((uint8_t[]){LED1, LED_FX_CTRL_STOP}, 2);
+	HOST_CHECK(IsColor(LED1, 1, 2, 3), "function color not restored");
+
+	// power policy LED action stops effect, timer does not overwrite its color
+	StartBlink(LED1, 200, 30, 30);
+	Tick(rand() % 20);
+	LedSetState(LED1, 127, 0, 127);
+	HOST_CHECK(!Running(LED1), "policy LED action did not stop effect");
+	Tick(20);
+	HOST_CHECK(IsColor(LED1, 127, 0, 127), "effect overwrote policy LED color");
+	HOST_CHECK(!(hostTIM3.DIER & TIM_DIER_UIE), "update interrupt left enabled");
+
+	// policy on one LED leaves effect of other LED running
+	StartBlink(LED1, 200, 30, 30);
+	StartBlink(LED2, 200, 30, 30);
+	LedSetState(LED1, 0, 127, 0);
+	HOST_CHECK(!Running(LED1) && Running(LED2), "policy stopped effect of other LED");
+	HOST_CHECK(hostTIM3.DIER & TIM_DIER_UIE, "update interrupt disabled with effect running");
+	Tick(20);
+	HOST_CHECK(IsColor(LED1, 0, 127, 0), "effect overwrote policy LED color");
+
+	// host user LED state, blink and configuration commands stop effect
+	hostIpsr = TEST_I2C_IRQ_IPSR;
+	LedCmdSetState(LED2, state, 3);
+	hostIpsr = 0;
+	HOST_CHECK(!Running(LED2) && IsColor(LED2, 10, 20, 30), "user LED state did not stop effect");
+	StartBlink(LED2, 200, 30, 30);
+	hostIpsr = TEST_I2C_IRQ_IPSR;
+	LedCmdSetBlink(LED2, blink, 9);
+	hostIpsr = 0;
+	HOST_CHECK(!Running(LED2), "blink command did not stop effect");
+	StartBlink(LED2, 200, 30, 30);
+	LedSetConfiguarion(LED2, config, 4);
+	HOST_CHECK(!Running(LED2), "configuration did not stop effect");
+}
+
+static void TestInterruptMask(void) {
+	// changes called with interrupts disabled leave them disabled
+	hostPrimask = 1;
+	StartBlink(LED1, 200, 30, 30);
+	HOST_CHECK(hostPrimask == 1, "effect start enabled interrupts");
+	LedSetState(LED1, 0, 0, 0);
+	HOST_CHECK(hostPrimask == 1, "policy LED action enabled interrupts");
+	LedFunctionSetRGB(LED_CHARGE_STATUS, 0, 0, 0);
+	HOST_CHECK(hostPrimask == 1, "function color enabled interrupts");
+	hostPrimask = 0;
+	StartBlink(LED1, 200, 30, 30);
+	Write((uint8_t[]){LED1, LED_FX_CTRL_STOP}, 2);
+	LedSetState(LED1, 0, 0, 0);
+	LedFunctionSetRGB(LED_CHARGE_STATUS, 0, 0, 0);
+	HOST_CHECK(hostPrimask == 0, "interrupts left disabled");
+}
+
+int main(int argc, char *argv[]) {
+	int seed = argc > 1 ? atoi(argv[1]) : 1;
+	char name[40];
+	uint16_t v;
+
+	srand(seed);
+	// brightness index is found from compare value set for it
+	for (v = 256; v-- > 0;) {
+		LedSetRGB(LED1, v, 0, 0);
+		brightness[hostTIM3.CCR1] = v;
+	}
+	LedSetRGB(LED1, 0, 0, 0);
+	LedSetRGB(LED2, 0, 0, 0);
+
+	TestTiming();
+	TestChargeLevel();
+	TestUpload();
+	TestPriority();
+	TestInterruptMask();
+
+	snprintf(name, sizeof(name), "test_led_effects seed %d", seed);
+	return HostReport(name);
+}
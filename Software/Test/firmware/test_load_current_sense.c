@@ -0,0 +1,244 @@
+// ----------------------------------------------------------------------------
+/*!
+ * @file         test_load_current_sense.c
+ * @date       19 October 2026
+ * @brief       PMOS load current model tests: fixed point drain current
+ *                  table compared with previous float polynomials over all
+ *                  VDG samples, temperatures to table end and calibration
+ *                  factors, within rounding and unbiased at table
+ *                  temperatures, never negative, calibration of random
+ *                  points read back as 52 mA, host time per
+ *                  measurement of both printed.
+ *                  Usage: test_load_current_sense [seed]
+ */
+// ----------------------------------------------------------------------------
+// Include section - add all #includes here:
+
+#include <math.h>
+#include <stdlib.h>
+#include <time.h>
+#include "analog.h"
+#include "load_current_sense.h"
+#include "power_source.h"
+#include "execution.h"
+#include "nv.h"
+
+// ----------------------------------------------------------------------------
+// Defines section - add all #defines here:
+
+#define ID_T_POLY_COEFF_VDG_START 	240
+#define ID_T_POLY_COEFF_VDG_END 	800
+#define ID_T_POLY_COEFF_VDG_INC 	10
+#define ID_T_POLY_COEFF_LEN 		(((int16_t)ID_T_POLY_COEFF_VDG_END - ID_T_POLY_COEFF_VDG_START) / ID_T_POLY_COEFF_VDG_INC + 1)
+
+#define TEST_TEMP_MIN	(-40)
+#define TEST_TEMP_MAX	88 // last table column
+#define TEST_TABLE_TEMPS	((TEST_TEMP_MAX - TEST_TEMP_MIN) / 4 + 1)
+#define TEST_CALIB_LOAD	52 // mA, 5.1 V on 100 ohm at calibration
+#define TEST_CALIBS_NUM	200
+#define TEST_TIMING_CALLS	1000000
+
+// ----------------------------------------------------------------------------
+// Variables section - add all global variables here:
+
+// module takes ADC samples, temperature and board state from
+uint32_t analogIn[ADC_BUFFER_LENGTH];
+uint16_t aVdd = 3300;
+int32_t mcuTemperature;
+ADC_HandleTypeDef hadc;
+uint32_t executionState = EXECUTION_STATE_NORMAL;
+uint8_t pow5vInDetStatus = POW_5V_IN_DETECTION_STATUS_NOT_PRESENT;
+
+extern int16_t pow5vIoPMOSLoadCurrent;
+
+static DMA_HandleTypeDef hdma;
+static DMA_Channel_TypeDef dmaChannel;
+
+static uint16_t nvVar[NV_VAR_NUM];
+
+// Previous firmware poly coefficients of drain current on temperature, ID = a * T^2 + b * T + c
+static const float a[ID_T_POLY_COEFF_LEN] = {0.00672, 0.0065, 0.00628, 0.00606, 0.00584, 0.00562, 0.0054, 0.00518, 0.00496, 0.00474, 0.00452, 0.0043, 0.00408, 0.00386, 0.00364, 0.00342, 0.0032, 0.00298, 0.00276, 0.00254, 0.00232, 0.0021, 0.00188, 0.00166, 0.00144, 0.00122, 0.001, 0.00065, 0.0003, 0,-0.0051,-0.0092,-0.0139,-0.0193,-0.0254,-0.0323,-0.0399,-0.0483,-0.0576,-0.0677,-0.0788,-0.0909,-0.104,-0.1181,-0.1311,-0.1458,-0.1612,-0.1774,-0.1945,-0.2123,-0.231,-0.2506,-0.271,-0.2922,-0.3144,-0.3374,-0.3614};
+static const float b[ID_T_POLY_COEFF_LEN] = {0.2169,0.1571,0.1201,0.1042,0.1078,0.1295,0.1676,0.2207,0.2872,0.3655,0.4541,0.5514,0.3989,0.4694,0.5615,0.6495,0.7352,0.8204,0.9068,0.9962,1.0904,1.1911,1.3001,1.4193,1.5503,1.695,1.8551,2.0323,2.2286,2.4456,3.0549,3.5263,4.0515,4.6335,5.2757,5.981,6.7528,7.5942,8.5084,9.4986,10.568,11.719,12.957,14.282,15.501,16.858,18.278,19.763,21.312,22.926,24.607,26.354,28.169,30.052,32.004,34.025,36.117};
+static const float c[ID_T_POLY_COEFF_LEN] = {-8.2299,-4.4796,-1.6241,0.4295,1.774,2.5026,2.708,2.4833,1.9213,1.115,0.1574,-0.8587,3.632,3.669,4.126,5.003,6.3,8.017,10.154,12.711,15.688,19.085,22.902,27.139,31.796,36.873,42.37,48.287,54.624,61.381,68.558,76.155,84.172,92.609,101.47,110.74,120.44,130.56,141.09,152.05,163.43,175.23,187.44,200.08,217.37,234.16,252.12,271.29,291.73,313.5,336.64,361.2,387.24,414.82,443.99,474.79,507.28};
+
+// ----------------------------------------------------------------------------
+// Function section - add all local functions here:
+
+uint16_t EE_ReadVariable(uint16_t VirtAddress, uint16_t *Data) {
+	*Data = nvVar[VirtAddress];
+	return 0;
+}
+
+uint16_t EE_WriteVariable(uint16_t VirtAddress, uint16_t Data) {
+	nvVar[VirtAddress] = Data;
+	return 0;
+}
+
+uint8_t AnalogSamplesReady(void) {
+	return 0;
+}
+
+int16_t Get5vIoVoltage(void) {
+	return 5000;
+}
+
+int32_t GetSampleAverage(uint8_t channel) {
+	return 0;
+}
+
+int32_t GetSampleAverageDiff(uint8_t channel1, uint8_t channel2) {
+	return 0;
+}
+
+int8_t Turn5vBoost(uint8_t onOff) {
+	if (onOff) GPIOA->IDR |= GPIO_PIN_10;
+	else GPIOA->IDR &= ~GPIO_PIN_10;
+	return 0;
+}
+
+void Power5VSetModeLDO(void) {
+}
+
+// Drain to gate voltage sample, ADC buffer is filled so any DMA position reads it
+static void SetVdgSample(uint16_t sample) {
+	uint16_t i;
+
+	for (i = POW_DET_SENS_CHN; i < ADC_BUFFER_LENGTH; i += ADC_SCAN_CHANNELS) analogIn[i] = sample;
+}
+
+static void SetCoeffs(uint8_t kta, uint8_t ktb) {
+	nvVar[VDG_ILOAD_CALIB_KTA_NV_ADDR] = kta | ((uint16_t)~kta << 8);
+	nvVar[VDG_ILOAD_CALIB_KTB_NV_ADDR] = ktb | ((uint16_t)~ktb << 8);
+	nvVar[RES_ILOAD_CALIB_ZERO_NV_ADDR] = 0 | ((uint16_t)~0 << 8);
+	LoadCurrentSenseInit();
+}
+
+// Previous firmware measurement
+static int16_t OldCurrent(uint16_t sample, uint8_t kta, uint8_t ktb) {
+	int32_t vdg = 4790 - ((sample * aVdd) >> 11);
+	int16_t i = vdg >= ID_T_POLY_COEFF_VDG_START ? (vdg - ID_T_POLY_COEFF_VDG_START + ID_T_POLY_COEFF_VDG_INC / 2) / ID_T_POLY_COEFF_VDG_INC : 0;
+	float current;
+
+	i = i >= ID_T_POLY_COEFF_LEN ? ID_T_POLY_COEFF_LEN - 1 : i;
+	current = a[i] * mcuTemperature * mcuTemperature + b[i] * mcuTemperature + c[i];
+	current = current > 0 ? current : 0;
+	return ((kta * mcuTemperature + (((uint16_t)ktb) << 8)) * ((int32_t)(current + 0.5))) >> 13;
+}
+
+// Calibration coefficients for gain k12 of board, as CalibrateLoadCurrent stores them
+static void Coeffs(float k12, uint8_t *kta, uint8_t *ktb) {
+	*kta = 0.0052 * k12 * 1024 * 8;
+	*ktb = 0.9376 * k12 * 32;
+}
+
+static void TestGrid(void) {
+	static const float k12s[] = {0.5, 1, 2, 3};
+	uint8_t kta, ktb, k;
+	uint16_t s;
+	int16_t d, maxErr, minCurrent = 0;
+	int32_t bias;
+	float scale, excess, maxExcess, mean;
+
+	for (k = 0; k < sizeof(k12s) / sizeof(k12s[0]); k++) {
+		Coeffs(k12s[k], &kta, &ktb);
+		SetCoeffs(kta, ktb);
+		maxErr = 0;
+		maxExcess = -1;
+		bias = 0;
+		for (mcuTemperature = TEST_TEMP_MIN; mcuTemperature <= TEST_TEMP_MAX; mcuTemperature++) {
+			// both models round reference current to mA, interpolation over 4 degrees adds at most 1.5 mA
+			scale = (kta * mcuTemperature + ktb * 256) / 8192.0;
+			for (s = 0; s < 4096; s++) {
+				SetVdgSample(s);
+				MeasurePMOSLoadCurrent();
+				d = pow5vIoPMOSLoadCurrent - OldCurrent(s, kta, ktb);
+				if (!(mcuTemperature & 0x03)) bias += d;
+				d = abs(d);
+				excess = d - 1 - scale * ((mcuTemperature & 0x03) ? 2.5 : 1);
+				if (d > maxErr) maxErr = d;
+				if (excess > maxExcess) maxExcess = excess;
+				if (pow5vIoPMOSLoadCurrent < minCurrent) minCurrent = pow5vIoPMOSLoadCurrent;
+			}
+		}
+		HOST_CHECK(maxExcess <= 0, "k12 %.1f: maximum error %d mA, %.1f mA above rounding and interpolation",
+				k12s[k], maxErr, maxExcess);
+		// reference is rounded to mA as before, interpolation under concave rows is left out
+		mean = (float)bias / (4096 * TEST_TABLE_TEMPS);
+		HOST_CHECK(fabsf(mean) < 0.1 * k12s[k], "k12 %.1f: mean error %.2f mA at table temperatures", k12s[k], mean);
+		HOST_CHECK(minCurrent == 0, "negative current %d mA", minCurrent);
+	}
+}
+
+static void TestCalibration(void) {
+	uint16_t k, s;
+	int16_t ref;
+
+	Turn5vBoost(0);
+	for (k = 0; k < TEST_CALIBS_NUM; k++) {
+		// gain above 1, where 8 bit kta and ktb keep it within few percent
+		do {
+			mcuTemperature = TEST_TEMP_MIN + rand() % (TEST_TEMP_MAX - TEST_TEMP_MIN + 1);
+			s = rand() % 4096;
+			ref = OldCurrent(s, 0, 32);
+		} while (ref < 20 || ref > 35);
+		SetVdgSample(s);
+		CalibrateLoadCurrent();
+		SetCoeffs(nvVar[VDG_ILOAD_CALIB_KTA_NV_ADDR] & 0xFF, nvVar[VDG_ILOAD_CALIB_KTB_NV_ADDR] & 0xFF);
+		MeasurePMOSLoadCurrent();
+		HOST_CHECK(abs(pow5vIoPMOSLoadCurrent - TEST_CALIB_LOAD) <= 4, "%d mA after calibration at %d C, reference %d mA",
+				pow5vIoPMOSLoadCurrent, mcuTemperature, ref);
+	}
+}
+
+static double Seconds(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Host time per measurement of table lookup and previous float polynomial, host FPU does not
+// show soft-float cost of Cortex-M0 so only order of both is compared
+static void TestTiming(void) {
+	volatile int32_t sink = 0;
+	uint8_t kta, ktb;
+	uint32_t k;
+	double t, table, poly;
+
+	Coeffs(1, &kta, &ktb);
+	SetCoeffs(kta, ktb);
+	mcuTemperature = 25;
+	SetVdgSample(2000);
+	t = Seconds();
+	for (k = 0; k < TEST_TIMING_CALLS; k++) {
+		mcuTemperature = TEST_TEMP_MIN + (k & 0x7F);
+		MeasurePMOSLoadCurrent();
+		sink += pow5vIoPMOSLoadCurrent;
+	}
+	table = (Seconds() - t) * 1e9 / TEST_TIMING_CALLS;
+	t = Seconds();
+	for (k = 0; k < TEST_TIMING_CALLS; k++) {
+		mcuTemperature = TEST_TEMP_MIN + (k & 0x7F);
+		sink += OldCurrent(2000, kta, ktb);
+	}
+	poly = (Seconds() - t) * 1e9 / TEST_TIMING_CALLS;
+	printf("host time per measurement: table %.1f ns, float polynomial %.1f ns\n", table, poly);
+	HOST_CHECK(sink != 0, "no current measured");
+}
+
+int main(int argc, char *argv[]) {
+	int seed = argc > 1 ? atoi(argv[1]) : 1;
+	char name[40];
+
+	srand(seed);
+
+	hdma.Instance = &dmaChannel;
+	hadc.DMA_Handle = &hdma;
+
+	TestGrid();
+	TestCalibration();
+	TestTiming();
+
+	snprintf(name, sizeof(name), "test_load_current_sense seed %d", seed);
+	return HostReport(name);
+}
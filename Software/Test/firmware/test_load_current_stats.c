@@ -0,0 +1,386 @@
+// ----------------------------------------------------------------------------
+/*!
+ * @file         test_load_current_stats.c
+ * @date       19 October 2026
+ * @brief       Load current statistics tests: ADC half buffers of
+ *                  synthetic load current profiles are fed to DMA
+ *                  callbacks, read frame is compared with reference
+ *                  statistics computed in double from same scans:
+ *                  nested windows, peak scan and its time, histogram,
+ *                  stop mode gaps, both current sensors, configuration.
+ *                  Usage: test_load_current_stats [seed]
+ */
+// ----------------------------------------------------------------------------
+// Include section - add all #includes here:
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "analog.h"
+#include "load_current_sense.h"
+#include "load_current_stats.h"
+#include "rtc_ds1339_emu.h"
+
+// ----------------------------------------------------------------------------
+// Defines section - add all #defines here:
+
+#define TEST_I2C_IRQ_IPSR	39 // exception number of I2C1 interrupt
+#define TEST_RTC_BASE	830000000.0 // RTC seconds since 2000-01-01 at start
+#define TEST_TICK_OFFSET	5000000 // ms tick at start
+#define TEST_HALF_SCANS	(ADC_BUFFER_LENGTH / ADC_SCAN_CHANNELS / 2)
+#define TEST_TIME_TOLERANCE	0.01 // s, time stamps are ms tick converted to 1/256 s
+
+// ----------------------------------------------------------------------------
+// Variables section - add all global variables here:
+
+// modules statistics take ADC samples and board configuration from
+uint32_t analogIn[ADC_BUFFER_LENGTH];
+uint16_t aVdd = 3300;
+uint8_t hardwareRev = HARD_REV_2_3_AND_ABOVE;
+ADC_HandleTypeDef hadc;
+static int16_t calib = 0;
+
+static double timeUs; // time since start
+
+// Reference statistics from per scan currents and scan times
+typedef struct {
+	double sum, sumSq;
+	long n;
+	int min, max;
+	int windows;
+	long completed;
+	double lastMin, lastMax, lastAvg, lastRms, lastEnd, peakAvg, peakEnd;
+} Ref_T;
+
+static Ref_T ref[LOAD_CURR_STATS_LEVELS];
+static long refBaseScans;
+static int refWindows[LOAD_CURR_STATS_LEVELS - 1];
+static int refShift;
+static double refHist[LOAD_CURR_STATS_HIST_BINS];
+static int refPeak;
+static double refPeakUs;
+
+typedef double (*Profile_T)(double t); // t in s, current mA
+static double inrushAt;
+
+// ----------------------------------------------------------------------------
+// Function section - add all local functions here:
+
+int16_t GetLoadCurrentCalib(void) {
+	return calib;
+}
+
+void RtcReadLinearTime(uint32_t *sec, uint8_t *sub) {
+	double t = TEST_RTC_BASE + timeUs / 1e6;
+	*sec = (uint32_t)t;
+	*sub = (uint8_t)((t - *sec) * 256);
+}
+
+static void SetTick(void) {
+	hostTick = (uint32_t)(timeUs / 1000) + TEST_TICK_OFFSET;
+}
+
+static double URand(void) {
+	return rand() / (RAND_MAX + 1.0);
+}
+
+static double Gauss(void) {
+	double u = URand() + 1e-12, v = URand();
+	return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+// ADC codes of one scan for current c mA, inverse of per scan conversion with ADC noise
+static void MakeScan(uint32_t *scan, double c) {
+	double s0, s1;
+	int i;
+
+	for (i = 0; i < ADC_SCAN_CHANNELS; i++) scan[i] = 1000;
+	s0 = 5100.0 / 2 * 4096 / aVdd;
+	if (hardwareRev == HARD_REV_2_3_AND_ABOVE) {
+		s1 = 1469 + s0 * 138 / 4096 - c * 16384 / (aVdd * 10.0);
+	} else {
+		s1 = s0 - (c + calib) * 256 / (aVdd * 25.0);
+	}
+	s0 += 0.5 * Gauss();
+	s1 += 0.5 * Gauss();
+	if (s1 < 0) s1 = 0;
+	if (s1 > 4095) s1 = 4095;
+	scan[0] = (uint32_t)lround(s0);
+	scan[1] = (uint32_t)lround(s1);
+}
+
+// Per scan conversion of firmware, reference statistics use same scan currents
+static int32_t ScanCurrent(const uint32_t *scan) {
+	int32_t s0 = scan[0], s1 = scan[1], c;
+
+	if (hardwareRev != HARD_REV_2_3_AND_ABOVE) {
+		c = (((s0 - s1) * aVdd * 25) >> 8) - calib;
+	} else if (s0 < 1500) {
+		c = 0;
+	} else {
+		c = ((1469 + ((s0 * 138) >> 12) - s1) * aVdd * 10 + 1) >> 14;
+	}
+	if (c > 4000) c = 4000;
+	if (c < -3000) c = -3000;
+	return c;
+}
+
+static void RefReset(void) {
+	memset(ref, 0, sizeof(ref));
+	memset(refHist, 0, sizeof(refHist));
+	refPeak = -100000;
+}
+
+static void RefAdd(Ref_T *r, double sum, double sumSq, long n, int min, int max) {
+	if (!r->n || min < r->min) r->min = min;
+	if (!r->n || max > r->max) r->max = max;
+	r->sum += sum;
+	r->sumSq += sumSq;
+	r->n += n;
+}
+
+static void RefClose(int level, double t) {
+	Ref_T *r = &ref[level];
+	double avg = r->sum / r->n;
+
+	r->lastMin = r->min;
+	r->lastMax = r->max;
+	r->lastAvg = avg;
+	r->lastRms = sqrt(r->sumSq / r->n);
+	r->lastEnd = t;
+	if (!r->completed || (int)trunc(avg) > (int)trunc(r->peakAvg)) {
+		r->peakAvg = avg;
+		r->peakEnd = t;
+	}
+	r->completed++;
+	if (level + 1 < LOAD_CURR_STATS_LEVELS) {
+		RefAdd(&ref[level + 1], r->sum, r->sumSq, r->n, r->min, r->max);
+		if (++ref[level + 1].windows >= refWindows[level]) RefClose(level + 1, t);
+	}
+	r->sum = 0;
+	r->sumSq = 0;
+	r->n = 0;
+	r->windows = 0;
+}
+
+static void RefScan(int c, double t) {
+	int b = c >> refShift;
+
+	RefAdd(&ref[0], c, (double)c * c, 1, c, c);
+	if (c > refPeak) {
+		refPeak = c;
+		refPeakUs = t;
+	}
+	refHist[b < 0 ? 0 : b >= LOAD_CURR_STATS_HIST_BINS ? LOAD_CURR_STATS_HIST_BINS - 1 : b]++;
+	if (ref[0].n >= refBaseScans) RefClose(0, t);
+}
+
+// ADC runs for seconds, DMA callbacks come at end of each buffer half with random latency
+static void RunAdc(Profile_T profile, double seconds) {
+	static int half = 0;
+	double start = timeUs, end = timeUs + seconds * 1e6, t;
+	uint32_t *buf;
+	int i;
+
+	while (timeUs + TEST_HALF_SCANS * LOAD_CURR_STATS_SCAN_US <= end) {
+		buf = analogIn + half * ADC_BUFFER_LENGTH / 2;
+		for (i = 0; i < TEST_HALF_SCANS; i++) {
+			t = timeUs + (i + 1) * LOAD_CURR_STATS_SCAN_US;
+			MakeScan(buf + i * ADC_SCAN_CHANNELS, profile((t - start) / 1e6));
+			RefScan(ScanCurrent(buf + i * ADC_SCAN_CHANNELS), t);
+		}
+		timeUs += TEST_HALF_SCANS * LOAD_CURR_STATS_SCAN_US;
+		t = timeUs;
+		timeUs += 300 * URand();
+		SetTick();
+		if (half) {
+			HAL_ADC_ConvCpltCallback(&hadc);
+		} else {
+			HAL_ADC_ConvHalfCpltCallback(&hadc);
+		}
+		timeUs = t;
+		half ^= 1;
+	}
+}
+
+// ADC does not run in stop mode
+static void StopMode(double seconds) {
+	timeUs += seconds * 1e6;
+}
+
+static int16_t I16(const uint8_t *p) {
+	return (int16_t)(p[0] | p[1] << 8);
+}
+
+static uint32_t U32(const uint8_t *p) {
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static double Time(const uint8_t *p) {
+	return U32(p) + p[4] / 256.0;
+}
+
+static void CheckTime(const char *step, const char *what, const uint8_t *p, double us) {
+	double err = fabs(Time(p) - (TEST_RTC_BASE + us / 1e6));
+	HOST_CHECK(err <= TEST_TIME_TOLERANCE, "%s: %s time error %.4f s", step, what, err);
+}
+
+static void Read(uint8_t data[LOAD_CURR_STATS_READ_LEN]) {
+	uint16_t len = 0;
+
+	SetTick();
+	hostIpsr = TEST_I2C_IRQ_IPSR;
+	LoadCurrentStatsReadCmd(data, &len);
+	hostIpsr = 0;
+	HOST_CHECK(len == LOAD_CURR_STATS_READ_LEN, "frame length %u", len);
+}
+
+// Read frame against reference statistics
+static void CheckStats(const char *step) {
+	uint8_t data[LOAD_CURR_STATS_READ_LEN];
+	const uint8_t *p;
+	Ref_T *r;
+	int level, i;
+	double h;
+
+	Read(data);
+	HOST_CHECK(data[0] == 1, "%s: not running", step);
+	p = data + LOAD_CURR_STATS_READ_HEADER_LEN;
+	for (level = 0; level < LOAD_CURR_STATS_LEVELS; level++, p += LOAD_CURR_STATS_READ_LEVEL_LEN) {
+		r = &ref[level];
+		HOST_CHECK(U32(p) == r->completed, "%s: level %d completed %u expected %ld", step, level, U32(p), r->completed);
+		if (!r->completed) continue;
+		HOST_CHECK(I16(p + 4) == r->lastMin, "%s: level %d min %d expected %.0f", step, level, I16(p + 4), r->lastMin);
+		HOST_CHECK(I16(p + 6) == r->lastMax, "%s: level %d max %d expected %.0f", step, level, I16(p + 6), r->lastMax);
+		HOST_CHECK(I16(p + 8) == trunc(r->lastAvg), "%s: level %d avg %d expected %.2f", step, level, I16(p + 8), r->lastAvg);
+		HOST_CHECK(fabs(I16(p + 10) - r->lastRms) <= 1, "%s: level %d rms %d expected %.2f", step, level, I16(p + 10), r->lastRms);
+		HOST_CHECK(I16(p + 17) == trunc(r->peakAvg), "%s: level %d peak avg %d expected %.2f", step, level, I16(p + 17), r->peakAvg);
+		CheckTime(step, "last end", p + 12, r->lastEnd);
+		CheckTime(step, "peak end", p + 19, r->peakEnd);
+	}
+	if (refPeak > -100000) {
+		HOST_CHECK(I16(p) == refPeak, "%s: peak %d expected %d", step, I16(p), refPeak);
+		CheckTime(step, "peak", p + 2, refPeakUs);
+	}
+	p += LOAD_CURR_STATS_READ_PEAK_LEN;
+	for (i = 0; i < LOAD_CURR_STATS_HIST_BINS; i++) {
+		h = (double)U32(p + i * 4) * (1 << data[6]);
+		HOST_CHECK(fabs(h - refHist[i]) <= (1 << data[6]), "%s: bin %d count %.0f expected %.0f", step, i, h, refHist[i]);
+	}
+}
+
+// Profiles
+static double Steady(double t) {
+	(void)t;
+	return 450 + 20 * Gauss();
+}
+
+// Pi boot: current steps with 2 ms spikes every 500 ms, kernel load plateau
+static double Boot(double t) {
+	double base = t < 2 ? 350 : t < 10 ? 650 + 150 * sin(t * 3) : 520;
+	double ph = fmod(t, 0.5);
+
+	if (t < 10 && ph > 0.25 && ph < 0.252) base = 2400;
+	return base + 15 * Gauss();
+}
+
+// USB device plugged at inrushAt: 3.2 A exponential decay, tau 3 ms
+static double Inrush(double t) {
+	double c = 600 + 10 * Gauss();
+
+	if (t >= inrushAt) c += 2600 * exp(-(t - inrushAt) / 0.003);
+	return c;
+}
+
+static double Ripple(double t) {
+	return 700 + 400 * sin(2 * M_PI * 7 * t) + 5 * Gauss();
+}
+
+static void Config(uint16_t baseMs, uint8_t n1, uint8_t n2, uint8_t shift) {
+	uint8_t cmd[6] = {0x02, baseMs, baseMs >> 8, n1, n2, shift};
+
+	hostIpsr = TEST_I2C_IRQ_IPSR;
+	LoadCurrentStatsWriteCmd(cmd, 6);
+	hostIpsr = 0;
+	refBaseScans = ((uint32_t)baseMs * 1000 + LOAD_CURR_STATS_SCAN_US / 2) / LOAD_CURR_STATS_SCAN_US;
+	refWindows[0] = n1;
+	refWindows[1] = n2;
+	refShift = shift;
+	RefReset();
+}
+
+static void TestNcsSensor(void) {
+	uint8_t reset = 0x01;
+	int k;
+
+	hardwareRev = HARD_REV_2_3_AND_ABOVE;
+	aVdd = 3300;
+	Config(100, 10, 60, 7);
+	RunAdc(Steady, 65);
+	CheckStats("steady");
+	RunAdc(Boot, 12);
+	CheckStats("boot spikes");
+	inrushAt = 5 + 10 * URand();
+	RunAdc(Inrush, 20);
+	CheckStats("usb inrush");
+	RunAdc(Ripple, 62);
+	CheckStats("ripple");
+
+	// windows continue over stop mode, partial half buffer is lost
+	LoadCurrentStatsWriteCmd(&reset, 1);
+	RefReset();
+	CheckStats("after reset");
+	for (k = 0; k < 30; k++) {
+		RunAdc(Ripple, 0.8);
+		StopMode(3.9);
+	}
+	CheckStats("stop mode gaps");
+}
+
+static void TestResistorSensor(void) {
+	hardwareRev = HARD_REV_BELOW_2_3;
+	calib = 37;
+	aVdd = 3280;
+	Config(50, 4, 5, 8);
+	inrushAt = 1 + 3 * URand();
+	RunAdc(Inrush, 5);
+	CheckStats("resistor sense inrush");
+}
+
+static void TestConfig(void) {
+	uint8_t data[LOAD_CURR_STATS_READ_LEN];
+	uint8_t cmd[6] = {0x02, 5, 0, 10, 60, 7};
+
+	hardwareRev = HARD_REV_2_3_AND_ABOVE;
+	aVdd = 3300;
+	Config(1000, 255, 255, 4);
+	RunAdc(Steady, 2);
+	CheckStats("1 s windows");
+
+	// base window below minimum is ignored
+	LoadCurrentStatsWriteCmd(cmd, 6);
+	Read(data);
+	HOST_CHECK((data[1] | data[2] << 8) == 1000 && data[5] == 4, "invalid config accepted");
+
+	// statistics off
+	cmd[1] = 0;
+	LoadCurrentStatsWriteCmd(cmd, 6);
+	RunAdc(Steady, 1);
+	Read(data);
+	HOST_CHECK(data[0] == 0 && U32(data + LOAD_CURR_STATS_READ_HEADER_LEN) == 0, "off running %u completed %u",
+			data[0], U32(data + LOAD_CURR_STATS_READ_HEADER_LEN));
+}
+
+int main(int argc, char *argv[]) {
+	int seed = argc > 1 ? atoi(argv[1]) : 1;
+	char name[48];
+
+	srand(seed);
+
+	TestNcsSensor();
+	TestResistorSensor();
+	TestConfig();
+
+	snprintf(name, sizeof(name), "test_load_current_stats seed %d", seed);
+	return HostReport(name);
+}
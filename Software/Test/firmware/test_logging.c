@@ -0,0 +1,321 @@
+// ----------------------------------------------------------------------------
+/*!
+ * @file         test_logging.c
+ * @date       19 October 2026
+ * @brief       Event log tests: drain frames decoded as pijuice_log.py
+ *                  does and compared with records put in 1/256 s RTC
+ *                  time, flood without drain overwriting oldest records
+ *                  with lost flag and retained ones read intact again
+ *                  after rewind, 5V regulator flapping storm with per
+ *                  class rate limit and repeated records count,
+ *                  log_config class and rate limit bits.
+ *                  Usage: test_logging [seed]
+ */
+// ----------------------------------------------------------------------------
+// Include section - add all #includes here:
+
+#include <stdlib.h>
+#include <string.h>
+#include "logging.h"
+#include "nv.h"
+#include "rtc_ds1339_emu.h"
+
+// ----------------------------------------------------------------------------
+// Defines section - add all #defines here:
+
+#define TEST_I2C_IRQ_IPSR	39 // exception number of I2C1 interrupt
+#define TEST_RECORDS_MAX	20000
+#define TEST_IDS_NUM	(LOG_REPEATED + 1)
+#define TEST_FLAG_MORE	0x01
+#define TEST_FLAG_LOST	0x02
+#define TEST_ALL_CLASSES	((0x01 << LOG_CLASSES_NUM) - 1)
+
+// ----------------------------------------------------------------------------
+// Variables section - add all global variables here:
+
+static uint64_t rtcNow; // 1/256 s since 2000-01-01
+static uint8_t nvConfig;
+static uint8_t config;
+
+// records put into log, in order
+static uint8_t refId[TEST_RECORDS_MAX];
+static uint8_t refLen[TEST_RECORDS_MAX];
+static uint64_t refTime[TEST_RECORDS_MAX];
+static uint8_t refPayload[TEST_RECORDS_MAX][LOG_MSG_MAX_LEN];
+static uint32_t refCount;
+static uint32_t refNext; // first record not read yet
+static uint8_t resync; // records before first one drained may be overwritten
+static uint32_t skipped; // records overwritten before first one drained
+
+// per id counts of records put, read and reported suppressed
+static uint32_t putCount[TEST_IDS_NUM];
+static uint32_t gotCount[TEST_IDS_NUM];
+static uint32_t repeatedCount[TEST_IDS_NUM];
+static uint64_t lastTime;
+
+// ----------------------------------------------------------------------------
+// Function section - add all local functions here:
+
+void RtcReadLinearTime(uint32_t *sec, uint8_t *sub) {
+	*sec = rtcNow >> 8;
+	*sub = rtcNow;
+}
+
+uint16_t NvReadVariableU8(uint16_t VirtAddress, uint8_t *pVar) {
+	*pVar = nvConfig;
+	return NV_READ_VARIABLE_SUCCESS;
+}
+
+uint16_t EE_WriteVariable(uint16_t VirtAddress, uint16_t Data) {
+	HOST_CHECK(VirtAddress == LOG_CONFIG_NV_ADDR, "nv address 0x%X", VirtAddress);
+	nvConfig = Data;
+	return 0;
+}
+
+static void Command(uint8_t c, uint8_t d) {
+	uint8_t cmd[2] = {c, d};
+
+	hostIpsr = TEST_I2C_IRQ_IPSR;
+	HOST_CHECK(LoggingWriteConfigCmd(cmd, 2) == 0, "command %u %u", c, d);
+	hostIpsr = 0;
+}
+
+// Clears log and reference, RTC continues from sec
+static void Start(uint8_t cfg, uint32_t sec) {
+	nvConfig = ~cfg;
+	LoggingInit();
+	config = cfg;
+	Command(3, LOG_DRAIN_MAX_LEN);
+	rtcNow = (uint64_t)sec << 8;
+	refCount = 0;
+	refNext = 0;
+	lastTime = rtcNow;
+	memset(putCount, 0, sizeof(putCount));
+	memset(gotCount, 0, sizeof(gotCount));
+	memset(repeatedCount, 0, sizeof(repeatedCount));
+}
+
+// Puts record with random payload, from interrupt handler sometimes
+static void Put(LogMsgId_T id, uint8_t len) {
+	uint8_t enabled = config & (0x01 << ((id > 3 && id < 10) ? id - 3 : 0));
+	uint8_t *p;
+	uint8_t i;
+
+	putCount[id]++;
+	if (rand() % 4 == 0) hostIpsr = TEST_I2C_IRQ_IPSR;
+	p = LoggingInitMessage(id, len);
+	hostIpsr = 0;
+	HOST_CHECK(hostPrimask == 0, "interrupts left disabled");
+	if (!enabled) {
+		HOST_CHECK(p == NULL, "disabled id %u logged, config 0x%02X", id, config);
+		return;
+	}
+	if (p == NULL) return; // suppressed by rate limit
+	if (refCount >= TEST_RECORDS_MAX) return;
+	refId[refCount] = id;
+	refLen[refCount] = len;
+	refTime[refCount] = rtcNow;
+	for (i = 0; i < len; i++) {
+		HOST_CHECK(p[i] == 0, "payload not cleared");
+		p[i] = rand();
+		refPayload[refCount][i] = p[i];
+	}
+	refCount++;
+}
+
+static uint8_t SameRecord(uint32_t k, uint8_t id, uint8_t len, uint64_t t, const uint8_t *payload) {
+	return id == refId[k] && len == refLen[k] && t == refTime[k] && memcmp(payload, refPayload[k], len) == 0;
+}
+
+// Reads frames until no more unread records, returns flags
+static uint8_t Drain(void) {
+	uint8_t data[LOG_DRAIN_MAX_LEN];
+	uint8_t flags = 0;
+	uint16_t len, pos, end;
+	uint64_t t, rt;
+	uint32_t delta;
+	uint8_t id, plen, abs, first, sh, b;
+
+	do {
+		len = 0;
+		hostIpsr = TEST_I2C_IRQ_IPSR;
+		LoggingReadMessageCmd(data, &len);
+		hostIpsr = 0;
+		HOST_CHECK(len == LOG_DRAIN_MAX_LEN && data[0] + LOG_DRAIN_HEADER_LEN <= len, "frame length %u records %u", len, data[0]);
+		flags |= data[1];
+		t = ((uint64_t)(data[2] | (data[3] << 8) | (data[4] << 16) | ((uint32_t)data[5] << 24)) << 8) | data[6];
+		pos = LOG_DRAIN_HEADER_LEN;
+		end = LOG_DRAIN_HEADER_LEN + data[0];
+		first = 1;
+		while (pos < end) {
+			id = data[pos] & ~LOG_ID_ABS_TIME;
+			abs = data[pos] & LOG_ID_ABS_TIME;
+			plen = data[pos + 1];
+			pos += LOG_RECORD_HEADER_LEN;
+			if (abs) {
+				rt = ((uint64_t)(data[pos] | (data[pos + 1] << 8) | (data[pos + 2] << 16) | ((uint32_t)data[pos + 3] << 24)) << 8) | data[pos + 4];
+				pos += 5;
+			} else {
+				delta = 0;
+				sh = 0;
+				do {
+					b = data[pos++];
+					delta |= (uint32_t)(b & 0x7F) << sh;
+					sh += 7;
+				} while (b & 0x80);
+				rt = t + delta;
+			}
+			// first record time is frame header time
+			if (!first || abs) t = rt;
+			first = 0;
+			HOST_CHECK(t >= lastTime, "record id %u time %llu before %llu", id, (unsigned long long)t, (unsigned long long)lastTime);
+			lastTime = t;
+			if (id == LOG_REPEATED) {
+				HOST_CHECK(plen == 3 && data[pos] < LOG_REPEATED, "repeated record length %u id %u", plen, data[pos]);
+				repeatedCount[data[pos] % TEST_IDS_NUM] += data[pos + 1] | (data[pos + 2] << 8);
+			} else if (id < TEST_IDS_NUM && refNext < refCount) {
+				gotCount[id]++;
+				for (; resync && refNext < refCount - 1 && !SameRecord(refNext, id, plen, t, data + pos); refNext++) skipped++;
+				resync = 0;
+				if (!SameRecord(refNext, id, plen, t, data + pos)) {
+					HOST_CHECK(0, "record %u id %u length %u time %llu expected %u %u %llu", refNext, id, plen,
+							(unsigned long long)t, refId[refNext], refLen[refNext], (unsigned long long)refTime[refNext]);
+				}
+				refNext++;
+			} else {
+				HOST_CHECK(0, "record id %u not put", id);
+			}
+			pos += plen;
+		}
+		HOST_CHECK(pos == end, "record crosses frame end");
+	} while (data[1] & TEST_FLAG_MORE);
+	HOST_CHECK(refNext == refCount, "%u records not read", refCount - refNext);
+
+	return flags;
+}
+
+static void TestTimestamps(void) {
+	uint32_t k;
+	LogMsgId_T id;
+
+	// records within one second are ordered and spaced in 1/256 s, no rate limit
+	Start(TEST_ALL_CLASSES, 700000000 + rand() % 1000);
+	for (k = 0; k < 5000; k++) {
+		rtcNow += rand() % 3 ? rand() % 8 : rand() % 100000;
+		id = LOG_MESSAGE + rand() % (ALARM_WRITE - LOG_MESSAGE + 1);
+		Put(id, rand() % (LOG_MSG_MAX_LEN + 1));
+		if (rand() % 40 == 0 || refCount - refNext >= 48) HOST_CHECK(!(Drain() & TEST_FLAG_LOST), "records lost");
+	}
+	HOST_CHECK(!(Drain() & TEST_FLAG_LOST), "records lost");
+	for (id = LOG_MESSAGE; id <= ALARM_WRITE; id++) {
+		HOST_CHECK(gotCount[id] == putCount[id], "id %u read %u of %u", id, gotCount[id], putCount[id]);
+	}
+	HOST_CHECK(repeatedCount[LOG_5VREG_ON] == 0, "repeated record without rate limit");
+}
+
+// Records put without drain overwrite oldest ones, newest ones are read back intact and again after rewind
+static void TestFlood(void) {
+	uint32_t k, n;
+	uint8_t flags;
+
+	for (k = 0; k < 20; k++) {
+		Start(TEST_ALL_CLASSES, 700000000 + rand() % 1000);
+		for (n = rand() % (8 * LOG_BUF_SIZE / LOG_RECORD_HEADER_LEN); n; n--) {
+			rtcNow += rand() % 3 ? rand() % 8 : rand() % 100000;
+			Put(LOG_MESSAGE + rand() % (ALARM_WRITE - LOG_MESSAGE + 1), rand() % (LOG_MSG_MAX_LEN + 1));
+		}
+		resync = 1;
+		skipped = 0;
+		flags = Drain();
+		HOST_CHECK(!(flags & TEST_FLAG_LOST) == !skipped, "lost flag 0x%02X with %u of %u records overwritten",
+				flags, skipped, refCount);
+		HOST_CHECK(refCount == 0 || skipped < refCount, "all %u records overwritten", refCount);
+
+		// rewind reads retained records again from oldest one
+		Command(0, 0);
+		refNext = skipped;
+		lastTime = 0;
+		HOST_CHECK(!(Drain() & TEST_FLAG_LOST), "records lost after rewind");
+	}
+}
+
+static void TestStorm(void) {
+	uint32_t ms, id, maxGot;
+
+	// 5V regulator flapping every 20 ms for 10 s, wake-up every 1.5 s, message burst for 1 s
+	Start(TEST_ALL_CLASSES | LOG_CONFIG_RATE_LIMIT, 700000000 + rand() % 1000);
+	for (ms = 0; ms < 20000; ms += 10) {
+		rtcNow += 2 + ((ms % 30) == 0);
+		if (ms < 10000 && ms % 20 == 0) Put((ms / 20) & 1 ? LOG_5VREG_OFF : LOG_5VREG_ON, 21);
+		if (ms % 1500 == 0) Put(WAKEUP_EVT, 13);
+		if (ms > 5000 && ms < 6000) Put(LOG_MESSAGE, 0);
+		LoggingTask();
+		if (ms % 1000 == 0) HOST_CHECK(!(Drain() & TEST_FLAG_LOST), "records lost");
+	}
+	HOST_CHECK(!(Drain() & TEST_FLAG_LOST), "records lost");
+
+	// every record is read or counted once quiet class reports it
+	for (id = LOG_MESSAGE; id < LOG_REPEATED; id++) {
+		HOST_CHECK(gotCount[id] + repeatedCount[id] == putCount[id], "id %u put %u read %u repeated %u",
+				id, putCount[id], gotCount[id], repeatedCount[id]);
+	}
+	// burst then one record per second for 10 s of flapping, 4 per second for 1 s of messages
+	maxGot = LOG_RATE_BURST + 10 + 1;
+	HOST_CHECK(gotCount[LOG_5VREG_ON] <= maxGot && gotCount[LOG_5VREG_OFF] <= maxGot, "regulator records %u %u",
+			gotCount[LOG_5VREG_ON], gotCount[LOG_5VREG_OFF]);
+	HOST_CHECK(repeatedCount[LOG_5VREG_ON] > 0 && repeatedCount[LOG_5VREG_OFF] > 0, "regulator records not coalesced");
+	HOST_CHECK(gotCount[LOG_MESSAGE] <= LOG_RATE_BURST + 4 + 1, "message records %u", gotCount[LOG_MESSAGE]);
+	// wake-up events are under their rate
+	HOST_CHECK(gotCount[WAKEUP_EVT] == putCount[WAKEUP_EVT], "wake-up events limited %u of %u",
+			gotCount[WAKEUP_EVT], putCount[WAKEUP_EVT]);
+
+	// same storm without rate limit bit keeps every record
+	Start(TEST_ALL_CLASSES, 700000000);
+	for (ms = 0; ms < 2000; ms += 10) {
+		rtcNow += 3;
+		Put(LOG_5VREG_ON + rand() % 2, 21);
+		if (ms % 100 == 0) Drain();
+	}
+	Drain();
+	HOST_CHECK(gotCount[LOG_5VREG_ON] + gotCount[LOG_5VREG_OFF] == 200, "records %u without rate limit",
+			gotCount[LOG_5VREG_ON] + gotCount[LOG_5VREG_OFF]);
+}
+
+static void TestConfig(void) {
+	uint8_t data[LOG_MSG_LEN];
+	uint16_t len = 0;
+	uint32_t k;
+	LogMsgId_T id;
+
+	// only enabled classes are logged
+	for (k = 0; k < 20; k++) {
+		Start((rand() & (TEST_ALL_CLASSES | LOG_CONFIG_RATE_LIMIT)) | (0x01 << (k % LOG_CLASSES_NUM)), 600000000);
+		for (id = LOG_MESSAGE; id <= ALARM_WRITE; id++) {
+			rtcNow += 300;
+			Put(id, 4);
+		}
+		Drain();
+	}
+
+	// configuration write is kept in NV inverted and read back with rate limit bit
+	Start(0x01, 600000000);
+	Command(1, TEST_ALL_CLASSES | LOG_CONFIG_RATE_LIMIT);
+	HOST_CHECK(nvConfig == (uint8_t)~(TEST_ALL_CLASSES | LOG_CONFIG_RATE_LIMIT), "NV config 0x%02X", nvConfig);
+	LoggingReadMessageCmd(data, &len);
+	HOST_CHECK(len == LOG_MSG_LEN && data[3] == (TEST_ALL_CLASSES | LOG_CONFIG_RATE_LIMIT), "config read 0x%02X", data[3]);
+}
+
+int main(int argc, char *argv[]) {
+	int seed = argc > 1 ? atoi(argv[1]) : 1;
+	char name[32];
+
+	srand(seed);
+
+	TestTimestamps();
+	TestFlood();
+	TestStorm();
+	TestConfig();
+
+	snprintf(name, sizeof(name), "test_logging seed %d", seed);
+	return HostReport(name);
+}
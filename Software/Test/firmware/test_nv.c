@@ -0,0 +1,299 @@
+// ----------------------------------------------------------------------------
+/*!
+ * @file         test_nv.c
+ * @date       19 October 2026
+ * @brief       NV layer tests on emulated eeprom: write-if-changed
+ *                  transactions, staging replace and overflow, all or
+ *                  none of transaction visible after power loss, save
+ *                  queue and transactions used from interrupt handlers.
+ */
+// ----------------------------------------------------------------------------
+// Include section - add all #includes here:
+
+#include <setjmp.h>
+#include <stdlib.h>
+#include <string.h>
+#include "nv.h"
+
+// ----------------------------------------------------------------------------
+// Defines section - add all #defines here:
+
+#define TEST_I2C_IRQ_IPSR	39 // exception number of I2C1 interrupt
+
+// ----------------------------------------------------------------------------
+// Variables section - add all global variables here:
+
+static uint8_t irqRuns;
+
+// ----------------------------------------------------------------------------
+// Function section - add all local functions here:
+
+static uint16_t ReadVar(uint16_t addr) {
+	uint16_t data = 0;
+	HOST_CHECK(EE_ReadVariable(addr, &data) == 0, "var %u not stored", addr);
+	return data;
+}
+
+static void TestTransactionChanged(void) {
+	uint32_t programs;
+
+	NvTransactionBegin();
+	NvTransactionStage(NV_ADDR_RESERVED0, 0x1111);
+	NvTransactionStage(NV_ADDR_RESERVED5, 0x2222);
+	NvTransactionStageU8(NV_RUN_PIN_CONFIG, 0x03);
+	programs = hostFlashPrograms;
+	HOST_CHECK(NvTransactionCommit() == HAL_OK, "commit");
+	// transaction record, three records and commit record, data and address half words
+	HOST_CHECK(hostFlashPrograms - programs == 10, "commit of 3 programmed %u", hostFlashPrograms - programs);
+	HOST_CHECK(ReadVar(NV_ADDR_RESERVED0) == 0x1111, "first var");
+	HOST_CHECK(ReadVar(NV_ADDR_RESERVED5) == 0x2222, "second var");
+	HOST_CHECK(ReadVar(NV_RUN_PIN_CONFIG) == 0xFC03, "u8 var");
+
+	// unchanged variables are skipped, only changed one is written
+	NvTransactionBegin();
+	NvTransactionStage(NV_ADDR_RESERVED0, 0x1111);
+	NvTransactionStage(NV_ADDR_RESERVED5, 0x2233);
+	NvTransactionStageU8(NV_RUN_PIN_CONFIG, 0x03);
+	programs = hostFlashPrograms;
+	HOST_CHECK(NvTransactionCommit() == HAL_OK, "commit");
+	HOST_CHECK(hostFlashPrograms - programs == 2, "commit of 1 changed programmed %u", hostFlashPrograms - programs);
+	HOST_CHECK(ReadVar(NV_ADDR_RESERVED5) == 0x2233, "changed var");
+
+	// nothing changed, nothing written
+	NvTransactionBegin();
+	NvTransactionStage(NV_ADDR_RESERVED0, 0x1111);
+	NvTransactionStage(NV_ADDR_RESERVED5, 0x2233);
+	programs = hostFlashPrograms;
+	HOST_CHECK(NvTransactionCommit() == HAL_OK, "empty commit");
+	HOST_CHECK(hostFlashPrograms == programs, "unchanged commit programmed %u", hostFlashPrograms - programs);
+}
+
+static void TestTransactionReplace(void) {
+	NvTransactionBegin();
+	NvTransactionStage(NV_ADDR_RESERVED0, 0x0001);
+	NvTransactionStage(NV_ADDR_RESERVED5, 0x0002);
+	NvTransactionStage(NV_ADDR_RESERVED0, 0x0003);
+	HOST_CHECK(NvTransactionCommit() == HAL_OK, "commit");
+	HOST_CHECK(ReadVar(NV_ADDR_RESERVED0) == 0x0003, "restaged var keeps last value");
+
+	// staging back to stored value still writes it, value was staged changed first
+	NvTransactionBegin();
+	NvTransactionStage(NV_ADDR_RESERVED0, 0x0004);
+	NvTransactionStage(NV_ADDR_RESERVED0, 0x0003);
+	HOST_CHECK(NvTransactionCommit() == HAL_OK, "commit");
+	HOST_CHECK(ReadVar(NV_ADDR_RESERVED0) == 0x0003, "restaged to stored value");
+}
+
+static void TestTransactionOverflow(void) {
+	uint32_t programs;
+	uint16_t i;
+
+	NvTransactionBegin();
+	for (i = 0; i <= EE_TRANSACTION_MAX_VARS; i++) {
+		NvTransactionStage(NV_START_ID + i, i);
+	}
+	programs = hostFlashPrograms;
+	HOST_CHECK(NvTransactionCommit() == PAGE_FULL, "overflow commit accepted");
+	HOST_CHECK(hostFlashPrograms == programs, "overflow commit programmed flash");
+
+	// next transaction starts clean
+	NvTransactionBegin();
+	for (i = 0; i < EE_TRANSACTION_MAX_VARS; i++) {
+		NvTransactionStage(NV_START_ID + i, 0x100 + i);
+	}
+	HOST_CHECK(NvTransactionCommit() == HAL_OK, "full transaction");
+	for (i = 0; i < EE_TRANSACTION_MAX_VARS; i++) {
+		HOST_CHECK(ReadVar(NV_START_ID + i) == 0x100 + i, "full transaction var %u", i);
+	}
+}
+
+static void TestTransactionPowerLoss(void) {
+	volatile int32_t cut;
+	uint16_t i, stored, base, newCount;
+	uint16_t status;
+
+	// power lost at each flash operation of 8 variable commit, program interrupted
+	// with random bits of half word left unprogrammed, 22 operations per round
+	for (cut = 0; cut < 22 * 20; cut++) {
+		base = (uint16_t)(cut << 5);
+		NvTransactionBegin();
+		for (i = 0; i < 8; i++) NvTransactionStage(NV_START_ID + i, base + i);
+		status = NvTransactionCommit();
+		HOST_CHECK(status == HAL_OK, "commit before cut %d status %u", (int)cut, status);
+		// main loop passes store commit buffered while log makes room
+		for (i = 0; i < 100 && EE_PendingWrites(); i++) NvTask();
+		HOST_CHECK(EE_PendingWrites() == 0, "commit before cut %d not stored", (int)cut);
+
+		hostFlashCutIn = cut % 22;
+		if (setjmp(hostFlashCut) == 0) {
+			NvTransactionBegin();
+			for (i = 0; i < 8; i++) NvTransactionStage(NV_START_ID + i, base + 0x10 + i);
+			NvTransactionCommit();
+		}
+		hostFlashCutIn = -1;
+
+		status = EE_Init();
+		HOST_CHECK(status == HAL_OK, "init after cut %d status %u", (int)cut, status);
+		newCount = 0;
+		for (i = 0; i < 8; i++) {
+			stored = ReadVar(NV_START_ID + i);
+			if (stored == base + 0x10 + i) {
+				newCount++;
+			} else {
+				HOST_CHECK(stored == base + i, "cut %d var %u 0x%04X", (int)cut, i, stored);
+			}
+		}
+		HOST_CHECK(newCount == 0 || newCount == 8, "cut %d left %u of 8 variables written", (int)cut, newCount);
+	}
+}
+
+static void SaveStatus(uint8_t status[9]) {
+	uint16_t len = 0;
+	NvSaveStatusGetCmd(status, &len);
+	HOST_CHECK(len == 9, "status length %u", len);
+}
+
+static void TestSaveQueue(void) {
+	uint8_t status[9], cmd;
+	uint16_t i;
+
+	cmd = 0x80;
+	NvSaveStatusSetCmd(&cmd, 1);
+	HOST_CHECK(NvSaveParameterReq(NV_ADDR_RESERVED0, 0x0101) == 0, "request");
+	HOST_CHECK(NvSaveParameterReq(NV_ADDR_RESERVED0, 0x0102) == 0, "replace request");
+	SaveStatus(status);
+	HOST_CHECK(status[0] == 1, "replaced request queued twice, depth %u", status[0]);
+
+	// rate limited, one save per period
+	NvTask();
+	HOST_CHECK(ReadVar(NV_ADDR_RESERVED0) != 0x0102, "saved before period");
+	hostTick += NV_SAVE_PERIOD_MS;
+	NvTask();
+	HOST_CHECK(ReadVar(NV_ADDR_RESERVED0) == 0x0102, "queued save");
+	SaveStatus(status);
+	HOST_CHECK(status[0] == 0, "depth after save %u", status[0]);
+
+	// full queue drops request
+	for (i = 0; i <= NV_SAVE_QUEUE_SIZE; i++) {
+		HOST_CHECK(NvSaveParameterReq(NV_START_ID + i, 0x200 + i) == (i == NV_SAVE_QUEUE_SIZE), "request %u", i);
+	}
+	SaveStatus(status);
+	HOST_CHECK(status[0] == NV_SAVE_QUEUE_SIZE && status[1] == NV_SAVE_QUEUE_SIZE, "depth %u max %u", status[0], status[1]);
+	HOST_CHECK(status[3] == 1 && status[4] == 0, "dropped %u", status[3]);
+
+	// flush writes all without rate limit
+	cmd = 0x01;
+	NvSaveStatusSetCmd(&cmd, 1);
+	for (i = 0; i < NV_SAVE_QUEUE_SIZE; i++) NvTask();
+	for (i = 0; i < NV_SAVE_QUEUE_SIZE; i++) {
+		HOST_CHECK(ReadVar(NV_START_ID + i) == 0x200 + i, "flushed var %u", i);
+	}
+	SaveStatus(status);
+	HOST_CHECK(status[0] == 0 && status[5] == 0 && status[6] == 0, "depth %u failed %u", status[0], status[5]);
+}
+
+// I2C command handler requesting save of variable being written by NvTask, eeprom
+// maintenance before it is taken from queue does not count
+static void IrqSaveCb(void) {
+	uint8_t status[9];
+
+	SaveStatus(status);
+	if (irqRuns || status[0]) return;
+	irqRuns++;
+	hostIpsr = TEST_I2C_IRQ_IPSR;
+	NvSaveParameterReq(NV_ADDR_RESERVED5, 0x0302);
+	hostIpsr = 0;
+}
+
+// I2C command handler with own transaction in the middle of main loop one
+static void IrqTransaction(uint16_t base) {
+	hostIpsr = TEST_I2C_IRQ_IPSR;
+	NvTransactionBegin();
+	NvTransactionStage(NV_START_ID + 10, base);
+	NvTransactionStage(NV_START_ID + 11, base + 1);
+	HOST_CHECK(NvTransactionCommit() == HAL_OK, "interrupt commit");
+	hostIpsr = 0;
+}
+
+static void IrqTransactionCb(void) {
+	if (irqRuns) return;
+	irqRuns++;
+	IrqTransaction(0x0600);
+}
+
+static void TestSaveQueueInterrupt(void) {
+	uint8_t status[9];
+
+	// request arriving while same variable is written is not lost
+	NvSaveParameterReq(NV_ADDR_RESERVED5, 0x0301);
+	hostTick += NV_SAVE_PERIOD_MS;
+	irqRuns = 0;
+	hostFlashOpCb = IrqSaveCb;
+	NvTask();
+	hostFlashOpCb = NULL;
+	HOST_CHECK(irqRuns == 1, "interrupt not run");
+	HOST_CHECK(ReadVar(NV_ADDR_RESERVED5) == 0x0301, "first save");
+	SaveStatus(status);
+	HOST_CHECK(status[0] == 1, "request in interrupt not queued, depth %u", status[0]);
+	hostTick += NV_SAVE_PERIOD_MS;
+	NvTask();
+	HOST_CHECK(ReadVar(NV_ADDR_RESERVED5) == 0x0302, "save requested in interrupt 0x%04X", ReadVar(NV_ADDR_RESERVED5));
+}
+
+static void TestTransactionInterrupt(void) {
+	uint32_t programs;
+	uint16_t i;
+
+	// interrupt transaction between stages of main loop one, staging is not mixed
+	NvTransactionBegin();
+	NvTransactionStage(NV_START_ID + 0, 0x0501);
+	NvTransactionStage(NV_START_ID + 1, 0x0502);
+	programs = hostFlashPrograms;
+	IrqTransaction(0x0510);
+	HOST_CHECK(hostFlashPrograms == programs, "flash programmed from interrupt");
+	NvTransactionStage(NV_START_ID + 2, 0x0503);
+	HOST_CHECK(NvTransactionCommit() == HAL_OK, "main commit");
+	for (i = 0; i < 3; i++) {
+		HOST_CHECK(ReadVar(NV_START_ID + i) == 0x0501 + i, "main var %u", i);
+	}
+	HOST_CHECK(ReadVar(NV_START_ID + 10) == 0x0510, "interrupt var");
+	HOST_CHECK(ReadVar(NV_START_ID + 11) == 0x0511, "interrupt var");
+	// main loop commit waited after buffered interrupt one
+	for (i = 0; i < 100 && EE_PendingWrites(); i++) NvTask();
+	HOST_CHECK(EE_PendingWrites() == 0, "%u writes buffered", EE_PendingWrites());
+
+	// interrupt transaction while main loop one is written
+	NvTransactionBegin();
+	for (i = 0; i < 3; i++) NvTransactionStage(NV_START_ID + i, 0x0701 + i);
+	irqRuns = 0;
+	hostFlashOpCb = IrqTransactionCb;
+	HOST_CHECK(NvTransactionCommit() == HAL_OK, "main commit");
+	hostFlashOpCb = NULL;
+	HOST_CHECK(irqRuns == 1, "interrupt not run");
+	for (i = 0; i < 3; i++) {
+		HOST_CHECK(ReadVar(NV_START_ID + i) == 0x0701 + i, "main var %u", i);
+	}
+	HOST_CHECK(ReadVar(NV_START_ID + 10) == 0x0600, "deferred interrupt var");
+	NvTask();
+	HOST_CHECK(ReadVar(NV_START_ID + 11) == 0x0601, "interrupt var after task");
+}
+
+int main(int argc, char *argv[]) {
+	int seed = argc > 1 ? atoi(argv[1]) : 1;
+	char name[32];
+
+	srand(seed);
+	HostFlashInit();
+	NvInit();
+
+	TestTransactionChanged();
+	TestTransactionReplace();
+	TestTransactionOverflow();
+	TestTransactionPowerLoss();
+	TestSaveQueue();
+	TestSaveQueueInterrupt();
+	TestTransactionInterrupt();
+
+	snprintf(name, sizeof(name), "test_nv seed %d", seed);
+	return HostReport(name);
+}
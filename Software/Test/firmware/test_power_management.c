@@ -0,0 +1,380 @@
+// ----------------------------------------------------------------------------
+/*!
+ * @file         test_power_management.c
+ * @date       19 October 2026
+ * @brief       Wake-up trigger to 5V on latency tests on simulated main
+ *                  loop: RTC alarm and input power events at random time
+ *                  while host is off and during host shutdown, latency
+ *                  distributions of both triggers measured from event are
+ *                  compared with each other and with statistics read with
+ *                  command 0x65. Reset of powered host is not counted and
+ *                  waits for silent host, wake-up on charge is posted on
+ *                  edge only.
+ *                  Usage: test_power_management [seed]
+ */
+// ----------------------------------------------------------------------------
+// Include section - add all #includes here:
+
+#include <stdlib.h>
+#include <string.h>
+#include "power_management.h"
+#include "charger_bq2416x.h"
+#include "fuel_gauge_lc709203f.h"
+#include "battery.h"
+#include "power_source.h"
+#include "button.h"
+#include "logging.h"
+#include "flash_log.h"
+#include "time_count.h"
+#include "nv.h"
+
+// ----------------------------------------------------------------------------
+// Defines section - add all #defines here:
+
+#define TEST_I2C_IRQ_IPSR	39 // exception number of I2C1 interrupt
+#define TEST_TRIALS	500
+#define TEST_INPUT_PRESENT	0x10 // charger status register, input present
+#define TEST_RSOC	800 // 80.0%
+#define TEST_WAKEUP_ON_CHARGE	50 // %
+#define TEST_NONE	0xFFFFFFFF
+
+// ----------------------------------------------------------------------------
+// Variables section - add all global variables here:
+
+uint8_t resetStatus;
+uint8_t noBatteryTurnOn;
+uint32_t lastHostCommandTimer;
+uint8_t regs[8];
+uint16_t batteryVoltage;
+uint16_t batteryRsoc;
+int8_t batteryTemp;
+BatteryStatus_T batteryStatus;
+PowerSourceStatus_T powerInStatus;
+PowerSourceStatus_T power5vIoStatus;
+uint8_t pow5vInDetStatus;
+
+extern uint32_t lastWakeupTimer;
+
+static uint32_t on5vTime; // tick 5V was turned on
+static uint32_t boostOffs;
+static uint32_t alarmTime; // tick of RTC alarm, TEST_NONE if not pending
+static uint32_t inputTime; // tick input power is connected, TEST_NONE if not pending
+static uint32_t postTime; // tick trigger was seen by main loop
+
+// per trigger latencies measured from event and from post, ms
+typedef struct {
+	uint32_t count;
+	uint32_t min, max, sum;
+	uint32_t postMin, postMax, postSum;
+} TestLatency_T;
+
+static TestLatency_T measured[WAKEUP_TRIGGER_NUM];
+
+// ----------------------------------------------------------------------------
+// Function section - add all local functions here:
+
+uint16_t EE_ReadVariable(uint16_t VirtAddress, uint16_t *Data) {
+	return 1;
+}
+
+uint16_t EE_WriteVariable(uint16_t VirtAddress, uint16_t Data) {
+	return 0;
+}
+
+uint16_t NvReadVariableU8(uint16_t VirtAddress, uint8_t *pVar) {
+	return 1;
+}
+
+int8_t Turn5vBoost(uint8_t onOff) {
+	if (onOff) {
+		if (!(hostGPIOA.IDR & GPIO_PIN_10)) on5vTime = hostTick;
+		hostGPIOA.IDR |= GPIO_PIN_10;
+	} else {
+		hostGPIOA.IDR &= ~GPIO_PIN_10;
+		boostOffs++;
+	}
+	return 0;
+}
+
+void HAL_GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_Init) {
+}
+
+void ButtonRemoveEvent(uint8_t b) {
+}
+
+uint8_t *LoggingInitMessage(LogMsgId_T id, uint8_t len) {
+	return NULL;
+}
+
+void FlashLogPutStatus(FlashLogEventId_T id, uint8_t data0) {
+}
+
+int16_t Get5vIoVoltage() {
+	return 0;
+}
+
+int32_t GetLoadCurrent(void) {
+	return 0;
+}
+
+// Main loop pass: alarm is evaluated before power management task, charger status is polled
+static void Pass(void) {
+	hostTick += TICK_PERIOD_MS;
+	if (alarmTime != TEST_NONE && (int32_t)(hostTick - alarmTime) >= 0) {
+		alarmTime = TEST_NONE;
+		postTime = hostTick;
+		PowerMngmtPostWakeupEvent(WAKEUP_TRIGGER_RTC);
+	}
+	if (inputTime != TEST_NONE && (int32_t)(hostTick - inputTime) >= 0) {
+		inputTime = TEST_NONE;
+		postTime = hostTick;
+		regs[0] = TEST_INPUT_PRESENT;
+	}
+	PowerManagementTask();
+}
+
+static void Run(uint32_t ms) {
+	uint32_t start = hostTick;
+	while (hostTick - start < ms) Pass();
+}
+
+static void HostOff(void) {
+	hostGPIOA.IDR &= ~GPIO_PIN_10;
+	regs[0] = 0;
+	alarmTime = TEST_NONE;
+	inputTime = TEST_NONE;
+	Run(200);
+}
+
+static void WakeupOnCharge(uint8_t percent) {
+	hostIpsr = TEST_I2C_IRQ_IPSR;
+	PowerMngmtSetWakeupOnChargeCmd(&percent, 1);
+	hostIpsr = 0;
+}
+
+// Reads latency statistics of trigger with command 0x65: count, last, min, max, average
+static void ReadLatency(WakeupTrigger_T trigger, uint16_t v[5]) {
+	uint8_t d[16];
+	uint8_t sel = trigger;
+	uint16_t len = 0;
+	uint8_t i;
+
+	hostIpsr = TEST_I2C_IRQ_IPSR;
+	PowerMngmtSetWakeupLatencyCmd(&sel, 1);
+	PowerMngmtGetWakeupLatencyCmd(d, &len);
+	hostIpsr = 0;
+	HOST_CHECK(len == 11 && d[0] == trigger, "latency read length %u trigger %u", len, d[0]);
+	for (i = 0; i < 5; i++) v[i] = d[1 + 2 * i] | (d[2 + 2 * i] << 8);
+}
+
+static void ResetLatency(void) {
+	uint8_t d = 0x80;
+	uint16_t v[5];
+	uint8_t i;
+
+	hostIpsr = TEST_I2C_IRQ_IPSR;
+	PowerMngmtSetWakeupLatencyCmd(&d, 1);
+	hostIpsr = 0;
+	memset(measured, 0, sizeof(measured));
+	for (i = 0; i < WAKEUP_TRIGGER_NUM; i++) {
+		ReadLatency(i, v);
+		HOST_CHECK(v[0] == 0 && v[1] == 0 && v[2] == 0 && v[3] == 0 && v[4] == 0,
+				"trigger %u after reset: count %u last %u min %u max %u avg %u", i, v[0], v[1], v[2], v[3], v[4]);
+	}
+}
+
+static void Measure(WakeupTrigger_T trigger, uint32_t eventTime) {
+	TestLatency_T *m = &measured[trigger];
+	uint32_t lat = on5vTime - eventTime;
+	uint32_t post = on5vTime - postTime;
+
+	if (!m->count || lat < m->min) m->min = lat;
+	if (lat > m->max) m->max = lat;
+	if (!m->count || post < m->postMin) m->postMin = post;
+	if (post > m->postMax) m->postMax = post;
+	m->sum += lat;
+	m->postSum += post;
+	m->count++;
+}
+
+// Event at random time while host is off or shuts down, 5V has to be turned on within pass after
+// event or after shutdown ends
+static void Trial(WakeupTrigger_T trigger, uint8_t shutdown) {
+	uint32_t eventTime, offTime = 0;
+	uint8_t code = 1 + rand() % 10;
+
+	if (shutdown) {
+		// host sends power off command and halts, 5V is cut after delay
+		hostGPIOA.IDR |= GPIO_PIN_10;
+		MS_TIME_COUNTER_INIT(lastHostCommandTimer);
+		PowerMngmtSchedulePowerOff(code);
+		offTime = hostTick + code * 1024;
+		eventTime = hostTick + 1 + rand() % (code * 1024 - 1);
+	} else {
+		eventTime = hostTick + 1 + rand() % 1000;
+	}
+	if (trigger == WAKEUP_TRIGGER_RTC) {
+		alarmTime = eventTime;
+	} else {
+		batteryRsoc = TEST_RSOC;
+		WakeupOnCharge(TEST_WAKEUP_ON_CHARGE);
+		inputTime = eventTime;
+	}
+
+	on5vTime = TEST_NONE;
+	boostOffs = 0;
+	while (on5vTime == TEST_NONE && (int32_t)(hostTick - eventTime) < 20000) Pass();
+	HOST_CHECK(on5vTime != TEST_NONE, "trigger %u shutdown %u: no wake-up", trigger, shutdown);
+	if (on5vTime == TEST_NONE) return;
+
+	if (shutdown) {
+		HOST_CHECK(boostOffs == 1, "trigger %u: 5V cut %u times in shutdown", trigger, boostOffs);
+		HOST_CHECK(on5vTime > offTime && on5vTime - offTime <= 2 * TICK_PERIOD_MS, "trigger %u: 5V on %u ms after shutdown",
+				trigger, on5vTime - offTime);
+	} else {
+		HOST_CHECK(on5vTime - eventTime < TICK_PERIOD_MS, "trigger %u: 5V on %u ms after event", trigger, on5vTime - eventTime);
+	}
+	Measure(trigger, eventTime);
+	HostOff();
+}
+
+// Statistics read from firmware are latencies from trigger post, measured from event they are longer
+// by time to next main loop pass
+static void Compare(WakeupTrigger_T trigger, const char *name) {
+	TestLatency_T *m = &measured[trigger];
+	uint16_t v[5];
+
+	ReadLatency(trigger, v);
+	HOST_CHECK(m->count, "%s: no wake-up", name);
+	if (!m->count) return;
+	HOST_CHECK(v[0] == m->count && v[2] == m->postMin && v[3] == m->postMax && v[4] == m->postSum / m->count,
+			"%s: firmware count %u min %u max %u avg %u, measured %u %u %u %u", name, v[0], v[2], v[3], v[4],
+			m->count, m->postMin, m->postMax, m->postSum / m->count);
+	HOST_CHECK(m->max - m->postMax < TICK_PERIOD_MS && m->sum / m->count - m->postSum / m->count < TICK_PERIOD_MS,
+			"%s: event to post adds more than main loop pass", name);
+	printf("%s: %u wake-ups, from event min %u avg %u max %u ms, reported min %u avg %u max %u ms\n", name,
+			m->count, m->min, m->sum / m->count, m->max, v[2], v[4], v[3]);
+}
+
+static void TestHostOff(void) {
+	uint32_t k;
+	double avg[2];
+
+	ResetLatency();
+	for (k = 0; k < TEST_TRIALS; k++) {
+		Trial(WAKEUP_TRIGGER_RTC, 0);
+		Trial(WAKEUP_TRIGGER_ON_CHARGE, 0);
+	}
+	Compare(WAKEUP_TRIGGER_RTC, "rtc alarm, host off");
+	Compare(WAKEUP_TRIGGER_ON_CHARGE, "input power, host off");
+
+	// both triggers wait for the same main loop pass
+	avg[0] = (double)measured[WAKEUP_TRIGGER_RTC].sum / TEST_TRIALS;
+	avg[1] = (double)measured[WAKEUP_TRIGGER_ON_CHARGE].sum / TEST_TRIALS;
+	HOST_CHECK(avg[0] - avg[1] < 2 && avg[1] - avg[0] < 2, "average latency rtc alarm %.1f ms, input power %.1f ms", avg[0], avg[1]);
+}
+
+static void TestShutdown(void) {
+	uint32_t k;
+
+	// host was talking until shutdown, wake-up of unpowered host does not wait 15s after last command
+	ResetLatency();
+	for (k = 0; k < TEST_TRIALS / 10; k++) {
+		Trial(WAKEUP_TRIGGER_RTC, 1);
+		Trial(WAKEUP_TRIGGER_ON_CHARGE, 1);
+	}
+	Compare(WAKEUP_TRIGGER_RTC, "rtc alarm, in shutdown");
+	Compare(WAKEUP_TRIGGER_ON_CHARGE, "input power, in shutdown");
+}
+
+static void TestPoweredHost(void) {
+	uint16_t v[5];
+	uint32_t start;
+
+	// running host is not reset by alarm, alarm after host stopped talking resets it 15s after
+	// last command
+	ResetLatency();
+	hostGPIOA.IDR |= GPIO_PIN_10;
+	MS_TIME_COUNTER_INIT(lastWakeupTimer);
+	on5vTime = TEST_NONE;
+	boostOffs = 0;
+	start = hostTick;
+	alarmTime = start + 1;
+	while (hostTick - start < 60000) {
+		Pass();
+		if (hostTick - start < 20000 && hostTick % 1000 == 0) {
+			MS_TIME_COUNTER_INIT(lastHostCommandTimer);
+			PowerMngmtHostPollEvent();
+		}
+		if (hostTick - start == 20000) alarmTime = hostTick + 500;
+		if (boostOffs) break;
+	}
+	HOST_CHECK(boostOffs == 1 && MS_TIME_COUNT(lastHostCommandTimer) > 15000 && MS_TIME_COUNT(lastHostCommandTimer) <= 15000 + TICK_PERIOD_MS,
+			"silent host power cycled %u ms after last command", MS_TIME_COUNT(lastHostCommandTimer));
+
+	// power cycle keeps 5V off for 100ms, latency of powered host is not counted
+	start = hostTick;
+	while (on5vTime == TEST_NONE && hostTick - start < 1000) Pass();
+	HOST_CHECK(on5vTime - start >= 100 && on5vTime - start <= 100 + TICK_PERIOD_MS, "5V back on after %u ms", on5vTime - start);
+	ReadLatency(WAKEUP_TRIGGER_RTC, v);
+	HOST_CHECK(v[0] == 0, "reset of powered host counted %u times", v[0]);
+	HostOff();
+}
+
+static void TestChargeEdge(void) {
+	uint16_t v[5];
+	uint32_t start;
+
+	// input power is connected while host runs, trigger is consumed by running host and not posted
+	// again on every pass, wake-up after shutdown is not counted from it
+	ResetLatency();
+	hostGPIOA.IDR |= GPIO_PIN_10;
+	batteryRsoc = TEST_RSOC;
+	WakeupOnCharge(TEST_WAKEUP_ON_CHARGE);
+	regs[0] = TEST_INPUT_PRESENT;
+	for (start = hostTick; hostTick - start < 5000;) {
+		Pass();
+		if (hostTick % 1000 == 0) {
+			MS_TIME_COUNTER_INIT(lastHostCommandTimer);
+			PowerMngmtHostPollEvent();
+		}
+	}
+	PowerMngmtSchedulePowerOff(1);
+	on5vTime = TEST_NONE;
+	Run(2000);
+	HOST_CHECK(on5vTime != TEST_NONE, "no wake-up on charge after shutdown");
+	ReadLatency(WAKEUP_TRIGGER_ON_CHARGE, v);
+	HOST_CHECK(v[0] == 0, "consumed wake-up on charge trigger counted, latency %u ms", v[1]);
+	HostOff();
+
+	// input connected while host off is posted once and counted once
+	WakeupOnCharge(TEST_WAKEUP_ON_CHARGE);
+	regs[0] = TEST_INPUT_PRESENT;
+	on5vTime = TEST_NONE;
+	Run(1000);
+	ReadLatency(WAKEUP_TRIGGER_ON_CHARGE, v);
+	HOST_CHECK(on5vTime != TEST_NONE && v[0] == 1 && v[1] == 0, "wake-up on charge count %u last %u ms", v[0], v[1]);
+	HostOff();
+}
+
+int main(int argc, char *argv[]) {
+	int seed = argc > 1 ? atoi(argv[1]) : 1;
+	char name[40];
+
+	srand(seed);
+	hostTick = 100000;
+	lastHostCommandTimer = 0;
+	regs[1] = 0x00; // battery present
+	power5vIoStatus = POW_SOURCE_NOT_PRESENT;
+	resetStatus = 0;
+	PowerManagementInit();
+	HostOff();
+
+	TestHostOff();
+	TestShutdown();
+	TestPoweredHost();
+	TestChargeEdge();
+
+	snprintf(name, sizeof(name), "test_power_management seed %d", seed);
+	return HostReport(name);
+}
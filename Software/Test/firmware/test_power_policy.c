@@ -0,0 +1,402 @@
+// ----------------------------------------------------------------------------
+/*!
+ * @file         test_power_policy.c
+ * @date       19 October 2026
+ * @brief       Power policy rule tests on scripted telemetry: battery
+ *                  discharge with bounce shorter than hold time, chained
+ *                  input loss and low voltage rule, host idle rule with
+ *                  hold in minutes, random rules of every source and
+ *                  operator against reference evaluation, and rule write
+ *                  reported as pending until main loop stores it, failed
+ *                  store reads back stored rule.
+ *                  Usage: test_power_policy [seed]
+ */
+// ----------------------------------------------------------------------------
+// Include section - add all #includes here:
+
+#include <stdlib.h>
+#include <string.h>
+#include "power_policy.h"
+#include "power_management.h"
+#include "power_source.h"
+#include "battery.h"
+#include "fuel_gauge_lc709203f.h"
+#include "load_current_sense.h"
+#include "button.h"
+#include "led.h"
+#include "time_count.h"
+#include "nv.h"
+
+// ----------------------------------------------------------------------------
+// Defines section - add all #defines here:
+
+#define TEST_I2C_IRQ_IPSR	39 // exception number of I2C1 interrupt
+#define TEST_RANDOM_RULES	5000
+#define TEST_NONE	0xFFFFFFFF
+
+// rule condition byte: source, operator, chain flag
+#define TEST_COND(src, op)	((src) | ((op) << 4))
+#define TEST_CHAIN	0x80
+// rule action byte: action, parameter
+#define TEST_ACT(act, param)	((act) | ((param) << 4))
+
+// ----------------------------------------------------------------------------
+// Variables section - add all global variables here:
+
+uint8_t resetStatus;
+uint32_t lastHostCommandTimer;
+uint16_t batteryVoltage;
+uint16_t batteryRsoc;
+int8_t batteryTemp;
+BatteryStatus_T batteryStatus;
+PowerSourceStatus_T powerInStatus;
+PowerSourceStatus_T power5vIoStatus;
+
+static uint16_t nvVar[NV_VAR_NUM];
+static uint8_t nvValid[NV_VAR_NUM];
+static uint8_t nvStaged;
+static uint8_t nvFail; // commit of transaction fails
+
+// scripted telemetry and actions seen
+static int32_t loadCurrent; // mA
+static uint8_t buttonActive;
+static uint8_t powerOffCounter;
+static uint32_t powerOffDelay;
+static uint32_t powerOffTime, wakeupTime, ledTime;
+static uint32_t wakeups;
+static uint8_t ledState[4]; // led, r, g, b
+
+// ----------------------------------------------------------------------------
+// Function section - add all local functions here:
+
+uint16_t EE_ReadVariable(uint16_t VirtAddress, uint16_t *Data) {
+	if (VirtAddress >= NV_VAR_NUM || !nvValid[VirtAddress]) return 1;
+	*Data = nvVar[VirtAddress];
+	return 0;
+}
+
+void NvTransactionBegin(void) {
+	nvStaged = 0;
+}
+
+void NvTransactionStage(uint16_t VirtAddress, uint16_t var) {
+	HOST_CHECK(VirtAddress >= POWER_POLICY_RULE0_COND_NV_ADDR && VirtAddress < POWER_POLICY_RULE0_ACT_NV_ADDR + 2 * POWER_POLICY_RULES_NUM,
+			"staged nv address %u", VirtAddress);
+	HOST_CHECK(__get_IPSR() == 0, "rule staged in interrupt");
+	if (!nvFail) {
+		nvVar[VirtAddress] = var;
+		nvValid[VirtAddress] = 1;
+	}
+	nvStaged++;
+}
+
+uint16_t NvTransactionCommit(void) {
+	HOST_CHECK(nvStaged == 2, "%u words committed, rule is not stored whole", nvStaged);
+	return nvFail;
+}
+
+int32_t GetLoadCurrent(void) {
+	return loadCurrent;
+}
+
+int8_t IsButtonActive(void) {
+	return buttonActive;
+}
+
+uint8_t PowerMngmtGetPowerOffCounter(void) {
+	return powerOffCounter;
+}
+
+void PowerMngmtSchedulePowerOff(uint8_t delayCode) {
+	powerOffCounter = delayCode;
+	powerOffDelay = delayCode;
+	powerOffTime = hostTick;
+}
+
+void PowerMngmtPostWakeupEvent(WakeupTrigger_T trigger) {
+	HOST_CHECK(trigger == WAKEUP_TRIGGER_POLICY, "wake-up trigger %u", trigger);
+	wakeupTime = hostTick;
+	wakeups++;
+}
+
+void LedSetState(uint8_t led, uint8_t r, uint8_t g, uint8_t b) {
+	ledState[0] = led;
+	ledState[1] = r;
+	ledState[2] = g;
+	ledState[3] = b;
+	ledTime = hostTick;
+}
+
+static void Pass(void) {
+	hostTick += TICK_PERIOD_MS;
+	PowerPolicyTask();
+}
+
+static void Run(uint32_t ms) {
+	uint32_t start = hostTick;
+	while (hostTick - start < ms) Pass();
+}
+
+// Telemetry as read by rule sources
+static void Telemetry(uint8_t charge, uint16_t mV, uint8_t input) {
+	batteryRsoc = charge * 10;
+	batteryVoltage = mV;
+	powerInStatus = input ? POW_SOURCE_NORMAL : POW_SOURCE_NOT_PRESENT;
+	power5vIoStatus = POW_SOURCE_NOT_PRESENT;
+}
+
+static void ClearActions(void) {
+	policyShutdownFlag = 0;
+	powerOffCounter = 0xFF;
+	powerOffTime = wakeupTime = ledTime = TEST_NONE;
+	wakeups = 0;
+}
+
+// Command 0xC4 write of rule and read of selected rule
+static void WriteRule(uint8_t i, uint8_t cond, uint8_t th, uint8_t act, uint8_t hold) {
+	uint8_t d[5] = {i, cond, th, act, hold};
+
+	hostIpsr = TEST_I2C_IRQ_IPSR;
+	PowerPolicySetRuleCmd(d, sizeof(d));
+	hostIpsr = 0;
+}
+
+static void ReadRule(uint8_t i, uint8_t d[6]) {
+	uint16_t len = 0;
+
+	hostIpsr = TEST_I2C_IRQ_IPSR;
+	PowerPolicySetRuleCmd(&i, 1);
+	PowerPolicyGetRuleCmd(d, &len);
+	hostIpsr = 0;
+	HOST_CHECK(len == 6 && d[0] == i, "rule %u read length %u index %u", i, len, d[0]);
+}
+
+static void SetRule(uint8_t i, uint8_t cond, uint8_t th, uint8_t act, uint8_t hold) {
+	WriteRule(i, cond, th, act, hold);
+	Pass();
+}
+
+static void ClearRules(void) {
+	uint8_t i;
+	for (i = 0; i < POWER_POLICY_RULES_NUM; i++) SetRule(i, 0, 0, 0, 0);
+}
+
+// Runs until shutdown flag is raised, returns time it took or TEST_NONE
+static uint32_t UntilShutdown(uint32_t ms) {
+	uint32_t start = hostTick;
+	while (!policyShutdownFlag && hostTick - start < ms) Pass();
+	return policyShutdownFlag ? hostTick - start : TEST_NONE;
+}
+
+static void TestDischarge(void) {
+	uint32_t t;
+	uint8_t charge;
+
+	// charge < 20% for 10 s raises host shutdown, bounce above threshold restarts hold
+	ClearRules();
+	ClearActions();
+	SetRule(0, TEST_COND(POLICY_SRC_CHARGE, POLICY_OP_LT), 20, TEST_ACT(POLICY_ACT_HOST_SHUTDOWN, 0), 10);
+	for (charge = 30; charge >= 20; charge--) {
+		Telemetry(charge, 3700, 0);
+		Run(3000);
+	}
+	Telemetry(19, 3650, 0);
+	Run(6000);
+	Telemetry(21, 3660, 0); // load step ends, charge estimate recovers
+	Run(2000);
+	HOST_CHECK(!policyShutdownFlag, "shutdown on charge below threshold for 6 s");
+	Telemetry(19, 3650, 0);
+	t = UntilShutdown(20000);
+	HOST_CHECK(t >= 10000 && t <= 10000 + TICK_PERIOD_MS, "shutdown %u ms after charge dropped below 20%%", t);
+
+	// fires once while condition holds, re-armed after it clears
+	policyShutdownFlag = 0;
+	Run(30000);
+	HOST_CHECK(!policyShutdownFlag, "shutdown raised again while charge stays low");
+	Telemetry(25, 3800, 1);
+	Run(1000);
+	Telemetry(18, 3640, 0);
+	t = UntilShutdown(20000);
+	HOST_CHECK(t >= 10000 && t <= 10000 + TICK_PERIOD_MS, "re-armed shutdown %u ms after charge dropped", t);
+}
+
+static void TestChainedInputLoss(void) {
+	uint32_t start;
+
+	// input lost AND battery below 3400 mV for 5 s turns 5V off after 16 s delay, LED 2 red on input loss
+	Telemetry(40, 3300, 1);
+	ClearRules();
+	SetRule(2, TEST_COND(POLICY_SRC_POWER_INPUT, POLICY_OP_EQ) | TEST_CHAIN, 0, TEST_ACT(POLICY_ACT_NONE, 0), 0);
+	SetRule(3, TEST_COND(POLICY_SRC_BAT_VOLTAGE, POLICY_OP_LT), 3400 / 20, TEST_ACT(POLICY_ACT_5V_OFF, 2), 5);
+	SetRule(5, TEST_COND(POLICY_SRC_POWER_INPUT, POLICY_OP_EQ), 0, TEST_ACT(POLICY_ACT_LED, 0x09), 0);
+	ClearActions();
+	Run(10000);
+	HOST_CHECK(powerOffTime == TEST_NONE && ledTime == TEST_NONE, "action with input present");
+
+	// input is lost, battery voltage sags under load
+	start = hostTick;
+	Telemetry(40, 3500, 0);
+	Run(8000);
+	HOST_CHECK(ledTime - start <= TICK_PERIOD_MS && ledState[0] == LED2 && ledState[1] == 127 && !ledState[2] && !ledState[3],
+			"LED %u (%u, %u, %u) set %u ms after input loss", ledState[0], ledState[1], ledState[2], ledState[3], ledTime - start);
+	HOST_CHECK(powerOffTime == TEST_NONE, "5V off with battery above threshold");
+	start = hostTick;
+	Telemetry(35, 3380, 0);
+	Run(3000);
+	Telemetry(35, 3420, 1); // input back before hold time
+	Run(1000);
+	Telemetry(35, 3380, 0);
+	Run(8000);
+	HOST_CHECK(powerOffTime != TEST_NONE && powerOffTime - start >= 4000 + 5000 && powerOffTime - start <= 4000 + 5000 + TICK_PERIOD_MS
+			&& powerOffDelay == 16, "5V off %u ms after low voltage, delay %u s", powerOffTime - start, powerOffDelay);
+
+	// already scheduled power off is not moved
+	powerOffDelay = 0;
+	Telemetry(35, 3420, 1);
+	Run(1000);
+	Telemetry(35, 3380, 0);
+	Run(8000);
+	HOST_CHECK(powerOffDelay == 0, "scheduled power off moved by rule");
+}
+
+static void TestHostIdle(void) {
+	uint32_t start;
+
+	// host silent for more than 3 minutes, held for 2 minutes, wakes host
+	ClearRules();
+	ClearActions();
+	SetRule(7, TEST_COND(POLICY_SRC_HOST_IDLE, POLICY_OP_GT), 3, TEST_ACT(POLICY_ACT_WAKEUP, 0), 0x80 | 2);
+	Telemetry(60, 3800, 1);
+	start = hostTick;
+	MS_TIME_COUNTER_INIT(lastHostCommandTimer);
+	while (wakeups == 0 && hostTick - start < 900000) {
+		Pass();
+		// host talks every 10 s for first 5 minutes
+		if (hostTick - start < 300000 && (hostTick - start) % 10000 == 0) MS_TIME_COUNTER_INIT(lastHostCommandTimer);
+	}
+	// idle minutes exceed 3 at 4 minutes of silence
+	HOST_CHECK(wakeups == 1 && wakeupTime - start >= 300000 + 240000 + 120000 - 10000 && wakeupTime - start <= 300000 + 240000 + 120000 + TICK_PERIOD_MS,
+			"host idle wake-up %u ms after start", wakeupTime - start);
+}
+
+static int16_t Reference(uint8_t src, uint8_t op, uint8_t th) {
+	int16_t val, t = src == POLICY_SRC_BAT_TEMP ? (int8_t)th : th;
+	int32_t load = loadCurrent / 10;
+
+	switch (src) {
+	case POLICY_SRC_CHARGE: val = batteryRsoc / 10; break;
+	case POLICY_SRC_BAT_VOLTAGE: val = batteryVoltage / 20; break;
+	case POLICY_SRC_POWER_INPUT: val = powerInStatus >= POW_SOURCE_WEAK || power5vIoStatus >= POW_SOURCE_WEAK; break;
+	case POLICY_SRC_LOAD_CURRENT: val = load < 0 ? 0 : (load > 255 ? 255 : load); break;
+	case POLICY_SRC_BAT_TEMP: val = batteryTemp; break;
+	case POLICY_SRC_BUTTON_IDLE: val = 0; break;
+	case POLICY_SRC_HOST_IDLE: val = 0; break;
+	case POLICY_SRC_5V_REG: val = (hostGPIOA.IDR & GPIO_PIN_10) != 0; break;
+	case POLICY_SRC_BAT_PRESENT: val = batteryStatus != BAT_STATUS_NOT_PRESENT; break;
+	default: val = 0;
+	}
+	switch (op) {
+	case POLICY_OP_LT: return val < t;
+	case POLICY_OP_GT: return val > t;
+	case POLICY_OP_EQ: return val == t;
+	default: return val != t;
+	}
+}
+
+static void TestRandomRules(void) {
+	uint32_t k;
+	uint8_t d[6], src, op, th, ref;
+
+	// every source and operator on random telemetry, immediate rule fires on first pass
+	ClearRules();
+	for (k = 0; k < TEST_RANDOM_RULES; k++) {
+		ClearActions();
+		src = 1 + rand() % (POLICY_SRC_NUM - 1);
+		op = rand() % POLICY_OP_NUM;
+		th = rand() % 256;
+		batteryRsoc = rand() % 1001;
+		batteryVoltage = 2500 + rand() % 2000;
+		powerInStatus = rand() % 4;
+		power5vIoStatus = rand() % 4;
+		loadCurrent = rand() % 4000 - 1000;
+		batteryTemp = rand() % 256 - 128;
+		batteryStatus = rand() % 2 ? BAT_STATUS_NOT_PRESENT : BAT_STATUS_NORMAL;
+		if (rand() % 2) hostGPIOA.IDR |= GPIO_PIN_10; else hostGPIOA.IDR &= ~GPIO_PIN_10;
+		if (src == POLICY_SRC_BUTTON_IDLE || src == POLICY_SRC_HOST_IDLE) th = rand() % 3;
+		buttonActive = 1;
+		MS_TIME_COUNTER_INIT(lastHostCommandTimer);
+		WriteRule(1, TEST_COND(src, op), th, TEST_ACT(POLICY_ACT_HOST_SHUTDOWN, 0), 0);
+		Pass();
+		lastHostCommandTimer += TICK_PERIOD_MS;
+		ref = Reference(src, op, th);
+		ReadRule(1, d);
+		HOST_CHECK((d[5] & 0x01) == ref && policyShutdownFlag == ref,
+				"source %u operator %u threshold %u: condition %u action %u, reference %u", src, op, th, d[5] & 0x01, policyShutdownFlag, ref);
+	}
+	buttonActive = 0;
+	loadCurrent = 0;
+	batteryStatus = BAT_STATUS_NORMAL;
+	hostGPIOA.IDR &= ~GPIO_PIN_10;
+}
+
+static void TestStore(void) {
+	uint8_t d[6], old[6];
+	uint8_t i;
+
+	// written rule is pending until main loop stores it, read reports stored rule
+	ClearRules();
+	for (i = 0; i < POWER_POLICY_RULES_NUM; i++) {
+		WriteRule(i, TEST_COND(POLICY_SRC_CHARGE, POLICY_OP_LT), 10 + i, TEST_ACT(POLICY_ACT_LED, i), 0x80 | i);
+		ReadRule(i, d);
+		HOST_CHECK((d[5] & 0x04) && d[1] == 0, "rule %u before store: status 0x%02X condition 0x%02X", i, d[5], d[1]);
+	}
+	Pass();
+	for (i = 0; i < POWER_POLICY_RULES_NUM; i++) {
+		ReadRule(i, d);
+		HOST_CHECK(!(d[5] & 0x04) && d[1] == TEST_COND(POLICY_SRC_CHARGE, POLICY_OP_LT) && d[2] == 10 + i
+				&& d[3] == TEST_ACT(POLICY_ACT_LED, i) && d[4] == (0x80 | i),
+				"rule %u stored: status 0x%02X %02X %02X %02X %02X", i, d[5], d[1], d[2], d[3], d[4]);
+	}
+
+	// rules are loaded from nv after MCU reset
+	resetStatus = 1;
+	PowerPolicyInit();
+	ReadRule(4, d);
+	HOST_CHECK(d[1] == TEST_COND(POLICY_SRC_CHARGE, POLICY_OP_LT) && d[2] == 14 && d[3] == TEST_ACT(POLICY_ACT_LED, 4) && d[4] == 0x84,
+			"rule 4 after reset %02X %02X %02X %02X", d[1], d[2], d[3], d[4]);
+
+	// failed store leaves stored rule, host compares it with written rule
+	ReadRule(2, old);
+	nvFail = 1;
+	WriteRule(2, TEST_COND(POLICY_SRC_BAT_TEMP, POLICY_OP_GT), 50, TEST_ACT(POLICY_ACT_HOST_SHUTDOWN, 0), 30);
+	Pass();
+	nvFail = 0;
+	ReadRule(2, d);
+	HOST_CHECK(!(d[5] & 0x04) && !memcmp(d + 1, old + 1, 4), "failed store reads %02X %02X %02X %02X", d[1], d[2], d[3], d[4]);
+
+	// invalid rule is refused and not pending
+	WriteRule(3, TEST_COND(POLICY_SRC_CHARGE, 7), 50, TEST_ACT(POLICY_ACT_NUM, 0), 0);
+	ReadRule(3, d);
+	HOST_CHECK(!(d[5] & 0x04) && d[2] == 13, "invalid rule accepted, status 0x%02X threshold %u", d[5], d[2]);
+	ClearRules();
+}
+
+int main(int argc, char *argv[]) {
+	int seed = argc > 1 ? atoi(argv[1]) : 1;
+	char name[40];
+
+	srand(seed);
+	hostTick = 100000;
+	batteryStatus = BAT_STATUS_NORMAL;
+	resetStatus = 0;
+	PowerPolicyInit();
+
+	TestStore();
+	TestDischarge();
+	TestChainedInputLoss();
+	TestHostIdle();
+	TestRandomRules();
+
+	snprintf(name, sizeof(name), "test_power_policy seed %d", seed);
+	return HostReport(name);
+}
@@ -0,0 +1,173 @@
+// ----------------------------------------------------------------------------
+/*!
+ * @file         test_power_stats.c
+ * @date       19 October 2026
+ * @brief       Power statistics tests: state residency, refuse time,
+ *                  stop entries and wake-up causes read in pages as
+ *                  pijuice.py does, every page fits SMBus block with
+ *                  checksum, page select, reset and statistics kept
+ *                  over MCU reset.
+ *                  Usage: test_power_stats [seed]
+ */
+// ----------------------------------------------------------------------------
+// Include section - add all #includes here:
+
+#include <stdlib.h>
+#include "power_stats.h"
+
+// ----------------------------------------------------------------------------
+// Defines section - add all #defines here:
+
+#define TEST_I2C_IRQ_IPSR	39 // exception number of I2C1 interrupt
+#define TEST_SMBUS_BLOCK_MAX	32 // bytes, with checksum
+#define TEST_PAGE_LEN	29 // page number and 7 values
+#define TEST_VALUES_NUM	(POWER_STATS_STATES_NUM + 1 + POWER_STATS_WAKE_NUM + LOW_POWER_REFUSE_NUM)
+
+// ----------------------------------------------------------------------------
+// Variables section - add all global variables here:
+
+uint8_t resetStatus;
+
+// expected values in read order, times in ms
+static uint64_t refValue[TEST_VALUES_NUM];
+
+// ----------------------------------------------------------------------------
+// Function section - add all local functions here:
+
+static void SetCmd(uint8_t d) {
+	hostIpsr = TEST_I2C_IRQ_IPSR;
+	PowerStatsSetCmd(&d, 1);
+	hostIpsr = 0;
+}
+
+// Reads pages until all values are collected, as GetPowerStats in pijuice.py
+static void ReadAll(uint32_t values[TEST_VALUES_NUM]) {
+	uint8_t data[64];
+	uint16_t len;
+	uint32_t v;
+	uint8_t page, k, n = 0;
+
+	for (page = 0; n < TEST_VALUES_NUM; page++) {
+		SetCmd(page);
+		len = 0;
+		hostIpsr = TEST_I2C_IRQ_IPSR;
+		PowerStatsGetCmd(data, &len);
+		hostIpsr = 0;
+		HOST_CHECK(len == TEST_PAGE_LEN && len + 1 <= TEST_SMBUS_BLOCK_MAX, "page %u length %u", page, len);
+		HOST_CHECK(data[0] == page, "page %u returned %u", page, data[0]);
+		for (k = 0; k < (TEST_PAGE_LEN - 1) / 4; k++, n++) {
+			v = data[1 + 4*k] | (data[2 + 4*k] << 8) | (data[3 + 4*k] << 16) | ((uint32_t)data[4 + 4*k] << 24);
+			if (n < TEST_VALUES_NUM) {
+				values[n] = v;
+			} else {
+				HOST_CHECK(v == 0, "padding value %u is %u", k, v);
+			}
+		}
+	}
+}
+
+static void Check(const char *step) {
+	uint32_t values[TEST_VALUES_NUM];
+	uint32_t expected;
+	uint8_t i;
+
+	ReadAll(values);
+	for (i = 0; i < TEST_VALUES_NUM; i++) {
+		expected = refValue[i];
+		// residency and refuse times are in seconds, counters are not
+		if (i < POWER_STATS_STATES_NUM || i >= POWER_STATS_STATES_NUM + 1 + POWER_STATS_WAKE_NUM) expected = refValue[i] / 1000;
+		HOST_CHECK(values[i] == expected, "%s: value %u is %u expected %u", step, i, values[i], expected);
+	}
+}
+
+static void Reset(void) {
+	uint8_t i;
+	for (i = 0; i < TEST_VALUES_NUM; i++) refValue[i] = 0;
+}
+
+// Main loop passes with random state decisions, refuse reasons, stop mode entries and wake-ups
+static void Run(uint32_t passes) {
+	PowerState_T state = STATE_NORMAL + rand() % 3;
+	uint16_t mask = 0;
+	uint32_t k, dt;
+	uint8_t i, cause;
+
+	PowerStatsUpdate(state, mask);
+	for (k = 0; k < passes; k++) {
+		dt = rand() % 3 ? rand() % 50 : rand() % 5000;
+		hostTick += dt;
+		refValue[state - STATE_NORMAL] += dt;
+		if (state != STATE_LOWPOWER) {
+			for (i = 0; i < LOW_POWER_REFUSE_NUM; i++) {
+				if (mask & (0x01 << i)) refValue[POWER_STATS_STATES_NUM + 1 + POWER_STATS_WAKE_NUM + i] += dt;
+			}
+		}
+		if (state == STATE_LOWPOWER && rand() % 2) {
+			PowerStatsStopEntry();
+			refValue[POWER_STATS_STATES_NUM]++;
+			cause = rand() % POWER_STATS_WAKE_NUM;
+			PowerStatsWakeup(cause);
+			refValue[POWER_STATS_STATES_NUM + 1 + cause]++;
+		}
+		if (rand() % 10 == 0) state = STATE_NORMAL + rand() % 3;
+		if (rand() % 10 == 0) mask = rand() & ((0x01 << LOW_POWER_REFUSE_NUM) - 1);
+		PowerStatsUpdate(state, mask);
+	}
+}
+
+static void TestPages(void) {
+	uint8_t data[64];
+	uint16_t len = 0;
+
+	resetStatus = 0;
+	PowerStatsInit();
+	Reset();
+	Check("init");
+
+	Run(20000);
+	Check("run");
+
+	// page past last one is not selected
+	SetCmd(0);
+	SetCmd(0x0F);
+	PowerStatsGetCmd(data, &len);
+	HOST_CHECK(data[0] == 0, "invalid page selected %u", data[0]);
+
+	// wake-up cause out of range is ignored
+	PowerStatsWakeup(POWER_STATS_WAKE_NUM);
+	Check("wake-up cause out of range");
+}
+
+static void TestReset(void) {
+	// statistics are kept over MCU reset
+	resetStatus = 1;
+	PowerStatsInit();
+	Run(100);
+	Check("after MCU reset");
+
+	// bit 7 resets statistics and selects page
+	SetCmd(0x80 | 1);
+	Reset();
+	Check("reset command");
+	Run(1000);
+	Check("run after reset");
+
+	// statistics are cleared on power up
+	resetStatus = 0;
+	PowerStatsInit();
+	Reset();
+	Check("power up");
+}
+
+int main(int argc, char *argv[]) {
+	int seed = argc > 1 ? atoi(argv[1]) : 1;
+	char name[40];
+
+	srand(seed);
+
+	TestPages();
+	TestReset();
+
+	snprintf(name, sizeof(name), "test_power_stats seed %d", seed);
+	return HostReport(name);
+}
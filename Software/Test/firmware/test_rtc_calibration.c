@@ -0,0 +1,181 @@
+// ----------------------------------------------------------------------------
+/*!
+ * @file         test_rtc_calibration.c
+ * @date       19 October 2026
+ * @brief       RTC drift calibration tests on model of 2000 crystals
+ *                  drifting up to 150 ppm: host references every 6 hours
+ *                  for 15 days with MCU reset and clock set midway, exact
+ *                  and with 20 ms jitter, residual drift after smooth
+ *                  calibration within half calibration step, no
+ *                  calibration from windows shorter than 8 hours.
+ *                  Usage: test_rtc_calibration [seed]
+ */
+// ----------------------------------------------------------------------------
+// Include section - add all #includes here:
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rtc_calibration.h"
+#include "rtc_ds1339_emu.h"
+#include "nv.h"
+
+// ----------------------------------------------------------------------------
+// Defines section - add all #defines here:
+
+#define TEST_I2C_IRQ_IPSR	39 // exception number of I2C1 interrupt
+#define TEST_START	820540800 // 2026-01-01 00:00:00 in seconds since 2000-01-01
+#define TEST_CRYSTALS_NUM	2000
+#define TEST_DRIFT_MAX_PPM	150
+#define TEST_REF_PERIOD	21600 // s
+#define TEST_REFS_NUM	60 // 15 days
+#define TEST_JITTER	0.02 // s
+#define TEST_RESIDUAL_MAX_PPM	0.6 // half of 0.954 ppm step, rounding of offsets in 1/256 s and jitter
+
+// ----------------------------------------------------------------------------
+// Variables section - add all global variables here:
+
+uint8_t resetStatus;
+
+static uint16_t nvVar[NV_VAR_NUM];
+static uint8_t nvValid[NV_VAR_NUM];
+
+// RTC model: time in s since 2000-01-01 running at crystal drift corrected by smooth calibration
+static double rtcTime;
+static double rtcCorrection;
+
+// ----------------------------------------------------------------------------
+// Function section - add all local functions here:
+
+uint16_t EE_ReadVariable(uint16_t VirtAddress, uint16_t *Data) {
+	if (VirtAddress >= NV_VAR_NUM || !nvValid[VirtAddress]) return 1;
+	*Data = nvVar[VirtAddress];
+	return 0;
+}
+
+uint16_t EE_WriteVariable(uint16_t VirtAddress, uint16_t Data) {
+	HOST_CHECK(VirtAddress == RTC_CALIBRATION_NV_ADDR, "nv address %u", VirtAddress);
+	nvVar[VirtAddress] = Data;
+	nvValid[VirtAddress] = 1;
+	return 0;
+}
+
+void RtcReadLinearTime(uint32_t *sec, uint8_t *sub) {
+	*sec = (uint32_t)rtcTime;
+	*sub = (uint8_t)((rtcTime - floor(rtcTime)) * 256);
+}
+
+// Frequency correction of STM32F0 RTC smooth calibration, 32 s period
+HAL_StatusTypeDef HAL_RTCEx_SetSmoothCalib(RTC_HandleTypeDef *hrtc, uint32_t SmoothCalibPeriod,
+		uint32_t SmoothCalibPlusPulses, uint32_t SmouthCalibMinusPulsesValue) {
+	int32_t pulses = (SmoothCalibPlusPulses == RTC_SMOOTHCALIB_PLUSPULSES_SET ? 512 : 0) - (int32_t)SmouthCalibMinusPulsesValue;
+
+	HOST_CHECK(SmoothCalibPeriod == RTC_SMOOTHCALIB_PERIOD_32SEC && SmouthCalibMinusPulsesValue <= 511,
+			"smooth calibration period 0x%X minus pulses %u", SmoothCalibPeriod, SmouthCalibMinusPulsesValue);
+	rtcCorrection = (double)pulses / ((1 << 20) - pulses);
+	return HAL_OK;
+}
+
+static void Submit(double ref) {
+	uint8_t cmd[6];
+	uint32_t sec = (uint32_t)ref;
+	uint8_t sub = (uint8_t)((ref - sec) * 256);
+
+	cmd[0] = 0;
+	cmd[1] = sec;
+	cmd[2] = sec >> 8;
+	cmd[3] = sec >> 16;
+	cmd[4] = sec >> 24;
+	cmd[5] = sub;
+	hostIpsr = TEST_I2C_IRQ_IPSR;
+	RtcCalibrationWriteCmd(cmd, sizeof(cmd));
+	hostIpsr = 0;
+}
+
+static uint8_t Status(void) {
+	uint8_t data[16];
+	uint16_t len = 0;
+
+	RtcCalibrationReadCmd(data, &len);
+	HOST_CHECK(len == 11, "status length %u", len);
+	return data[10];
+}
+
+static double Uniform(double max) {
+	return max * (2.0 * rand() / RAND_MAX - 1);
+}
+
+// Residual drift in ppm of crystal after references every 6 hours, power up of new board first
+static double RunCrystal(double drift, double jitter) {
+	double refTime = TEST_START + rand() % 86400;
+	int32_t step;
+	uint8_t k;
+
+	memset(nvValid, 0, sizeof(nvValid));
+	resetStatus = 0;
+	RtcCalibrationInit();
+	rtcTime = refTime + Uniform(10);
+
+	for (k = 1; k <= TEST_REFS_NUM; k++) {
+		refTime += TEST_REF_PERIOD;
+		rtcTime += TEST_REF_PERIOD * (1 + drift) * (1 + rtcCorrection);
+		Submit(refTime + Uniform(jitter));
+		// first submission is anchor, next one is within 8 hours
+		if (k <= 2) HOST_CHECK(!(Status() & RTC_CALIB_STATUS_APPLIED), "calibration from %u s window", (k - 1) * TEST_REF_PERIOD);
+
+		// watchdog reset and clock set by host midway, time step is not drift
+		if (k == TEST_REFS_NUM / 2) {
+			resetStatus = 1;
+			RtcCalibrationInit();
+			step = rand() % 25600 - 12800;
+			rtcTime += step / 256.0;
+			RtcCalibrationTimeStep(step);
+		}
+	}
+	HOST_CHECK(!(Status() & RTC_CALIB_STATUS_RANGE), "%.1f ppm out of calibration range", drift * 1e6);
+
+	return ((1 + drift) * (1 + rtcCorrection) - 1) * 1e6;
+}
+
+static void TestCrystals(void) {
+	double drift, residual, worst[2] = {0, 0};
+	uint32_t k;
+	uint8_t j;
+
+	for (k = 0; k < TEST_CRYSTALS_NUM; k++) {
+		drift = Uniform(TEST_DRIFT_MAX_PPM) * 1e-6;
+		for (j = 0; j < 2; j++) {
+			residual = RunCrystal(drift, j ? TEST_JITTER : 0);
+			if (fabs(residual) > worst[j]) worst[j] = fabs(residual);
+			HOST_CHECK(fabs(residual) <= TEST_RESIDUAL_MAX_PPM, "crystal %.2f ppm, %s references: residual %.2f ppm",
+					drift * 1e6, j ? "jittered" : "exact", residual);
+		}
+	}
+	printf("worst residual %.2f ppm with exact references, %.2f ppm with %.0f ms jitter, %u ppm uncalibrated\n",
+			worst[0], worst[1], TEST_JITTER * 1000, TEST_DRIFT_MAX_PPM);
+}
+
+static void TestInit(void) {
+	// calibration is applied from NV on boot, out of range value is ignored
+	nvVar[RTC_CALIBRATION_NV_ADDR] = (uint16_t)-100;
+	nvValid[RTC_CALIBRATION_NV_ADDR] = 1;
+	resetStatus = 0;
+	RtcCalibrationInit();
+	HOST_CHECK(fabs(rtcCorrection * (1 << 20) + 100) < 0.01, "boot correction %.3f steps", rtcCorrection * (1 << 20));
+	nvVar[RTC_CALIBRATION_NV_ADDR] = RTC_CALIB_MAX_STEP + 1;
+	RtcCalibrationInit();
+	HOST_CHECK(rtcCorrection == 0, "out of range NV calibration applied");
+}
+
+int main(int argc, char *argv[]) {
+	int seed = argc > 1 ? atoi(argv[1]) : 1;
+	char name[40];
+
+	srand(seed);
+
+	TestInit();
+	TestCrystals();
+
+	snprintf(name, sizeof(name), "test_rtc_calibration seed %d", seed);
+	return HostReport(name);
+}
@@ -0,0 +1,523 @@
+// ----------------------------------------------------------------------------
+/*!
+ * @file         test_rtc_ds1339_emu.c
+ * @date       19 October 2026
+ * @brief       DS1339 emulation tests on host RTC: wake-up schedule tables
+ *                  run for weeks second by second with alarm A programmed by
+ *                  emulation, wake-ups and fired record compared with
+ *                  schedules decoded from written registers, alarm 1 merged
+ *                  into same alarm, schedules kept in NV over MCU reset,
+ *                  rtc-ds1307 driver register reads served in one transfer
+ *                  from BCD time shadow without HAL calendar reads,
+ *                  clock sync of rtcsync.c from one read of 0x00-0x11 at
+ *                  0x68 and from 0x80 at 0x14 with known offsets over
+ *                  100 and 400 kHz bus within 1/256 s, sub-seconds
+ *                  register read alone at 0x91 within same second.
+ *                  Usage: test_rtc_ds1339_emu [seed]
+ */
+// ----------------------------------------------------------------------------
+// Include section - add all #includes here:
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rtc_ds1339_emu.h"
+#include "power_management.h"
+#include "power_source.h"
+#include "logging.h"
+#include "nv.h"
+
+// ----------------------------------------------------------------------------
+// Defines section - add all #defines here:
+
+#define TEST_I2C_IRQ_IPSR	39 // exception number of I2C1 interrupt
+#define TEST_START	1767225600 // 2026-01-01 00:00:00
+#define TEST_RUNS_NUM	3
+#define TEST_BCD2BIN(b)	((((b)>>4)&0x0F)*10 + ((b)&0x0F))
+#define TEST_SYNC_READS	20000
+#define TEST_SNAPSHOT_BYTES	3 // address, register and repeated start address bytes before firmware takes snapshot
+#define TEST_SYNC_LATENCY	300e-6 // s, scheduling between system time reads and transfer
+
+// ----------------------------------------------------------------------------
+// Variables section - add all global variables here:
+
+uint8_t resetStatus;
+extern uint8_t alarmEventFlag;
+
+// used by alarm log records
+BatteryStatus_T batteryStatus;
+PowerSourceStatus_T powerInStatus;
+PowerSourceStatus_T power5vIoStatus;
+uint16_t batteryRsoc;
+int8_t batteryTemp;
+uint16_t batteryVoltage;
+
+static uint16_t nvVar[NV_VAR_NUM];
+static uint8_t nvValid[NV_VAR_NUM];
+
+static uint32_t wakeEvents;
+static uint32_t alarmInterrupts;
+
+// slave transmit requests and per byte transmit complete callbacks of register reads
+static uint32_t readRequests;
+static uint32_t readCallbacks;
+
+// schedules as written, extended alarm 1 registers
+static uint8_t refSchedule[RTC_WAKE_SCHEDULES_NUM][9];
+
+// ----------------------------------------------------------------------------
+// Function section - add all local functions here:
+
+uint16_t EE_ReadVariable(uint16_t VirtAddress, uint16_t *Data) {
+	if (VirtAddress >= NV_VAR_NUM || !nvValid[VirtAddress]) return 1;
+	*Data = nvVar[VirtAddress];
+	return 0;
+}
+
+void NvTransactionBegin(void) {
+}
+
+void NvTransactionStage(uint16_t VirtAddress, uint16_t var) {
+	HOST_CHECK(VirtAddress >= RTC_WAKE_SCHEDULE0_TIME_NV_ADDR && VirtAddress <= RTC_WAKE_SCHEDULE7_WDAYS_NV_ADDR,
+			"nv address %u", VirtAddress);
+	nvVar[VirtAddress] = var;
+	nvValid[VirtAddress] = 1;
+}
+
+uint16_t NvTransactionCommit(void) {
+	return 0;
+}
+
+void PowerMngmtPostWakeupEvent(WakeupTrigger_T trigger) {
+	HOST_CHECK(trigger == WAKEUP_TRIGGER_RTC, "wake-up trigger %u", trigger);
+	wakeEvents++;
+}
+
+uint8_t *LoggingInitMessage(LogMsgId_T id, uint8_t len) {
+	return NULL;
+}
+
+void RtcCalibrationTimeStep(int32_t delta) {
+}
+
+void EnergyAccountingTimeStep(int32_t delta) {
+}
+
+void Error_Handler(void) {
+}
+
+// Matches written registers against UTC time, as DS1339 alarm with PiJuice extensions is documented
+static uint8_t ScheduleMatch(const uint8_t r[9], const struct tm *tm) {
+	uint8_t wday = tm->tm_wday ? tm->tm_wday : 7;
+	uint32_t hoursSelection = r[4] | (r[5] << 8) | ((uint32_t)r[6] << 16);
+
+	if (!(r[0] || r[1] || r[2] || r[3])) return 0;
+	if (!(r[0] & 0x80) && TEST_BCD2BIN(r[0]) != tm->tm_sec) return 0;
+	if (!(r[1] & 0x80) && TEST_BCD2BIN(r[1]) != tm->tm_min) return 0;
+	if (!(r[2] & 0x80) && TEST_BCD2BIN(r[2] & 0x3F) != tm->tm_hour) return 0;
+	if (!(r[3] & 0x80)) {
+		if ((r[3] & 0x40) ? (r[3] & 0x0F) != wday : TEST_BCD2BIN(r[3] & 0x3F) != tm->tm_mday) return 0;
+	}
+	if (!((hoursSelection >> tm->tm_hour) & 0x01)) return 0;
+	if (r[7] > 1 && tm->tm_min % r[7]) return 0;
+	return (r[8] >> wday) & 0x01;
+}
+
+static uint8_t RandomBcd(uint8_t min, uint8_t num) {
+	uint8_t b = min + rand() % num;
+	return ((b / 10) << 4) | (b % 10);
+}
+
+static void RandomSchedule(uint8_t r[9]) {
+	uint8_t k = rand() % 4;
+
+	// seconds match any rarely, so schedule does not fire every second for hours
+	r[0] = rand() % 8 ? RandomBcd(0, 60) : 0x80;
+	r[1] = rand() % 2 ? RandomBcd(0, 60) : 0x80;
+	r[2] = rand() % 2 ? RandomBcd(0, 24) : 0x80;
+	r[3] = k == 0 ? 0x80 : (k == 1 ? 0x40 | (1 + rand() % 7) : (k == 2 ? RandomBcd(1, 31) : 0x80));
+	r[4] = rand() % 2 ? 0xFF : rand();
+	r[5] = rand() % 2 ? 0xFF : rand();
+	r[6] = rand() % 2 ? 0xFF : rand();
+	r[7] = rand() % 2 ? 0 : rand() % 30;
+	r[8] = rand() % 2 ? 0xFF : rand();
+	if (r[0] == 0x80 && r[1] == 0x80 && r[7] < 2) r[0] = RandomBcd(0, 60);
+}
+
+static void WriteSchedule(uint8_t i, const uint8_t r[9]) {
+	uint8_t cmd[10];
+
+	cmd[0] = i;
+	memcpy(cmd + 1, r, 9);
+	hostIpsr = TEST_I2C_IRQ_IPSR;
+	RtcWakeScheduleWriteCmd(cmd, 10);
+	hostIpsr = 0;
+	memcpy(refSchedule[i], r, 9);
+}
+
+static void ReadSchedule(uint8_t i, uint8_t data[17]) {
+	uint16_t len = 0;
+
+	hostIpsr = TEST_I2C_IRQ_IPSR;
+	RtcWakeScheduleWriteCmd(&i, 1);
+	RtcWakeScheduleReadCmd(data, &len);
+	hostIpsr = 0;
+	HOST_CHECK(len == 17 && data[0] == i, "read length %u index %u", len, data[0]);
+}
+
+// One RTC second, alarm interrupt and main loop alarm evaluation as in main.c
+static void Second(time_t t) {
+	HostRtcSet(t, 0);
+	if (HostRtcAlarm()) {
+		alarmInterrupts++;
+		HAL_RTC_AlarmAEventCallback(&hrtc);
+	}
+	if (alarmEventFlag) {
+		EvaluateAlarm();
+		alarmEventFlag = 0;
+	}
+}
+
+static void Boot(uint8_t reset, time_t t) {
+	resetStatus = reset;
+	HostRtcSet(t, 0);
+	RtcInit();
+}
+
+static void TestWeeks(void) {
+	uint8_t data[17], r[9];
+	uint32_t run, span, k, matches;
+	uint8_t n, i, mask;
+	struct tm tm;
+	time_t t, start;
+
+	for (run = 0; run < TEST_RUNS_NUM; run++) {
+		memset(nvValid, 0, sizeof(nvValid));
+		memset(refSchedule, 0, sizeof(refSchedule));
+		start = TEST_START + (rand() % 3000) * 86400 + rand() % 86400;
+		Boot(0, start);
+		n = 1 + rand() % RTC_WAKE_SCHEDULES_NUM;
+		for (i = 0; i < n; i++) {
+			RandomSchedule(r);
+			WriteSchedule(rand() % 2 ? i : RTC_WAKE_SCHEDULES_NUM - 1 - i, r);
+		}
+
+		// 2 to 4 weeks, MCU is woken only when schedule matches
+		wakeEvents = 0;
+		alarmInterrupts = 0;
+		matches = 0;
+		span = (14 + rand() % 15) * 86400;
+		for (k = 1; k <= span; k++) {
+			t = start + k;
+			Second(t);
+			gmtime_r(&t, &tm);
+			mask = 0;
+			for (i = 0; i < RTC_WAKE_SCHEDULES_NUM; i++) {
+				if (ScheduleMatch(refSchedule[i], &tm)) mask |= 0x01 << i;
+			}
+			if (!mask) continue;
+			matches++;
+			ReadSchedule(0, data);
+			if (data[10] != mask || data[11] != tm.tm_year - 100 || data[12] != tm.tm_mon + 1 || data[13] != tm.tm_mday
+				|| data[14] != tm.tm_hour || data[15] != tm.tm_min || data[16] != tm.tm_sec) {
+				HOST_CHECK(0, "run %u at %u-%u-%u %u:%u:%u fired 0x%02X at %u-%u-%u %u:%u:%u expected 0x%02X", run,
+						tm.tm_year - 100, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, data[10],
+						data[11], data[12], data[13], data[14], data[15], data[16], mask);
+				break;
+			}
+		}
+		HOST_CHECK(wakeEvents == matches, "run %u %u wake-ups for %u matches", run, wakeEvents, matches);
+		// alarm A further than a month ahead fires on same date of earlier month too
+		HOST_CHECK(alarmInterrupts <= matches + span / (28 * 86400) + 1, "run %u %u alarm interrupts for %u matches",
+				run, alarmInterrupts, matches);
+	}
+}
+
+static void TestAlarm1(void) {
+	uint8_t cr[2] = {0x05, 0}; // INTCN, A1IE, clear A1F
+	uint8_t alarm1[9] = {0x00, 0x30, 0x06, 0x80, 0xFF, 0xFF, 0xFF, 0, 0xFF}; // 06:30:00 every day
+	uint8_t schedule[9] = {0x00, 0x80, 0x80, 0x80, 0xFF, 0xFF, 0xFF, 20, 0xFF}; // every 20 minutes
+	uint8_t hourly[9] = {0x00, 0x00, 0x80, 0x80, 0xFF, 0xFF, 0xFF, 0, 0xFF};
+	uint8_t data[17], status[2];
+	uint32_t k, alarm1Flags = 0;
+	uint16_t len;
+	time_t t;
+
+	memset(nvValid, 0, sizeof(nvValid));
+	memset(refSchedule, 0, sizeof(refSchedule));
+	Boot(0, TEST_START);
+	RtcWriteControlStatus(cr, 2);
+	RtcWriteAlarm1(alarm1, 1);
+	WriteSchedule(3, schedule);
+	WriteSchedule(5, hourly);
+
+	// all wake up through single alarm A, alarm 1 flag is set only by alarm 1
+	wakeEvents = 0;
+	for (k = 1; k <= 2 * 86400; k++) {
+		t = TEST_START + k;
+		Second(t);
+		RtcReadControlStatus(status, &len);
+		if (status[1] & 0x01) {
+			HOST_CHECK((t % 86400) == 6 * 3600 + 30 * 60, "alarm 1 flag at %u s of day", (uint32_t)(t % 86400));
+			alarm1Flags++;
+			RtcWriteControlStatus(cr, 2);
+		}
+	}
+	HOST_CHECK(alarm1Flags == 2, "alarm 1 flag set %u times", alarm1Flags);
+	HOST_CHECK(wakeEvents == 2 * 72 + 2, "%u wake-ups", wakeEvents);
+	ReadSchedule(3, data);
+	// hourly schedule fires together with 20 minute one, last at midnight
+	HOST_CHECK(data[10] == 0x28 && data[14] == 0 && data[15] == 0 && memcmp(data + 1, schedule, 9) == 0,
+			"fired 0x%02X at %u:%u", data[10], data[14], data[15]);
+}
+
+static void TestNv(void) {
+	uint8_t data[17], k;
+	uint8_t every[9] = {0x80, 0x80, 0x80, 0x80, 0xFF, 0xFF, 0xFF, 0, 0xFF}; // every second
+	uint8_t disabled[9] = {0};
+	time_t t = TEST_START + 12345;
+
+	// schedules are read from NV and fired record is kept over MCU reset
+	memset(nvValid, 0, sizeof(nvValid));
+	Boot(0, t);
+	for (k = 0; k < RTC_WAKE_SCHEDULES_NUM; k++) {
+		RandomSchedule(refSchedule[k]);
+		WriteSchedule(k, refSchedule[k]);
+	}
+	memcpy(refSchedule[2], every, 9);
+	WriteSchedule(2, every);
+	Second(t + 1);
+	Boot(1, t + 1);
+	for (k = 0; k < RTC_WAKE_SCHEDULES_NUM; k++) {
+		ReadSchedule(k, data);
+		HOST_CHECK(memcmp(data + 1, refSchedule[k], 9) == 0, "schedule %u not kept in NV", k);
+		HOST_CHECK(data[10] & 0x04, "fired record lost over MCU reset");
+	}
+
+	// cleared by host and on power up
+	data[0] = 0xFF;
+	RtcWakeScheduleWriteCmd(data, 1);
+	ReadSchedule(2, data);
+	HOST_CHECK(data[10] == 0 && data[16] == 0, "fired record not cleared");
+	Second(t + 2);
+	Boot(0, t + 2);
+	ReadSchedule(2, data);
+	HOST_CHECK(data[10] == 0, "fired record kept over power up");
+
+	// disabled schedule never fires, NV entry with invalid week days word is disabled
+	WriteSchedule(2, disabled);
+	nvVar[RTC_WAKE_SCHEDULE0_WDAYS_NV_ADDR + RTC_WAKE_SCHEDULE_NV_VARS * 5] ^= 0x0100;
+	Boot(1, t + 3);
+	ReadSchedule(5, data);
+	HOST_CHECK(data[4] == 0, "invalid NV schedule day 0x%02X", data[4]);
+	Second(t + 4);
+	ReadSchedule(2, data);
+	HOST_CHECK(memcmp(data + 1, disabled, 4) == 0 && !(data[10] & 0x24), "disabled schedule fired 0x%02X", data[10]);
+}
+
+// Register pointer write and repeated start read of n bytes, as HAL_I2C_AddrCallback and
+// HAL_I2C_SlaveTxCpltCallback in main.c serve it
+static void ReadRegisters(uint8_t reg, uint8_t n, uint8_t out[]) {
+	uint8_t tx[256];
+	uint16_t dataLen = 1;
+	uint8_t k, cmd;
+
+	hostIpsr = TEST_I2C_IRQ_IPSR;
+	readRequests++;
+	RtcDs1339ProcessRequest(I2C_DIRECTION_RECEIVE, reg, tx, &dataLen);
+	RtcSetPointer(reg + dataLen);
+	for (k = 0; k < n && k < dataLen; k++) out[k] = tx[k];
+	for (; k < n; k++) {
+		readCallbacks++;
+		dataLen = 1;
+		cmd = RtcGetPointer();
+		RtcDs1339ProcessRequest(I2C_DIRECTION_RECEIVE, cmd, tx, &dataLen);
+		RtcSetPointer(cmd + 1);
+		out[k] = tx[0];
+	}
+	hostIpsr = 0;
+}
+
+// Read from 0x80 at 0x14 address, HAL_I2C_AddrCallback serves rest of RTC map in one transfer
+static void ReadWindow(uint8_t cmd, uint8_t n, uint8_t out[]) {
+	uint8_t tx[256];
+	uint16_t dataLen = 1;
+
+	hostIpsr = TEST_I2C_IRQ_IPSR;
+	RtcDs1339ProcessRequest(I2C_DIRECTION_RECEIVE, cmd - 0x80, tx, &dataLen);
+	RtcSetPointer(cmd - 0x80 + dataLen);
+	hostIpsr = 0;
+	HOST_CHECK(dataLen >= n, "%u bytes from 0x%02X", dataLen, cmd);
+	memcpy(out, tx, n);
+}
+
+static void WriteRegisters(uint8_t reg, uint8_t n, uint8_t data[]) {
+	uint16_t len = n;
+
+	hostIpsr = TEST_I2C_IRQ_IPSR;
+	RtcDs1339ProcessRequest(I2C_DIRECTION_TRANSMIT, reg, data, &len);
+	hostIpsr = 0;
+}
+
+// DS1339 time registers for UTC time, hours in 12 or 24 hour format
+static void TimeRegisters(time_t t, uint8_t format12, uint8_t r[7]) {
+	struct tm tm;
+	uint8_t h;
+
+	gmtime_r(&t, &tm);
+	h = format12 ? (tm.tm_hour % 12 ? tm.tm_hour % 12 : 12) : tm.tm_hour;
+	r[0] = ((tm.tm_sec / 10) << 4) | (tm.tm_sec % 10);
+	r[1] = ((tm.tm_min / 10) << 4) | (tm.tm_min % 10);
+	r[2] = ((h / 10) << 4) | (h % 10);
+	if (format12) r[2] |= 0x40 | (tm.tm_hour >= 12 ? 0x20 : 0);
+	r[3] = tm.tm_wday ? tm.tm_wday : 7;
+	r[4] = ((tm.tm_mday / 10) << 4) | (tm.tm_mday % 10);
+	r[5] = (((tm.tm_mon + 1) / 10) << 4) | ((tm.tm_mon + 1) % 10);
+	r[6] = (((tm.tm_year - 100) / 10) << 4) | ((tm.tm_year - 100) % 10);
+}
+
+static void TestBurstRead(void) {
+	uint8_t alarm1[4] = {0x00, 0x30, 0x06, 0x80};
+	uint8_t cr[2] = {0x05, 0};
+	uint8_t out[RTC_MAP_LEN], ref[7];
+	uint32_t k, reads;
+	uint8_t start, reg, n, i, sub, format12;
+	time_t t = TEST_START + rand() % 100000000;
+
+	memset(nvValid, 0, sizeof(nvValid));
+	Boot(0, t);
+	WriteRegisters(7, 4, alarm1);
+	WriteRegisters(0x0E, 2, cr);
+
+	// hwclock get_time: 7 bytes from register 0 in one transfer, time decoded only on second tick
+	for (format12 = 0; format12 < 2; format12++) {
+		TimeRegisters(t, format12, ref);
+		WriteRegisters(0, 7, ref);
+		readRequests = 0;
+		readCallbacks = 0;
+		reads = hostRtcReads;
+		for (k = 0; k < 3000; k++) {
+			if (rand() % 10 == 0) t += 1 + rand() % 100000;
+			HostRtcSet(t, rand());
+			ReadRegisters(0, 7, out);
+			TimeRegisters(t, format12, ref);
+			if (memcmp(out, ref, 7) != 0) {
+				HOST_CHECK(0, "time %02X %02X %02X %02X %02X %02X %02X expected %02X %02X %02X %02X %02X %02X %02X",
+						out[0], out[1], out[2], out[3], out[4], out[5], out[6],
+						ref[0], ref[1], ref[2], ref[3], ref[4], ref[5], ref[6]);
+				break;
+			}
+		}
+		HOST_CHECK(readRequests == 3000 && readCallbacks == 0, "%u requests %u byte callbacks", readRequests, readCallbacks);
+		HOST_CHECK(hostRtcReads == reads, "%u HAL calendar reads", hostRtcReads - reads);
+	}
+
+	// time write is read back before next second tick
+	HostRtcSet(t, 0);
+	ReadRegisters(0, 7, out);
+	TimeRegisters(t + 86400 + 3600, 1, ref);
+	WriteRegisters(0, 7, ref);
+	ReadRegisters(0, 7, out);
+	HOST_CHECK(memcmp(out, ref, 7) == 0, "written time not read back");
+	// bit RTC does not keep is dropped even if calendar registers are unchanged by write
+	HostRtcSet(t, 0);
+	ReadRegisters(0, 7, out);
+	TimeRegisters(t, 1, ref);
+	ref[0] |= 0x80; // oscillator stop bit of DS1339
+	WriteRegisters(0, 7, ref);
+	ReadRegisters(0, 7, out);
+	HOST_CHECK(out[0] == (ref[0] & 0x7F), "seconds 0x%02X", out[0]);
+
+	// any start register and length, single registers are current without register 0 read first
+	for (k = 0; k < 3000; k++) {
+		if (rand() % 4 == 0) t += 1 + rand() % 5000;
+		sub = rand();
+		HostRtcSet(t, sub);
+		start = rand() % RTC_MAP_LEN;
+		n = 1 + rand() % (RTC_MAP_LEN - start);
+		readCallbacks = 0;
+		ReadRegisters(start, n, out);
+		HOST_CHECK(readCallbacks == 0, "%u byte callbacks reading %u bytes from 0x%02X", readCallbacks, n, start);
+		TimeRegisters(t, 1, ref);
+		for (i = 0; i < n; i++) {
+			reg = start + i;
+			if (reg < 7) {
+				HOST_CHECK(out[i] == ref[reg], "register 0x%02X is 0x%02X expected 0x%02X", reg, out[i], ref[reg]);
+			} else if (reg == 8 || reg == 0x0E) {
+				HOST_CHECK(out[i] == (reg == 8 ? alarm1[1] : cr[0]), "register 0x%02X is 0x%02X", reg, out[i]);
+			} else if (reg == RTC_SUBSECONDS_REG) {
+				HOST_CHECK(out[i] == sub, "sub seconds 0x%02X expected 0x%02X", out[i], sub);
+			}
+		}
+	}
+
+	// register pointer wraps at end of map as on DS1339
+	TimeRegisters(t, 1, ref);
+	ReadRegisters(RTC_MAP_LEN - 1, 2, out);
+	HOST_CHECK(RtcSetPointer(RTC_MAP_LEN) == 0 && out[1] == ref[0], "pointer after map end 0x%02X", out[1]);
+}
+
+// Clock sync as rtcsync.c does it: registers 0x00-0x11 in one read, calendar and middle of 1/256 s
+// step taken as RTC time at snapshot placed 3 bytes into transfer, compared with known offset
+static void TestSync(void) {
+	uint8_t out[RTC_MAP_LEN];
+	double offset, byteTime, before, snapshot, after, rtc, estimate, err, maxErr = 0;
+	struct tm tm;
+	time_t sec;
+	uint32_t k;
+	uint8_t sub;
+
+	for (k = 0; k < TEST_SYNC_READS; k++) {
+		offset = rand() % 3 == 0 ? 0 : (rand() % 2 ? 86400.0 : 1.0) * (2.0 * rand() / RAND_MAX - 1);
+		byteTime = 9.0 / (rand() % 2 ? 100000 : 400000);
+		before = TEST_START + rand() % 100000000 + (double)rand() / RAND_MAX;
+		snapshot = before + TEST_SYNC_LATENCY * rand() / RAND_MAX + TEST_SNAPSHOT_BYTES * byteTime;
+		after = snapshot + RTC_MAP_LEN * byteTime + TEST_SYNC_LATENCY * rand() / RAND_MAX;
+		rtc = snapshot + offset;
+		sec = floor(rtc);
+		HostRtcSet(sec, (rtc - sec) * 256);
+
+		// at 0x68, or at 0x14 from 0x80 where sub-seconds register is 0x91
+		if (k % 2) {
+			ReadRegisters(0, RTC_MAP_LEN, out);
+		} else {
+			ReadWindow(0x80, RTC_MAP_LEN, out);
+		}
+
+		memset(&tm, 0, sizeof(tm));
+		tm.tm_sec = TEST_BCD2BIN(out[0] & 0x7F);
+		tm.tm_min = TEST_BCD2BIN(out[1] & 0x7F);
+		tm.tm_hour = (out[2] & 0x40) ? TEST_BCD2BIN(out[2] & 0x1F) % 12 + ((out[2] & 0x20) ? 12 : 0) : TEST_BCD2BIN(out[2] & 0x3F);
+		tm.tm_mday = TEST_BCD2BIN(out[4] & 0x3F);
+		tm.tm_mon = TEST_BCD2BIN(out[5] & 0x1F) - 1;
+		tm.tm_year = TEST_BCD2BIN(out[6]) + 100;
+		estimate = timegm(&tm) + (out[RTC_SUBSECONDS_REG] * 2 + 1) / 512.0
+			- (before + (after - before) * TEST_SNAPSHOT_BYTES / (TEST_SNAPSHOT_BYTES + RTC_MAP_LEN));
+		err = fabs(estimate - offset);
+		if (err > maxErr) maxErr = err;
+		HOST_CHECK(err < 1.0 / 256, "offset %.4f s estimated %.4f s", offset, estimate);
+
+		// sub-seconds alone at 0x91, later in same second
+		sub = rand();
+		HostRtcSet(sec, sub);
+		ReadWindow(0x80 + RTC_SUBSECONDS_REG, 1, out);
+		HOST_CHECK(out[0] == sub, "sub seconds 0x%02X at 0x91 expected 0x%02X", out[0], sub);
+	}
+	printf("worst sync error %.2f ms over %u reads\n", maxErr * 1000, TEST_SYNC_READS);
+}
+
+int main(int argc, char *argv[]) {
+	int seed = argc > 1 ? atoi(argv[1]) : 1;
+	char name[40];
+
+	srand(seed);
+
+	TestWeeks();
+	TestAlarm1();
+	TestNv();
+	TestBurstRead();
+	TestSync();
+
+	snprintf(name, sizeof(name), "test_rtc_ds1339_emu seed %d", seed);
+	return HostReport(name);
+}
@@ -0,0 +1,192 @@
+// ----------------------------------------------------------------------------
+/*!
+ * @file         test_rtc_schedule.c
+ * @date       19 October 2026
+ * @brief       RTC alarm schedule tests: a year of random alarm masks with
+ *                  alarm programmed for exact next matching time compared
+ *                  with previous hardware alarm and software selection
+ *                  check, wake-ups and matches counted, schedules that
+ *                  can not match and 29th February in leap year.
+ *                  Usage: test_rtc_schedule [seed]
+ */
+// ----------------------------------------------------------------------------
+// Include section - add all #includes here:
+
+#include <stdlib.h>
+#include <time.h>
+#include "rtc_schedule.h"
+
+// ----------------------------------------------------------------------------
+// Defines section - add all #defines here:
+
+#define TEST_START	1767225600 // 2026-01-01 00:00:00
+#define TEST_CONFIGS_NUM	25
+#define TEST_MATCHES_MAX	600000
+
+// ----------------------------------------------------------------------------
+// Variables section - add all global variables here:
+
+static time_t oldMatch[TEST_MATCHES_MAX];
+static time_t newMatch[TEST_MATCHES_MAX];
+static uint32_t oldWakes, newWakes;
+
+// ----------------------------------------------------------------------------
+// Function section - add all local functions here:
+
+static void Calendar(time_t e, RtcCalendar_T *c) {
+	struct tm tm;
+
+	gmtime_r(&e, &tm);
+	c->year = tm.tm_year - 100;
+	c->month = tm.tm_mon + 1;
+	c->date = tm.tm_mday;
+	c->weekDay = tm.tm_wday ? tm.tm_wday : 7;
+	c->hours = tm.tm_hour;
+	c->minutes = tm.tm_min;
+	c->seconds = tm.tm_sec;
+}
+
+// Previous firmware: hardware alarm on DS1339 fields wakes MCU, then selections are checked in software
+static uint8_t OldAlarm(const RtcSchedule_T *s, const RtcCalendar_T *c) {
+	return ((s->seconds & RTC_SCHEDULE_ANY) || s->seconds == c->seconds)
+		&& ((s->minutes & RTC_SCHEDULE_ANY) || s->minutes == c->minutes)
+		&& ((s->hours & RTC_SCHEDULE_ANY) || s->hours == c->hours)
+		&& ((s->day & RTC_SCHEDULE_ANY) || ((s->day & RTC_SCHEDULE_WEEKDAY) ? (s->day & 0x0F) == c->weekDay
+			: (s->day & 0x3F) == c->date));
+}
+
+static uint8_t OldSelection(const RtcSchedule_T *s, const RtcCalendar_T *c) {
+	if ( !((s->weekDaysSelection >> c->weekDay) & 0x01) ) return 0;
+	if ( s->minutesStep > 1 && (c->minutes % s->minutesStep) ) return 0;
+	return (s->hoursSelection >> c->hours) & 0x01;
+}
+
+static void RandomSchedule(RtcSchedule_T *s) {
+	uint8_t r = rand() % 4;
+
+	s->seconds = rand() % 10 ? rand() % 60 : RTC_SCHEDULE_ANY;
+	s->minutes = rand() % 2 ? RTC_SCHEDULE_ANY : rand() % 60;
+	s->minutesStep = rand() % 10 < 3 ? 2 + rand() % 29 : 0;
+	s->hours = rand() % 2 ? RTC_SCHEDULE_ANY : rand() % 24;
+	s->hoursSelection = rand() % 10 < 4 ? (rand() & 0x00FFFFFF) : 0x00FFFFFF;
+	s->day = r < 2 ? RTC_SCHEDULE_ANY : (r == 2 ? RTC_SCHEDULE_WEEKDAY | (1 + rand() % 7) : 1 + rand() % 31);
+	s->weekDaysSelection = rand() % 10 < 4 ? (rand() & 0xFE) : 0xFE;
+}
+
+// Compares matches of one schedule over span, alarm is checked every second if seconds match any
+static void CompareSchedule(const RtcSchedule_T *s) {
+	uint8_t anySec = s->seconds & RTC_SCHEDULE_ANY;
+	time_t end = TEST_START + (anySec ? 3 * 86400 : 366 * 86400);
+	time_t first = TEST_START + (anySec ? 0 : s->seconds);
+	uint32_t step = anySec ? 1 : 60;
+	uint32_t nOld = 0, nNew = 0, k;
+	RtcCalendar_T c, alarm;
+	uint8_t r;
+	time_t t;
+
+	for (t = first; t < end; t += step) {
+		Calendar(t, &c);
+		if (!OldAlarm(s, &c)) continue;
+		oldWakes++;
+		if (OldSelection(s, &c) && nOld < TEST_MATCHES_MAX) oldMatch[nOld++] = t;
+	}
+
+	// alarm is programmed for exact time, found time is searched again from it after wake-up
+	Calendar(TEST_START - 1, &alarm);
+	r = RtcScheduleNext(s, &alarm);
+	for (t = first; t < end && r == RTC_SCHEDULE_FOUND; t += step) {
+		Calendar(t, &c);
+		if (RtcCalendarCompare(&c, &alarm) != 0) continue;
+		newWakes++;
+		HOST_CHECK(RtcScheduleMatch(s, &c), "alarm at not matching time");
+		if (nNew < TEST_MATCHES_MAX) newMatch[nNew++] = t;
+		r = RtcScheduleNext(s, &alarm);
+		HOST_CHECK(RtcCalendarCompare(&alarm, &c) > 0, "next alarm not after wake-up");
+	}
+
+	for (k = 0; k < nOld && k < nNew && oldMatch[k] == newMatch[k]; k++);
+	if (nOld != nNew || k < nOld) {
+		HOST_CHECK(0, "seconds %02X minutes %02X hours %02X day %02X hours selection %06X step %u week days %02X:"
+				" %u matches expected %u, first differs at %u", s->seconds, s->minutes, s->hours, s->day,
+				s->hoursSelection, s->minutesStep, s->weekDaysSelection, nNew, nOld, k);
+	}
+}
+
+static void TestYear(void) {
+	RtcSchedule_T s;
+	uint32_t k;
+
+	oldWakes = 0;
+	newWakes = 0;
+	for (k = 0; k < TEST_CONFIGS_NUM; k++) {
+		RandomSchedule(&s);
+		CompareSchedule(&s);
+	}
+	// every wake-up is a match now, previous alarm woke up for each hardware match
+	HOST_CHECK(newWakes <= oldWakes, "wake-ups %u previous %u", newWakes, oldWakes);
+}
+
+static void TestSparse(void) {
+	RtcSchedule_T s = {0, 30, RTC_SCHEDULE_ANY, RTC_SCHEDULE_ANY, 0x00000040, 0, 0x3E};
+
+	// 06:30 on work days wakes MCU once a day, not every hour
+	oldWakes = 0;
+	newWakes = 0;
+	CompareSchedule(&s);
+	HOST_CHECK(newWakes == 262, "work day wake-ups %u in 2026 and 1st January 2027", newWakes);
+	HOST_CHECK(oldWakes == 366 * 24, "previous wake-ups %u", oldWakes);
+}
+
+static void TestNone(void) {
+	RtcSchedule_T s = {0, 0, 0, 1, 0x00FFFFFF, 0, 0xFE};
+	RtcCalendar_T c;
+
+	// fields and selections that exclude each other never match
+	Calendar(TEST_START, &c);
+	s.day = 32;
+	HOST_CHECK(RtcScheduleNext(&s, &c) == RTC_SCHEDULE_NONE, "date 32");
+	s.day = RTC_SCHEDULE_WEEKDAY | 3;
+	s.weekDaysSelection = 0xFE & ~(0x01 << 3);
+	HOST_CHECK(RtcScheduleNext(&s, &c) == RTC_SCHEDULE_NONE, "week day not selected");
+	s.day = RTC_SCHEDULE_ANY;
+	s.weekDaysSelection = 0xFE;
+	s.hours = 5;
+	s.hoursSelection = 0x00FFFFFF & ~(0x01 << 5);
+	HOST_CHECK(RtcScheduleNext(&s, &c) == RTC_SCHEDULE_NONE, "hour not selected");
+	s.hours = RTC_SCHEDULE_ANY;
+	s.minutes = 25;
+	s.minutesStep = 10;
+	HOST_CHECK(RtcScheduleNext(&s, &c) == RTC_SCHEDULE_NONE, "minute not multiple of step");
+	s.minutes = 0;
+	s.hoursSelection = 0;
+	HOST_CHECK(RtcScheduleNext(&s, &c) == RTC_SCHEDULE_NONE, "no hour selected");
+}
+
+static void TestLeapDay(void) {
+	RtcSchedule_T s = {0, 0, 12, 29, 0x00FFFFFF, 0, 0xFE};
+	RtcCalendar_T c;
+
+	// 29th is next in March in 2027, in February in leap year 2028
+	Calendar(TEST_START + 396 * 86400, &c);
+	HOST_CHECK(RtcScheduleNext(&s, &c) == RTC_SCHEDULE_FOUND && c.year == 27 && c.month == 3 && c.date == 29,
+			"29th after 2027-02-01 is %u-%u-%u", c.year, c.month, c.date);
+	Calendar(TEST_START + 761 * 86400, &c);
+	HOST_CHECK(RtcScheduleNext(&s, &c) == RTC_SCHEDULE_FOUND && c.year == 28 && c.month == 2 && c.date == 29
+			&& c.weekDay == 2 && c.hours == 12, "29th after 2028-02-01 is %u-%u-%u week day %u",
+			c.year, c.month, c.date, c.weekDay);
+}
+
+int main(int argc, char *argv[]) {
+	int seed = argc > 1 ? atoi(argv[1]) : 1;
+	char name[40];
+
+	srand(seed);
+
+	TestYear();
+	TestSparse();
+	TestNone();
+	TestLeapDay();
+
+	snprintf(name, sizeof(name), "test_rtc_schedule seed %d", seed);
+	return HostReport(name);
+}
@@ -0,0 +1,307 @@
+// ----------------------------------------------------------------------------
+/*!
+ * @file         test_trace.c
+ * @date       19 October 2026
+ * @brief       Telemetry trace tests: drain frames decoded as
+ *                  pijuice_trace.py does and compared with sampled
+ *                  values and times, signal mask, new chunk after missed
+ *                  samples, overwritten chunks, frame repeat and rewind.
+ *                  Usage: test_trace [seed]
+ */
+// ----------------------------------------------------------------------------
+// Include section - add all #includes here:
+
+#include <stdlib.h>
+#include <string.h>
+#include "trace.h"
+#include "power_source.h"
+#include "charger_bq2416x.h"
+#include "fuel_gauge_lc709203f.h"
+#include "load_current_sense.h"
+#include "rtc_ds1339_emu.h"
+
+// ----------------------------------------------------------------------------
+// Defines section - add all #defines here:
+
+#define TEST_I2C_IRQ_IPSR	39 // exception number of I2C1 interrupt
+#define TEST_SAMPLES_MAX	4000
+#define TEST_FLAG_MORE	0x01
+#define TEST_FLAG_LOST	0x02
+
+// ----------------------------------------------------------------------------
+// Variables section - add all global variables here:
+
+// modules trace takes signals from
+uint16_t batteryVoltage;
+volatile int16_t batteryCurrent;
+int8_t batteryTemp;
+uint16_t batteryRsoc;
+ChargerStatus_T chargerStatus;
+PowerSourceStatus_T power5vIoStatus = POW_SOURCE_NORMAL;
+uint8_t resetStatus;
+static int16_t loadCurrent;
+static uint16_t period;
+
+// sampled values and their time, in order of sampling
+static int16_t refValue[TEST_SAMPLES_MAX][TRACE_SIGNALS_NUM];
+static uint32_t refTick[TEST_SAMPLES_MAX];
+static uint32_t refCount;
+
+// samples decoded from drain frames
+static int16_t outValue[TEST_SAMPLES_MAX][TRACE_SIGNALS_NUM];
+static uint32_t outTick[TEST_SAMPLES_MAX];
+static uint32_t outCount;
+
+// ----------------------------------------------------------------------------
+// Function section - add all local functions here:
+
+int32_t GetLoadCurrent(void) {
+	return loadCurrent;
+}
+
+void RtcReadLinearTime(uint32_t *sec, uint8_t *sub) {
+	*sec = hostTick / 1000;
+	*sub = (hostTick % 1000) * 256 / 1000;
+}
+
+static void Start(uint8_t mask, uint16_t p, uint8_t flags) {
+	uint8_t cmd[5] = {0, mask, p, p >> 8, flags};
+
+	hostIpsr = TEST_I2C_IRQ_IPSR;
+	TraceWriteCmd(cmd, 5);
+	hostIpsr = 0;
+	period = p;
+	refCount = 0;
+	outCount = 0;
+}
+
+static void Command(uint8_t c) {
+	hostIpsr = TEST_I2C_IRQ_IPSR;
+	TraceWriteCmd(&c, 1);
+	hostIpsr = 0;
+}
+
+// Signals change by random steps, some stay unchanged, some make full range jumps
+static void SetSignals(void) {
+	int16_t step = rand() % 4 == 0 ? (int16_t)rand() : rand() % 200 - 100;
+
+	switch (rand() % 6) {
+	case 0: batteryVoltage += step; break;
+	case 1: batteryCurrent += step; break;
+	case 2: loadCurrent += step; break;
+	case 3: batteryTemp += step; break;
+	case 4: batteryRsoc = rand() % 1001; break;
+	default: chargerStatus = rand() % 4; break;
+	}
+}
+
+// Runs main loop after elapsed ms and records sample taken in it
+static void Tick(uint32_t elapsed) {
+	SetSignals();
+	hostTick += elapsed;
+	TraceTask();
+	if (refCount < TEST_SAMPLES_MAX) {
+		refValue[refCount][TRACE_SIGNAL_VBAT] = batteryVoltage;
+		refValue[refCount][TRACE_SIGNAL_IBAT] = batteryCurrent;
+		refValue[refCount][TRACE_SIGNAL_IIO] = loadCurrent;
+		refValue[refCount][TRACE_SIGNAL_TEMP] = batteryTemp;
+		refValue[refCount][TRACE_SIGNAL_SOC] = batteryRsoc;
+		refValue[refCount][TRACE_SIGNAL_CHARGER] = chargerStatus;
+		refTick[refCount] = hostTick;
+		refCount++;
+	}
+}
+
+static uint16_t ReadLeb128(const uint8_t **p) {
+	uint16_t v = 0;
+	uint8_t shift = 0;
+
+	do {
+		v |= (uint16_t)(**p & 0x7F) << shift;
+		shift += 7;
+	} while (*(*p)++ & 0x80);
+	return v;
+}
+
+// Decodes chunks of drain frame into out samples, returns frame flags
+static uint8_t Drain(uint8_t data[TRACE_DRAIN_LEN]) {
+	const uint8_t *p, *end, *chunk;
+	uint16_t len = 0, z;
+	uint8_t mask, count, k, i, bit, changed;
+	uint32_t sec, ms, framePeriod;
+	int16_t v[TRACE_SIGNALS_NUM] = {0};
+
+	hostIpsr = TEST_I2C_IRQ_IPSR;
+	TraceReadCmd(data, &len);
+	hostIpsr = 0;
+	HOST_CHECK(len == TRACE_DRAIN_LEN, "frame length %u", len);
+	HOST_CHECK(data[0] <= TRACE_DRAIN_LEN - TRACE_DRAIN_HEADER_LEN, "chunks length %u", data[0]);
+
+	mask = data[2];
+	framePeriod = data[3] | (data[4] << 8);
+	HOST_CHECK(framePeriod == period, "frame period %u", framePeriod);
+	p = data + TRACE_DRAIN_HEADER_LEN;
+	end = p + data[0];
+	while (p < end) {
+		chunk = p;
+		count = p[1];
+		sec = p[2] | (p[3] << 8) | (p[4] << 16) | ((uint32_t)p[5] << 24);
+		ms = sec * 1000 + (p[6] * 1000 + 255) / 256;
+		p += TRACE_CHUNK_HEADER_LEN;
+		for (k = 0; k < count; k++) {
+			if (k == 0) {
+				for (i = 0; i < TRACE_SIGNALS_NUM; i++) {
+					if (!(mask & (0x01 << i))) continue;
+					v[i] = p[0] | (p[1] << 8);
+					p += 2;
+				}
+			} else {
+				changed = *p++;
+				bit = 0x01;
+				for (i = 0; i < TRACE_SIGNALS_NUM; i++) {
+					if (!(mask & (0x01 << i))) continue;
+					if (changed & bit) {
+						z = ReadLeb128(&p);
+						v[i] += (int16_t)((z >> 1) ^ -(z & 1));
+					}
+					bit <<= 1;
+				}
+			}
+			if (outCount < TEST_SAMPLES_MAX) {
+				memcpy(outValue[outCount], v, sizeof(v));
+				outTick[outCount] = ms + k * framePeriod;
+				outCount++;
+			}
+		}
+		HOST_CHECK(p - chunk == chunk[0], "chunk length %u decoded %u", chunk[0], (unsigned)(p - chunk));
+		p = chunk + chunk[0];
+	}
+	return data[1];
+}
+
+// Reads as pijuice_trace.py streaming, until open chunk is returned too, returns or of flags
+static uint8_t DrainAll(void) {
+	uint8_t data[TRACE_DRAIN_LEN];
+	uint8_t flags = 0, f;
+
+	do {
+		f = Drain(data);
+		flags |= f;
+	} while (data[0] || (f & TEST_FLAG_MORE));
+	return flags;
+}
+
+// Decoded samples must be ref samples from first, in order
+static void CheckSamples(const char *step, uint32_t first, uint8_t mask) {
+	uint32_t n, k;
+	uint8_t i;
+
+	HOST_CHECK(outCount == refCount - first, "%s: decoded %u samples of %u", step, outCount, refCount - first);
+	n = outCount < refCount - first ? outCount : refCount - first;
+	for (k = 0; k < n; k++) {
+		for (i = 0; i < TRACE_SIGNALS_NUM; i++) {
+			if (!(mask & (0x01 << i))) continue;
+			if (outValue[k][i] != refValue[first + k][i]) {
+				HOST_CHECK(0, "%s: sample %u signal %u value %d expected %d", step, k, i, outValue[k][i], refValue[first + k][i]);
+				return;
+			}
+		}
+		// time has 1/256 s resolution
+		if (outTick[k] + 4 < refTick[first + k] || outTick[k] > refTick[first + k] + 4) {
+			HOST_CHECK(0, "%s: sample %u time %u expected %u", step, k, outTick[k], refTick[first + k]);
+			return;
+		}
+	}
+}
+
+static void TestSamples(void) {
+	uint32_t k;
+	uint8_t mask;
+
+	// drained often enough that nothing is lost
+	Start(0x3F, TRACE_MIN_PERIOD_MS, 0);
+	for (k = 0; k < 2000; k++) {
+		Tick(period);
+		if (rand() % 40 == 0) HOST_CHECK(!(DrainAll() & TEST_FLAG_LOST), "lost at %u", k);
+	}
+	DrainAll();
+	CheckSamples("all signals", 0, 0x3F);
+
+	// random subset of signals and period
+	mask = 1 + rand() % 0x3F;
+	Start(mask, 100 + rand() % 900, 0);
+	for (k = 0; k < 500; k++) {
+		Tick(period);
+		if (rand() % 40 == 0) DrainAll();
+	}
+	DrainAll();
+	CheckSamples("signal subset", 0, mask);
+}
+
+static void TestMissedSamples(void) {
+	uint32_t k;
+
+	// sample later than two periods starts chunk with its own time
+	Start(0x3F, 50, 0);
+	for (k = 0; k < 300; k++) {
+		Tick(rand() % 20 ? period : 2 * period + rand() % 500);
+		if (rand() % 40 == 0) DrainAll();
+	}
+	DrainAll();
+	CheckSamples("missed samples", 0, 0x3F);
+}
+
+static void TestOverwrite(void) {
+	uint32_t k;
+
+	// unread chunks are overwritten, newest samples are kept in order
+	Start(0x3F, TRACE_MIN_PERIOD_MS, 0);
+	for (k = 0; k < 1500; k++) Tick(period);
+	HOST_CHECK(DrainAll() & TEST_FLAG_LOST, "lost chunks not reported");
+	HOST_CHECK(outCount > 100 && outCount < refCount, "kept %u of %u", outCount, refCount);
+	CheckSamples("overwrite", refCount - outCount, 0x3F);
+	HOST_CHECK(!(DrainAll() & TEST_FLAG_LOST), "lost reported again");
+}
+
+static void TestRepeatRewind(void) {
+	uint8_t first[TRACE_DRAIN_LEN], again[TRACE_DRAIN_LEN];
+	uint32_t k, n;
+
+	Start(0x3F, TRACE_MIN_PERIOD_MS, 0);
+	for (k = 0; k < 300; k++) Tick(period);
+
+	// frame received with error is repeated
+	Drain(first);
+	n = outCount;
+	Tick(period);
+	Command(2);
+	Drain(again);
+	HOST_CHECK(memcmp(first, again, TRACE_DRAIN_LEN) == 0, "repeated frame differs");
+	outCount = n;
+	DrainAll();
+	CheckSamples("repeat", 0, 0x3F);
+
+	// rewind returns all chunks still in buffer
+	Command(1);
+	outCount = 0;
+	DrainAll();
+	CheckSamples("rewind", 0, 0x3F);
+}
+
+int main(int argc, char *argv[]) {
+	int seed = argc > 1 ? atoi(argv[1]) : 1;
+	char name[32];
+
+	srand(seed);
+	// 5V regulator on, host is powered
+	hostGPIOA.IDR = GPIO_PIN_10;
+	TraceInit();
+
+	TestSamples();
+	TestMissedSamples();
+	TestOverwrite();
+	TestRepeatRewind();
+
+	snprintf(name, sizeof(name), "test_trace seed %d", seed);
+	return HostReport(name);
+}
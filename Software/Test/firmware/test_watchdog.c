@@ -0,0 +1,430 @@
+// ----------------------------------------------------------------------------
+/*!
+ * @file         test_watchdog.c
+ * @date       19 October 2026
+ * @brief       Host watchdog tests on simulated GPIO and EXTI line 7:
+ *                  IO1 heartbeat edges at random intervals keep watchdog
+ *                  from expiring, warning and expiry follow last edge,
+ *                  line is on I2C SDA in stop mode and level change of IO1
+ *                  in stop refreshes watchdog at exit, reconfigured IO1
+ *                  does not refresh it, sub-minute period reads back with
+ *                  command 0x61.
+ *                  Usage: test_watchdog [seed]
+ */
+// ----------------------------------------------------------------------------
+// Include section - add all #includes here:
+
+#include <stdlib.h>
+#include <string.h>
+#include "power_management.h"
+#include "io_control.h"
+#include "io_log.h"
+#include "io_counter.h"
+#include "analog.h"
+#include "charger_bq2416x.h"
+#include "fuel_gauge_lc709203f.h"
+#include "battery.h"
+#include "power_source.h"
+#include "button.h"
+#include "logging.h"
+#include "flash_log.h"
+#include "time_count.h"
+#include "nv.h"
+
+// ----------------------------------------------------------------------------
+// Defines section - add all #defines here:
+
+#define TEST_I2C_IRQ_IPSR	39 // exception number of I2C1 interrupt
+#define TEST_EXTI_IRQ_IPSR	23 // exception number of EXTI4_15 interrupt
+#define TEST_PERIOD	20 // s
+#define TEST_WARN	5 // s
+#define TEST_TASK_PERIOD	500 // ms, watchdog is evaluated by power management task
+#define TEST_EXTI_MODE	0x10000000 // GPIO mode flags of HAL
+#define TEST_RISING_EDGE	0x00100000
+#define TEST_FALLING_EDGE	0x00200000
+#define TEST_NONE	0xFFFFFFFF
+
+// ----------------------------------------------------------------------------
+// Variables section - add all global variables here:
+
+uint8_t resetStatus;
+uint8_t noBatteryTurnOn;
+uint32_t lastHostCommandTimer;
+uint8_t regs[8];
+uint16_t batteryVoltage;
+uint16_t batteryRsoc;
+int8_t batteryTemp;
+BatteryStatus_T batteryStatus;
+PowerSourceStatus_T powerInStatus;
+PowerSourceStatus_T power5vIoStatus;
+uint8_t pow5vInDetStatus;
+
+extern TIM_HandleTypeDef htim1;
+extern TIM_HandleTypeDef htim14;
+
+// EXTI line 7 as set by GPIO init: port it is mapped to and enabled edges
+static GPIO_TypeDef *exti7Port;
+static uint32_t exti7Edges;
+static uint32_t sdaEvents; // EXTI line 7 events left for I2C SDA service
+static uint32_t boostOffs;
+
+// ----------------------------------------------------------------------------
+// Function section - add all local functions here:
+
+uint16_t EE_ReadVariable(uint16_t VirtAddress, uint16_t *Data) {
+	return 1;
+}
+
+uint16_t EE_WriteVariable(uint16_t VirtAddress, uint16_t Data) {
+	return 0;
+}
+
+uint16_t NvReadVariableU8(uint16_t VirtAddress, uint8_t *pVar) {
+	return 1;
+}
+
+int8_t Turn5vBoost(uint8_t onOff) {
+	if (onOff) {
+		hostGPIOA.IDR |= GPIO_PIN_10;
+	} else {
+		hostGPIOA.IDR &= ~GPIO_PIN_10;
+		boostOffs++;
+	}
+	return 0;
+}
+
+// Line of EXTI is mapped to port of last pin initialized in interrupt mode, other modes leave it
+void HAL_GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_Init) {
+	if (!(GPIO_Init->Pin & GPIO_PIN_7) || (GPIO_Init->Mode & TEST_EXTI_MODE) != TEST_EXTI_MODE) return;
+	exti7Port = GPIOx;
+	exti7Edges = GPIO_Init->Mode & (TEST_RISING_EDGE | TEST_FALLING_EDGE);
+	hostEXTI.IMR |= GPIO_PIN_7;
+}
+
+void Error_Handler(void) {
+	HOST_CHECK(0, "timer init error");
+}
+
+HAL_StatusTypeDef HAL_TIM_Base_Init(TIM_HandleTypeDef *htim) {
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_ConfigClockSource(TIM_HandleTypeDef *htim, TIM_ClockConfigTypeDef *sClockSourceConfig) {
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_PWM_Init(TIM_HandleTypeDef *htim) {
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_PWM_ConfigChannel(TIM_HandleTypeDef *htim, TIM_OC_InitTypeDef *sConfig, uint32_t Channel) {
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIMEx_MasterConfigSynchronization(TIM_HandleTypeDef *htim, TIM_MasterConfigTypeDef *sMasterConfig) {
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIMEx_ConfigBreakDeadTime(TIM_HandleTypeDef *htim, TIM_BreakDeadTimeConfigTypeDef *sBreakDeadTimeConfig) {
+	return HAL_OK;
+}
+
+void HAL_TIM_MspPostInit(TIM_HandleTypeDef *htim) {
+}
+
+HAL_StatusTypeDef HAL_TIM_PWM_Start(TIM_HandleTypeDef *htim, uint32_t Channel) {
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_PWM_Stop(TIM_HandleTypeDef *htim, uint32_t Channel) {
+	return HAL_OK;
+}
+
+void IoLogConfigure(uint16_t interval, uint8_t oversampling, uint8_t flags) {
+}
+
+void IoCounterStart(uint8_t pin, uint16_t param1, uint16_t param2) {
+}
+
+void IoCounterStop(uint8_t pin) {
+}
+
+uint8_t IoCounterEdge(uint8_t pin) {
+	return 1;
+}
+
+void IoCounterTask(void) {
+}
+
+void IoCounterRead(uint8_t pin, uint8_t data[], uint16_t *len) {
+	*len = 0;
+}
+
+void IoCounterWrite(uint8_t pin, uint8_t data[], uint8_t len) {
+}
+
+uint16_t GetSampleVoltage(uint8_t channel) {
+	return 0;
+}
+
+void ButtonRemoveEvent(uint8_t b) {
+}
+
+uint8_t *LoggingInitMessage(LogMsgId_T id, uint8_t len) {
+	return NULL;
+}
+
+void FlashLogPutStatus(FlashLogEventId_T id, uint8_t data0) {
+}
+
+int16_t Get5vIoVoltage() {
+	return 0;
+}
+
+int32_t GetLoadCurrent(void) {
+	return 0;
+}
+
+// Level change of pin 7, EXTI interrupt runs as HAL_GPIO_EXTI_Callback of main would call
+// IO edge handler when line is mapped to port and edge is enabled
+static void Edge(GPIO_TypeDef *port, uint8_t level) {
+	uint8_t old = (port->IDR & GPIO_PIN_7) != 0;
+
+	if (level) port->IDR |= GPIO_PIN_7; else port->IDR &= ~GPIO_PIN_7;
+	if (old == level || port != exti7Port || !(hostEXTI.IMR & GPIO_PIN_7)) return;
+	if (!(exti7Edges & (level ? TEST_RISING_EDGE : TEST_FALLING_EDGE))) return;
+	hostIpsr = TEST_EXTI_IRQ_IPSR;
+	if (IoEdgeEvent(1)) sdaEvents++;
+	hostIpsr = 0;
+}
+
+static void Toggle(void) {
+	Edge(GPIOA, !(hostGPIOA.IDR & GPIO_PIN_7));
+}
+
+static void Pass(void) {
+	hostTick += TICK_PERIOD_MS;
+	IoControlTask();
+	PowerManagementTask();
+}
+
+static void Run(uint32_t ms) {
+	uint32_t start = hostTick;
+	while (hostTick - start < ms) Pass();
+}
+
+// Stop mode entry and exit of main, EXTI line 7 wakes MCU on I2C SDA falling edge
+static void StopEntry(void) {
+	GPIO_InitTypeDef init = {0};
+
+	IoControlStopEntry();
+	init.Pin = GPIO_PIN_7;
+	init.Mode = GPIO_MODE_IT_FALLING;
+	HAL_GPIO_Init(GPIOB, &init);
+}
+
+static void StopExit(void) {
+	GPIO_InitTypeDef init = {0};
+
+	init.Pin = GPIO_PIN_7;
+	init.Mode = GPIO_MODE_AF_OD;
+	HAL_GPIO_Init(GPIOB, &init);
+	IoControlStopExit();
+}
+
+static void ConfigureIo1(uint8_t mode, uint8_t param) {
+	uint8_t d[5] = {mode, param, 0, 0, 0};
+
+	hostIpsr = TEST_I2C_IRQ_IPSR;
+	IoSetConfiguarion(1, d, sizeof(d));
+	hostIpsr = 0;
+}
+
+// Command 0xC5 write, heartbeat only mode, warning and period in seconds
+static void ConfigureWatchdog(uint8_t heartbeatOnly, uint8_t warn, uint16_t period) {
+	uint8_t d[4] = {heartbeatOnly, warn, period, period >> 8};
+
+	hostIpsr = TEST_I2C_IRQ_IPSR;
+	PowerMngmtSetWatchdogExtConfigCmd(d, sizeof(d));
+	hostIpsr = 0;
+}
+
+// Command 0xC5 read, returns remaining time in s and warning flag
+static uint16_t Remaining(uint8_t *warning) {
+	uint8_t d[8];
+	uint16_t len = 0;
+
+	hostIpsr = TEST_I2C_IRQ_IPSR;
+	PowerMngmtGetWatchdogExtConfigCmd(d, &len);
+	hostIpsr = 0;
+	HOST_CHECK(len == 6, "0xC5 read length %u", len);
+	if (warning) *warning = (d[0] >> 6) & 0x01;
+	return d[4] | (d[5] << 8);
+}
+
+// Command 0x61 read, period in minutes
+static uint16_t PeriodMinutes(void) {
+	uint8_t d[4];
+	uint16_t len = 0;
+
+	hostIpsr = TEST_I2C_IRQ_IPSR;
+	PowerMngmtGetWatchdogConfigurationCmd(d, &len);
+	hostIpsr = 0;
+	HOST_CHECK(len == 2, "0x61 read length %u", len);
+	return d[0] | ((d[1] & 0x7F) << 8);
+}
+
+static void TestHeartbeat(void) {
+	uint32_t start, last, warnTime = TEST_NONE, next;
+	uint8_t warning;
+
+	ConfigureIo1(0x02, 0x04);
+	HOST_CHECK(exti7Port == GPIOA && exti7Edges == (TEST_RISING_EDGE | TEST_FALLING_EDGE) && (hostEXTI.IMR & GPIO_PIN_7),
+			"IO1 heartbeat is not on EXTI line 7 on both edges");
+	ConfigureWatchdog(1, TEST_WARN, TEST_PERIOD);
+
+	// edges within warning time keep watchdog quiet
+	boostOffs = 0;
+	sdaEvents = 0;
+	start = hostTick;
+	next = hostTick + 500 + rand() % ((TEST_PERIOD - TEST_WARN) * 1000 - 1000);
+	while (hostTick - start < 300000) {
+		Pass();
+		if (hostTick >= next) {
+			Toggle();
+			next = hostTick + 500 + rand() % ((TEST_PERIOD - TEST_WARN) * 1000 - 1000);
+		}
+		Remaining(&warning);
+		HOST_CHECK(!warning && !boostOffs, "watchdog warning %u expiry %u with heartbeat", warning, boostOffs);
+		if (warning || boostOffs) return;
+	}
+	HOST_CHECK(sdaEvents == 0, "%u heartbeat edges left for I2C service", sdaEvents);
+
+	// heartbeat stops, warning and expiry are counted from last edge
+	Toggle();
+	last = hostTick;
+	while (!boostOffs && hostTick - last < 2 * TEST_PERIOD * 1000) {
+		Pass();
+		Remaining(&warning);
+		if (warning && warnTime == TEST_NONE) warnTime = hostTick;
+	}
+	HOST_CHECK(warnTime - last > (TEST_PERIOD - TEST_WARN) * 1000 && warnTime - last <= (TEST_PERIOD - TEST_WARN) * 1000 + TEST_TASK_PERIOD,
+			"warning %u ms after last edge", warnTime - last);
+	HOST_CHECK(boostOffs == 1 && hostTick - last > TEST_PERIOD * 1000 && hostTick - last <= TEST_PERIOD * 1000 + TEST_TASK_PERIOD,
+			"host reset %u times, %u ms after last edge", boostOffs, hostTick - last);
+	Remaining(&warning);
+	HOST_CHECK(!warning, "warning stays after expiry");
+	Run(1000);
+}
+
+static void TestStop(void) {
+	uint16_t r;
+	uint8_t k;
+
+	ConfigureIo1(0x02, 0x04);
+	ConfigureWatchdog(1, TEST_WARN, TEST_PERIOD);
+	Toggle();
+	boostOffs = 0;
+
+	// line is on SDA in stop, its edges wake MCU for I2C and do not refresh watchdog
+	for (k = 0; k < 10; k++) {
+		Run(rand() % 2000);
+		StopEntry();
+		sdaEvents = 0;
+		Edge(GPIOB, 1);
+		Edge(GPIOB, 0);
+		hostTick += 3000;
+		r = Remaining(NULL);
+		HOST_CHECK(sdaEvents == 1, "SDA falling edge in stop gave %u events", sdaEvents);
+		Edge(GPIOA, !(hostGPIOA.IDR & GPIO_PIN_7));
+		HOST_CHECK(Remaining(NULL) == r, "IO1 edge on SDA line refreshed watchdog in stop");
+		if (k & 1) Edge(GPIOA, !(hostGPIOA.IDR & GPIO_PIN_7));
+
+		// level change of IO1 while line was on SDA is heartbeat at exit
+		StopExit();
+		r = Remaining(NULL);
+		if (k & 1) {
+			HOST_CHECK(r < TEST_PERIOD - 1, "no level change in stop refreshed watchdog, %u s remaining", r);
+		} else {
+			HOST_CHECK(r >= TEST_PERIOD - 1, "level change in stop did not refresh watchdog, %u s remaining", r);
+		}
+		HOST_CHECK(exti7Port == GPIOA && (hostEXTI.IMR & GPIO_PIN_7), "EXTI line 7 not back on IO1 after stop");
+		Toggle();
+		HOST_CHECK(Remaining(NULL) >= TEST_PERIOD - 1, "IO1 edge after stop did not refresh watchdog");
+	}
+	HOST_CHECK(boostOffs == 0, "host reset %u times", boostOffs);
+
+	// nested in masked code, interrupt mask is restored
+	hostPrimask = 1;
+	PowerMngmtWatchdogHeartbeat();
+	HOST_CHECK(hostPrimask == 1, "heartbeat enabled interrupts");
+	hostPrimask = 0;
+	PowerMngmtWatchdogHeartbeat();
+	HOST_CHECK(hostPrimask == 0, "heartbeat left interrupts disabled");
+}
+
+static void TestReconfigure(void) {
+	uint16_t r;
+
+	// IO1 as analog input is off EXTI, its level changes are not heartbeat and stop exit keeps line on SDA
+	ConfigureIo1(0x02, 0x04);
+	ConfigureWatchdog(1, TEST_WARN, TEST_PERIOD);
+	ConfigureIo1(0x01, 0x00);
+	HOST_CHECK(!(hostEXTI.IMR & GPIO_PIN_7), "EXTI line 7 enabled for IO1 analog input");
+	Run(3000);
+	r = Remaining(NULL);
+	Toggle();
+	HOST_CHECK(Remaining(NULL) == r, "analog IO1 edge refreshed watchdog");
+	StopEntry();
+	Edge(GPIOA, !(hostGPIOA.IDR & GPIO_PIN_7));
+	StopExit();
+	HOST_CHECK(exti7Port == GPIOB && Remaining(NULL) == r, "stop exit changed line 7 of analog IO1");
+	ConfigureWatchdog(0, 0, 0);
+	Run(1000);
+}
+
+static void TestPeriodReadback(void) {
+	uint8_t d[2];
+
+	// period set in seconds is rounded up to minutes, active watchdog does not read as disabled
+	ConfigureWatchdog(0, 0, 20);
+	HOST_CHECK(PeriodMinutes() == 1, "20 s period reads %u min", PeriodMinutes());
+	ConfigureWatchdog(0, 0, 90);
+	HOST_CHECK(PeriodMinutes() == 2, "90 s period reads %u min", PeriodMinutes());
+	ConfigureWatchdog(0, 0, 180);
+	HOST_CHECK(PeriodMinutes() == 3, "180 s period reads %u min", PeriodMinutes());
+	d[0] = 7;
+	d[1] = 0;
+	hostIpsr = TEST_I2C_IRQ_IPSR;
+	PowerMngmtConfigureWatchdogCmd(d, sizeof(d));
+	hostIpsr = 0;
+	HOST_CHECK(PeriodMinutes() == 7, "7 min period reads %u min", PeriodMinutes());
+	d[0] = 0;
+	hostIpsr = TEST_I2C_IRQ_IPSR;
+	PowerMngmtConfigureWatchdogCmd(d, sizeof(d));
+	hostIpsr = 0;
+	HOST_CHECK(PeriodMinutes() == 0, "disabled watchdog reads %u min", PeriodMinutes());
+}
+
+int main(int argc, char *argv[]) {
+	int seed = argc > 1 ? atoi(argv[1]) : 1;
+	char name[40];
+
+	srand(seed);
+	hostTick = 100000;
+	regs[1] = 0x00; // battery present
+	power5vIoStatus = POW_SOURCE_NOT_PRESENT;
+	htim1.Instance = TIM1;
+	htim14.Instance = TIM14;
+	resetStatus = 0;
+	PowerManagementInit();
+	hostGPIOA.IDR |= GPIO_PIN_10; // host is powered
+
+	TestHeartbeat();
+	TestStop();
+	TestReconfigure();
+	TestPeriodReadback();
+
+	snprintf(name, sizeof(name), "test_watchdog seed %d", seed);
+	return HostReport(name);
+}
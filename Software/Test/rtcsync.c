@@ -0,0 +1,190 @@
+// ----------------------------------------------------------------------------
+/*!
+ * @file         rtcsync.c
+ * @date       19 October 2026
+ * @brief       Sets system clock from PiJuice RTC with single i2c read.
+ *                  Unlike readtime.c (and hwclock) it does not poll RTC
+ *                  until seconds change, time registers are read in one
+ *                  burst together with vendor sub-seconds register,
+ *                  firmware version >= 1.7.
+ *                  Usage: rtcsync [-n] [-b bus]
+ *                  -n only prints offset of system clock to RTC.
+ *                  RTC time is expected in UTC.
+ */
+// ----------------------------------------------------------------------------
+// Include section - add all #includes here:
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+
+// ----------------------------------------------------------------------------
+// Defines section - add all #defines here:
+
+#define RTC_I2C_ADDRESS		0x68
+#define RTC_SUBSECONDS_REG	0x11 // 1/256 s elapsed in current second
+#define RTC_READ_LEN		(RTC_SUBSECONDS_REG + 1)
+
+// Firmware takes time snapshot when read starts, after address, register
+// and repeated start address bytes of the whole transfer
+#define RTC_SNAPSHOT_BYTES	3
+#define RTC_TRANSFER_BYTES	(RTC_SNAPSHOT_BYTES + RTC_READ_LEN)
+
+#define BCD2BIN(b)	((((b) >> 4) & 0x0F) * 10 + ((b) & 0x0F))
+
+
+// ----------------------------------------------------------------------------
+// Function section:
+
+static int64_t TimespecToNs(const struct timespec *ts)
+{
+	return (int64_t)ts->tv_sec * 1000000000 + ts->tv_nsec;
+}
+
+// RTC registers to nanoseconds since epoch, -1 if registers are not valid time
+int64_t RtcRegistersToNs(const uint8_t regs[RTC_READ_LEN])
+{
+	struct tm t;
+	time_t sec;
+
+	memset(&t, 0, sizeof(t));
+	t.tm_sec = BCD2BIN(regs[0] & 0x7F);
+	t.tm_min = BCD2BIN(regs[1] & 0x7F);
+	if (regs[2] & 0x40)
+	{
+		// 12 hour format
+		t.tm_hour = BCD2BIN(regs[2] & 0x1F) % 12 + ((regs[2] & 0x20) ? 12 : 0);
+	}
+	else
+	{
+		t.tm_hour = BCD2BIN(regs[2] & 0x3F);
+	}
+	t.tm_mday = BCD2BIN(regs[4] & 0x3F);
+	t.tm_mon = BCD2BIN(regs[5] & 0x1F) - 1;
+	t.tm_year = BCD2BIN(regs[6]) + 100;
+
+	if (t.tm_sec > 59 || t.tm_min > 59 || t.tm_hour > 23 || t.tm_mday < 1 || t.tm_mday > 31 || t.tm_mon < 0 || t.tm_mon > 11)
+	{
+		return -1;
+	}
+
+	sec = timegm(&t);
+	if (sec == (time_t)-1)
+	{
+		return -1;
+	}
+
+	// middle of 1/256 s step, so error is within half step
+	return (int64_t)sec * 1000000000 + ((int64_t)regs[RTC_SUBSECONDS_REG] * 2 + 1) * 1000000000 / 512;
+}
+
+// System time at which firmware took RTC snapshot, from times around the transfer
+int64_t RtcSnapshotNs(int64_t before, int64_t after)
+{
+	return before + (after - before) * RTC_SNAPSHOT_BYTES / RTC_TRANSFER_BYTES;
+}
+
+int main(int argc, char *argv[])
+{
+	uint8_t reg = 0x00;
+	uint8_t regs[RTC_READ_LEN];
+	struct i2c_msg msgs[2];
+	struct i2c_rdwr_ioctl_data xfer;
+	struct timespec before, after, now;
+	int64_t rtcNs, offsetNs;
+	time_t rtcSec;
+	char timeStr[32];
+	int bus = 1, dryRun = 0;
+	int rc, i, fd;
+	char dev[32];
+
+	for (i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-n") == 0)
+		{
+			dryRun = 1;
+		}
+		else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+		{
+			bus = atoi(argv[++i]);
+		}
+		else
+		{
+			printf("Usage: %s [-n] [-b bus]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	snprintf(dev, sizeof(dev), "/dev/i2c-%d", bus);
+	fd = open(dev, O_RDWR);
+	if (fd < 0)
+	{
+		printf("Failed to open %s\n", dev);
+		return 1;
+	}
+
+	// register address write and burst read in one combined transfer,
+	// works while rtc-ds1307 driver is bound to the address
+	msgs[0].addr = RTC_I2C_ADDRESS;
+	msgs[0].flags = 0;
+	msgs[0].len = 1;
+	msgs[0].buf = &reg;
+	msgs[1].addr = RTC_I2C_ADDRESS;
+	msgs[1].flags = I2C_M_RD;
+	msgs[1].len = RTC_READ_LEN;
+	msgs[1].buf = regs;
+	xfer.msgs = msgs;
+	xfer.nmsgs = 2;
+
+	clock_gettime(CLOCK_REALTIME, &before);
+	rc = ioctl(fd, I2C_RDWR, &xfer);
+	clock_gettime(CLOCK_REALTIME, &after);
+	close(fd);
+
+	if (rc < 0)
+	{
+		printf("Failed to read time, %s\n", strerror(errno));
+		return 1;
+	}
+
+	rtcNs = RtcRegistersToNs(regs);
+	if (rtcNs < 0)
+	{
+		printf("Invalid RTC time\n");
+		return 1;
+	}
+
+	offsetNs = rtcNs - RtcSnapshotNs(TimespecToNs(&before), TimespecToNs(&after));
+	rtcSec = rtcNs / 1000000000;
+	strftime(timeStr, sizeof(timeStr), "%Y-%m-%d %H:%M:%S", gmtime(&rtcSec));
+	printf("RTC - %s.%03d, system clock offset %+.3f s\n", timeStr, (int)(rtcNs % 1000000000 / 1000000), offsetNs / 1e9);
+
+	if (dryRun)
+	{
+		return 0;
+	}
+
+	// apply offset to current time, so time spent since read is kept
+	clock_gettime(CLOCK_REALTIME, &now);
+	rtcNs = TimespecToNs(&now) + offsetNs;
+	now.tv_sec = rtcNs / 1000000000;
+	now.tv_nsec = rtcNs % 1000000000;
+	if (clock_settime(CLOCK_REALTIME, &now) != 0)
+	{
+		printf("Failed to set system clock, %s\n", strerror(errno));
+		return 1;
+	}
+
+	printf("System clock set\n");
+
+	return 0;
+}